@@ -1,8 +1,11 @@
 #pragma once
 
+#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <unordered_map>
+
+class SourceFile;
 
 enum class TokenType {
     IDENTIFIER,
@@ -51,29 +54,46 @@ enum class TokenType {
 };
 
 
+// The lexeme is a view into the text the Lexer lexed (string literals
+// without their quotes), so a token is only valid while that text is: as
+// long as the Lexer, or the SourceFile it was built from, lives.
 struct Token {
-    TokenType type;
-    std::string lexeme;
+    TokenType type = TokenType::EOF_TOKEN;
+    std::string_view lexeme;
 
-    Token(TokenType type, const std::string& lexeme);
+    Token() = default;
+    Token(TokenType type, std::string_view lexeme);
     std::string toString() const;
 };
 
 
+// Lexes on demand: next() scans and returns one token at a time, so a
+// Parser built on the Lexer holds only a few tokens however long the
+// source is. tokenize() collects the rest of the tokens into a vector.
 class Lexer {
 public:
-    explicit Lexer(const std::string& source);
+    explicit Lexer(std::string source);       // keeps its own copy of the text
+    explicit Lexer(const SourceFile& source);  // lexes the file's text in place
+    Lexer(const Lexer&) = delete;
+    Lexer& operator=(const Lexer&) = delete;
+
+    Token next();  // EOF_TOKEN once the text is used up, and on every call after
     std::vector<Token> tokenize();
 
 private:
-    std::string source;
-    std::vector<Token> tokens;
-    size_t current;
+    std::string owned;
+    std::string_view source;
+    std::optional<Token> scanned;  // set by addToken, taken by next()
+    size_t start = 0;  // first character of the token being scanned
+    size_t current = 0;
     bool isAtEnd() const;
     char advance();
     char peek() const;
+    bool match(char expected);
 
-    void addToken(TokenType type, const std::string& lexeme);
+    void addToken(TokenType type);  // the lexeme is source[start, current)
+    void addToken(TokenType type, std::string_view lexeme);
+    void scanToken();
     void number();
     void identifier();
     void string();
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+// Byte-class scanners behind the Lexer's inner loops. Each returns the
+// index of the first byte at or after `from` that ends the run it scans,
+// or text.size() if the run reaches the end. On x86-64 they test 16 (SSE2)
+// or 32 (AVX2, when the CPU has it) bytes per step and finish the last
+// partial block one byte at a time; they never read past text.size().
+// -DPENGUIN_LEXER_SIMD=OFF builds only the byte-at-a-time loops.
+
+size_t skipWhitespace(std::string_view text, size_t from);  // ' ', '\t', '\n', '\r'
+size_t skipIdentifier(std::string_view text, size_t from);  // [A-Za-z0-9_]
+size_t findQuote(std::string_view text, size_t from);       // stops at '"'
+size_t findLineEnd(std::string_view text, size_t from);     // stops at '\n'
+
+enum class ScanIsa {
+    SCALAR,
+    SSE2,
+    AVX2,
+};
+
+// The instruction set the scanners use: the widest this build and CPU
+// support, unless lowered by setScanIsa (tests and penguin_lexer_bench
+// compare them). A request above what is available is clamped.
+ScanIsa scanIsa();
+void setScanIsa(ScanIsa isa);
+const char* scanIsaName(ScanIsa isa);
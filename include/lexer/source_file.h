@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// The whole text of a source file, read once and never modified. Files of
+// at least MAP_THRESHOLD bytes are mapped read-only where the platform
+// allows it; smaller ones are read straight into one string. A Lexer built
+// from a SourceFile lexes this text in place.
+class SourceFile {
+public:
+    static constexpr size_t MAP_THRESHOLD = 64 * 1024;
+
+    explicit SourceFile(const std::string& path);
+    ~SourceFile();
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    bool isOpen() const { return opened; }
+    std::string_view text() const { return view; }
+
+private:
+    bool opened = false;
+    std::string contents;  // small files
+    void* mapping = nullptr;
+    size_t mappedSize = 0;
+    std::string_view view;
+};
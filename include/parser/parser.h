@@ -9,18 +9,27 @@
 class Parser {
 public:
     explicit Parser(const std::vector<Token>& tokens);
+    explicit Parser(Lexer& lexer);  // pulls each token from the lexer as it is reached
     std::unique_ptr<Program> parse();
     std::unique_ptr<Expr> parseExpression();
 
 private:
-    const std::vector<Token>& tokens;
-    size_t current;
+    // Token `current` and the ones before it are kept in a ring, token i in
+    // slot i % LOOKAHEAD_SLOTS. A reference from peek()/previous() stays
+    // valid for the next two advances; copy a Token to keep it longer.
+    static constexpr size_t LOOKAHEAD_SLOTS = 4;
+
+    const std::vector<Token>* tokens = nullptr;
+    Lexer* lexer = nullptr;
+    Token ring[LOOKAHEAD_SLOTS];
+    size_t current = 0;
+    void load();  // reads token `current` into its slot
     bool match(TokenType type);
     bool check(TokenType type) const;
-    Token advance();
-    Token peek() const;
-    Token previous() const;
-    Token consume(TokenType type, const std::string& message);
+    const Token& advance();
+    const Token& peek() const;
+    const Token& previous() const;
+    const Token& consume(TokenType type, const std::string& message);
     bool isAtEnd() const;
 
     std::unique_ptr<Function> parseFunction();
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "vm/value.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace vm {
+
+// A compiled program as main.cpp hands it to the VM: the script, every
+// function and method the compiler produced (in Compiler::compiledFunctions
+// order) and the names of the global slots.
+struct CompiledProgram {
+    FunctionObject* script = nullptr;
+    std::vector<FunctionObject*> functions;
+    std::vector<std::string> globalNames;
+    size_t mainOffset = 0;  // Compiler::mainOffset
+
+    // Heap snapshot: the global slots once the script has run up to
+    // mainOffset (VM::runUntil), so every class is built and every function
+    // registered. Without one (hasSnapshot false) the script runs from its
+    // first instruction. A program with no globals has an empty snapshot.
+    bool hasSnapshot = false;
+    std::vector<Value> globals;
+};
+
+// Bytecode cache (.pgc files). A file holds one CompiledProgram as the
+// compiler left it, before any run quickened it, under a key hashing the
+// source text and the compile options. Loading maps the file and rebuilds
+// the objects in one pass over it: each chunk's code is copied in one
+// piece, string constants are recreated, and functions and classes, stored
+// as indices into the file's tables, become pointers again. A snapshot
+// stores each class with its parent, field layout and method tables, and
+// each method's owner class.
+
+// FNV-1a over the source, `options` (e.g. "O" for -O) and an identifier of
+// the running build, so a rebuilt compiler misses every older file.
+uint64_t cacheKey(std::string_view source, std::string_view options);
+
+// <dir>/<key as 16 hex digits>.pgc, where <dir> is $PENGUIN_CACHE_DIR,
+// $XDG_CACHE_HOME/penguin or $HOME/.cache/penguin; "" if none is set.
+std::string cachePath(uint64_t key);
+
+// Writes a temporary file and renames it over `path`, so readers never see
+// a partial file. False if a constant or global cannot be stored (only
+// scalars, strings and the program's own functions and classes can) or the
+// write failed.
+bool saveProgram(const CompiledProgram& program, uint64_t key, const std::string& path);
+
+// False, leaving `program` untouched, if the file is missing, was written
+// for another key or format version, fails its checksum, is malformed, or
+// holds code with an operand outside its chunk or the global table.
+bool loadProgram(const std::string& path, uint64_t key, CompiledProgram& program);
+
+}  // namespace vm
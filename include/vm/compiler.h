@@ -1,6 +1,11 @@
 #pragma once
 #include "chunk.h"
+#include "ir.h"
+#include "peephole.h"
+#include "static_type.h"
 #include "../parser/ast.h"
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace vm {
@@ -24,23 +29,94 @@ public:
     int scopeDepth = 0;
     std::vector<LoopContext> loopStack;
 
+    // Globals are resolved to slots at compile time; the VM only sees the
+    // slot numbers. globalNames[slot] keeps the name for reflection/debugging.
+    std::vector<std::string> globalNames;
+    std::unordered_map<std::string, int> globalSlots;
+
+    // Offset in the script's code where main's body starts. Everything
+    // before it defines the classes, and the value stack is empty there, so
+    // VM::run can start at it once the globals hold what that code built.
+    size_t mainOffset = 0;
+
+    // What the peephole pass (peephole.cpp) removed from every chunk
+    // compile() produced.
+    PeepholeStats peepholeStats;
+
+    // Compile function bodies and main through the SSA IR (ir.h), falling
+    // back to direct compilation for what it does not cover. Set by -O.
+    bool useIR = false;
+    IRStats irStats;
+
     FunctionObject* compile(ASTNode* node);
+    int resolveGlobal(const std::string& name);
+
+    // Parses a NumberExpr literal the way the VM stores it (int64 or double).
+    static bool parseNumber(const std::string& text, Value& out);
+
+    // The binary operator behind a compound assignment token ("+" for
+    // `+=`), or "" for the ones without a plain binary form.
+    static std::string compoundOperator(TokenType op);
 
 private:
+    friend class IRLowering;
+
     Chunk& currentChunk();
 
     void emit(uint8_t byte);
+    void emitShort(uint16_t value);
     void emitConstant(Value v);
+    void emitPropertyCache();
+
+
+    // The call whose value a `return` is compiling; it becomes OP_TAIL_CALL
+    // (OP_TAIL_INVOKE for a method call).
+    CallExpr* tailCall = nullptr;
+
+    // Program functions a call can bind to at compile time (OP_CALL_DIRECT):
+    // declared once and not shadowed by a class of the same name. Created
+    // before any body is compiled, so forward and recursive calls bind too.
+    std::unordered_map<std::string, FunctionObject*> directFunctions;
+    // Constant index of the function a call of `name` with `argCount`
+    // arguments binds to, or -1. The caller has checked `name` is not a
+    // local and no method's `this` can shadow it.
+    int directCall(const std::string& name, size_t argCount);
 
     int emitJump(uint8_t instruction);
     void patchJump(int offset);
     void emitLoop(int loopStart);
+    int emitJumpIfFalse(Expr* condition, bool& leavesValue);
+    bool emitLocalIncrement(int slot, const Assignment& assign);
 
     void beginScope();
     void endScope();
     void addLocal(const std::string& name);
     int resolveLocal(const std::string& name);
 
+    // Proven types of the current function's locals (by name, joined over
+    // every declaration of that name) and of already compiled functions'
+    // return values.
+    std::unordered_map<std::string, StaticType> localTypes;
+    std::unordered_map<std::string, StaticType> returnTypes;
+    StaticType currentReturnType = StaticType::NONE;
+
+    void inferLocalTypes(const std::vector<std::unique_ptr<Stmt>>& body,
+                         const std::vector<Param>& params, bool hasThis);
+    StaticType typeOf(Expr* expr);
+    StaticType callReturnType(const std::string& name);
+    void emitBinaryOp(const std::string& op, StaticType left, StaticType right);
+
+    void foldConstants(ASTNode* node);
+    bool emitSimplifiedBinary(BinaryExpr* bin);
+    bool emitSimplifiedUnary(UnaryExpr* unary);
+
+    FunctionObject* optimize(FunctionObject* script);
+
+    // Builds, optimizes and lowers the body into the current chunk; false
+    // (with nothing emitted) if useIR is off or the body is not supported.
+    bool compileIR(const std::vector<std::unique_ptr<Stmt>>& body,
+                   const std::vector<Param>& params, bool isScript);
+
     void compileFunction(Function* func);
     void compileExpr(ASTNode*);
     void compileStmt(ASTNode*);
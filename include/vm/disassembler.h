@@ -0,0 +1,17 @@
+#pragma once
+
+#include "vm/chunk.h"
+
+#include <ostream>
+#include <string>
+
+namespace vm {
+
+// Opcode metadata shared by the disassembler and the bytecode tools.
+const char* opcodeName(uint8_t op);
+int instructionLength(uint8_t op);  // opcode byte plus operands
+
+void disassembleChunk(const Chunk& chunk, const std::string& name, std::ostream& out);
+int disassembleInstruction(const Chunk& chunk, int offset, std::ostream& out);
+
+}  // namespace vm
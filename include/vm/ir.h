@@ -0,0 +1,121 @@
+#pragma once
+#include "static_type.h"
+#include "value.h"
+#include "../parser/ast.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace vm {
+
+// Mid-level IR used by `-O`: a control-flow graph of basic blocks over SSA
+// values, built from a function body (ir_build.cpp), optimized
+// (ir_opt.cpp) and lowered back into a stack Chunk (compiler_ir.cpp).
+//
+// Constants and parameters float: they belong to no block and are
+// rematerialized at every use. Every other value lives in one block and
+// executes in block order.
+
+enum class IRKind : uint8_t {
+    CONST,   // constant (strings keep their text until lowering)
+    PARAM,   // incoming argument in frame slot `slot`
+    PHI,     // one operand per entry of block->preds, in the same order
+    BINARY,  // `op` is the source operator ("+", "<", ...)
+    UNARY,   // `op` is "-" or "!"
+    VM,      // `opcode` + `immediates`; operands are pushed in order first
+};
+
+struct IRBlock;
+
+struct IRValue {
+    IRKind kind;
+    int id = 0;
+    std::string op;                   // BINARY, UNARY
+    uint8_t opcode = 0;               // VM
+    std::vector<uint8_t> immediates;  // VM
+    bool pushesResult = true;         // VM
+    Value constant;                   // CONST, unless isString
+    std::string text;                 // CONST string
+    bool isString = false;
+    int slot = -1;                    // PARAM; frame slot once lowered
+    std::vector<IRValue*> operands;
+    IRBlock* block = nullptr;
+    StaticType type = StaticType::NONE;
+    IRValue* replacement = nullptr;   // set when the value was merged into another
+};
+
+enum class IRTerminator : uint8_t {
+    NONE,
+    JUMP,    // to succs[0]
+    BRANCH,  // on the truthiness of `value`: succs[0] if true, succs[1] if false
+    RETURN,  // `value`
+    HALT,
+};
+
+struct IRBlock {
+    int id = 0;
+    std::vector<IRValue*> phis;
+    std::vector<IRValue*> values;
+    std::vector<IRBlock*> preds;
+    IRTerminator terminator = IRTerminator::NONE;
+    IRValue* value = nullptr;
+    IRBlock* succs[2] = {nullptr, nullptr};
+
+    // Analyses, valid after IRFunction::analyze().
+    int order = -1;  // reverse postorder index; -1 if unreachable
+    IRBlock* idom = nullptr;
+
+    int succCount() const {
+        return terminator == IRTerminator::BRANCH ? 2 : terminator == IRTerminator::JUMP ? 1 : 0;
+    }
+};
+
+struct IRFunction {
+    std::vector<std::unique_ptr<IRBlock>> blocks;
+    std::vector<std::unique_ptr<IRValue>> values;
+    IRBlock* entry = nullptr;
+    std::vector<IRBlock*> rpo;  // reachable blocks in reverse postorder
+
+    IRBlock* newBlock();
+    IRValue* newValue(IRKind kind, IRBlock* block = nullptr);
+
+    // Recomputes rpo, order and idom; drops edges from unreachable blocks.
+    void analyze();
+    bool dominates(const IRBlock* a, const IRBlock* b) const;
+};
+
+// Follows replacement links to the value that stands for `value` now.
+IRValue* resolveValue(IRValue* value);
+
+// True if the value has no side effects and cannot fail, so it may be
+// merged, moved or dropped.
+bool isPure(const IRValue* value);
+
+struct IRStats {
+    size_t functions = 0;  // compiled through the IR
+    size_t fallbacks = 0;  // outside the IR's subset; compiled directly
+    size_t cse = 0;        // values merged into an equal dominating value
+    size_t hoisted = 0;    // loop-invariant values moved to a preheader
+    size_t inductions = 0; // multiplications by an induction variable strength-reduced
+    size_t dead = 0;       // values (including dead local stores) removed
+};
+
+// What the builder needs from the compiler around it.
+struct IRContext {
+    std::function<int(const std::string&)> globalSlot;
+    std::function<StaticType(const std::string&)> returnType;
+    std::function<int(const std::string&, size_t)> directCall;  // Compiler::directCall
+};
+
+// Builds SSA for a function body whose parameters occupy frame slots
+// 1..params.size(). A script body ends in HALT instead of returning null.
+// Returns nullptr, with the reason in `unsupported`, for constructs the IR
+// does not cover.
+std::unique_ptr<IRFunction> buildIR(const std::vector<std::unique_ptr<Stmt>>& body,
+                                    const std::vector<Param>& params, bool isScript,
+                                    const IRContext& context, std::string& unsupported);
+
+void optimizeIR(IRFunction& function, IRStats& stats);
+
+}  // namespace vm
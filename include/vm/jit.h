@@ -0,0 +1,75 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+namespace vm {
+
+struct CallFrame;
+struct FunctionObject;
+class VM;
+
+// Baseline JIT (--jit). Once a function's hotness counter (calls plus loop
+// back-edges run by the interpreter) reaches the threshold, its bytecode is
+// translated instruction by instruction into x86-64 machine code
+// (jit_x64.cpp). The code works on the VM's own value stack and call frames,
+// so the interpreter can hand a frame over at any instruction: when the
+// function is called, or at a hot loop's back-edge in the middle of a call.
+// Locals, constants, int and float arithmetic, comparisons, jumps and the
+// superinstructions are inlined behind tag checks; every other opcode calls
+// back into the VM's handler for it.
+
+// Machine code for one function.
+struct JitCode {
+    uint8_t* code = nullptr;        // executable mapping; the entry stub is at offset 0
+    size_t size = 0;                // bytes mapped
+    std::vector<uint32_t> entries;  // bytecode offset -> offset of its machine code
+};
+
+enum class JitStatus : int {
+    ERROR = 0,  // reported already, or an exception the VM rethrows
+    RETURNED,   // the frame returned; its result is in its first slot
+    HALTED,
+    TAIL_CALLED,  // the frame now runs another function, from its first instruction
+};
+
+struct JitStats {
+    size_t functions = 0;    // compiled
+    size_t codeBytes = 0;    // machine code generated
+    size_t loopEntries = 0;  // frames moved into machine code at a loop back-edge
+};
+
+class Jit {
+public:
+    static constexpr uint32_t HOT_THRESHOLD = 1000;
+
+    // False if this build has no code generator for the host (x86-64 Linux only).
+    static bool supported();
+
+    // With `writePerfMap` every compiled function is listed in
+    // /tmp/perf-<pid>.map, where `perf report` looks up JIT frames.
+    explicit Jit(bool writePerfMap = true);
+    ~Jit();  // detaches the code from its functions and unmaps it
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+
+    uint32_t threshold = HOT_THRESHOLD;  // tests lower it
+    JitStats stats;
+
+    // Sets function.jitCode. On failure the function stays interpreted and
+    // its hotness starts over.
+    bool compile(FunctionObject& function);
+
+    // Runs the VM's top frame in its function's machine code from frame.ip.
+    static JitStatus execute(VM& vm, CallFrame& frame);
+
+private:
+    std::vector<std::unique_ptr<JitCode>> code;
+    std::vector<FunctionObject*> functions;
+    bool writePerfMap;
+    FILE* perfMap = nullptr;
+};
+
+}  // namespace vm
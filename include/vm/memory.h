@@ -0,0 +1,136 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace vm {
+
+struct Value;
+
+enum class ObjType : uint8_t {
+    STRING,
+    ARRAY,
+    FUNCTION,
+    CLASS,
+    INSTANCE,
+    BOUND_METHOD
+};
+
+// Common header of every VM heap object. Objects created while a Heap is
+// active are linked into its `objects` list and freed by its sweep; anything
+// else (compiler constants, functions, objects built by hand in tests) is
+// never tracked and lives as long as its owner keeps it.
+struct Obj {
+    ObjType objType;
+    uint32_t markEpoch = 0;  // == Heap::epoch once reached in the current collection
+    Obj* next = nullptr;     // next tracked object
+
+    explicit Obj(ObjType type) : objType(type) {}
+};
+
+struct GCStats {
+    size_t collections = 0;
+    size_t objectsFreed = 0;
+    size_t bytesAllocated = 0;  // total over the heap's lifetime
+    size_t bytesReclaimed = 0;
+    size_t liveBytes = 0;       // after the last collection
+    size_t arenaBytes = 0;      // reserved for small objects
+    std::chrono::nanoseconds totalPause{0};
+    std::chrono::nanoseconds maxPause{0};
+};
+
+// Mark-sweep collector for one VM. Allocation only accounts bytes; the VM
+// collects at safepoints (loop back-edges and calls), where every live
+// value is reachable from its stack, frames and globals.
+//
+// Small objects (strings, arrays, instances, bound methods) are carved from
+// bump-allocated arena blocks and recycled through per-size-class free
+// lists, so the short-lived ones never reach malloc. The blocks are released
+// only with the heap.
+class Heap {
+public:
+    static constexpr size_t INITIAL_THRESHOLD = 1024 * 1024;
+    static constexpr size_t SIZE_CLASS = 16;         // granularity (and alignment) of small objects
+    static constexpr size_t MAX_SMALL_OBJECT = 128;  // larger objects use operator new
+    static constexpr size_t ARENA_BLOCK_SIZE = 64 * 1024;
+
+    Heap() = default;
+    ~Heap();
+    Heap(const Heap&) = delete;
+    Heap& operator=(const Heap&) = delete;
+
+    // The heap new objects are tracked by; set by VM::run for its duration.
+    static Heap* active();
+
+    class Scope {
+    public:
+        explicit Scope(Heap* heap);
+        ~Scope();
+
+    private:
+        Heap* previous;
+    };
+
+    void* allocate(size_t size);
+    void release(void* memory, size_t size);
+    void track(Obj* object);
+    void noteAllocation(size_t bytes);
+    bool shouldCollect() const { return bytesSinceCollection > nextCollection; }
+
+    // Smallest allocation volume between collections (tests lower it).
+    void setMinimumThreshold(size_t bytes) { minimumThreshold = nextCollection = bytes; }
+
+    void beginCollection();
+    void markValue(const Value& value);
+    void markObject(Obj* object);
+    void finishCollection();  // traces from the marked roots, then sweeps
+
+    const GCStats& stats() const { return gcStats; }
+    size_t objectCount() const { return trackedObjects; }
+
+private:
+    struct FreeSlot {
+        FreeSlot* next;
+    };
+
+    std::vector<void*> arenaBlocks;
+    char* bumpNext = nullptr;
+    char* bumpEnd = nullptr;
+    FreeSlot* freeLists[MAX_SMALL_OBJECT / SIZE_CLASS] = {};
+
+    Obj* objects = nullptr;
+    size_t trackedObjects = 0;
+    size_t bytesSinceCollection = 0;
+    size_t minimumThreshold = INITIAL_THRESHOLD;
+    size_t nextCollection = INITIAL_THRESHOLD;  // collect once bytesSinceCollection passes this
+    uint32_t epoch = 0;
+    std::vector<Obj*> grayStack;
+    std::chrono::steady_clock::time_point collectionStart;
+    GCStats gcStats;
+
+    void blacken(Obj* object);
+    void sweep();
+    void freeObject(Obj* object);
+    template <typename T>
+    void destroy(Obj* object);
+};
+
+size_t objectSize(const Obj* object);
+
+// Allocates a heap object from the active heap and tracks it there. With
+// no heap active the object is a plain, untracked `new`.
+template <typename T, typename... Args>
+T* newObject(Args&&... args) {
+    Heap* heap = Heap::active();
+    if (!heap) {
+        return new T(std::forward<Args>(args)...);
+    }
+    T* object = new (heap->allocate(sizeof(T))) T(std::forward<Args>(args)...);
+    heap->track(object);
+    return object;
+}
+
+}  // namespace vm
@@ -72,7 +72,63 @@ enum OpCode {
     OP_CAST_CHAR,
     OP_TYPEOF,
     OP_READLINE,
-    OP_FIELD
+    OP_FIELD,
+
+    // Superinstructions emitted by the compiler for common sequences.
+    OP_SET_LOCAL_POP,         // slot: SET_LOCAL slot; POP
+    OP_INC_LOCAL_CONST,       // slot, const: slot = slot + const
+    OP_JUMP_IF_NOT_LT_LOCAL,  // slotA, slotB, off16: jump unless slotA < slotB
+    OP_JUMP_IF_NOT_LT_CONST,  // slot, const, off16: jump unless slot < const
+
+    OP_INVOKE,  // name, argc, cache16: receiver.name(args...) without a BoundMethod
+
+    OP_TAIL_CALL,  // argc: OP_CALL in `return f(...)`; a function callee reuses the caller's frame
+    OP_CALL_DIRECT,  // const, argc: OP_CALL of the function in that constant, arity checked by the compiler
+
+    OP_JUMP_IF_TRUE,  // off16: like OP_JUMP_IF_FALSE on a truthy value; only the peephole pass emits it
+
+    OP_TAIL_INVOKE,  // name, argc, cache16: OP_INVOKE in `return obj.m(...)`; a method callee reuses the caller's frame
+
+    // Type-specialized binary operators, emitted when the compiler has proven
+    // both operand types (see compiler_types.cpp). No operands, no type checks.
+    OP_ADD_INT,
+    OP_SUB_INT,
+    OP_MUL_INT,
+    OP_MOD_INT,
+    OP_BITAND_INT,
+    OP_BITOR_INT,
+    OP_XOR_INT,
+    OP_SHL_INT,
+    OP_SHR_INT,
+    OP_LT_INT,
+    OP_LE_INT,
+    OP_GT_INT,
+    OP_GE_INT,
+    OP_EQ_INT,
+    OP_NE_INT,
+    OP_ADD_F64,
+    OP_SUB_F64,
+    OP_MUL_F64,
+    OP_DIV_F64,
+
+    // Guarded variants installed at run time by quickening (vm_quicken.cpp)
+    // over a generic opcode whose operands were observed to be ints (or
+    // floats). A guard failure rewrites the site back to the generic opcode.
+    OP_ADD_INT_GUARDED,
+    OP_SUB_INT_GUARDED,
+    OP_MUL_INT_GUARDED,
+    OP_LT_INT_GUARDED,
+    OP_LE_INT_GUARDED,
+    OP_GT_INT_GUARDED,
+    OP_GE_INT_GUARDED,
+    OP_EQ_INT_GUARDED,
+    OP_NE_INT_GUARDED,
+    OP_ADD_F64_GUARDED,
+    OP_SUB_F64_GUARDED,
+    OP_MUL_F64_GUARDED,
+    OP_DIV_F64_GUARDED,
+
+    OP_COUNT  // number of opcodes; keep last
 };
 
 }
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "vm/value.h"
+
+#include <cstddef>
+
+namespace vm {
+
+// Instructions removed (or, for threading, jumps retargeted) by each
+// peephole pass, summed over every chunk optimized with the same stats.
+struct PeepholeStats {
+    size_t instructionsBefore = 0;
+    size_t instructionsAfter = 0;
+    size_t storeLoad = 0;      // SET x; POP; GET x  =>  SET x   (and push; POP => nothing)
+    size_t jumpThreading = 0;  // jumps retargeted past a jump chain (none removed)
+    size_t jumpToNext = 0;     // jumps to the next instruction
+    size_t jumpIfTrue = 0;     // JUMP_IF_FALSE over a JUMP  =>  JUMP_IF_TRUE
+    size_t unreachable = 0;    // code after RETURN/JUMP/LOOP/HALT no jump reaches
+};
+
+// Rewrites `chunk.code` in place. Jump offsets are recomputed; if a
+// threaded jump would no longer fit its 16-bit offset the chunk is left
+// unchanged. With `entry`, that code offset stays an instruction boundary
+// no rewrite reaches across, like a jump destination, and is updated to
+// where the instruction ends up.
+void optimizeChunk(Chunk& chunk, PeepholeStats& stats, size_t* entry = nullptr);
+
+}  // namespace vm
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "vm/value.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace vm {
+
+// Register-machine encoding used by `--vm=reg`. Every instruction is one
+// fixed-size word. A is a destination register (or a flag); B and C are RK
+// operands: a register of the current frame, or a constant when RK_CONSTANT
+// is set. Branches carry a displacement relative to the next instruction.
+enum RegOp : uint8_t {
+    ROP_MOVE,       // R[A] = R[B]
+    ROP_LOADK,      // R[A] = K[B]
+    ROP_LOADBOOL,   // R[A] = (B != 0)
+    ROP_GETGLOBAL,  // R[A] = globals[B]
+
+    ROP_ADD,        // R[A] = RK(B) op RK(C), with the stack VM's operator semantics
+    ROP_SUB,
+    ROP_MUL,
+    ROP_DIV,
+    ROP_MOD,
+    ROP_BAND,
+    ROP_BOR,
+    ROP_BXOR,
+    ROP_SHL,
+    ROP_SHR,
+    ROP_LT,         // R[A] = RK(B) < RK(C); > and >= swap their operands
+    ROP_LE,
+    ROP_EQ,
+    ROP_NE,
+
+    ROP_JMP,        // ip += sbx
+    ROP_JMPIF,      // if (RK(B)) ip += sbx
+    ROP_JMPIFNOT,   // if (!RK(B)) ip += sbx
+    ROP_JLT,        // if ((RK(B) < RK(C)) == A) ip += sbx
+    ROP_JLE,
+    ROP_JEQ,
+
+    ROP_CALL,       // R[A] = R[A](R[A+1] .. R[A+B])
+    ROP_RETURN,     // return RK(B)
+    ROP_PRINT,      // print RK(B)
+    ROP_PRINTLN,
+    ROP_HALT,
+
+    ROP_COUNT  // number of opcodes; keep last
+};
+
+constexpr uint16_t RK_CONSTANT = 0x8000;
+constexpr int REG_MAX = 256;  // registers per frame, matching VM::FRAME_SLOTS
+
+struct RegInstr {
+    uint8_t op;
+    uint8_t a;
+    uint16_t b;
+    uint16_t c;
+    int16_t sbx;
+};
+
+static_assert(sizeof(RegInstr) == 8, "register instructions should stay one 8-byte word");
+
+struct RegChunk {
+    std::vector<RegInstr> code;
+    std::vector<Value> constants;
+    int registerCount = 1;  // frame size, including R0 (the callee)
+
+    int emit(uint8_t op, uint8_t a = 0, uint16_t b = 0, uint16_t c = 0) {
+        code.push_back({op, a, b, c, 0});
+        return static_cast<int>(code.size()) - 1;
+    }
+
+    int addConstant(Value v) {
+        constants.push_back(v);
+        return constants.size() - 1;
+    }
+};
+
+}  // namespace vm
@@ -0,0 +1,63 @@
+#pragma once
+#include "compiler.h"
+#include "reg_chunk.h"
+#include "../parser/ast.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace vm {
+
+// Lowers the same AST as vm::Compiler into register-machine code for
+// `--vm=reg`. Locals live in fixed frame registers and expression temporaries
+// are allocated above them, so arithmetic on locals needs no moves at all.
+//
+// Only a subset of the language is supported (functions, locals, arithmetic,
+// comparisons, control flow, calls and printing). compile() returns nullptr
+// for anything else and unsupported() names the construct; the caller then
+// runs the stack VM, which stays the reference implementation.
+class RegCompiler {
+public:
+    std::vector<FunctionObject*> compiledFunctions;  // all compiled non-main functions
+    std::vector<std::string> globalNames;
+    std::unordered_map<std::string, int> globalSlots;
+
+    FunctionObject* compile(Program* program);
+    const std::string& unsupported() const { return unsupportedFeature; }
+
+private:
+    FunctionObject* currentFunction = nullptr;
+    std::vector<Local> locals;
+    int scopeDepth = 0;
+    int freeReg = 0;  // first register not holding a local or a live temporary
+    std::vector<LoopContext> loopStack;
+    std::string unsupportedFeature;
+
+    RegChunk& currentChunk();
+
+    int emit(uint8_t op, int a = 0, int b = 0, int c = 0);
+    uint16_t constant(Value value);
+    int emitJump(uint8_t op, int a = 0, int b = 0, int c = 0);
+    void patchJump(int jump);
+    void patchJumpTo(int jump, int target);
+
+    int allocRegister();
+    bool isLocalRegister(int reg) const;
+    void beginScope();
+    void endScope();
+    int resolveLocal(const std::string& name);
+    int resolveGlobal(const std::string& name);
+
+    void compileFunction(Function* func);
+    void compileStmt(ASTNode* node);
+    void compileAssignment(const Assignment& assign);
+    void compileLoop(Expr* condition, ASTNode* body, ASTNode* increment);
+    int compileConditionJump(Expr* condition, bool jumpWhen);
+    void compileExpr(Expr* expr, int target);
+    void compileCall(CallExpr* call, int target);
+    void compileInterpolation(const std::string& str, int target);
+    uint16_t operand(Expr* expr);
+    void moveOperand(int target, uint16_t rk);
+};
+
+}  // namespace vm
@@ -0,0 +1,42 @@
+#pragma once
+#include "reg_chunk.h"
+#include "vm.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace vm {
+
+struct RegFrame {
+    FunctionObject* function;
+    const RegInstr* ip;  // next instruction in function->regCode
+    Value* base;         // R0 of this frame; the caller's register holding the callee
+};
+
+// Executes RegCompiler output (`--vm=reg`). Frames are windows onto one
+// register file: a call's window starts at the caller register holding the
+// callee, so arguments are already in place as the callee's parameters.
+class RegVM {
+public:
+    // As in VM: depth and register file are limited separately, and each
+    // frame takes only the registers its function uses.
+    static constexpr size_t FRAMES_MAX = VM::FRAMES_MAX;
+    static constexpr size_t REGISTERS_MAX = VM::STACK_MAX;
+
+    RegVM();
+
+    ValueBlock registers;
+    std::vector<RegFrame> frames;
+    std::vector<Value> globals;            // indexed by compiler-assigned slot
+    std::vector<std::string> globalNames;  // slot -> name, for reflection and debugging
+
+    void defineGlobals(const std::vector<std::string>& names);
+    Value* findGlobal(const std::string& name);
+
+    void run(FunctionObject* script);
+
+private:
+    bool pushFrame(FunctionObject* function, Value* base);
+};
+
+}  // namespace vm
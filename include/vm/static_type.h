@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace vm {
+
+// Static type of an expression as far as the compiler can prove it.
+// NONE is "no value seen yet" while inference iterates; anything the
+// compiler cannot prove is UNKNOWN and uses the generic opcodes.
+enum class StaticType : uint8_t {
+    NONE,
+    UNKNOWN,
+    INT,
+    FLOAT,
+    BOOL,
+    STRING,
+};
+
+StaticType joinTypes(StaticType a, StaticType b);
+StaticType binaryType(const std::string& op, StaticType left, StaticType right);
+StaticType castType(StaticType arg, StaticType result);
+
+}  // namespace vm
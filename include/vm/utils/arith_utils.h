@@ -0,0 +1,88 @@
+#pragma once
+
+#include "vm/utils/value_utils.h"
+
+namespace vm {
+
+// Operator semantics shared by every dispatch path. These live in the header
+// so the threaded loop can inline them straight into the opcode bodies.
+
+inline Value addValues(const Value& a, const Value& b) {
+    if (a.isString() || b.isString()) {
+        return Value(valueToString(a) + valueToString(b));
+    }
+    if (a.isInt() && b.isInt()) {
+        return a.as.integer + b.as.integer;
+    }
+    return asDouble(a) + asDouble(b);
+}
+
+inline Value subValues(const Value& a, const Value& b) {
+    if (a.isInt() && b.isInt()) {
+        return a.as.integer - b.as.integer;
+    }
+    return asDouble(a) - asDouble(b);
+}
+
+inline Value mulValues(const Value& a, const Value& b) {
+    if (a.isInt() && b.isInt()) {
+        return a.as.integer * b.as.integer;
+    }
+    return asDouble(a) * asDouble(b);
+}
+
+inline Value divValues(const Value& a, const Value& b) {
+    return asDouble(a) / asDouble(b);
+}
+
+inline Value modValues(const Value& a, const Value& b) {
+    if (a.isInt() && b.isInt()) {
+        return a.as.integer % b.as.integer;
+    }
+    int64_t divisor = asInt(b);
+    int64_t dividend = asInt(a);
+    return static_cast<int64_t>(dividend % divisor);
+}
+
+// Bitwise operators and shifts keep int operands as int64; anything else
+// goes through asInt and yields a float.
+inline int64_t shiftCount(int64_t count) {
+    return count & 63;
+}
+
+inline Value bitAndValues(const Value& a, const Value& b) {
+    if (a.isInt() && b.isInt()) {
+        return a.as.integer & b.as.integer;
+    }
+    return static_cast<double>(asInt(a) & asInt(b));
+}
+
+inline Value bitOrValues(const Value& a, const Value& b) {
+    if (a.isInt() && b.isInt()) {
+        return a.as.integer | b.as.integer;
+    }
+    return static_cast<double>(asInt(a) | asInt(b));
+}
+
+inline Value xorValues(const Value& a, const Value& b) {
+    if (a.isInt() && b.isInt()) {
+        return a.as.integer ^ b.as.integer;
+    }
+    return static_cast<double>(asInt(a) ^ asInt(b));
+}
+
+inline Value shiftLeftValues(const Value& a, const Value& b) {
+    if (a.isInt() && b.isInt()) {
+        return static_cast<int64_t>(static_cast<uint64_t>(a.as.integer) << shiftCount(b.as.integer));
+    }
+    return static_cast<double>(asInt(a) << asInt(b));
+}
+
+inline Value shiftRightValues(const Value& a, const Value& b) {
+    if (a.isInt() && b.isInt()) {
+        return a.as.integer >> shiftCount(b.as.integer);
+    }
+    return static_cast<double>(asInt(a) >> asInt(b));
+}
+
+}  // namespace vm
@@ -1,13 +1,15 @@
 #pragma once
 
-#include <variant>
 #include <string>
 #include <stdexcept>
 #include <iostream>
 #include <unordered_map>
 #include <vector>
 #include <cstdint>
+#include <cstdlib>
+#include <memory>
 #include "opcode.h"
+#include "memory.h"
 #include "../parser/ast.h"
 
 namespace vm {
@@ -19,27 +21,143 @@ struct ObjectObject;
 struct ClassObject;
 struct InstanceObject;
 struct BoundMethod;
+struct RegChunk;
+struct JitCode;
 
+struct StringObject : Obj {
+    std::string chars;
 
-using Value = std::variant<
-    int64_t,      
-    bool,
-    char,
-    double,
-    __int128,
-    ArrayObject*,
-    std::monostate,
-    FunctionObject*,
-    ObjectObject*,
-    ClassObject*,
-    InstanceObject*,
-    BoundMethod*,
-    std::string 
->;
+    explicit StringObject(std::string chars) : Obj(ObjType::STRING), chars(std::move(chars)) {}
+};
+
+enum class ValueType : uint8_t {
+    NIL,
+    BOOL,
+    CHAR,
+    INT,
+    FLOAT,
+    STRING,
+    ARRAY,
+    FUNCTION,
+    OBJECT,
+    CLASS,
+    INSTANCE,
+    BOUND_METHOD
+};
+
+// 16-byte tagged value: a one-byte type tag plus an 8-byte payload. Scalars
+// are stored inline; strings and every other heap type live behind a pointer,
+// so copying a Value is always a trivial 16-byte copy.
+struct Value {
+    ValueType type;
+    union {
+        bool boolean;
+        char character;
+        int64_t integer;
+        double number;
+        StringObject* string;
+        ArrayObject* array;
+        FunctionObject* function;
+        ObjectObject* object;
+        ClassObject* klass;
+        InstanceObject* instance;
+        BoundMethod* bound;
+    } as;
+
+    Value() : type(ValueType::NIL) { as.integer = 0; }
+    Value(bool value) : type(ValueType::BOOL) { as.integer = 0; as.boolean = value; }
+    Value(char value) : type(ValueType::CHAR) { as.integer = 0; as.character = value; }
+    Value(int value) : type(ValueType::INT) { as.integer = value; }
+    Value(int64_t value) : type(ValueType::INT) { as.integer = value; }
+    Value(double value) : type(ValueType::FLOAT) { as.number = value; }
+    Value(StringObject* value) : type(ValueType::STRING) { as.string = value; }
+    // These allocate a StringObject (tracked by the collector under a
+    // Heap::Scope), so a call site must spell out Value(text).
+    explicit Value(const std::string& value) : Value(newObject<StringObject>(value)) {}
+    explicit Value(const char* value) : Value(newObject<StringObject>(value)) {}
+    // Any other pointer, a string literal passed where a Value is expected
+    // included, would silently become a bool.
+    template <typename T>
+    Value(T*) = delete;
+    Value(ArrayObject* value) : type(ValueType::ARRAY) { as.array = value; }
+    Value(FunctionObject* value) : type(ValueType::FUNCTION) { as.function = value; }
+    Value(ObjectObject* value) : type(ValueType::OBJECT) { as.object = value; }
+    Value(ClassObject* value) : type(ValueType::CLASS) { as.klass = value; }
+    Value(InstanceObject* value) : type(ValueType::INSTANCE) { as.instance = value; }
+    Value(BoundMethod* value) : type(ValueType::BOUND_METHOD) { as.bound = value; }
+
+    bool isNull() const { return type == ValueType::NIL; }
+    bool isBool() const { return type == ValueType::BOOL; }
+    bool isChar() const { return type == ValueType::CHAR; }
+    bool isInt() const { return type == ValueType::INT; }
+    bool isFloat() const { return type == ValueType::FLOAT; }
+    bool isString() const { return type == ValueType::STRING; }
+    bool isArray() const { return type == ValueType::ARRAY; }
+    bool isFunction() const { return type == ValueType::FUNCTION; }
+    bool isClass() const { return type == ValueType::CLASS; }
+    bool isInstance() const { return type == ValueType::INSTANCE; }
+    bool isBoundMethod() const { return type == ValueType::BOUND_METHOD; }
+
+    const std::string& str() const { return as.string->chars; }
+};
+
+static_assert(sizeof(Value) == 16, "vm::Value should stay a 16-byte tagged value");
+static_assert(static_cast<int>(ValueType::NIL) == 0, "an all-zero Value must be nil");
+
+// The VM value stack and register file: `count` nil Values from calloc.
+// Since nil is all zero bits, the pages a run never reaches are never
+// touched, so the regions can be sized for deep recursion at no cost.
+struct ValueBlockDeleter {
+    void operator()(Value* values) const { std::free(values); }
+};
+using ValueBlock = std::unique_ptr<Value[], ValueBlockDeleter>;
+
+inline ValueBlock allocateValueBlock(size_t count) {
+    void* values = std::calloc(count, sizeof(Value));
+    if (!values) throw std::bad_alloc();
+    return ValueBlock(static_cast<Value*>(values));
+}
+
+// Inline cache for one property-access site (OP_GET_PROPERTY and friends),
+// keyed on the receiver's class. A site always runs in the same calling
+// context, so each entry also stands for an access check that passed.
+struct PropertyCacheEntry {
+    enum Kind : uint8_t {
+        EMPTY,
+        FIELD,   // declared field: instance->slots[slot]
+        METHOD,  // methods of the class under the site's name
+        GLOBAL,  // *_OR_GLOBAL/*_OR_LOCAL sites that fall through to the global
+    };
+
+    ClassObject* klass = nullptr;
+    uint32_t version = 0;  // klass->version when the entry was filled
+    Kind kind = EMPTY;
+    uint32_t slot = 0;
+    const std::vector<FunctionObject*>* methods = nullptr;
+    FunctionObject* method = nullptr;  // OP_INVOKE: the overload matching the site's argc
+};
+
+struct PropertyCache {
+    static constexpr int ENTRIES = 4;  // polymorphic up to this many classes, then left alone
+    PropertyCacheEntry entries[ENTRIES];
+
+    const PropertyCacheEntry* find(const InstanceObject* instance) const;
+
+    void add(const PropertyCacheEntry& entry) {
+        for (auto& e : entries) {
+            if (e.kind == PropertyCacheEntry::EMPTY || e.klass == entry.klass) {
+                e = entry;
+                return;
+            }
+        }
+    }
+};
 
 struct Chunk {
     std::vector<uint8_t> code;
     std::vector<Value> constants;
+    std::vector<PropertyCache> propertyCaches;  // indexed by the property ops' cache operand
+    std::vector<uint8_t> quickenCounters;       // per code byte; allocated on the first quickening
 
     void write(uint8_t byte) {
         code.push_back(byte);
@@ -54,59 +172,143 @@ struct Chunk {
         constants.push_back(v);
         return constants.size() - 1;
     }
+
+    int addPropertyCache() {
+        propertyCaches.emplace_back();
+        return propertyCaches.size() - 1;
+    }
 };
 
 struct ObjectObject {
     std::unordered_map<std::string, Value> fields;
 };
 
-struct ClassObject {
+struct FieldSlot {
+    std::string name;
+    AccessModifier access;
+};
+
+struct ClassObject : Obj {
     std::string name;
     ClassObject* parent = nullptr;
     std::unordered_map<std::string, std::vector<FunctionObject*>> methods;
     std::unordered_map<std::string, AccessModifier> methodAccess;
-    std::unordered_map<std::string, AccessModifier> fields;
-    
-    ClassObject(const std::string& name) : name(name) {}
+
+    // Field layout ("shape"), fixed while the class is built: OP_INHERIT copies
+    // the parent's non-private slots, then each OP_FIELD appends one (or only
+    // updates the access of a field the parent already declared).
+    std::vector<FieldSlot> fieldLayout;
+    std::unordered_map<std::string, uint32_t> fieldSlots;  // name -> index into fieldLayout
+
+    // Bumped whenever a field or method is declared, so property caches
+    // filled before the class was complete stop matching.
+    uint32_t version = 0;
+
+    ClassObject(const std::string& name) : Obj(ObjType::CLASS), name(name) {}
+
+    void declareField(const std::string& fieldName, AccessModifier access) {
+        ++version;
+        auto it = fieldSlots.find(fieldName);
+        if (it != fieldSlots.end()) {
+            fieldLayout[it->second].access = access;
+            return;
+        }
+        fieldSlots.emplace(fieldName, static_cast<uint32_t>(fieldLayout.size()));
+        fieldLayout.push_back({fieldName, access});
+    }
+
+    int findField(const std::string& fieldName) const {
+        auto it = fieldSlots.find(fieldName);
+        return it == fieldSlots.end() ? -1 : static_cast<int>(it->second);
+    }
 };
 
-struct InstanceObject {
+// Declared fields live in `slots`, indexed by the class's field layout.
+// Fields the class never declared (set dynamically) go to the lazily
+// allocated `overflow` map.
+struct InstanceObject : Obj {
     ClassObject* klass;
-    std::unordered_map<std::string, Value> fields;
-    
-    InstanceObject(ClassObject* klass) : klass(klass) {}
+    uint32_t slotCount;
+    Value* slots;
+    std::unordered_map<std::string, Value>* overflow = nullptr;
+
+    explicit InstanceObject(ClassObject* klass)
+        : Obj(ObjType::INSTANCE),
+          klass(klass),
+          slotCount(static_cast<uint32_t>(klass->fieldLayout.size())),
+          slots(slotCount ? new Value[slotCount] : nullptr) {}
+
+    ~InstanceObject() {
+        delete[] slots;
+        delete overflow;
+    }
+
+    InstanceObject(const InstanceObject&) = delete;
+    InstanceObject& operator=(const InstanceObject&) = delete;
+
+    // Only needed if the class layout grew after this instance was created.
+    void growSlots(uint32_t count) {
+        Value* grown = new Value[count];
+        for (uint32_t i = 0; i < slotCount; ++i) {
+            grown[i] = slots[i];
+        }
+        delete[] slots;
+        slots = grown;
+        slotCount = count;
+    }
 };
 
-struct ArrayObject {
+// Method and fall-through entries only hold while the instance has no
+// overflow field, which would shadow them.
+inline const PropertyCacheEntry* PropertyCache::find(const InstanceObject* instance) const {
+    for (const auto& e : entries) {
+        if (e.klass != instance->klass || e.version != instance->klass->version) continue;
+        if (e.kind == PropertyCacheEntry::FIELD) {
+            return e.slot < instance->slotCount ? &e : nullptr;
+        }
+        return instance->overflow ? nullptr : &e;
+    }
+    return nullptr;
+}
+
+struct ArrayObject : Obj {
     bool isFixed;
     size_t length;
     size_t capacity;
     Value* data;    
     int refCount;    
 
-    ArrayObject() : isFixed(false), length(0), capacity(0), data(nullptr), refCount(0) {}
+    ArrayObject() : Obj(ObjType::ARRAY), isFixed(false), length(0), capacity(0), data(nullptr), refCount(0) {}
     ~ArrayObject() {
-        // if (data) delete[] data;
+        delete[] data;
     }
+
+    ArrayObject(const ArrayObject&) = delete;
+    ArrayObject& operator=(const ArrayObject&) = delete;
 };
 
-struct FunctionObject {
+// Functions are created by the compiler and never tracked by a Heap; the
+// collector only traces through them (constants, caches, owner class).
+struct FunctionObject : Obj {
     std::string name;
     int arity;
     bool isMethod;
     ClassObject* ownerClass = nullptr;
     Chunk chunk;
+    RegChunk* regCode = nullptr;  // register-machine code, set by RegCompiler (--vm=reg)
+    JitCode* jitCode = nullptr;   // machine code, set by the JIT once the function is hot (--jit)
+    uint32_t hotness = 0;         // calls and loop back-edges interpreted; counted only with a JIT
 
     FunctionObject(const std::string& name, int arity, bool isMethod = false)
-        : name(name), arity(arity), isMethod(isMethod) {}
+        : Obj(ObjType::FUNCTION), name(name), arity(arity), isMethod(isMethod) {}
 };
 
-struct BoundMethod {
+struct BoundMethod : Obj {
     InstanceObject* instance;
     std::vector<FunctionObject*> methods;
 
     BoundMethod(InstanceObject* instance, std::vector<FunctionObject*> methods)
-        : instance(instance), methods(std::move(methods)) {}
+        : Obj(ObjType::BOUND_METHOD), instance(instance), methods(std::move(methods)) {}
 };
 
 }
@@ -1,33 +1,138 @@
 #pragma once
 #include "chunk.h"
+#include "memory.h"
+#include <exception>
+#include <memory>
+#include <string>
 #include <vector>
-#include <unordered_map>
 
 namespace vm {
 
+class Jit;
+
 struct CallFrame {
     FunctionObject* function;
-    size_t ip;
-    size_t base;  // stack base for this call frame
+    uint8_t* ip;   // next byte to execute in function->chunk.code
+    Value* slots;  // first stack slot owned by this call frame
+
+    uint8_t readByte() { return *ip++; }
+    uint16_t readShort() {
+        ip += 2;
+        return static_cast<uint16_t>((ip[-2] << 8) | ip[-1]);
+    }
+    const Value& readConstant() { return function->chunk.constants[readByte()]; }
 };
 
 class VM {
 public:
-    std::vector<Value> stack;
+    // Call depth and value stack are limited separately: a call overflows
+    // when either runs out, and a frame needs only the slots it uses, so
+    // typical recursion reaches the frame limit long before the stack
+    // fills. Both are reserved up front but only touched as they are used.
+    static constexpr size_t FRAMES_MAX = 1 << 18;
+    static constexpr size_t FRAME_SLOTS = 256;  // locals are addressed by a uint8_t slot
+    static constexpr size_t STACK_MAX = 1 << 22;
+
+    VM();
+
+    ValueBlock stack;
+    Value* stackTop;
     std::vector<CallFrame> frames;
-    std::unordered_map<std::string, Value> globals;
+    std::vector<Value> globals;            // indexed by compiler-assigned slot
+    std::vector<std::string> globalNames;  // slot -> name, for reflection and debugging
+    Heap heap;                             // objects allocated while this VM runs
+    Jit* jit = nullptr;                    // compiles hot functions when set (--jit)
 
-    void push(Value v);
-    Value pop();
+    void defineGlobals(const std::vector<std::string>& names);
+    Value* findGlobal(const std::string& name);
 
-    void run(FunctionObject* script);
+    void push(Value value) { *stackTop++ = value; }
+    Value pop() { return *--stackTop; }
+    Value& peek(int distance = 0) { return stackTop[-1 - distance]; }
+    void drop(int count = 1) { stackTop -= count; }
+
+    // Runs `script` from the code offset `entry`: its start, or
+    // Compiler::mainOffset when the globals already hold the classes.
+    void run(FunctionObject* script, size_t entry = 0);
+    // Runs `script` from its start up to the instruction at `offset` and
+    // stops there. False if it stopped earlier, on an error or a HALT.
+    bool runUntil(FunctionObject* script, size_t offset);
+    void collectGarbage();
 
 private:
+    friend class Jit;
+
+    Value* stackLimit;  // highest slot a new frame may start at: one full frame from the end
+    size_t baseDepth = 0;  // the dispatch loop returns once a return leaves this many frames
+    // Each call made from machine code nests runCompiled() on the native
+    // stack. Past this many the callees are interpreted instead, which
+    // keeps deep recursion within FRAMES_MAX rather than the C++ stack.
+    static constexpr size_t JIT_NESTING_MAX = 1000;
+    size_t jitNesting = 0;
+
+    bool pushFrame(FunctionObject* function, Value* slots);
+    void countCall(FunctionObject* function);  // hotness; compiles the function once hot
+    void interpret();
+
+    // Called only where every live value is on the stack or in a global.
+    void safepoint() {
+        if (heap.shouldCollect()) collectGarbage();
+    }
+
+    // Runtime quickening of the generic arithmetic opcode at `site`, given
+    // the two operands on top of the stack; and the reverse on guard failure.
+    void quicken(Chunk& chunk, uint8_t* site);
+    void deoptimize(Chunk& chunk, uint8_t* site);
+    void observeOperands(CallFrame& frame) {
+        if (peek(1).type == peek().type && (peek().isInt() || peek().isFloat())) {
+            quicken(frame.function->chunk, frame.ip - 1);
+        }
+    }
+
+    void runThreaded();
+    void runHandlers();
+
+    // Baseline JIT (vm_jit.cpp). Each returns false when the dispatch loop
+    // should stop: on an error, at HALT, or once the frame at baseDepth returned.
+    bool runCompiled();
+    bool jitBackEdge(CallFrame& frame);
+    bool runCallee(size_t depth);
+    bool enterCompiled() {
+        // A call just pushed (or a tail call restarted) a frame whose
+        // function has machine code.
+        const CallFrame& top = frames.back();
+        if (!top.function->jitCode || top.ip != top.function->chunk.code.data()) return true;
+        if (jitNesting >= JIT_NESTING_MAX) return true;
+        return runCompiled();
+    }
+
+    // Called from machine code with stackTop written back. A zero result
+    // stops it; exceptions cannot unwind through it, so they wait in
+    // jitException until it has returned.
+    std::exception_ptr jitException;
+    static int jitOperator(VM* vm, uint32_t instruction);
+    static int jitIncrement(VM* vm, uint32_t slot, const Value* step);
+    static int jitSafepoint(VM* vm);
+    static int jitCall(VM* vm, uint32_t argCount);
+    static int jitTailCall(VM* vm, uint8_t* ip);
+    static int jitCallDirect(VM* vm, uint8_t* ip);
+    static int jitInvoke(VM* vm, uint8_t* ip);
+    static int jitTailInvoke(VM* vm, uint8_t* ip);
+    static int jitExecute(VM* vm, uint8_t* ip);
+
     bool executeInstruction(CallFrame& frame, uint8_t instruction);
     bool handleArithmetic(uint8_t instruction);
     bool handleComparison(uint8_t instruction);
+    bool handleTypedOp(uint8_t instruction);
+    bool handleGuardedOp(CallFrame& frame, uint8_t instruction);
     bool handleJump(CallFrame& frame, uint8_t instruction);
+    bool handleSuperinstruction(CallFrame& frame, uint8_t instruction);
     bool handleCall(CallFrame& frame);
+    bool handleTailCall(CallFrame& frame);
+    void reuseFrame(CallFrame& frame, FunctionObject* function, Value* callee);
+    bool handleCallDirect(CallFrame& frame);
+    bool callValue(Value* callee, uint8_t argCount);
+    bool handleInvoke(CallFrame& frame, bool tail = false);
     bool handleReturn(CallFrame& frame);
     bool handleArrayOp(CallFrame& frame, uint8_t instruction);
     bool handleClassOp(CallFrame& frame, uint8_t instruction);
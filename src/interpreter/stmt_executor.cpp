@@ -69,8 +69,7 @@ std::string formatString(const std::string& str, Environment* env, Interpreter*
                 
                 try {
                     Lexer lexer(content);
-                    std::vector<Token> tokens = lexer.tokenize();
-                    Parser parser(tokens);
+                    Parser parser(lexer);
                     auto expr = parser.parseExpression(); // We assume it's an expression
                     Value val = interpreter->evaluateExpr(expr.get(), env);
                     result += valueToString(val);
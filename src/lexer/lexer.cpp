@@ -1,13 +1,15 @@
 #include "lexer/lexer.h"
+#include "lexer/scan.h"
+#include "lexer/source_file.h"
 #include <iostream>
 #include <cctype>
 #include <vector>
 #include <string>
-#include <unordered_map>
+#include <utility>
 
 
 
-Token::Token(TokenType type, const std::string& lexeme)
+Token::Token(TokenType type, std::string_view lexeme)
     : type(type), lexeme(lexeme) {}
 
 std::string Token::toString() const {
@@ -36,13 +38,57 @@ std::string Token::toString() const {
         case TokenType::EOF_TOKEN: typeStr = "EOF"; break;
         default: typeStr = "UNKNOWN"; break;
     }
-    return "Token(" + typeStr + ", \"" + lexeme + "\")";
+    return "Token(" + typeStr + ", \"" + std::string(lexeme) + "\")";
 }
 
-Lexer::Lexer(const std::string& src)
-    : source(src), current(0) {}
+Lexer::Lexer(std::string src)
+    : owned(std::move(src)), source(owned) {}
 
+Lexer::Lexer(const SourceFile& file)
+    : source(file.text()) {}
 
+namespace {
+
+constexpr std::string_view KEYWORDS[] = {
+    "if", "else", "while", "return", "func", "true", "false", "break",
+    "continue", "for", "class", "dec", "private", "public", "protected", "inherits",
+};
+
+// Perfect hash over KEYWORDS: length and second character alone give every
+// keyword its own slot (checked below), so a lookup is one comparison.
+constexpr size_t KEYWORD_SLOTS = 32;
+constexpr size_t MAX_KEYWORD_LENGTH = 9;
+
+constexpr size_t keywordSlot(std::string_view word) {
+    return (word.size() * 5 + static_cast<unsigned char>(word[1])) % KEYWORD_SLOTS;
+}
+
+struct KeywordTable {
+    std::string_view slots[KEYWORD_SLOTS] = {};
+    bool perfect = true;
+};
+
+constexpr KeywordTable makeKeywordTable() {
+    KeywordTable table;
+    for (std::string_view keyword : KEYWORDS) {
+        std::string_view& slot = table.slots[keywordSlot(keyword)];
+        if (!slot.empty() || keyword.size() < 2 || keyword.size() > MAX_KEYWORD_LENGTH) {
+            table.perfect = false;
+        }
+        slot = keyword;
+    }
+    return table;
+}
+
+constexpr KeywordTable keywordTable = makeKeywordTable();
+static_assert(keywordTable.perfect, "keywordSlot() no longer separates the keywords");
+
+bool isKeyword(std::string_view word) {
+    return word.size() >= 2 && word.size() <= MAX_KEYWORD_LENGTH &&
+           keywordTable.slots[keywordSlot(word)] == word;
+}
+
+}  // namespace
 
 
 bool Lexer::isAtEnd() const {
@@ -55,224 +101,149 @@ char Lexer::peek() const {
     if (isAtEnd()) return '\0';
     return source[current];
 }
-void Lexer::addToken(TokenType type, const std::string& lexeme) {
-    tokens.emplace_back(type, lexeme);
+bool Lexer::match(char expected) {
+    if (peek() != expected) return false;
+    ++current;
+    return true;
+}
+void Lexer::addToken(TokenType type) {
+    scanned.emplace(type, source.substr(start, current - start));
+}
+void Lexer::addToken(TokenType type, std::string_view lexeme) {
+    scanned.emplace(type, lexeme);
 }
 
 void Lexer::number() {
-    size_t start = current - 1;
     while (isdigit(peek())) advance();
 
     // Look for a fractional part.
-    if (peek() == '.' && isdigit(source[current + 1])) {
+    if (peek() == '.' && current + 1 < source.size() && isdigit(source[current + 1])) {
         // Consume the "."
         advance();
 
         while (isdigit(peek())) advance();
     }
 
-    std::string value = source.substr(start, current - start);
-    addToken(TokenType::NUMBER, value);
+    addToken(TokenType::NUMBER);
 }
 
 void Lexer::string() {
-    size_t start = current;
-    while (peek() != '"' && !isAtEnd()) {
-        if (peek() == '\n') {
-            // Handle newlines if tracked
-        }
-        advance();
-    }
+    current = findQuote(source, current);
 
     if (isAtEnd()) {
         std::cerr << "Unterminated string." << std::endl;
         return;
     }
 
-    std::string value = source.substr(start, current - start);
     advance(); // Consume the closing "
-    addToken(TokenType::STRING, value);
+    addToken(TokenType::STRING, source.substr(start + 1, current - start - 2));
 }
 
 void Lexer::identifier() {
-    size_t start = current - 1;
-    while (isalnum(peek()) || peek() == '_') advance();
-
-    std::string value = source.substr(start, current - start);
-    
-    static const std::unordered_map<std::string, TokenType> keywords = {
-        {"if", TokenType::KEYWORD},
-        {"else", TokenType::KEYWORD},
-        {"while", TokenType::KEYWORD},
-        {"return", TokenType::KEYWORD},
-        {"func", TokenType::KEYWORD},
-        {"true", TokenType::KEYWORD},
-        {"false", TokenType::KEYWORD},
-        {"break", TokenType::KEYWORD},
-        {"continue", TokenType::KEYWORD},
-        {"for",TokenType::KEYWORD},
-        {"class",TokenType::KEYWORD},
-        {"dec",TokenType::KEYWORD},
-        {"private",TokenType::KEYWORD},
-        {"public",TokenType::KEYWORD},
-        {"protected",TokenType::KEYWORD},
-        {"inherits",TokenType::KEYWORD},
-
-        
-    };
-
-    if (keywords.count(value)) {
-        addToken(TokenType::KEYWORD, value);
-    } else {
-        addToken(TokenType::IDENTIFIER, value);
-    }
+    current = skipIdentifier(source, current);
+
+    std::string_view value = source.substr(start, current - start);
+    addToken(isKeyword(value) ? TokenType::KEYWORD : TokenType::IDENTIFIER);
 }
 
 std::vector<Token> Lexer::tokenize() {
+    std::vector<Token> tokens;
+    // Real code averages well over four bytes a token; reserving for that
+    // avoids copying the whole vector as it grows.
+    tokens.reserve((source.size() - current) / 4 + 1);
+    do {
+        tokens.push_back(next());
+    } while (tokens.back().type != TokenType::EOF_TOKEN);
+    return tokens;
+}
+
+Token Lexer::next() {
     while (!isAtEnd()) {
-        char c = advance();
-
-        switch (c) {
-            case '+': 
-                if(peek() =='='){
-                    advance();
-                    addToken(TokenType::PLUS_EQUAL,"+=");
-                }else{
-                    addToken(TokenType::PLUS,"+");
-                }
-                break;
-            case '-':
-                if(peek() =='='){
-                    advance();
-                    addToken(TokenType::MINUS_EQUAL,"-=");
-                }else{
-                    addToken(TokenType::MINUS,"-");
-                }
-                break;
-            case '*': 
-                if(peek() == '='){
-                    advance();
-                    addToken(TokenType::STAR_EQUAL,"*=");
-                }else{
-                    addToken(TokenType::STAR, "*");
-                }
-                break;
-            case '%':
-                if(peek() == '='){
-                        advance();
-                        addToken(TokenType::MOD_OP_EQUAL,"%=");
-                }else{
-                        addToken(TokenType::MOD_OP, "%");
-                }
-                break; 
-            case '/': 
-                if (peek() == '/') {
-                    while (peek() != '\n' && !isAtEnd()) advance();
-                }else if(peek() == '='){
-                    advance();
-                    addToken(TokenType::SLASH_EQUAL,"/=");
-                }else {
-                    addToken(TokenType::SLASH, "/");
-                }
-                break;
-            case '&' :
-                if(peek() == '&'){
-                    advance();
-                    addToken(TokenType::AND, "&&");
-                }else if(peek() == '='){
-                    advance();
-                    addToken(TokenType::BITWISE_AND_EQUAL, "&=");
-                }else{
-                    addToken(TokenType::BITWISE_AND, "&");
-                }
-                break;
-            case '|' :
-                if(peek() == '|'){
-                    advance();
-                    addToken(TokenType::OR, "||");
-                }else if(peek() == '='){
-                    advance();
-                    addToken(TokenType::BITWISE_OR_EQUAL, "|=");
-                }else{
-                    addToken(TokenType::BITWISE_OR, "|");
-                }
-                break;
-            case '^' :
-                if(peek() =='='){
-                    advance();
-                    addToken(TokenType::XOR_EQUAL,"^=");
-                }else{
-                    addToken(TokenType::BITWISE_XOR, "^");
-                }
-                break;
-            case '!' :
-                if(peek() == '='){
-                    advance();
-                    addToken(TokenType::NOT_EQUAL, "!=");
-                }else{
-                    addToken(TokenType::NOT, "!");
-                }
-                break;
-            case '=':
-                if (peek() == '=') {
-                    advance();
-                    addToken(TokenType::EQUAL_EQUAL, "==");
-                } else {
-                    addToken(TokenType::EQUAL, "=");
-                }
-                break;
-            case '<': 
-                if(peek() =='='){
-                    advance();
-                    addToken(TokenType::LESS_EQUAL, "<=");
-                }else if (peek() == '<'){
-                    advance();
-                    addToken(TokenType::LEFT_SHIFT, "<<");
-                }else{
-                    addToken(TokenType::LESS, "<");
-                }
-                break;
-            case '>': 
-                if(peek() == '='){
-                    advance();  
-                    addToken(TokenType::GREATER_EQUAL, ">=");
-                }else if(peek() == '>'){
-                    advance();
-                    addToken(TokenType::RIGHT_SHIFT, ">>");
-                }else{
-                    addToken(TokenType::GREATER, ">");
-                }
-                break;
-            case '(': addToken(TokenType::LPAREN, "("); break;
-            case ')': addToken(TokenType::RPAREN, ")"); break;
-            case '[': addToken(TokenType::LBRACKET, "["); break;
-            case ']': addToken(TokenType::RBRACKET, "]"); break;
-            case '{': addToken(TokenType::LBRACE, "{"); break;
-            case '}': addToken(TokenType::RBRACE, "}"); break;
-            case ';': addToken(TokenType::SEMICOLON, ";"); break;
-            case ':': addToken(TokenType::COLON, ":"); break;
-            case ',': addToken(TokenType::COMMA, ","); break;
-            case '.': addToken(TokenType::DOT, "."); break;
-            case '"': string(); break;
-
-            case ' ':
-            case '\t':
-            case '\n':
-            case '\r':
-                break; // ignore whitespace
-
-            default:
-                if (isdigit(c)) {
-                    number();
-                } else if (isalpha(c) || c == '_') {
-                    identifier();
-                }  else {
-                    std::cerr << "Unexpected character: " << c << "\n";
-                }
-            }
+        start = current;
+        scanToken();
+        if (scanned) {
+            Token token = *scanned;
+            scanned.reset();
+            return token;
         }
-
-    addToken(TokenType::EOF_TOKEN, "");
-    return tokens;
+    }
+    return Token(TokenType::EOF_TOKEN, source.substr(source.size()));
 }
 
+// Scans one lexeme starting at source[start]. Whitespace, comments and
+// unexpected characters add no token.
+void Lexer::scanToken() {
+    char c = advance();
+
+    switch (c) {
+        case '+': addToken(match('=') ? TokenType::PLUS_EQUAL : TokenType::PLUS); break;
+        case '-': addToken(match('=') ? TokenType::MINUS_EQUAL : TokenType::MINUS); break;
+        case '*': addToken(match('=') ? TokenType::STAR_EQUAL : TokenType::STAR); break;
+        case '%': addToken(match('=') ? TokenType::MOD_OP_EQUAL : TokenType::MOD_OP); break;
+        case '/':
+            if (peek() == '/') {
+                current = findLineEnd(source, current);
+            } else {
+                addToken(match('=') ? TokenType::SLASH_EQUAL : TokenType::SLASH);
+            }
+            break;
+        case '&':
+            if (match('&')) {
+                addToken(TokenType::AND);
+            } else {
+                addToken(match('=') ? TokenType::BITWISE_AND_EQUAL : TokenType::BITWISE_AND);
+            }
+            break;
+        case '|':
+            if (match('|')) {
+                addToken(TokenType::OR);
+            } else {
+                addToken(match('=') ? TokenType::BITWISE_OR_EQUAL : TokenType::BITWISE_OR);
+            }
+            break;
+        case '^': addToken(match('=') ? TokenType::XOR_EQUAL : TokenType::BITWISE_XOR); break;
+        case '!': addToken(match('=') ? TokenType::NOT_EQUAL : TokenType::NOT); break;
+        case '=': addToken(match('=') ? TokenType::EQUAL_EQUAL : TokenType::EQUAL); break;
+        case '<':
+            if (match('=')) {
+                addToken(TokenType::LESS_EQUAL);
+            } else {
+                addToken(match('<') ? TokenType::LEFT_SHIFT : TokenType::LESS);
+            }
+            break;
+        case '>':
+            if (match('=')) {
+                addToken(TokenType::GREATER_EQUAL);
+            } else {
+                addToken(match('>') ? TokenType::RIGHT_SHIFT : TokenType::GREATER);
+            }
+            break;
+        case '(': addToken(TokenType::LPAREN); break;
+        case ')': addToken(TokenType::RPAREN); break;
+        case '[': addToken(TokenType::LBRACKET); break;
+        case ']': addToken(TokenType::RBRACKET); break;
+        case '{': addToken(TokenType::LBRACE); break;
+        case '}': addToken(TokenType::RBRACE); break;
+        case ';': addToken(TokenType::SEMICOLON); break;
+        case ':': addToken(TokenType::COLON); break;
+        case ',': addToken(TokenType::COMMA); break;
+        case '.': addToken(TokenType::DOT); break;
+        case '"': string(); break;
+
+        case ' ':
+        case '\t':
+        case '\n':
+        case '\r':
+            current = skipWhitespace(source, current);
+            break;
+
+        default:
+            if (isdigit(c)) {
+                number();
+            } else if (isalpha(c) || c == '_') {
+                identifier();
+            }  else {
+                std::cerr << "Unexpected character: " << c << "\n";
+            }
+    }
+}
@@ -0,0 +1,192 @@
+#include "lexer/scan.h"
+
+#include <cstdint>
+
+// SSE2 is part of x86-64; AVX2 code is compiled for that target only
+// (function attributes) and picked at run time if the CPU has it.
+#if !defined(PENGUIN_LEXER_NO_SIMD) && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define PENGUIN_SCAN_X86 1
+#include <immintrin.h>
+#define PENGUIN_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace {
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Same set as isalnum(c) || c == '_' in the "C" locale.
+bool isIdentifierChar(char c) {
+    unsigned u = static_cast<unsigned char>(c);
+    return (u | 0x20) - 'a' < 26 || u - '0' < 10 || c == '_';
+}
+
+#ifdef PENGUIN_SCAN_X86
+
+// The vector loops below stop at the first block containing a byte that
+// ends the run and return its index, or return the start of the last
+// partial block for the byte loops to finish.
+
+// Bytes c with lo <= c <= hi as 0xff. The compares are signed, so bytes
+// >= 0x80 never match an ASCII range.
+__m128i inRange(__m128i bytes, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8(static_cast<char>(lo - 1))),
+                         _mm_cmpgt_epi8(_mm_set1_epi8(static_cast<char>(hi + 1)), bytes));
+}
+
+__m128i spaceBytes(__m128i bytes) {
+    return _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\t'))),
+                        _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r'))));
+}
+
+__m128i identifierBytes(__m128i bytes) {
+    // Setting bit 5 folds upper case onto lower case and moves no other
+    // byte into a-z.
+    __m128i letters = inRange(_mm_or_si128(bytes, _mm_set1_epi8(0x20)), 'a', 'z');
+    return _mm_or_si128(_mm_or_si128(letters, inRange(bytes, '0', '9')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('_')));
+}
+
+size_t whileSse2(const char* data, size_t from, size_t size, bool identifier) {
+    for (; from + 16 <= size; from += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + from));
+        __m128i inRun = identifier ? identifierBytes(bytes) : spaceBytes(bytes);
+        uint32_t stop = ~static_cast<uint32_t>(_mm_movemask_epi8(inRun)) & 0xffff;
+        if (stop) return from + __builtin_ctz(stop);
+    }
+    return from;
+}
+
+size_t untilSse2(const char* data, size_t from, size_t size, char target) {
+    __m128i wanted = _mm_set1_epi8(target);
+    for (; from + 16 <= size; from += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + from));
+        uint32_t stop = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, wanted)));
+        if (stop) return from + __builtin_ctz(stop);
+    }
+    return from;
+}
+
+PENGUIN_AVX2 __m256i inRange(__m256i bytes, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8(static_cast<char>(lo - 1))),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(hi + 1)), bytes));
+}
+
+PENGUIN_AVX2 __m256i spaceBytes(__m256i bytes) {
+    return _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\t'))),
+        _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\r'))));
+}
+
+PENGUIN_AVX2 __m256i identifierBytes(__m256i bytes) {
+    __m256i letters = inRange(_mm256_or_si256(bytes, _mm256_set1_epi8(0x20)), 'a', 'z');
+    return _mm256_or_si256(_mm256_or_si256(letters, inRange(bytes, '0', '9')),
+                           _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('_')));
+}
+
+// The last 16-31 bytes go through the SSE2 loop.
+PENGUIN_AVX2 size_t whileAvx2(const char* data, size_t from, size_t size, bool identifier) {
+    for (; from + 32 <= size; from += 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + from));
+        __m256i inRun = identifier ? identifierBytes(bytes) : spaceBytes(bytes);
+        uint32_t stop = ~static_cast<uint32_t>(_mm256_movemask_epi8(inRun));
+        if (stop) return from + __builtin_ctz(stop);
+    }
+    return whileSse2(data, from, size, identifier);
+}
+
+PENGUIN_AVX2 size_t untilAvx2(const char* data, size_t from, size_t size, char target) {
+    __m256i wanted = _mm256_set1_epi8(target);
+    for (; from + 32 <= size; from += 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + from));
+        uint32_t stop = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, wanted)));
+        if (stop) return from + __builtin_ctz(stop);
+    }
+    return untilSse2(data, from, size, target);
+}
+
+ScanIsa detectIsa() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? ScanIsa::AVX2 : ScanIsa::SSE2;
+}
+
+#else
+
+ScanIsa detectIsa() {
+    return ScanIsa::SCALAR;
+}
+
+#endif
+
+const ScanIsa bestIsa = detectIsa();
+ScanIsa activeIsa = bestIsa;
+
+// Runs of whitespace or identifier characters.
+size_t scanWhile(std::string_view text, size_t from, bool identifier) {
+    const char* data = text.data();
+    size_t size = text.size();
+    auto inRun = [identifier](char c) { return identifier ? isIdentifierChar(c) : isSpace(c); };
+    // Most runs end within a byte or two (a single space, a short name);
+    // those never reach the vector loops.
+    for (size_t quick = 0; quick < 2; ++quick, ++from) {
+        if (from >= size || !inRun(data[from])) return from;
+    }
+#ifdef PENGUIN_SCAN_X86
+    if (activeIsa == ScanIsa::AVX2) {
+        from = whileAvx2(data, from, size, identifier);
+    } else if (activeIsa == ScanIsa::SSE2) {
+        from = whileSse2(data, from, size, identifier);
+    }
+#endif
+    while (from < size && inRun(data[from])) ++from;
+    return from;
+}
+
+size_t scanUntil(std::string_view text, size_t from, char target) {
+    const char* data = text.data();
+    size_t size = text.size();
+#ifdef PENGUIN_SCAN_X86
+    if (activeIsa == ScanIsa::AVX2) {
+        from = untilAvx2(data, from, size, target);
+    } else if (activeIsa == ScanIsa::SSE2) {
+        from = untilSse2(data, from, size, target);
+    }
+#endif
+    while (from < size && data[from] != target) ++from;
+    return from;
+}
+
+}  // namespace
+
+size_t skipWhitespace(std::string_view text, size_t from) {
+    return scanWhile(text, from, false);
+}
+
+size_t skipIdentifier(std::string_view text, size_t from) {
+    return scanWhile(text, from, true);
+}
+
+size_t findQuote(std::string_view text, size_t from) {
+    return scanUntil(text, from, '"');
+}
+
+size_t findLineEnd(std::string_view text, size_t from) {
+    return scanUntil(text, from, '\n');
+}
+
+ScanIsa scanIsa() {
+    return activeIsa;
+}
+
+void setScanIsa(ScanIsa isa) {
+    activeIsa = isa < bestIsa ? isa : bestIsa;
+}
+
+const char* scanIsaName(ScanIsa isa) {
+    switch (isa) {
+        case ScanIsa::SCALAR: return "scalar";
+        case ScanIsa::SSE2: return "sse2";
+        case ScanIsa::AVX2: return "avx2";
+    }
+    return "unknown";
+}
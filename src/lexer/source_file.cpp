@@ -0,0 +1,66 @@
+#include "lexer/source_file.h"
+
+#include <fstream>
+#include <iterator>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PENGUIN_SOURCE_MMAP 1
+#endif
+
+SourceFile::SourceFile(const std::string& path) {
+#ifdef PENGUIN_SOURCE_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    // Only regular files have a size to map. Pipes, FIFOs and /dev/stdin
+    // (and files reporting size 0, as some special files do) are read
+    // until EOF.
+    struct stat info;
+    bool regular = fstat(fd, &info) == 0 && S_ISREG(info.st_mode);
+    size_t size = regular ? static_cast<size_t>(info.st_size) : 0;
+    if (regular && size >= MAP_THRESHOLD) {
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            madvise(mapped, size, MADV_SEQUENTIAL);
+            mapping = mapped;
+            mappedSize = size;
+            view = std::string_view(static_cast<const char*>(mapped), size);
+            opened = true;
+            close(fd);
+            return;
+        }
+    }
+    // One byte past the expected size, so reaching EOF costs no regrowth.
+    contents.resize(size + 1 > 4096 ? size + 1 : 4096);
+    size_t done = 0;
+    for (;;) {
+        if (done == contents.size()) contents.resize(contents.size() * 2);
+        ssize_t got = read(fd, &contents[done], contents.size() - done);
+        if (got == 0) break;
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            close(fd);
+            return;
+        }
+        done += static_cast<size_t>(got);
+    }
+    close(fd);
+    contents.resize(done);
+#else
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return;
+    contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+#endif
+    view = contents;
+    opened = true;
+}
+
+SourceFile::~SourceFile() {
+#ifdef PENGUIN_SOURCE_MMAP
+    if (mapping) munmap(mapping, mappedSize);
+#endif
+}
@@ -0,0 +1,155 @@
+// Measures Lexer throughput in MB/s once for each scanner instruction set
+// this build and CPU support (scalar, SSE2, AVX2), so the SIMD scanners
+// can be compared against the byte-at-a-time loops on the same input.
+//
+// Usage: penguin_lexer_bench [--runs N] [--size MB] [file.pg|dir]...
+//
+// With no inputs the text is generated: a mix of declarations, long
+// identifiers, comments and string literals repeated to --size megabytes.
+// Each figure is the best of --runs full tokenize() passes; the last line
+// pulls the same tokens one at a time with next(), as the parser does.
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "lexer/lexer.h"
+#include "lexer/scan.h"
+#include "lexer/source_file.h"
+
+namespace fs = std::filesystem;
+
+struct Options {
+    size_t runs = 5;
+    size_t sizeMb = 16;
+    std::vector<std::string> inputs;
+};
+
+static void collectInputs(const std::string& input, std::vector<std::string>& files) {
+    if (fs::is_directory(input)) {
+        std::vector<std::string> found;
+        for (const auto& entry : fs::recursive_directory_iterator(input)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".pg") {
+                found.push_back(entry.path().string());
+            }
+        }
+        std::sort(found.begin(), found.end());
+        files.insert(files.end(), found.begin(), found.end());
+    } else {
+        files.push_back(input);
+    }
+}
+
+static std::string generateSource(size_t bytes) {
+    static const char* const SNIPPET =
+        "// Accumulates the running totals for every account in the ledger.\n"
+        "func accumulate_balances(ledger_entries, starting_balance) {\n"
+        "    dec running_total = starting_balance;\n"
+        "    for (dec entry_index = 0; entry_index < 128; entry_index += 1) {\n"
+        "        if (ledger_entries[entry_index] > 0) {\n"
+        "            running_total = running_total + ledger_entries[entry_index] * 2;\n"
+        "        } else {\n"
+        "            print(\"skipping an empty ledger entry at this position\");\n"
+        "        }\n"
+        "    }\n"
+        "    return running_total;\n"
+        "}\n"
+        "\n";
+    std::string source;
+    source.reserve(bytes + 1024);
+    while (source.size() < bytes) source += SNIPPET;
+    return source;
+}
+
+static double bestSeconds(std::string_view source, size_t runs, bool pull, size_t& tokenCount) {
+    double best = 0;
+    for (size_t run = 0; run < runs; ++run) {
+        std::string text(source);
+        auto started = std::chrono::steady_clock::now();
+        Lexer lexer(std::move(text));
+        if (pull) {
+            tokenCount = 1;
+            while (lexer.next().type != TokenType::EOF_TOKEN) tokenCount++;
+        } else {
+            tokenCount = lexer.tokenize().size();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        if (run == 0 || seconds < best) best = seconds;
+    }
+    return best;
+}
+
+static void report(const char* name, size_t bytes, double seconds, size_t tokenCount) {
+    std::cout << std::left << std::setw(8) << name << std::right
+              << std::setw(10) << bytes / seconds / 1e6 << " MB/s  " << tokenCount << " tokens\n";
+}
+
+static void printUsage() {
+    std::cerr << "Usage: penguin_lexer_bench [--runs N] [--size MB] [file.pg|dir]...\n";
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ((arg == "--runs" || arg == "--size") && i + 1 < argc) {
+            size_t value = std::stoul(argv[++i]);
+            (arg == "--runs" ? options.runs : options.sizeMb) = value;
+        } else if (arg == "--help" || arg == "-h") {
+            printUsage();
+            return 0;
+        } else {
+            options.inputs.push_back(arg);
+        }
+    }
+    if (options.runs < 1) {
+        printUsage();
+        return 1;
+    }
+
+    std::string source;
+    if (options.inputs.empty()) {
+        source = generateSource(options.sizeMb * 1024 * 1024);
+    } else {
+        std::vector<std::string> files;
+        for (const auto& input : options.inputs) {
+            collectInputs(input, files);
+        }
+        for (const auto& path : files) {
+            SourceFile file(path);
+            if (!file.isOpen()) {
+                std::cerr << "Skipping " << path << ": cannot open\n";
+                continue;
+            }
+            source.append(file.text());
+            source += '\n';
+        }
+    }
+    if (source.empty()) {
+        std::cerr << "No input\n";
+        return 1;
+    }
+
+    std::cout << std::fixed << std::setprecision(2)
+              << "input: " << source.size() / (1024.0 * 1024.0) << " MB, best of " << options.runs << " runs\n";
+
+    ScanIsa best = scanIsa();
+    for (ScanIsa isa : {ScanIsa::SCALAR, ScanIsa::SSE2, ScanIsa::AVX2}) {
+        if (isa > best) break;
+        setScanIsa(isa);
+        size_t tokenCount = 0;
+        double seconds = bestSeconds(source, options.runs, false, tokenCount);
+        report(scanIsaName(isa), source.size(), seconds, tokenCount);
+    }
+    setScanIsa(best);
+
+    size_t tokenCount = 0;
+    double seconds = bestSeconds(source, options.runs, true, tokenCount);
+    report("next()", source.size(), seconds, tokenCount);
+    return 0;
+}
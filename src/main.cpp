@@ -1,11 +1,16 @@
 #include <iostream>
-#include <fstream>
-#include <sstream>
+#include <memory>
+#include <unordered_map>
 
 #include "lexer/lexer.h"
+#include "lexer/source_file.h"
 #include "parser/parser.h"
 #include "interpreter/interpreter.h"
+#include "vm/bytecode_cache.h"
 #include "vm/compiler.h"
+#include "vm/jit.h"
+#include "vm/reg_compiler.h"
+#include "vm/reg_vm.h"
 #include "vm/vm.h"
 
 static void printInfo() {
@@ -13,6 +18,43 @@ static void printInfo() {
     std::cout << "Version: 0.1.0\n";
     std::cout << "Meet my creator Tonmay Sardar !!\n";
     std::cout << "Usage: penguin <file.pg>\n";
+    std::cout << "       penguin --vm[=stack|reg] [-O] [--jit] [--no-cache] [--gc-stats] [--opt-stats] <file.pg>\n";
+}
+
+static void printGCStats(const vm::GCStats& stats) {
+    using std::chrono::duration;
+    std::cerr << "[gc] collections: " << stats.collections << "\n";
+    std::cerr << "[gc] pause: total " << duration<double, std::milli>(stats.totalPause).count()
+              << " ms, max " << duration<double, std::milli>(stats.maxPause).count() << " ms\n";
+    std::cerr << "[gc] allocated: " << stats.bytesAllocated << " bytes\n";
+    std::cerr << "[gc] reclaimed: " << stats.bytesReclaimed << " bytes (" << stats.objectsFreed
+              << " objects)\n";
+    std::cerr << "[gc] live after last collection: " << stats.liveBytes << " bytes\n";
+    std::cerr << "[gc] small-object arena: " << stats.arenaBytes << " bytes\n";
+}
+
+static void printPeepholeStats(const vm::PeepholeStats& stats) {
+    std::cerr << "[opt] instructions: " << stats.instructionsBefore << " -> " << stats.instructionsAfter
+              << "\n";
+    std::cerr << "[opt] store/load and dead push removed: " << stats.storeLoad << "\n";
+    std::cerr << "[opt] jumps threaded: " << stats.jumpThreading << "\n";
+    std::cerr << "[opt] jumps to next removed: " << stats.jumpToNext << "\n";
+    std::cerr << "[opt] JUMP_IF_FALSE/JUMP fused to JUMP_IF_TRUE: " << stats.jumpIfTrue << "\n";
+    std::cerr << "[opt] unreachable removed: " << stats.unreachable << "\n";
+}
+
+static void printIRStats(const vm::IRStats& stats) {
+    std::cerr << "[ir] functions: " << stats.functions << " (" << stats.fallbacks << " compiled directly)\n";
+    std::cerr << "[ir] common subexpressions merged: " << stats.cse << "\n";
+    std::cerr << "[ir] loop invariants hoisted: " << stats.hoisted << "\n";
+    std::cerr << "[ir] induction variables strength-reduced: " << stats.inductions << "\n";
+    std::cerr << "[ir] dead values removed: " << stats.dead << "\n";
+}
+
+static void printJitStats(const vm::JitStats& stats) {
+    std::cerr << "[jit] functions compiled: " << stats.functions << " (" << stats.codeBytes
+              << " bytes of machine code)\n";
+    std::cerr << "[jit] entered at a loop back-edge: " << stats.loopEntries << "\n";
 }
 
 static void printVersion() {
@@ -48,15 +90,39 @@ int main(int argc, char* argv[]) {
     }
 
     bool useVM = false;
+    bool useRegVM = false;
+    bool gcStats = false;
+    bool optStats = false;
+    bool optimizeIR = false;
+    bool useJit = false;
+    bool useCache = true;
     std::string filename;
 
-    if (arg1 == "--vm") {
+    if (arg1 == "--vm" || arg1 == "--vm=stack" || arg1 == "--vm=reg") {
         useVM = true;
-        if (argc != 3) {
-            std::cerr << "Usage: penguin --vm <file.pg>\n";
+        useRegVM = (arg1 == "--vm=reg");
+        int fileArgs = 0;
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--gc-stats") {
+                gcStats = true;
+            } else if (arg == "-O") {
+                optimizeIR = true;
+            } else if (arg == "--jit") {
+                useJit = true;
+            } else if (arg == "--no-cache") {
+                useCache = false;
+            } else if (arg == "--opt-stats") {
+                optStats = true;
+            } else {
+                filename = arg;
+                ++fileArgs;
+            }
+        }
+        if (fileArgs != 1) {
+            std::cerr << "Usage: penguin --vm[=stack|reg] [-O] [--jit] [--no-cache] [--gc-stats] [--opt-stats] <file.pg>\n";
             return 1;
         }
-        filename = argv[2];
     } else {
         if (argc != 2) {
              std::cerr << "Usage: penguin <file.pg>\n";
@@ -65,39 +131,109 @@ int main(int argc, char* argv[]) {
         filename = argv[1];
     }
 
-    // 1. Read source file
-    std::ifstream file(filename);
-    if (!file) {
+    // 1. Read source file, once; the lexer works on it in place
+    SourceFile file(filename);
+    if (!file.isOpen()) {
         std::cerr << "Error: could not open file " << filename << "\n";
         return 1;
     }
-
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    std::string source = buffer.str();
+    std::string_view source = file.text();
 
     try {
-        // 2. Lex
-        Lexer lexer(source);
-        auto tokens = lexer.tokenize();
-
+        // 2. Stack VM runs reuse the bytecode cached by an earlier run of the
+        // same source. --opt-stats needs the compiler to run, and --vm=reg
+        // compiles from the AST.
+        std::string cacheFile;
+        uint64_t cacheKey = 0;
+        vm::CompiledProgram compiled;
+        if (useVM && !useRegVM && useCache && !optStats) {
+            cacheKey = vm::cacheKey(source, optimizeIR ? "O" : "");
+            cacheFile = vm::cachePath(cacheKey);
+        }
+        bool cached = !cacheFile.empty() && vm::loadProgram(cacheFile, cacheKey, compiled);
+
+        // 3. Lex and 4. Parse: the parser pulls tokens from the lexer as it
+        // goes, so no token list for the whole file is built.
+        std::unique_ptr<Program> program;
+        if (!cached) {
+            Lexer lexer(file);
+            Parser parser(lexer);
+            program = parser.parse();
+        }
 
-        // 3. Parse
-        Parser parser(tokens);
-        auto program = parser.parse();
+        // 5. Interpret
+        if (useRegVM) {
+             vm::RegCompiler regCompiler;
+             if (auto* script = regCompiler.compile(program.get())) {
+                 vm::RegVM regVM;
+                 regVM.defineGlobals(regCompiler.globalNames);
+                 for (auto* fn : regCompiler.compiledFunctions) {
+                     regVM.globals[regCompiler.globalSlots.at(fn->name)] = fn;
+                 }
+                 regVM.run(script);
+                 return 0;
+             }
+             // Outside the register backend's subset: the stack VM runs it.
+             std::cerr << "Note: --vm=reg does not support " << regCompiler.unsupported()
+                       << "; using the stack VM\n";
+        }
 
-        // 4. Interpret
         if (useVM) {
-             vm::Compiler compiler;
-             auto* script = compiler.compile(program.get());
+             if (!cached) {
+                 vm::Compiler compiler;
+                 compiler.useIR = optimizeIR;
+                 compiled.script = compiler.compile(program.get());
+                 compiled.functions = compiler.compiledFunctions;
+                 compiled.globalNames = compiler.globalNames;
+                 compiled.mainOffset = compiler.mainOffset;
+                 if (optStats) {
+                     printPeepholeStats(compiler.peepholeStats);
+                     if (optimizeIR) printIRStats(compiler.irStats);
+                 }
+             }
+             std::unique_ptr<vm::Jit> jit;
              vm::VM vmInstance;
-             // Register all compiled functions as globals
-             for (auto* fn : compiler.compiledFunctions) {
-                 if (!fn->isMethod) {
-                     vmInstance.globals[fn->name] = fn;
+             if (useJit && vm::Jit::supported()) {
+                 jit = std::make_unique<vm::Jit>();
+                 vmInstance.jit = jit.get();
+             } else if (useJit) {
+                 std::cerr << "Note: --jit needs an x86-64 Linux build; using the interpreter\n";
+             }
+             vmInstance.defineGlobals(compiled.globalNames);
+             if (compiled.hasSnapshot) {
+                 // The snapshot holds the built classes and the functions:
+                 // straight to main.
+                 vmInstance.globals = compiled.globals;
+                 vmInstance.run(compiled.script, compiled.mainOffset);
+             } else {
+                 // Register all compiled functions in their global slots
+                 std::unordered_map<std::string, size_t> globalSlots;
+                 for (size_t slot = 0; slot < compiled.globalNames.size(); ++slot) {
+                     globalSlots.emplace(compiled.globalNames[slot], slot);
+                 }
+                 for (auto* fn : compiled.functions) {
+                     if (!fn->isMethod) {
+                         vmInstance.globals[globalSlots.at(fn->name)] = fn;
+                     }
+                 }
+                 if (cacheFile.empty()) {
+                     vmInstance.run(compiled.script);
+                 } else if (vmInstance.runUntil(compiled.script, compiled.mainOffset)) {
+                     // Class definitions done: save them with the code,
+                     // which main has not quickened yet. A failed save only
+                     // means the next run compiles again.
+                     compiled.hasSnapshot = true;
+                     compiled.globals = vmInstance.globals;
+                     vm::saveProgram(compiled, cacheKey, cacheFile);
+                     vmInstance.run(compiled.script, compiled.mainOffset);
                  }
              }
-             vmInstance.run(script);
+             if (gcStats) {
+                 printGCStats(vmInstance.heap.stats());
+             }
+             if (optStats && jit) {
+                 printJitStats(jit->stats);
+             }
         } else {
              Interpreter interpreter;
              interpreter.executeProgram(program.get());
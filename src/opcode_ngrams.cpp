@@ -0,0 +1,213 @@
+// Mines opcode n-gram frequencies from the bytecode the VM compiler produces
+// for a corpus of .pg programs. Used to pick candidate superinstructions.
+//
+// Usage: penguin_opcode_ngrams [--max N] [--top K] [--dump] <file.pg|dir>...
+//
+// Counts are static (per emitted instruction, not per executed one). An n-gram
+// never spans a jump target or follows an unconditional transfer, since such
+// a sequence could not be fused into one instruction.
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "lexer/lexer.h"
+#include "parser/parser.h"
+#include "vm/compiler.h"
+#include "vm/disassembler.h"
+
+namespace fs = std::filesystem;
+
+using NGram = std::vector<uint8_t>;
+
+struct Options {
+    size_t maxLength = 4;
+    size_t top = 15;
+    bool dump = false;
+    std::vector<std::string> inputs;
+};
+
+static bool endsBlock(uint8_t op) {
+    return op == vm::OP_JUMP || op == vm::OP_LOOP ||
+           op == vm::OP_RETURN || op == vm::OP_HALT;
+}
+
+static uint16_t readShortAt(const vm::Chunk& chunk, size_t offset) {
+    return static_cast<uint16_t>((chunk.code[offset] << 8) | chunk.code[offset + 1]);
+}
+
+// Splits a chunk into straight-line runs of opcodes.
+static std::vector<std::vector<uint8_t>> basicBlocks(const vm::Chunk& chunk) {
+    std::vector<bool> isTarget(chunk.code.size() + 1, false);
+    for (size_t offset = 0; offset < chunk.code.size();) {
+        uint8_t op = chunk.code[offset];
+        size_t next = offset + vm::instructionLength(op);
+        if (next > chunk.code.size()) break;
+
+        switch (op) {
+            case vm::OP_JUMP:
+            case vm::OP_JUMP_IF_FALSE:
+            case vm::OP_JUMP_IF_TRUE:
+                isTarget[std::min(next + readShortAt(chunk, offset + 1), chunk.code.size())] = true;
+                break;
+            case vm::OP_LOOP:
+                if (readShortAt(chunk, offset + 1) <= next) {
+                    isTarget[next - readShortAt(chunk, offset + 1)] = true;
+                }
+                break;
+            case vm::OP_JUMP_IF_NOT_LT_LOCAL:
+            case vm::OP_JUMP_IF_NOT_LT_CONST:
+                isTarget[std::min(next + readShortAt(chunk, offset + 3), chunk.code.size())] = true;
+                break;
+            default:
+                break;
+        }
+        offset = next;
+    }
+
+    std::vector<std::vector<uint8_t>> blocks(1);
+    for (size_t offset = 0; offset < chunk.code.size();) {
+        uint8_t op = chunk.code[offset];
+        if (isTarget[offset] && !blocks.back().empty()) {
+            blocks.emplace_back();
+        }
+        blocks.back().push_back(op);
+        if (endsBlock(op)) {
+            blocks.emplace_back();
+        }
+        offset += vm::instructionLength(op);
+    }
+    return blocks;
+}
+
+static bool compileFile(const std::string& path, std::vector<vm::FunctionObject*>& functions,
+                        const Options& options) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Error: could not open file " << path << "\n";
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+
+    try {
+        Lexer lexer(buffer.str());
+        Parser parser(lexer);
+        auto program = parser.parse();
+
+        vm::Compiler compiler;
+        vm::FunctionObject* script = compiler.compile(program.get());
+        functions.push_back(script);
+        functions.insert(functions.end(), compiler.compiledFunctions.begin(),
+                         compiler.compiledFunctions.end());
+
+        if (options.dump) {
+            for (auto* fn : compiler.compiledFunctions) {
+                vm::disassembleChunk(fn->chunk, path + ":" + fn->name, std::cout);
+            }
+            vm::disassembleChunk(script->chunk, path + ":" + script->name, std::cout);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Skipping " << path << ": " << e.what() << "\n";
+        return false;
+    }
+    return true;
+}
+
+static void collectInputs(const std::string& input, std::vector<std::string>& files) {
+    if (fs::is_directory(input)) {
+        std::vector<std::string> found;
+        for (const auto& entry : fs::recursive_directory_iterator(input)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".pg") {
+                found.push_back(entry.path().string());
+            }
+        }
+        std::sort(found.begin(), found.end());
+        files.insert(files.end(), found.begin(), found.end());
+    } else {
+        files.push_back(input);
+    }
+}
+
+static void printTop(const std::map<NGram, size_t>& counts, size_t total, size_t top) {
+    std::vector<std::pair<NGram, size_t>> sorted(counts.begin(), counts.end());
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const auto& a, const auto& b) { return a.second > b.second; });
+
+    for (size_t i = 0; i < sorted.size() && i < top; ++i) {
+        double share = total ? 100.0 * sorted[i].second / total : 0.0;
+        std::cout << std::setw(8) << sorted[i].second << "  "
+                  << std::fixed << std::setprecision(2) << std::setw(6) << share << "%  ";
+        for (size_t j = 0; j < sorted[i].first.size(); ++j) {
+            if (j) std::cout << ' ';
+            std::cout << vm::opcodeName(sorted[i].first[j]);
+        }
+        std::cout << "\n";
+    }
+}
+
+static void printUsage() {
+    std::cerr << "Usage: penguin_opcode_ngrams [--max N] [--top K] [--dump] <file.pg|dir>...\n";
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ((arg == "--max" || arg == "--top") && i + 1 < argc) {
+            size_t value = std::stoul(argv[++i]);
+            (arg == "--max" ? options.maxLength : options.top) = value;
+        } else if (arg == "--dump") {
+            options.dump = true;
+        } else if (arg == "--help" || arg == "-h") {
+            printUsage();
+            return 0;
+        } else {
+            options.inputs.push_back(arg);
+        }
+    }
+    if (options.inputs.empty() || options.maxLength < 1) {
+        printUsage();
+        return 1;
+    }
+
+    std::vector<std::string> files;
+    for (const auto& input : options.inputs) {
+        collectInputs(input, files);
+    }
+
+    std::vector<vm::FunctionObject*> functions;
+    size_t compiled = 0;
+    for (const auto& path : files) {
+        if (compileFile(path, functions, options)) compiled++;
+    }
+
+    // counts[n - 1] holds the n-grams of length n.
+    std::vector<std::map<NGram, size_t>> counts(options.maxLength);
+    std::vector<size_t> totals(options.maxLength, 0);
+    for (auto* fn : functions) {
+        for (const auto& block : basicBlocks(fn->chunk)) {
+            for (size_t start = 0; start < block.size(); ++start) {
+                for (size_t n = 1; n <= options.maxLength && start + n <= block.size(); ++n) {
+                    NGram gram(block.begin() + start, block.begin() + start + n);
+                    counts[n - 1][gram]++;
+                    totals[n - 1]++;
+                }
+            }
+        }
+    }
+
+    std::cout << "Compiled " << compiled << " of " << files.size() << " files, "
+              << functions.size() << " functions, " << totals[0] << " instructions\n";
+    for (size_t n = 1; n <= options.maxLength; ++n) {
+        std::cout << "\n== " << n << "-grams ==\n";
+        printTop(counts[n - 1], totals[n - 1], options.top);
+    }
+    return 0;
+}
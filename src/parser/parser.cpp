@@ -3,7 +3,13 @@
 #include <stdexcept>
 
 
-Parser::Parser(const std::vector<Token>& tokens) : tokens(tokens), current(0) {}
+Parser::Parser(const std::vector<Token>& tokens) : tokens(&tokens) {
+    load();
+}
+
+Parser::Parser(Lexer& lexer) : lexer(&lexer) {
+    load();
+}
 
 std::unique_ptr<Program> Parser::parse() {
     auto program = std::make_unique<Program>();
@@ -180,7 +186,7 @@ std::unique_ptr<AssignmentStmt> Parser::parseAssignmentStmt() {
             throw std::runtime_error("Expect assignment operator after variable name.");
         }
         auto value = parseExpression();
-        auto target = std::make_unique<VarExpr>(nameToken.lexeme);
+        auto target = std::make_unique<VarExpr>(std::string(nameToken.lexeme));
         
         // Pass the operator type to Assignment
         assignments.emplace_back(std::move(target), opType, std::move(value));
@@ -257,7 +263,7 @@ std::unique_ptr<Expr> Parser::parseLogicalOr() {
     auto left = parseLogicalAnd();
 
     while (match(TokenType::OR)) { 
-        std::string op = previous().lexeme;
+        std::string op(previous().lexeme);
         auto right = parseLogicalAnd();
         left = std::make_unique<BinaryExpr>(std::move(left), op, std::move(right));
     }
@@ -269,7 +275,7 @@ std::unique_ptr<Expr> Parser::parseLogicalOr() {
 std::unique_ptr<Expr> Parser::parseBitwiseAnd(){
     auto left = parseEquality();
     while(match(TokenType::BITWISE_AND)) {
-        std::string op = previous().lexeme;
+        std::string op(previous().lexeme);
         auto right = parseEquality();
         left = std::make_unique<BinaryExpr>(std::move(left),op,std::move(right));
     }
@@ -278,7 +284,7 @@ std::unique_ptr<Expr> Parser::parseBitwiseAnd(){
 std::unique_ptr<Expr> Parser::parseBitwiseXor(){
     auto left = parseBitwiseAnd();
     while(match(TokenType::BITWISE_XOR)){
-        std::string op = previous().lexeme;
+        std::string op(previous().lexeme);
         auto right = parseBitwiseAnd();
         left = std::make_unique<BinaryExpr>(std::move(left),op,std::move(right));
     }
@@ -288,7 +294,7 @@ std::unique_ptr<Expr> Parser::parseBitwiseXor(){
 std::unique_ptr<Expr> Parser::parseBitwiseOr(){
     auto left = parseBitwiseXor();
     while(match(TokenType::BITWISE_OR)){
-        std::string op = previous().lexeme;
+        std::string op(previous().lexeme);
         auto right = parseBitwiseXor();
         left = std::make_unique<BinaryExpr>(std::move(left),op,std::move(right));
     }
@@ -299,7 +305,7 @@ std::unique_ptr<Expr> Parser::parseLogicalAnd() {
     auto left = parseBitwiseOr();
 
     while (match(TokenType::AND)) { 
-        std::string op = previous().lexeme;
+        std::string op(previous().lexeme);
         auto right = parseBitwiseOr();
         left = std::make_unique<BinaryExpr>(std::move(left), op, std::move(right));
     }
@@ -310,7 +316,7 @@ std::unique_ptr<Expr> Parser::parseEquality() {
     auto left = parseComparison();
 
     while (match(TokenType::EQUAL_EQUAL) || match(TokenType::NOT_EQUAL)) {
-        std::string op = previous().lexeme;
+        std::string op(previous().lexeme);
         auto right = parseComparison();
         left = std::make_unique<BinaryExpr>(std::move(left), op, std::move(right));
     }
@@ -322,7 +328,7 @@ std::unique_ptr<Expr> Parser::parseComparison() {
 
     while (match(TokenType::LESS) || match(TokenType::LESS_EQUAL) ||
            match(TokenType::GREATER) || match(TokenType::GREATER_EQUAL)) {
-        std::string op = previous().lexeme;
+        std::string op(previous().lexeme);
         auto right = parseShift();
         left = std::make_unique<BinaryExpr>(std::move(left), op, std::move(right));
     }
@@ -333,7 +339,7 @@ std::unique_ptr<Expr> Parser::parseShift() {
     auto left = parseAdditive();
 
     while (match(TokenType::LEFT_SHIFT) || match(TokenType::RIGHT_SHIFT)) {
-        std::string op = previous().lexeme;
+        std::string op(previous().lexeme);
         auto right = parseAdditive();
         left = std::make_unique<BinaryExpr>(std::move(left), op, std::move(right));
     }
@@ -346,7 +352,7 @@ std::unique_ptr<Expr> Parser::parseAdditive() {
     auto left = parseMultiplicative();
     
     while (match(TokenType::PLUS) || match(TokenType::MINUS)) {
-        std::string op = previous().lexeme;
+        std::string op(previous().lexeme);
         auto right = parseMultiplicative();
         left = std::make_unique<BinaryExpr>(std::move(left), op, std::move(right));
     }
@@ -358,7 +364,7 @@ std::unique_ptr<Expr> Parser::parseMultiplicative() {
     auto left = parseUnary();
 
     while (match(TokenType::STAR) || match(TokenType::SLASH) || match(TokenType::MOD_OP)) {
-        std::string op = previous().lexeme;
+        std::string op(previous().lexeme);
         auto right = parseUnary();
         left = std::make_unique<BinaryExpr>(std::move(left), op, std::move(right));
     }
@@ -368,7 +374,7 @@ std::unique_ptr<Expr> Parser::parseMultiplicative() {
 
 std::unique_ptr<Expr> Parser::parseUnary() {
     if (match(TokenType::NOT) || match(TokenType::MINUS)) {
-        std::string op = previous().lexeme;
+        std::string op(previous().lexeme);
         auto right = parseUnary();
         return std::make_unique<UnaryExpr>(op, std::move(right));
     }
@@ -397,7 +403,7 @@ std::unique_ptr<Expr> Parser::parsePostfix() {
         }
         else if (match(TokenType::DOT)) {
             Token name = consume(TokenType::IDENTIFIER, "Expect property name after '.'.");
-            expr = std::make_unique<MemberExpr>(std::move(expr), name.lexeme);
+            expr = std::make_unique<MemberExpr>(std::move(expr), std::string(name.lexeme));
         }
         else {
             break;
@@ -424,11 +430,11 @@ std::unique_ptr<Expr> Parser::parsePrimary() {
 
 
     if (match(TokenType::NUMBER)) {
-        return std::make_unique<NumberExpr>(previous().lexeme);
+        return std::make_unique<NumberExpr>(std::string(previous().lexeme));
     }
 
     if (match(TokenType::STRING)) {
-        return std::make_unique<StringExpr>(previous().lexeme);
+        return std::make_unique<StringExpr>(std::string(previous().lexeme));
     }
     
     if (match(TokenType::KEYWORD)) {
@@ -441,7 +447,7 @@ std::unique_ptr<Expr> Parser::parsePrimary() {
     }
 
     if (match(TokenType::IDENTIFIER)) {
-        return std::make_unique<VarExpr>(previous().lexeme);
+        return std::make_unique<VarExpr>(std::string(previous().lexeme));
     }
 
     if (match(TokenType::LPAREN)) {
@@ -460,7 +466,7 @@ std::unique_ptr<ClassStmt> Parser::parseClassStmt() {
     if (check(TokenType::KEYWORD) && peek().lexeme == "inherits") {
         advance();
         Token parent = consume(TokenType::IDENTIFIER, "Expect class name.");
-        parentName = parent.lexeme;
+        parentName = std::string(parent.lexeme);
     }
     
 
@@ -483,7 +489,7 @@ std::unique_ptr<ClassStmt> Parser::parseClassStmt() {
 
     consume(TokenType::RBRACE, "Expect '}' after class body.");
 
-    return std::make_unique<ClassStmt>(name.lexeme, std::move(sections), parentName);
+    return std::make_unique<ClassStmt>(std::string(name.lexeme), std::move(sections), parentName);
 }
 
 std::unique_ptr<ClassSection> Parser::parseSection() {
@@ -503,7 +509,7 @@ std::unique_ptr<ClassSection> Parser::parseSection() {
 }
 AccessModifier Parser::parseAccessModifier() {
     if (match(TokenType::KEYWORD)) {
-        std::string word = previous().lexeme;
+        std::string_view word = previous().lexeme;
 
         if (word == "public") return AccessModifier::PUBLIC;
         if (word == "private") return AccessModifier::PRIVATE;
@@ -515,7 +521,7 @@ AccessModifier Parser::parseAccessModifier() {
 std::unique_ptr<ClassMember> Parser::parseClassMember() {
 
     if (check(TokenType::KEYWORD)) {
-        std::string lexeme = peek().lexeme;
+        std::string_view lexeme = peek().lexeme;
         
         if (lexeme == "dec") {
             advance(); // Consume 'dec'
@@ -525,11 +531,11 @@ std::unique_ptr<ClassMember> Parser::parseClassMember() {
 
             // method declaration?
             if (match(TokenType::LPAREN)) {
-                return parseMethodDeclAfterName(name.lexeme);
+                return parseMethodDeclAfterName(std::string(name.lexeme));
             }
 
             consume(TokenType::SEMICOLON, "Expect ';' after field.");
-            return std::make_unique<FieldDecl>(name.lexeme);
+            return std::make_unique<FieldDecl>(std::string(name.lexeme));
         }
         
         if (lexeme == "func") {
@@ -538,7 +544,7 @@ std::unique_ptr<ClassMember> Parser::parseClassMember() {
         }
     }
 
-    throw std::runtime_error("Invalid class member. Found: " + peek().lexeme);
+    throw std::runtime_error("Invalid class member. Found: " + std::string(peek().lexeme));
 }
 std::unique_ptr<MethodDecl> Parser::parseMethodDeclAfterName(std::string name) {
 
@@ -554,7 +560,7 @@ std::unique_ptr<MethodDecl> Parser::parseMethodDeclAfterName(std::string name) {
             }
 
             Token paramName = consume(TokenType::IDENTIFIER, "Expect parameter name.");
-            params.emplace_back(paramName.lexeme, isRef);
+            params.emplace_back(std::string(paramName.lexeme), isRef);
 
         } while (match(TokenType::COMMA));
     }
@@ -581,7 +587,7 @@ std::unique_ptr<MethodDef> Parser::parseMethodDef() {
             }
 
             Token paramName = consume(TokenType::IDENTIFIER, "Expect parameter name.");
-            params.emplace_back(paramName.lexeme, isRef);
+            params.emplace_back(std::string(paramName.lexeme), isRef);
 
         } while (match(TokenType::COMMA));
     }
@@ -590,7 +596,7 @@ std::unique_ptr<MethodDef> Parser::parseMethodDef() {
 
     auto body = parseBlock();
 
-    return std::make_unique<MethodDef>(name.lexeme, std::move(params), std::move(body));
+    return std::make_unique<MethodDef>(std::string(name.lexeme), std::move(params), std::move(body));
 }
 
 
@@ -609,8 +615,22 @@ bool Parser::check(TokenType type) const {
     return peek().type == type;
 }
 
-Token Parser::advance() {
-    if (!isAtEnd()) current++;
+void Parser::load() {
+    Token& slot = ring[current % LOOKAHEAD_SLOTS];
+    if (lexer) {
+        slot = lexer->next();
+    } else if (current < tokens->size()) {
+        slot = (*tokens)[current];
+    } else {
+        slot = Token(TokenType::EOF_TOKEN, "");
+    }
+}
+
+const Token& Parser::advance() {
+    if (!isAtEnd()) {
+        current++;
+        load();
+    }
     return previous();
 }
 
@@ -618,17 +638,17 @@ bool Parser::isAtEnd() const {
     return peek().type == TokenType::EOF_TOKEN;
 }
 
-Token Parser::peek() const {
-    return tokens[current];
+const Token& Parser::peek() const {
+    return ring[current % LOOKAHEAD_SLOTS];
 }
 
-Token Parser::previous() const {
-    return tokens[current - 1];
+const Token& Parser::previous() const {
+    return ring[(current - 1) % LOOKAHEAD_SLOTS];
 }
 
-Token Parser::consume(TokenType type, const std::string& message) {
+const Token& Parser::consume(TokenType type, const std::string& message) {
     if (check(type)) return advance();
-    throw std::runtime_error(message + " Found: " + peek().lexeme);
+    throw std::runtime_error(message + " Found: " + std::string(peek().lexeme));
 }
 std::vector<Param> Parser::parseParams(){
 
@@ -645,7 +665,7 @@ std::vector<Param> Parser::parseParams(){
         }
 
         consume(TokenType::IDENTIFIER, "Expected parameter name");
-        std::string name = previous().lexeme;
+        std::string name(previous().lexeme);
 
         params.emplace_back(name, isRef);
 
@@ -657,7 +677,7 @@ std::vector<Param> Parser::parseParams(){
 std::unique_ptr<Function> Parser::parseFunction() {
     consume(TokenType::KEYWORD, "Expected 'func'");
     consume(TokenType::IDENTIFIER, "Expected function name");
-    std::string name = previous().lexeme;
+    std::string name(previous().lexeme);
 
     consume(TokenType::LPAREN, "Expected '(' after function name");
     auto params = parseParams();
@@ -1,7 +1,10 @@
 #include "../include/lexer/lexer.h"
+#include "../include/lexer/scan.h"
 #include <iostream>
 #include <vector>
 #include <cassert>
+#include <cctype>
+#include <cstdint>
 #include <string>
 
 #define ASSERT_TOKEN(token, expectedType, expectedLexeme) \
@@ -283,10 +286,145 @@ void testReturn() {
     std::cout << "testReturn passed" << std::endl;
 }
 
+void testAllKeywords() {
+    const std::vector<std::string> keywords = {
+        "if", "else", "while", "return", "func", "true", "false", "break",
+        "continue", "for", "class", "dec", "private", "public", "protected", "inherits",
+    };
+    std::string source;
+    for (const auto& keyword : keywords) source += keyword + " ";
+    // Words hashing near the keywords, and prefixes and extensions of them.
+    source += "i of ef iff elsewhere Return fun fo decl classes ref print x_";
+    Lexer lexer(source);
+    auto tokens = lexer.tokenize();
+
+    size_t i = 0;
+    for (const auto& keyword : keywords) {
+        ASSERT_TOKEN(tokens[i], TokenType::KEYWORD, keyword);
+        ++i;
+    }
+    for (const char* word : {"i", "of", "ef", "iff", "elsewhere", "Return", "fun", "fo", "decl", "classes", "ref", "print", "x_"}) {
+        ASSERT_TOKEN(tokens[i], TokenType::IDENTIFIER, word);
+        ++i;
+    }
+    ASSERT_TOKEN(tokens[i], TokenType::EOF_TOKEN, "");
+
+    std::cout << "testAllKeywords passed" << std::endl;
+}
+
+void testLexemesViewSource() {
+    const std::string source = "name = \"hi there\"; // done\nx";
+    Lexer lexer(source);
+    auto tokens = lexer.tokenize();
+
+    ASSERT_TOKEN(tokens[0], TokenType::IDENTIFIER, "name");
+    ASSERT_TOKEN(tokens[1], TokenType::EQUAL, "=");
+    ASSERT_TOKEN(tokens[2], TokenType::STRING, "hi there");
+    ASSERT_TOKEN(tokens[3], TokenType::SEMICOLON, ";");
+    ASSERT_TOKEN(tokens[4], TokenType::IDENTIFIER, "x");
+    ASSERT_TOKEN(tokens[5], TokenType::EOF_TOKEN, "");
+    // Every lexeme lies in one buffer, in source order.
+    for (size_t i = 1; i < tokens.size(); ++i) {
+        assert(tokens[i].lexeme.data() >= tokens[i - 1].lexeme.data() + tokens[i - 1].lexeme.size());
+    }
+    assert(tokens[5].lexeme.data() - tokens[0].lexeme.data() == static_cast<long>(source.size()));
+
+    std::cout << "testLexemesViewSource passed" << std::endl;
+}
+
+void testNext() {
+    const std::string source = "func f(a) { // note\n  return a >= 10 && \"x\"; }  ";
+    Lexer listing(source);
+    auto tokens = listing.tokenize();
+
+    Lexer pulling(source);
+    for (const auto& expected : tokens) {
+        Token token = pulling.next();
+        assert(token.type == expected.type);
+        assert(token.lexeme == expected.lexeme);
+    }
+    // EOF_TOKEN again on every later call.
+    assert(pulling.next().type == TokenType::EOF_TOKEN);
+    assert(pulling.next().type == TokenType::EOF_TOKEN);
+
+    // tokenize() after next() returns the tokens not yet pulled.
+    Lexer both(source);
+    both.next();
+    both.next();
+    auto rest = both.tokenize();
+    assert(rest.size() == tokens.size() - 2);
+    ASSERT_TOKEN(rest[0], TokenType::LPAREN, "(");
+
+    std::cout << "testNext passed" << std::endl;
+}
+
+// Each scanner, at every instruction set available, must agree with a byte
+// loop for all start offsets and buffer lengths around the 16/32-byte blocks.
+void testScanners() {
+    const std::string alphabet = "aZ_09 \t\n\r\"/;({@[`{\x80\xff";
+    uint32_t seed = 12345;
+    auto next = [&seed]() {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) & 0x7fff;
+    };
+    auto isIdentifierChar = [](char c) {
+        return isalnum(static_cast<unsigned char>(c)) || c == '_';
+    };
+    auto isSpace = [](char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; };
+
+    const ScanIsa best = scanIsa();
+    for (ScanIsa isa : {ScanIsa::SCALAR, ScanIsa::SSE2, ScanIsa::AVX2}) {
+        if (isa > best) break;
+        setScanIsa(isa);
+        assert(scanIsa() == isa);
+        for (size_t length = 0; length <= 100; ++length) {
+            // Long runs of one class, so the vector loops cross whole blocks.
+            std::vector<char> buffer(length);
+            char fill = alphabet[next() % alphabet.size()];
+            for (char& c : buffer) {
+                c = next() % 8 == 0 ? alphabet[next() % alphabet.size()] : fill;
+            }
+            std::string_view text(buffer.data(), buffer.size());
+            for (size_t from = 0; from <= length; ++from) {
+                size_t expected = from;
+                while (expected < length && isSpace(text[expected])) ++expected;
+                assert(skipWhitespace(text, from) == expected);
+                expected = from;
+                while (expected < length && isIdentifierChar(text[expected])) ++expected;
+                assert(skipIdentifier(text, from) == expected);
+                expected = from;
+                while (expected < length && text[expected] != '"') ++expected;
+                assert(findQuote(text, from) == expected);
+                expected = from;
+                while (expected < length && text[expected] != '\n') ++expected;
+                assert(findLineEnd(text, from) == expected);
+            }
+        }
+
+        const std::string name(70, 'k');
+        Lexer lexer("  \t\r\n" + name + "9 = \"" + std::string(40, '.') + "\"; // " + name + "\n" + std::string(33, ' ') + "x");
+        auto tokens = lexer.tokenize();
+        ASSERT_TOKEN(tokens[0], TokenType::IDENTIFIER, name + "9");
+        ASSERT_TOKEN(tokens[1], TokenType::EQUAL, "=");
+        ASSERT_TOKEN(tokens[2], TokenType::STRING, std::string(40, '.'));
+        ASSERT_TOKEN(tokens[3], TokenType::SEMICOLON, ";");
+        ASSERT_TOKEN(tokens[4], TokenType::IDENTIFIER, "x");
+        ASSERT_TOKEN(tokens[5], TokenType::EOF_TOKEN, "");
+    }
+    setScanIsa(ScanIsa::AVX2);
+    assert(scanIsa() == best);
+
+    std::cout << "testScanners passed (up to " << scanIsaName(best) << ")" << std::endl;
+}
+
 int main() {
     std::cout << "Running Lexer Tests..." << std::endl;
     testBasics();
     testKeywords();
+    testAllKeywords();
+    testLexemesViewSource();
+    testScanners();
+    testNext();
     testIdentifiers();
     testComplex();
     test_and();
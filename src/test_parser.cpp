@@ -2,6 +2,7 @@
 #include <iostream>
 #include <vector>
 #include <cassert>
+#include <stdexcept>
 #include <string>
 
 // Helper macros for verification
@@ -914,6 +915,57 @@ void test_shift_with_parentheses(){
     ASSERT_EQ(rightRight->name, "c");
 }
 
+// Parser(Lexer&) pulls tokens as it parses; the names it copies out and
+// its error messages must match what parsing a token vector gives.
+void testStreamingParser() {
+    std::cout << "Testing StreamingParser..." << std::endl;
+    std::string source = "{\n  class Point inherits Base { public { dec : x; func norm() { return this.x * 2 + 1; } } }\n";
+    const int count = 3000;
+    for (int i = 0; i < count; ++i) {
+        source += "  func f" + std::to_string(i) + "(a, ref: b) { a = (a + 2) * b; return \"s" + std::to_string(i) + "\"; }\n";
+    }
+    source += "}\n";
+
+    Lexer lexer(source);
+    Parser parser(lexer);
+    auto program = parser.parse();
+    ASSERT_EQ(program->classes.size(), 1);
+    ASSERT_EQ(program->classes[0]->name, "Point");
+    ASSERT_EQ(program->classes[0]->parentName, "Base");
+    ASSERT_EQ(program->functions.size(), static_cast<size_t>(count));
+    for (int i = 0; i < count; ++i) {
+        auto& func = program->functions[i];
+        ASSERT_EQ(func->name, "f" + std::to_string(i));
+        ASSERT_EQ(func->params.size(), 2);
+        ASSERT_EQ(func->params[1].name, "b");
+        ASSERT_EQ(func->body->statements.size(), 2);
+    }
+    auto* assign = dynamic_cast<AssignmentStmt*>(program->functions[count - 1]->body->statements[0].get());
+    ASSERT_NOT_NULL(assign);
+    auto* product = dynamic_cast<BinaryExpr*>(assign->assignments[0].value.get());
+    ASSERT_NOT_NULL(product);
+    ASSERT_EQ(product->op, "*");
+
+    for (const std::string& bad : {std::string("{ func f( { }"), std::string("{ func g() { x = ; } }")}) {
+        std::string streamed, listed;
+        try {
+            Lexer badLexer(bad);
+            Parser(badLexer).parse();
+        } catch (const std::runtime_error& e) {
+            streamed = e.what();
+        }
+        try {
+            Lexer badLexer(bad);
+            std::vector<Token> tokens = badLexer.tokenize();
+            Parser(tokens).parse();
+        } catch (const std::runtime_error& e) {
+            listed = e.what();
+        }
+        assert(!streamed.empty());
+        ASSERT_EQ(streamed, listed);
+    }
+}
+
 void test_array_defination(){
     
 }
@@ -936,6 +988,7 @@ int main() {
     test_left_shift();
     test_right_shift();
     test_shift_with_parentheses();
+    testStreamingParser();
     std::cout << "All parser tests passed!" << std::endl;
     return 0;
 }
@@ -0,0 +1,146 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cassert>
+
+#include "lexer/lexer.h"
+#include "parser/parser.h"
+#include "vm/compiler.h"
+#include "vm/reg_compiler.h"
+#include "vm/reg_vm.h"
+#include "vm/vm.h"
+
+// Differential tests: the register backend must print exactly what the stack
+// VM prints for every program it accepts.
+
+static std::unique_ptr<Program> parse(const std::string& source) {
+    Lexer lexer(source);
+    auto tokens = lexer.tokenize();
+    Parser parser(tokens);
+    return parser.parse();
+}
+
+static std::string runStack(const std::string& source) {
+    auto program = parse(source);
+    vm::Compiler compiler;
+    auto* script = compiler.compile(program.get());
+    vm::VM vm;
+    vm.defineGlobals(compiler.globalNames);
+    for (auto* fn : compiler.compiledFunctions) {
+        if (!fn->isMethod) {
+            vm.globals[compiler.globalSlots.at(fn->name)] = fn;
+        }
+    }
+
+    std::ostringstream out;
+    auto* saved = std::cout.rdbuf(out.rdbuf());
+    vm.run(script);
+    std::cout.rdbuf(saved);
+    return out.str();
+}
+
+static std::string runRegister(const std::string& source) {
+    auto program = parse(source);
+    vm::RegCompiler compiler;
+    auto* script = compiler.compile(program.get());
+    assert(script != nullptr);
+    vm::RegVM vm;
+    vm.defineGlobals(compiler.globalNames);
+    for (auto* fn : compiler.compiledFunctions) {
+        vm.globals[compiler.globalSlots.at(fn->name)] = fn;
+    }
+
+    std::ostringstream out;
+    auto* saved = std::cout.rdbuf(out.rdbuf());
+    vm.run(script);
+    std::cout.rdbuf(saved);
+    return out.str();
+}
+
+static void expectSameOutput(const std::string& name, const std::string& source) {
+    std::cout << "Testing " << name << "..." << std::endl;
+    std::string expected = runStack(source);
+    std::string actual = runRegister(source);
+    if (expected != actual) {
+        std::cerr << "stack VM:\n" << expected << "register VM:\n" << actual << std::endl;
+    }
+    assert(expected == actual);
+    std::cout << name << " Test Passed" << std::endl;
+}
+
+void test_arithmetic() {
+    expectSameOutput("Register Arithmetic", R"({
+        func main() {
+            a = 7;
+            b = 2;
+            println(a + b * 3 - a % b);
+            println(a / b);
+            println((a & 3) | (b << 2));
+            a += 5;
+            b *= a;
+            println(a);
+            println(b);
+            println("n = {a}, m = {b}");
+        }
+    })");
+}
+
+void test_control_flow() {
+    expectSameOutput("Register Control Flow", R"({
+        func main() {
+            s = 0;
+            for (i = 0; i < 20; i = i + 1) {
+                if (i == 3) { continue; }
+                if (i >= 15) { break; }
+                s = s + i;
+            }
+            println(s);
+            j = 10;
+            while (j > 0 && s != 0) {
+                j = j - 3;
+            }
+            println(j);
+            println(j < 0 || false);
+        }
+    })");
+}
+
+void test_calls() {
+    expectSameOutput("Register Calls", R"({
+        func fib(n) {
+            if (n < 2) { return n; }
+            return fib(n - 1) + fib(n - 2);
+        }
+        func add(x, y) {
+            return x + y;
+        }
+        func main() {
+            println(fib(15));
+            println(add(fib(5), add(1, 2)));
+            f = add;
+            println(f(3, 4));
+        }
+    })");
+}
+
+void test_unsupported_falls_back() {
+    std::cout << "Testing Register Fallback..." << std::endl;
+    auto program = parse(R"({
+        func main() {
+            a = [1, 2, 3];
+            println(a[0]);
+        }
+    })");
+    vm::RegCompiler compiler;
+    assert(compiler.compile(program.get()) == nullptr);
+    assert(compiler.unsupported() == "arrays");
+    std::cout << "Register Fallback Test Passed" << std::endl;
+}
+
+int main() {
+    test_arithmetic();
+    test_control_flow();
+    test_calls();
+    test_unsupported_falls_back();
+    return 0;
+}
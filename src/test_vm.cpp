@@ -1,8 +1,20 @@
+#include <algorithm>
 #include <iostream>
+#include <sstream>
 #include <vector>
 #include <cassert>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include "lexer/lexer.h"
+#include "parser/parser.h"
 #include "vm/vm.h"
+#include "vm/bytecode_cache.h"
 #include "vm/chunk.h"
+#include "vm/compiler.h"
+#include "vm/disassembler.h"
+#include "vm/jit.h"
 #include "vm/opcode.h"
 #include "vm/value.h"
 
@@ -38,37 +50,41 @@ void test_classes() {
     vm::FunctionObject fn("test", 0);
     vm::VM vm;
 
+    // Global slots, as the compiler would assign them
+    vm.defineGlobals({"Point", "p"});
+    const uint16_t pointSlot = 0;
+    const uint16_t pSlot = 1;
+
     // 1. Define class "Point"
-    int classNameIdx = fn.chunk.addConstant(std::string("Point"));
+    int classNameIdx = fn.chunk.addConstant(vm::Value("Point"));
     fn.chunk.write(vm::OP_CLASS);
     fn.chunk.write(classNameIdx);
     
     // Save class to global to keep it around
     fn.chunk.write(vm::OP_SET_GLOBAL);
-    fn.chunk.write(classNameIdx);
+    fn.chunk.write16(pointSlot);
     fn.chunk.write(vm::OP_POP); // Keep stack clean
 
     // 2. Instantiate "Point" 
     fn.chunk.write(vm::OP_GET_GLOBAL);
-    fn.chunk.write(classNameIdx);
+    fn.chunk.write16(pointSlot);
     
     // Call the class (0 arguments) to instantiate
     fn.chunk.write(vm::OP_CALL);
     fn.chunk.write(0);
     
     // 3. Set property "x" = 10 on the instance
-    int xIdx = fn.chunk.addConstant(std::string("x"));
+    int xIdx = fn.chunk.addConstant(vm::Value("x"));
     
     // Duplicate instance on stack so we can use it again
     // We don't have OP_DUP, so let's save instance to global "p"
-    int pIdx = fn.chunk.addConstant(std::string("p"));
     fn.chunk.write(vm::OP_SET_GLOBAL);
-    fn.chunk.write(pIdx);
+    fn.chunk.write16(pSlot);
     fn.chunk.write(vm::OP_POP);
     
     // Get "p"
     fn.chunk.write(vm::OP_GET_GLOBAL);
-    fn.chunk.write(pIdx);
+    fn.chunk.write16(pSlot);
     
     // Value 10
     int val10 = fn.chunk.addConstant((int64_t)10);
@@ -78,13 +94,15 @@ void test_classes() {
     // p.x = 10
     fn.chunk.write(vm::OP_SET_PROPERTY);
     fn.chunk.write(xIdx);
+    fn.chunk.write16(fn.chunk.addPropertyCache());
     fn.chunk.write(vm::OP_POP); // pop assignment result
     
     // 4. Get property "x"
     fn.chunk.write(vm::OP_GET_GLOBAL);
-    fn.chunk.write(pIdx);
+    fn.chunk.write16(pSlot);
     fn.chunk.write(vm::OP_GET_PROPERTY);
     fn.chunk.write(xIdx);
+    fn.chunk.write16(fn.chunk.addPropertyCache());
     
     // print
     fn.chunk.write(vm::OP_PRINTLN);
@@ -96,9 +114,1358 @@ void test_classes() {
     std::cout << "Class and Object Test Passed (Clean Run)" << std::endl;
 }
 
+void test_stack_overflow() {
+    std::cout << "Testing Stack Overflow Detection..." << std::endl;
+
+    vm::FunctionObject script("test", 0);
+    vm::FunctionObject recurse("recurse", 0);
+    vm::VM vm;
+    vm.defineGlobals({"recurse"});
+    vm.globals[0] = &recurse;
+
+    // recurse() { return recurse(); }
+    recurse.chunk.write(vm::OP_GET_GLOBAL);
+    recurse.chunk.write16(0);
+    recurse.chunk.write(vm::OP_CALL);
+    recurse.chunk.write(0);
+    recurse.chunk.write(vm::OP_RETURN);
+
+    script.chunk.write(vm::OP_GET_GLOBAL);
+    script.chunk.write16(0);
+    script.chunk.write(vm::OP_CALL);
+    script.chunk.write(0);
+    script.chunk.write(vm::OP_HALT);
+
+    vm.run(&script);
+
+    // Two slots a frame: the call depth runs out first.
+    assert(vm.frames.size() == vm::VM::FRAMES_MAX);
+
+    // wide() { 200 temporaries; return wide(); }: the value stack runs out
+    // first, well short of FRAMES_MAX, and no frame starts past stackLimit.
+    vm::FunctionObject wide("wide", 0);
+    vm::VM wideVM;
+    wideVM.defineGlobals({"wide"});
+    wideVM.globals[0] = &wide;
+    for (int i = 0; i < 200; ++i) wide.chunk.write(vm::OP_NULL);
+    wide.chunk.write(vm::OP_GET_GLOBAL);
+    wide.chunk.write16(0);
+    wide.chunk.write(vm::OP_CALL);
+    wide.chunk.write(0);
+    wide.chunk.write(vm::OP_RETURN);
+
+    wideVM.run(&script);
+
+    assert(wideVM.frames.size() < vm::VM::FRAMES_MAX);
+    assert(wideVM.frames.size() > vm::VM::STACK_MAX / 202 - 2);
+    assert(wideVM.frames.back().slots <= wideVM.stack.get() + vm::VM::STACK_MAX - vm::VM::FRAME_SLOTS);
+    std::cout << "Stack Overflow Test Passed" << std::endl;
+}
+
+void test_global_slots() {
+    std::cout << "Testing Global Slots..." << std::endl;
+
+    vm::FunctionObject fn("test", 0);
+    vm::VM vm;
+    vm.defineGlobals({"a", "b"});
+
+    // b = 42 (slot 1), then print a (slot 0, never assigned)
+    int c42 = fn.chunk.addConstant((int64_t)42);
+    fn.chunk.write(vm::OP_CONSTANT);
+    fn.chunk.write(c42);
+    fn.chunk.write(vm::OP_SET_GLOBAL);
+    fn.chunk.write16(1);
+    fn.chunk.write(vm::OP_POP);
+    fn.chunk.write(vm::OP_GET_GLOBAL);
+    fn.chunk.write16(0);
+    fn.chunk.write(vm::OP_PRINTLN);
+    fn.chunk.write(vm::OP_HALT);
+
+    vm.run(&fn);
+
+    vm::Value* b = vm.findGlobal("b");
+    assert(b != nullptr && b->isInt() && b->as.integer == 42);
+    assert(vm.findGlobal("a")->isNull());
+    assert(vm.findGlobal("missing") == nullptr);
+    std::cout << "Global Slots Test Passed" << std::endl;
+}
+
+void test_superinstructions() {
+    std::cout << "Testing Superinstructions..." << std::endl;
+
+    vm::FunctionObject fn("test", 0);
+    vm::VM vm;
+    vm.defineGlobals({"sum"});
+
+    // i = 0 (local 0), sum = 0 (local 1)
+    // while (i < 10) { sum = sum + i; i = i + 1; }
+    int c0 = fn.chunk.addConstant((int64_t)0);
+    int c1 = fn.chunk.addConstant((int64_t)1);
+    int c10 = fn.chunk.addConstant((int64_t)10);
+    fn.chunk.write(vm::OP_CONSTANT);
+    fn.chunk.write(c0);
+    fn.chunk.write(vm::OP_CONSTANT);
+    fn.chunk.write(c0);
+
+    size_t loopStart = fn.chunk.code.size();
+    fn.chunk.write(vm::OP_JUMP_IF_NOT_LT_CONST);
+    fn.chunk.write(0);
+    fn.chunk.write(c10);
+    size_t exitJump = fn.chunk.code.size();
+    fn.chunk.write16(0);
+
+    fn.chunk.write(vm::OP_GET_LOCAL);
+    fn.chunk.write(1);
+    fn.chunk.write(vm::OP_GET_LOCAL);
+    fn.chunk.write(0);
+    fn.chunk.write(vm::OP_ADD);
+    fn.chunk.write(vm::OP_SET_LOCAL_POP);
+    fn.chunk.write(1);
+    fn.chunk.write(vm::OP_INC_LOCAL_CONST);
+    fn.chunk.write(0);
+    fn.chunk.write(c1);
+    fn.chunk.write(vm::OP_LOOP);
+    fn.chunk.write16(fn.chunk.code.size() + 2 - loopStart);
+
+    uint16_t exitOffset = fn.chunk.code.size() - exitJump - 2;
+    fn.chunk.code[exitJump] = (exitOffset >> 8) & 0xff;
+    fn.chunk.code[exitJump + 1] = exitOffset & 0xff;
+
+    fn.chunk.write(vm::OP_GET_LOCAL);
+    fn.chunk.write(1);
+    fn.chunk.write(vm::OP_SET_GLOBAL);
+    fn.chunk.write16(0);
+    fn.chunk.write(vm::OP_HALT);
+
+    vm.run(&fn);
+
+    vm::Value* sum = vm.findGlobal("sum");
+    assert(sum->isInt() && sum->as.integer == 45);
+    std::cout << "Superinstructions Test Passed" << std::endl;
+}
+
+void test_field_layout() {
+    std::cout << "Testing Field Layout..." << std::endl;
+
+    vm::FunctionObject fn("test", 0);
+    vm::VM vm;
+    vm.defineGlobals({"Base", "Derived", "d"});
+
+    int baseIdx = fn.chunk.addConstant(vm::Value("Base"));
+    int derivedIdx = fn.chunk.addConstant(vm::Value("Derived"));
+    int aIdx = fn.chunk.addConstant(vm::Value("a"));
+    int bIdx = fn.chunk.addConstant(vm::Value("b"));
+    int cIdx = fn.chunk.addConstant(vm::Value("c"));
+    int extraIdx = fn.chunk.addConstant(vm::Value("extra"));
+    int c7 = fn.chunk.addConstant((int64_t)7);
+
+    // class Base { public a; private b; }
+    fn.chunk.write(vm::OP_CLASS);
+    fn.chunk.write(baseIdx);
+    fn.chunk.write(vm::OP_SET_GLOBAL);
+    fn.chunk.write16(0);
+    fn.chunk.write(vm::OP_FIELD);
+    fn.chunk.write(aIdx);
+    fn.chunk.write(static_cast<uint8_t>(AccessModifier::PUBLIC));
+    fn.chunk.write(vm::OP_FIELD);
+    fn.chunk.write(bIdx);
+    fn.chunk.write(static_cast<uint8_t>(AccessModifier::PRIVATE));
+    fn.chunk.write(vm::OP_POP);
+
+    // class Derived : Base { public c; protected a; }
+    fn.chunk.write(vm::OP_CLASS);
+    fn.chunk.write(derivedIdx);
+    fn.chunk.write(vm::OP_SET_GLOBAL);
+    fn.chunk.write16(1);
+    fn.chunk.write(vm::OP_GET_GLOBAL);
+    fn.chunk.write16(0);
+    fn.chunk.write(vm::OP_INHERIT);
+    fn.chunk.write(vm::OP_FIELD);
+    fn.chunk.write(cIdx);
+    fn.chunk.write(static_cast<uint8_t>(AccessModifier::PUBLIC));
+    fn.chunk.write(vm::OP_FIELD);
+    fn.chunk.write(aIdx);
+    fn.chunk.write(static_cast<uint8_t>(AccessModifier::PROTECTED));
+    fn.chunk.write(vm::OP_POP);
+
+    // d = Derived(); d.c = 7; d.extra = 7;
+    fn.chunk.write(vm::OP_GET_GLOBAL);
+    fn.chunk.write16(1);
+    fn.chunk.write(vm::OP_CALL);
+    fn.chunk.write(0);
+    fn.chunk.write(vm::OP_SET_GLOBAL);
+    fn.chunk.write16(2);
+    fn.chunk.write(vm::OP_CONSTANT);
+    fn.chunk.write(c7);
+    fn.chunk.write(vm::OP_SET_PROPERTY);
+    fn.chunk.write(cIdx);
+    fn.chunk.write16(fn.chunk.addPropertyCache());
+    fn.chunk.write(vm::OP_POP);
+    fn.chunk.write(vm::OP_GET_GLOBAL);
+    fn.chunk.write16(2);
+    fn.chunk.write(vm::OP_CONSTANT);
+    fn.chunk.write(c7);
+    fn.chunk.write(vm::OP_SET_PROPERTY);
+    fn.chunk.write(extraIdx);
+    fn.chunk.write16(fn.chunk.addPropertyCache());
+    fn.chunk.write(vm::OP_POP);
+    fn.chunk.write(vm::OP_HALT);
+
+    vm.run(&fn);
+
+    vm::ClassObject* base = vm.findGlobal("Base")->as.klass;
+    vm::ClassObject* derived = vm.findGlobal("Derived")->as.klass;
+    assert(base->fieldLayout.size() == 2);
+    assert(base->findField("b") == 1);
+
+    // Private parent fields are not inherited; redeclaring keeps the slot.
+    assert(derived->fieldLayout.size() == 2);
+    assert(derived->findField("a") == 0);
+    assert(derived->fieldLayout[0].access == AccessModifier::PROTECTED);
+    assert(derived->findField("b") == -1);
+    assert(derived->findField("c") == 1);
+
+    vm::InstanceObject* d = vm.findGlobal("d")->as.instance;
+    assert(d->slotCount == 2);
+    assert(d->slots[0].isNull());
+    assert(d->slots[1].isInt() && d->slots[1].as.integer == 7);
+    assert(d->overflow != nullptr && d->overflow->count("extra") == 1);
+    std::cout << "Field Layout Test Passed" << std::endl;
+}
+
+void test_property_cache() {
+    std::cout << "Testing Property Inline Cache..." << std::endl;
+
+    // class A { x; }  class B { y; x; }  -- `x` lives in a different slot
+    vm::ClassObject a("A");
+    a.declareField("x", AccessModifier::PUBLIC);
+    vm::ClassObject b("B");
+    b.declareField("y", AccessModifier::PUBLIC);
+    b.declareField("x", AccessModifier::PUBLIC);
+    vm::InstanceObject ia(&a);
+    ia.slots[0] = (int64_t)1;
+    vm::InstanceObject ib(&b);
+    ib.slots[1] = (int64_t)2;
+
+    // result = obj.x
+    vm::FunctionObject fn("test", 0);
+    vm::VM vm;
+    vm.defineGlobals({"obj", "result"});
+    int xIdx = fn.chunk.addConstant(vm::Value("x"));
+    int cache = fn.chunk.addPropertyCache();
+    fn.chunk.write(vm::OP_GET_GLOBAL);
+    fn.chunk.write16(0);
+    fn.chunk.write(vm::OP_GET_PROPERTY);
+    fn.chunk.write(xIdx);
+    fn.chunk.write16(cache);
+    fn.chunk.write(vm::OP_SET_GLOBAL);
+    fn.chunk.write16(1);
+    fn.chunk.write(vm::OP_HALT);
+
+    const vm::PropertyCacheEntry* entries = fn.chunk.propertyCaches[cache].entries;
+    auto readX = [&](vm::InstanceObject* instance) {
+        vm.globals[0] = instance;
+        vm.run(&fn);
+        return vm.globals[1].as.integer;
+    };
+
+    // Miss fills the first entry, the second run hits it.
+    assert(readX(&ia) == 1);
+    assert(entries[0].klass == &a && entries[0].kind == vm::PropertyCacheEntry::FIELD);
+    assert(entries[0].slot == 0);
+    assert(readX(&ia) == 1);
+    assert(entries[1].kind == vm::PropertyCacheEntry::EMPTY);
+
+    // A second receiver class goes polymorphic.
+    assert(readX(&ib) == 2);
+    assert(entries[1].klass == &b && entries[1].slot == 1);
+
+    // Changing a class invalidates its entry, which is refilled in place.
+    a.declareField("w", AccessModifier::PUBLIC);
+    assert(fn.chunk.propertyCaches[cache].find(&ia) == nullptr);
+    assert(readX(&ia) == 1);
+    assert(entries[0].klass == &a && entries[0].version == a.version);
+    assert(entries[2].kind == vm::PropertyCacheEntry::EMPTY);
+    std::cout << "Property Inline Cache Test Passed" << std::endl;
+}
+
+void test_invoke() {
+    std::cout << "Testing Invoke..." << std::endl;
+
+    // class K { func twice(n) { return n * 2; } }
+    vm::ClassObject k("K");
+    vm::FunctionObject twice("twice", 2, true);
+    twice.ownerClass = &k;
+    int c2 = twice.chunk.addConstant((int64_t)2);
+    twice.chunk.write(vm::OP_GET_LOCAL);
+    twice.chunk.write(1);
+    twice.chunk.write(vm::OP_CONSTANT);
+    twice.chunk.write(c2);
+    twice.chunk.write(vm::OP_MUL);
+    twice.chunk.write(vm::OP_RETURN);
+    k.methods["twice"].push_back(&twice);
+    k.methodAccess["twice"] = AccessModifier::PUBLIC;
+    vm::InstanceObject instance(&k);
+
+    // result = obj.twice(21)
+    vm::FunctionObject fn("test", 0);
+    vm::VM vm;
+    vm.defineGlobals({"obj", "result"});
+    vm.globals[0] = &instance;
+    int nameIdx = fn.chunk.addConstant(vm::Value("twice"));
+    int c21 = fn.chunk.addConstant((int64_t)21);
+    int cache = fn.chunk.addPropertyCache();
+    fn.chunk.write(vm::OP_GET_GLOBAL);
+    fn.chunk.write16(0);
+    fn.chunk.write(vm::OP_CONSTANT);
+    fn.chunk.write(c21);
+    fn.chunk.write(vm::OP_INVOKE);
+    fn.chunk.write(nameIdx);
+    fn.chunk.write(1);
+    fn.chunk.write16(cache);
+    fn.chunk.write(vm::OP_SET_GLOBAL);
+    fn.chunk.write16(1);
+    fn.chunk.write(vm::OP_HALT);
+
+    // The first run resolves and caches the overload, the second uses it.
+    for (int run = 0; run < 2; ++run) {
+        vm.globals[1] = vm::Value();
+        vm.run(&fn);
+        assert(vm.globals[1].isInt() && vm.globals[1].as.integer == 42);
+        const vm::PropertyCacheEntry& entry = fn.chunk.propertyCaches[cache].entries[0];
+        assert(entry.klass == &k && entry.kind == vm::PropertyCacheEntry::METHOD);
+        assert(entry.method == &twice);
+    }
+    std::cout << "Invoke Test Passed" << std::endl;
+}
+
+void test_garbage_collection() {
+    std::cout << "Testing Garbage Collection..." << std::endl;
+
+    vm::FunctionObject fn("test", 0);
+    vm::VM vm;
+    vm.defineGlobals({"last"});
+    vm.heap.setMinimumThreshold(1);
+
+    // for (i = 0; i < 100; i += 1) { last = [i]; }
+    int c0 = fn.chunk.addConstant((int64_t)0);
+    int c1 = fn.chunk.addConstant((int64_t)1);
+    int c100 = fn.chunk.addConstant((int64_t)100);
+    fn.chunk.write(vm::OP_CONSTANT);
+    fn.chunk.write(c0);
+
+    size_t loopStart = fn.chunk.code.size();
+    fn.chunk.write(vm::OP_JUMP_IF_NOT_LT_CONST);
+    fn.chunk.write(0);
+    fn.chunk.write(c100);
+    size_t exitJump = fn.chunk.code.size();
+    fn.chunk.write16(0);
+
+    fn.chunk.write(vm::OP_GET_LOCAL);
+    fn.chunk.write(0);
+    fn.chunk.write(vm::OP_NEW_ARRAY);
+    fn.chunk.write(1);
+    fn.chunk.write(vm::OP_SET_GLOBAL);
+    fn.chunk.write16(0);
+    fn.chunk.write(vm::OP_POP);
+    fn.chunk.write(vm::OP_INC_LOCAL_CONST);
+    fn.chunk.write(0);
+    fn.chunk.write(c1);
+    fn.chunk.write(vm::OP_LOOP);
+    fn.chunk.write16(fn.chunk.code.size() + 2 - loopStart);
+
+    uint16_t exitOffset = fn.chunk.code.size() - exitJump - 2;
+    fn.chunk.code[exitJump] = (exitOffset >> 8) & 0xff;
+    fn.chunk.code[exitJump + 1] = exitOffset & 0xff;
+    fn.chunk.write(vm::OP_HALT);
+
+    vm.run(&fn);
+
+    // Every back-edge is a safepoint; only the array still in `last` survives.
+    const vm::GCStats& stats = vm.heap.stats();
+    assert(stats.collections > 0);
+    assert(stats.objectsFreed > 0 && stats.bytesReclaimed > 0);
+    assert(vm.heap.objectCount() <= 2);
+
+    vm::Value* last = vm.findGlobal("last");
+    assert(last->isArray() && last->as.array->length == 1);
+    assert(last->as.array->data[0].as.integer == 99);
+
+    vm.collectGarbage();
+    assert(vm.heap.objectCount() == 1);
+    std::cout << "Garbage Collection Test Passed" << std::endl;
+}
+
+void test_heap_arena() {
+    std::cout << "Testing Heap Arena..." << std::endl;
+
+    vm::Heap heap;
+    void* a = heap.allocate(sizeof(vm::InstanceObject));
+    void* b = heap.allocate(sizeof(vm::ArrayObject));
+    assert(reinterpret_cast<uintptr_t>(a) % vm::Heap::SIZE_CLASS == 0);
+    assert(reinterpret_cast<uintptr_t>(b) % vm::Heap::SIZE_CLASS == 0);
+    assert(a != b);
+
+    // Freed slots are reused by the next allocation of the same size class.
+    heap.release(a, sizeof(vm::InstanceObject));
+    assert(heap.allocate(sizeof(vm::BoundMethod)) == a);
+    assert(heap.allocate(sizeof(vm::InstanceObject)) != a);
+    assert(heap.stats().arenaBytes == vm::Heap::ARENA_BLOCK_SIZE);
+    std::cout << "Heap Arena Test Passed" << std::endl;
+}
+
+static bool containsOpcode(const vm::Chunk& chunk, uint8_t op) {
+    for (size_t offset = 0; offset < chunk.code.size(); offset += vm::instructionLength(chunk.code[offset])) {
+        if (chunk.code[offset] == op) return true;
+    }
+    return false;
+}
+
+static vm::FunctionObject* compileSource(vm::Compiler& compiler, const std::string& source) {
+    Lexer lexer(source);
+    auto tokens = lexer.tokenize();
+    Parser parser(tokens);
+    auto program = parser.parse();
+    return compiler.compile(program.get());
+}
+
+static vm::FunctionObject* findFunction(const vm::Compiler& compiler, const std::string& name) {
+    for (auto* fn : compiler.compiledFunctions) {
+        if (fn->name == name) return fn;
+    }
+    return nullptr;
+}
+
+// Runs a compiled script and returns what it printed.
+static std::string runScript(const vm::Compiler& compiler, vm::FunctionObject* script, vm::Jit* jit = nullptr) {
+    vm::VM vm;
+    vm.jit = jit;
+    vm.defineGlobals(compiler.globalNames);
+    for (auto* fn : compiler.compiledFunctions) {
+        if (!fn->isMethod) {
+            vm.globals[compiler.globalSlots.at(fn->name)] = fn;
+        }
+    }
+    std::ostringstream out;
+    auto* saved = std::cout.rdbuf(out.rdbuf());
+    vm.run(script);
+    std::cout.rdbuf(saved);
+    return out.str();
+}
+
+// Recursion far deeper than the old 1024-frame limit, in plain functions
+// and through methods, must run rather than report an overflow.
+void test_deep_recursion() {
+    std::cout << "Testing Deep Recursion..." << std::endl;
+
+    const std::string source = R"({
+        class Counter {
+            public {
+                func go(n) {
+                    if (n == 0) { return 0; }
+                    return 1 + this.go(n - 1);
+                }
+            }
+        }
+        func sum(n) {
+            if (n == 0) { return 0; }
+            return n + sum(n - 1);
+        }
+        func main() {
+            println(sum(5000));
+            c = Counter();
+            println(c.go(3000));
+        }
+    })";
+    for (bool useIR : {false, true}) {
+        vm::Compiler compiler;
+        compiler.useIR = useIR;
+        auto* script = compileSource(compiler, source);
+        assert(runScript(compiler, script) == "12502500\n3000\n");
+
+        // Machine code nests on the C++ stack; past JIT_NESTING_MAX the
+        // callees are interpreted instead.
+        if (vm::Jit::supported()) {
+            vm::Jit jit(false);
+            jit.threshold = 2;
+            assert(runScript(compiler, script, &jit) == "12502500\n3000\n");
+            assert(findFunction(compiler, "sum")->jitCode != nullptr);
+        }
+    }
+
+    std::cout << "Deep Recursion Test Passed" << std::endl;
+}
+
+void test_typed_opcodes() {
+    std::cout << "Testing Typed Opcodes..." << std::endl;
+
+    vm::Compiler compiler;
+    auto* script = compileSource(compiler, R"({
+        func half(x) {
+            return x / 2;
+        }
+        func count(n) {
+            c = 0;
+            for (i = 0; i < n; i = i + 1) {
+                c = c + 1;
+            }
+            return c;
+        }
+        func main() {
+            a = 6;
+            b = a * 7 - 2;
+            f = 1.5;
+            g = f * 2.0;
+            m = a;
+            m = "six";
+            h = half(b) * 2.5;
+            println(b % 5);
+            println(b < 41);
+            println(g + f);
+            println(m + a);
+            println(count(3) + 1);
+            println(h);
+        }
+    })");
+    const vm::Chunk& chunk = script->chunk;
+
+    // a and b only ever hold ints, f and g only floats.
+    assert(containsOpcode(chunk, vm::OP_MUL_INT));
+    assert(containsOpcode(chunk, vm::OP_SUB_INT));
+    assert(containsOpcode(chunk, vm::OP_MOD_INT));
+    assert(containsOpcode(chunk, vm::OP_LT_INT));
+    assert(containsOpcode(chunk, vm::OP_MUL_F64));
+    assert(containsOpcode(chunk, vm::OP_ADD_F64));
+    // count() is known to return an int; m is a string or an int, so m + a
+    // stays generic.
+    assert(containsOpcode(chunk, vm::OP_ADD_INT));
+    assert(containsOpcode(chunk, vm::OP_ADD));
+
+    assert(runScript(compiler, script) == "0\ntrue\n4.5\nsix6\n4\n50\n");
+    std::cout << "Typed Opcodes Test Passed" << std::endl;
+}
+
+void test_quickening() {
+    std::cout << "Testing Quickening..." << std::endl;
+
+    // Parameters have no static type, so these sites start out generic.
+    vm::Compiler compiler;
+    auto* script = compileSource(compiler, R"({
+        func sum(a, b) {
+            return a + b;
+        }
+        func join(a, b) {
+            return a + b;
+        }
+        func scale(x) {
+            return x * 0.5;
+        }
+        func main() {
+            s = 0;
+            t = 0;
+            for (i = 0; i < 10; i = i + 1) {
+                s = sum(s, i);
+                t = join(t, i);
+            }
+            println(s);
+            println(join("a", t));
+            println(scale(3.0) + scale(5.0));
+        }
+    })");
+    const vm::Chunk& sum = findFunction(compiler, "sum")->chunk;
+    const vm::Chunk& join = findFunction(compiler, "join")->chunk;
+    const vm::Chunk& scale = findFunction(compiler, "scale")->chunk;
+    assert(containsOpcode(sum, vm::OP_ADD));
+
+    assert(runScript(compiler, script) == "45\na45\n4\n");
+
+    assert(containsOpcode(sum, vm::OP_ADD_INT_GUARDED));
+    assert(containsOpcode(scale, vm::OP_MUL_F64_GUARDED));
+    // The string operand failed join's guard and put the generic opcode back.
+    assert(containsOpcode(join, vm::OP_ADD));
+    assert(!containsOpcode(join, vm::OP_ADD_INT_GUARDED));
+    std::cout << "Quickening Test Passed" << std::endl;
+}
+
+void test_constant_folding() {
+    std::cout << "Testing Constant Folding..." << std::endl;
+
+    vm::Compiler compiler;
+    auto* script = compileSource(compiler, R"({
+        func main() {
+            day = 60 * 60 * 24;
+            label = "day=" + 86400 + " half=" + 0.5;
+            n = 3;
+            m = n * 8 + n * 1 + 0;
+            flag = n < 4;
+            same = !!flag;
+            if (1 > 2) {
+                println("dead");
+            } else {
+                println(label);
+            }
+            while (false) {
+                println("never");
+            }
+            println(day);
+            println(m);
+            println(same);
+            println(-(2 + 1));
+            println(7 / 0);
+        }
+    })");
+    const vm::Chunk& chunk = script->chunk;
+
+    bool hasDay = false;
+    for (const vm::Value& constant : chunk.constants) {
+        hasDay = hasDay || (constant.isInt() && constant.as.integer == 86400);
+        assert(!constant.isString() || (constant.str() != "dead" && constant.str() != "never"));
+    }
+    assert(hasDay);
+    assert(!containsOpcode(chunk, vm::OP_MUL));
+    assert(!containsOpcode(chunk, vm::OP_MUL_INT));  // n * 8 is a shift, n * 1 is n
+    assert(containsOpcode(chunk, vm::OP_SHL_INT));
+    assert(!containsOpcode(chunk, vm::OP_NOT));
+    assert(!containsOpcode(chunk, vm::OP_NEGATE));
+    // Division by zero is left for run time.
+    assert(containsOpcode(chunk, vm::OP_DIV));
+
+    assert(runScript(compiler, script) == "day=86400 half=0.5\n86400\n27\ntrue\n-3\ninf\n");
+    std::cout << "Constant Folding Test Passed" << std::endl;
+}
+
+void test_peephole() {
+    std::cout << "Testing Peephole Pass..." << std::endl;
+
+    vm::Compiler compiler;
+    auto* script = compileSource(compiler, R"({
+        func sign(a) {
+            if (a > 0) {
+                if (a > 100) {
+                    return 2;
+                } else {
+                    return 1;
+                }
+            } else {
+                return 0;
+            }
+        }
+        func main() {
+            i = 0;
+            count = 0;
+            while (i < 20) {
+                if (i < 3 || i > 15) {
+                    count = count * 2 + 1;
+                } else {
+                    if (i == 7) {
+                        count = count + 100;
+                    }
+                }
+                i = i + 1;
+            }
+            x = 5;
+            x = x * 3;
+            println(x);
+            println(count);
+            println(sign(5));
+            println(sign(500));
+            println(sign(-5));
+        }
+    })");
+
+    // `||` lowers to JUMP_IF_FALSE over a JUMP; the pass fuses the pair.
+    assert(containsOpcode(script->chunk, vm::OP_JUMP_IF_TRUE));
+    assert(compiler.peepholeStats.jumpIfTrue > 0);
+    assert(compiler.peepholeStats.storeLoad > 0);
+    assert(compiler.peepholeStats.instructionsAfter < compiler.peepholeStats.instructionsBefore);
+
+    std::vector<const vm::Chunk*> chunks = {&script->chunk, &findFunction(compiler, "sign")->chunk};
+    for (const vm::Chunk* chunk : chunks) {
+        const std::vector<uint8_t>& code = chunk->code;
+        std::vector<bool> isTarget(code.size() + 1, false);
+        std::vector<size_t> jumpTargets;
+        for (size_t offset = 0; offset < code.size(); offset += vm::instructionLength(code[offset])) {
+            uint8_t op = code[offset];
+            if (op == vm::OP_JUMP || op == vm::OP_JUMP_IF_FALSE || op == vm::OP_JUMP_IF_TRUE || op == vm::OP_LOOP) {
+                size_t next = offset + 3;
+                uint16_t jump = static_cast<uint16_t>((code[offset + 1] << 8) | code[offset + 2]);
+                size_t target = op == vm::OP_LOOP ? next - jump : next + jump;
+                isTarget[target] = true;
+                jumpTargets.push_back(target);
+            }
+        }
+        // No jump lands on an unconditional jump: chains are threaded.
+        for (size_t target : jumpTargets) {
+            assert(target == code.size() || (code[target] != vm::OP_JUMP && code[target] != vm::OP_LOOP));
+        }
+        // Nothing follows RETURN or JUMP unless some jump reaches it.
+        for (size_t offset = 0; offset < code.size();) {
+            uint8_t op = code[offset];
+            offset += vm::instructionLength(op);
+            if ((op == vm::OP_RETURN || op == vm::OP_JUMP) && offset < code.size()) {
+                assert(isTarget[offset]);
+            }
+        }
+    }
+
+    assert(runScript(compiler, script) == "15\n1727\n1\n2\n0\n");
+    std::cout << "Peephole Pass Test Passed" << std::endl;
+}
+
+void test_ir_optimizations() {
+    std::cout << "Testing IR Optimizations..." << std::endl;
+
+    const std::string source = R"({
+        func scale(n, k) {
+            total = 0;
+            i = 0;
+            while (i < n) {
+                unused = i - k;
+                total = total + i * 4 + k * k;
+                i = i + 1;
+            }
+            return total;
+        }
+        func rotate(n) {
+            a = 1;
+            b = 2;
+            c = 3;
+            for (i = 0; i < n; i += 1) {
+                t = a;
+                a = b;
+                b = c;
+                c = t;
+            }
+            return "{a} {b} {c}";
+        }
+        func shared(x, y) {
+            p = (x + y) * (x + y);
+            if (x < y && p > 10) {
+                return p + (x + y);
+            }
+            return p - 1;
+        }
+        func main() {
+            println(scale(10, 3));
+            println(rotate(4));
+            println(rotate(5));
+            println(shared(2, 3));
+            println(shared(3, 2));
+            println(shared(1, 1));
+        }
+    })";
+
+    vm::Compiler direct;
+    std::string expected = runScript(direct, compileSource(direct, source));
+    assert(expected == "270\n2 3 1\n3 1 2\n30\n24\n3\n");
+
+    vm::Compiler compiler;
+    compiler.useIR = true;
+    auto* script = compileSource(compiler, source);
+    assert(runScript(compiler, script) == expected);
+    assert(compiler.irStats.functions == 4);
+    assert(compiler.irStats.fallbacks == 0);
+    assert(compiler.irStats.cse > 0);         // x + y in shared()
+    assert(compiler.irStats.hoisted > 0);     // k * k in scale()
+    assert(compiler.irStats.inductions > 0);  // i * 4 in scale()
+    assert(compiler.irStats.dead > 0);        // unused in scale()
+
+    // The multiply left the loop: scale() only multiplies once, before it.
+    const vm::Chunk& chunk = findFunction(compiler, "scale")->chunk;
+    int multiplies = 0;
+    for (size_t offset = 0; offset < chunk.code.size(); offset += vm::instructionLength(chunk.code[offset])) {
+        uint8_t op = chunk.code[offset];
+        if (op == vm::OP_MUL || op == vm::OP_MUL_INT || op == vm::OP_SHL_INT) ++multiplies;
+    }
+    assert(multiplies == 1);
+
+    // Method calls are outside the IR; that body compiles directly.
+    vm::Compiler fallback;
+    fallback.useIR = true;
+    auto* methods = compileSource(fallback, R"({
+        func main() {
+            a = [1, 2];
+            a.push(3);
+            println(a[2]);
+        }
+    })");
+    assert(runScript(fallback, methods) == "3\n");
+    assert(fallback.irStats.fallbacks > 0);
+
+    // A body the IR gives up on partway leaves nothing behind: the constants
+    // and global slots it took before bailing out are rolled back, so the
+    // fallback compiles it exactly as without the IR.
+    const std::string partial = R"({
+        func helper(x) { return x + 1; }
+        func main() {
+            y = helper(2) + later(1);
+            a = [y];
+            a.push(3);
+            println(a[1]);
+        }
+        func later(x) { return x * 2; }
+    })";
+    vm::Compiler astOnly;
+    vm::Compiler rolledBack;
+    rolledBack.useIR = true;
+    auto* astScript = compileSource(astOnly, partial);
+    auto* partialScript = compileSource(rolledBack, partial);
+    assert(rolledBack.irStats.fallbacks > 0);
+    assert(rolledBack.globalNames == astOnly.globalNames);
+    assert(partialScript->chunk.constants.size() == astScript->chunk.constants.size());
+    assert(runScript(rolledBack, partialScript) == "3\n");
+
+    std::cout << "IR Optimizations Test Passed" << std::endl;
+}
+
+void test_tail_calls() {
+    std::cout << "Testing Tail Calls..." << std::endl;
+
+    // Far deeper than FRAMES_MAX: only runs if every `return f(...)` reuses
+    // the caller's frame.
+    const std::string source = R"({
+        class Box {
+            public {
+                dec: value;
+                func Box(value) {
+                    this.value = value;
+                    return this;
+                }
+            }
+        }
+        class Walker {
+            public {
+                func Walker() {
+                    return this;
+                }
+                func down(n, acc) {
+                    if (n == 0) {
+                        return acc;
+                    }
+                    return this.down(n - 1, acc + 1);
+                }
+                func ping(other, n) {
+                    if (n == 0) {
+                        return n;
+                    }
+                    return other.ping(this, n - 1);
+                }
+            }
+        }
+        func sum(n, acc) {
+            if (n == 0) {
+                return acc;
+            }
+            return sum(n - 1, acc + n);
+        }
+        func isEven(n) {
+            if (n == 0) {
+                return true;
+            }
+            return isOdd(n - 1);
+        }
+        func isOdd(n) {
+            if (n == 0) {
+                return false;
+            }
+            return isEven(n - 1);
+        }
+        func box(n) {
+            return Box(sum(n, 0));
+        }
+        func main() {
+            println(sum(1000000, 0));
+            println(isEven(300001));
+            println(box(4).value);
+            w = Walker();
+            println(w.down(1000000, 0));
+            println(w.ping(Walker(), 300001));
+        }
+    })";
+    const std::string expected = "500000500000\nfalse\n10\n1000000\n0\n";
+
+    for (bool useIR : {false, true}) {
+        vm::Compiler compiler;
+        compiler.useIR = useIR;
+        auto* script = compileSource(compiler, source);
+        assert(containsOpcode(findFunction(compiler, "sum")->chunk, vm::OP_TAIL_CALL));
+        assert(containsOpcode(findFunction(compiler, "isOdd")->chunk, vm::OP_TAIL_CALL));
+        // The class callee takes the ordinary call path.
+        assert(containsOpcode(findFunction(compiler, "box")->chunk, vm::OP_TAIL_CALL));
+        // Method calls through `this` and through another receiver.
+        assert(containsOpcode(findFunction(compiler, "down")->chunk, vm::OP_TAIL_INVOKE));
+        assert(containsOpcode(findFunction(compiler, "ping")->chunk, vm::OP_TAIL_INVOKE));
+        assert(runScript(compiler, script) == expected);
+
+        if (vm::Jit::supported()) {
+            vm::Jit jit(false);
+            jit.threshold = 2;
+            assert(runScript(compiler, script, &jit) == expected);
+            assert(findFunction(compiler, "sum")->jitCode != nullptr);
+            assert(findFunction(compiler, "down")->jitCode != nullptr);
+        }
+    }
+
+    std::cout << "Tail Calls Test Passed" << std::endl;
+}
+
+void test_direct_calls() {
+    std::cout << "Testing Direct Calls..." << std::endl;
+
+    const std::string source = R"({
+        func fib(n) {
+            if (n < 2) {
+                return n;
+            }
+            return fib(n - 1) + fib(n - 2);
+        }
+        func twice(f, x) {
+            y = f(x);
+            return y + f(x);
+        }
+        func square(x) {
+            return x * x;
+        }
+        func main() {
+            println(fib(15));
+            println(twice(square, 3));
+            g = fib;
+            println(g(10));
+        }
+    })";
+
+    for (bool useIR : {false, true}) {
+        vm::Compiler compiler;
+        compiler.useIR = useIR;
+        auto* script = compileSource(compiler, source);
+        const vm::Chunk& fib = findFunction(compiler, "fib")->chunk;
+        assert(containsOpcode(fib, vm::OP_CALL_DIRECT));
+        assert(!containsOpcode(fib, vm::OP_CALL));
+        // A callee held in a parameter or local is only known at run time.
+        assert(containsOpcode(findFunction(compiler, "twice")->chunk, vm::OP_CALL));
+        assert(!containsOpcode(findFunction(compiler, "twice")->chunk, vm::OP_CALL_DIRECT));
+        assert(containsOpcode(script->chunk, vm::OP_CALL));
+        assert(runScript(compiler, script) == "610\n18\n55\n");
+    }
+
+    // A wrong argument count keeps the generic call and its run-time error.
+    vm::Compiler mismatch;
+    auto* script = compileSource(mismatch, R"({
+        func one(a) {
+            return a;
+        }
+        func main() {
+            println(one(1));
+            println(one(1, 2));
+        }
+    })");
+    assert(containsOpcode(script->chunk, vm::OP_CALL_DIRECT));
+    assert(containsOpcode(script->chunk, vm::OP_CALL));
+    assert(runScript(mismatch, script) == "1\n");
+
+    std::cout << "Direct Calls Test Passed" << std::endl;
+}
+
+void test_bytecode_cache() {
+    std::cout << "Testing Bytecode Cache..." << std::endl;
+
+    const std::string source = R"({
+        class Counter {
+            public {
+                dec: count;
+                func Counter() {
+                    this.count = 0;
+                    return this;
+                }
+                func bump(by) {
+                    this.count = this.count + by;
+                    return this.count;
+                }
+            }
+        }
+        func scale(x) {
+            return x * 1.5;
+        }
+        func main() {
+            c = Counter();
+            c.bump(2);
+            println(c.bump(3));
+            println(scale(4));
+            println("done");
+        }
+    })";
+    const std::string expected = "5\n6\ndone\n";
+    const std::string path = "test_bytecode_cache.pgc";
+
+    for (bool useIR : {false, true}) {
+        vm::Compiler compiler;
+        compiler.useIR = useIR;
+        vm::CompiledProgram saved;
+        saved.script = compileSource(compiler, source);
+        saved.functions = compiler.compiledFunctions;
+        saved.globalNames = compiler.globalNames;
+        uint64_t key = vm::cacheKey(source, useIR ? "O" : "");
+        bool savedOk = vm::saveProgram(saved, key, path);
+        assert(savedOk);
+
+        vm::CompiledProgram wrongKey;
+        bool wrongKeyOk = vm::loadProgram(path, key + 1, wrongKey);
+        assert(!wrongKeyOk);
+        assert(wrongKey.script == nullptr);
+
+        vm::CompiledProgram loaded;
+        bool loadedOk = vm::loadProgram(path, key, loaded);
+        assert(loadedOk);
+        assert(!loaded.hasSnapshot);
+        assert(loaded.globalNames == saved.globalNames);
+        assert(loaded.functions.size() == saved.functions.size());
+        assert(loaded.script->chunk.code == saved.script->chunk.code);
+
+        vm::VM vm;
+        vm.defineGlobals(loaded.globalNames);
+        for (auto* fn : loaded.functions) {
+            if (!fn->isMethod) {
+                *vm.findGlobal(fn->name) = fn;
+            }
+        }
+        std::ostringstream out;
+        auto* previous = std::cout.rdbuf(out.rdbuf());
+        vm.run(loaded.script);
+        std::cout.rdbuf(previous);
+        assert(out.str() == expected);
+        assert(runScript(compiler, saved.script) == expected);
+    }
+
+    // A file cut short is rejected, not read past its end.
+    std::string bytes;
+    {
+        std::ifstream in(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    std::ofstream(path, std::ios::binary | std::ios::trunc).write(bytes.data(), bytes.size() / 2);
+    vm::CompiledProgram truncated;
+    bool truncatedOk = vm::loadProgram(path, vm::cacheKey(source, "O"), truncated);
+    assert(!truncatedOk);
+    bool missingOk = vm::loadProgram("missing.pgc", 0, truncated);
+    assert(!missingOk);
+
+    // A corrupt record count is rejected before anything is allocated for
+    // it. The function count sits at byte 12 of the header and the global
+    // count right after the 40-byte header.
+    for (size_t offset : {size_t(12), size_t(40)}) {
+        std::string corrupt = bytes;
+        const uint32_t huge = 0xffffffffu;
+        std::memcpy(&corrupt[offset], &huge, sizeof(huge));
+        std::ofstream(path, std::ios::binary | std::ios::trunc).write(corrupt.data(), corrupt.size());
+        vm::CompiledProgram bad;
+        bool badOk = vm::loadProgram(path, vm::cacheKey(source, "O"), bad);
+        assert(!badOk);
+    }
+
+    // Any damaged byte fails the header or the checksum.
+    for (size_t offset = 0; offset < bytes.size(); ++offset) {
+        std::string corrupt = bytes;
+        corrupt[offset] = static_cast<char>(corrupt[offset] ^ 0xff);
+        std::ofstream(path, std::ios::binary | std::ios::trunc).write(corrupt.data(), corrupt.size());
+        vm::CompiledProgram bad;
+        bool badOk = vm::loadProgram(path, vm::cacheKey(source, "O"), bad);
+        assert(!badOk);
+    }
+
+    // Code that passes the checksum is still checked before it can run:
+    // an unknown opcode, or an operand outside the constants, globals,
+    // property caches or code, fails the load.
+    vm::Compiler compiler;
+    vm::CompiledProgram program;
+    program.script = compileSource(compiler, source);
+    program.functions = compiler.compiledFunctions;
+    program.globalNames = compiler.globalNames;
+    uint64_t key = vm::cacheKey(source, "");
+    std::vector<vm::FunctionObject*> functions = {program.script};
+    functions.insert(functions.end(), program.functions.begin(), program.functions.end());
+    for (vm::FunctionObject* function : functions) {
+        std::vector<uint8_t>& code = function->chunk.code;
+        const std::vector<uint8_t> original = code;
+        for (size_t offset = 0; offset < code.size(); offset += vm::instructionLength(code[offset])) {
+            uint8_t op = original[offset];
+            code[offset] = 0xff;
+            bool savedOk = vm::saveProgram(program, key, path);
+            vm::CompiledProgram bad;
+            bool badOk = vm::loadProgram(path, key, bad);
+            assert(savedOk && !badOk);
+            code[offset] = op;
+
+            // Operand spans indexing the constants, globals, caches or code;
+            // all ones is past each of them here.
+            std::vector<std::pair<size_t, size_t>> operands;
+            if (op == vm::OP_GET_GLOBAL || op == vm::OP_JUMP || op == vm::OP_JUMP_IF_FALSE || op == vm::OP_LOOP) {
+                operands = {{1, 2}};
+            } else if (op == vm::OP_GET_PROPERTY) {
+                operands = {{1, 1}, {2, 2}};
+            } else if (op == vm::OP_INVOKE) {
+                operands = {{1, 1}, {3, 2}};
+            }
+            for (auto [first, size] : operands) {
+                std::fill_n(code.begin() + offset + first, size, 0xff);
+                savedOk = vm::saveProgram(program, key, path);
+                badOk = vm::loadProgram(path, key, bad);
+                assert(savedOk && !badOk);
+                code = original;
+            }
+        }
+        assert(code == original);
+    }
+    std::remove(path.c_str());
+
+    std::cout << "Bytecode Cache Test Passed" << std::endl;
+}
+
+void test_heap_snapshot() {
+    std::cout << "Testing Heap Snapshot..." << std::endl;
+
+    // Empty is defined last and used first, so class setup and main meet at
+    // SET_GLOBAL Empty; POP | GET_GLOBAL Empty, which the peephole pass
+    // would otherwise fold across the boundary.
+    const std::string source = R"({
+        class Shape {
+            public {
+                dec: sides;
+                func Shape(n) {
+                    this.sides = n;
+                    return this;
+                }
+                func describe() {
+                    return "shape";
+                }
+            }
+        }
+        class Square inherits Shape {
+            public {
+                func Square() {
+                    this.sides = 4;
+                    return this;
+                }
+                func describe() {
+                    return "square";
+                }
+            }
+        }
+        class Empty {
+        }
+        func area(side) {
+            return side * side;
+        }
+        func main() {
+            e = Empty();
+            s = Square();
+            println(s.describe());
+            println(s.sides);
+            println(area(3));
+        }
+    })";
+    const std::string expected = "square\n4\n9\n";
+    const std::string path = "test_heap_snapshot.pgc";
+
+    for (bool useIR : {false, true}) {
+        vm::Compiler compiler;
+        compiler.useIR = useIR;
+        vm::CompiledProgram saved;
+        saved.script = compileSource(compiler, source);
+        saved.functions = compiler.compiledFunctions;
+        saved.globalNames = compiler.globalNames;
+        saved.mainOffset = compiler.mainOffset;
+        assert(saved.mainOffset > 0);
+        assert(saved.script->chunk.code[saved.mainOffset] == vm::OP_GET_GLOBAL);
+
+        vm::VM setup;
+        setup.defineGlobals(saved.globalNames);
+        for (auto* fn : saved.functions) {
+            if (!fn->isMethod) {
+                *setup.findGlobal(fn->name) = fn;
+            }
+        }
+        bool reachedMain = setup.runUntil(saved.script, saved.mainOffset);
+        assert(reachedMain);
+        assert(setup.findGlobal("Square")->isClass());
+        saved.hasSnapshot = true;
+        saved.globals = setup.globals;
+        uint64_t key = vm::cacheKey(source, useIR ? "O" : "");
+        bool savedOk = vm::saveProgram(saved, key, path);
+        assert(savedOk);
+
+        vm::CompiledProgram loaded;
+        bool loadedOk = vm::loadProgram(path, key, loaded);
+        assert(loadedOk);
+        assert(loaded.hasSnapshot);
+        assert(loaded.mainOffset == saved.mainOffset);
+        assert(loaded.globals.size() == saved.globals.size());
+
+        vm::VM vm;
+        vm.defineGlobals(loaded.globalNames);
+        vm.globals = loaded.globals;
+        vm::ClassObject* square = vm.findGlobal("Square")->as.klass;
+        vm::ClassObject* shape = vm.findGlobal("Shape")->as.klass;
+        assert(square->parent == shape);
+        assert(square->findField("sides") == 0);
+        assert(square->methods.at("describe").size() == 1);
+        assert(square->methods.at("describe")[0]->ownerClass == square);
+        assert(shape->methods.at("describe")[0]->ownerClass == shape);
+        assert(vm.findGlobal("area")->isFunction());
+
+        std::ostringstream out;
+        auto* previous = std::cout.rdbuf(out.rdbuf());
+        vm.run(loaded.script, loaded.mainOffset);
+        setup.run(saved.script, saved.mainOffset);
+        std::cout.rdbuf(previous);
+        assert(out.str() == expected + expected);
+    }
+
+    // With no functions or classes there are no globals, but the snapshot
+    // still counts as taken.
+    vm::Compiler compiler;
+    vm::CompiledProgram saved;
+    saved.script = compileSource(compiler, R"({ func main() { println("hi"); } })");
+    saved.mainOffset = compiler.mainOffset;
+    saved.hasSnapshot = true;
+    assert(compiler.globalNames.empty());
+    uint64_t key = vm::cacheKey("empty", "");
+    bool savedOk = vm::saveProgram(saved, key, path);
+    assert(savedOk);
+    vm::CompiledProgram loaded;
+    bool loadedOk = vm::loadProgram(path, key, loaded);
+    assert(loadedOk);
+    assert(loaded.hasSnapshot && loaded.globals.empty());
+    std::remove(path.c_str());
+
+    std::cout << "Heap Snapshot Test Passed" << std::endl;
+}
+
+void test_jit() {
+    std::cout << "Testing JIT..." << std::endl;
+    if (!vm::Jit::supported()) {
+        std::cout << "JIT Test Skipped (no code generator for this host)" << std::endl;
+        return;
+    }
+
+    const std::string source = R"({
+        class Counter {
+            public {
+                dec: count;
+                func Counter() {
+                    this.count = 0;
+                    return this;
+                }
+                func bump(by) {
+                    this.count = this.count + by;
+                    return this.count;
+                }
+            }
+        }
+        func fib(n) {
+            if (n < 2) {
+                return n;
+            }
+            return fib(n - 1) + fib(n - 2);
+        }
+        func mixed(n) {
+            x = 1;
+            y = 0.5;
+            s = "";
+            for (i = 0; i < n; i += 1) {
+                x = x * 3 % 1000 - i / 2;
+                y = y + x * 0.25;
+                if (i % 4 == 0) {
+                    s = s + "{i},";
+                }
+            }
+            return "{x} {y} {s}";
+        }
+        func main() {
+            println(fib(15));
+            println(mixed(12));
+            c = Counter();
+            items = [];
+            total = 0;
+            for (i = 0; i < 3000; i += 1) {
+                total += c.bump(2) % 7;
+                if (i < 5) {
+                    items.push(i * i);
+                }
+            }
+            println(total);
+            println(items[4]);
+            println(c.count);
+        }
+    })";
+
+    vm::Compiler compiler;
+    auto* script = compileSource(compiler, source);
+    std::string expected = runScript(compiler, script);
+
+    // With a threshold of 2 every function but the script compiles, and main
+    // enters machine code in the middle of its loop.
+    vm::Jit jit(false);
+    jit.threshold = 2;
+    assert(runScript(compiler, script, &jit) == expected);
+    assert(jit.stats.functions >= 4);  // fib, mixed, bump, main
+    assert(jit.stats.loopEntries > 0);
+    assert(findFunction(compiler, "fib")->jitCode != nullptr);
+
+    // Exceptions from handlers called by machine code reach the caller of run().
+    vm::Compiler failing;
+    auto* bad = compileSource(failing, R"({
+        func parse(s) {
+            return int(s);
+        }
+        func main() {
+            for (i = 0; i < 10; i += 1) {
+                parse("1");
+            }
+            parse("abc");
+        }
+    })");
+    vm::Jit eager(false);
+    eager.threshold = 1;
+    vm::VM vm;
+    vm.jit = &eager;
+    vm.defineGlobals(failing.globalNames);
+    for (auto* fn : failing.compiledFunctions) {
+        vm.globals[failing.globalSlots.at(fn->name)] = fn;
+    }
+    bool threw = false;
+    try {
+        vm.run(bad);
+    } catch (const std::exception&) {
+        threw = true;
+    }
+    assert(threw);
+    assert(eager.stats.functions > 0);
+
+    std::cout << "JIT Test Passed" << std::endl;
+}
+
 int main() {
     test_basic_arithmetic();
     test_classes();
+    test_stack_overflow();
+    test_deep_recursion();
+    test_global_slots();
+    test_superinstructions();
+    test_field_layout();
+    test_property_cache();
+    test_invoke();
+    test_garbage_collection();
+    test_heap_arena();
+    test_typed_opcodes();
+    test_quickening();
+    test_constant_folding();
+    test_peephole();
+    test_ir_optimizations();
+    test_jit();
+    test_tail_calls();
+    test_direct_calls();
+    test_bytecode_cache();
+    test_heap_snapshot();
     return 0;
 }
 
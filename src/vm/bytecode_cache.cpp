@@ -0,0 +1,622 @@
+#include "vm/bytecode_cache.h"
+
+#include "vm/disassembler.h"
+#include "vm/opcode.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <unordered_map>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PENGUIN_CACHE_MMAP 1
+#endif
+
+namespace vm {
+
+// File layout, all integers in host byte order (the cache never leaves the
+// machine that wrote it):
+//
+//   Header
+//   u32 global count, then each name as a string
+//   one record per function, the script first:
+//     string name, i32 arity, u8 isMethod
+//     u32 code size, code bytes
+//     u32 constant count, then each constant as a value
+//     u32 property cache count
+//   u32 main offset
+//   u8 1 if a heap snapshot follows, else 0; the snapshot is
+//     u32 class count, then per class:
+//       string name, i32 parent class index or -1, u32 version
+//       u32 field count, then per field: string name, u8 access
+//       u32 method name count, then per name: string, u32 count, function indices
+//       u32 method access count, then per name: string, u8 access
+//     per function: i32 owner class index or -1
+//     each global slot as a value
+//
+// A string is a u32 length followed by its bytes. A value is its u8
+// ValueType tag followed by 8 payload bytes (NIL, BOOL, CHAR, INT, FLOAT),
+// a string (STRING), or a u32 index into the function or class table
+// (FUNCTION, CLASS). Objects are referred to by index throughout, so the
+// loader creates every function and class first and fills them in after.
+
+namespace {
+
+constexpr char MAGIC[4] = {'P', 'G', 'C', '\0'};
+constexpr uint32_t FORMAT_VERSION = 3;  // bump when the layout changes
+
+struct Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t opcodeCount;  // OP_COUNT: renumbered opcodes make the file stale
+    uint32_t functionCount;
+    uint64_t key;
+    uint64_t size;      // whole file; catches truncation
+    uint64_t checksum;  // FNV-1a over everything after the header
+};
+
+uint64_t fnv1a(const uint8_t* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull) {
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// The running build: the executable's size and modification time where the
+// platform can name it, otherwise when this file was compiled. Part of
+// every key, so a rebuilt compiler never loads an older build's output.
+const std::string& buildId() {
+    static const std::string id = [] {
+#ifdef __linux__
+        struct stat info;
+        if (stat("/proc/self/exe", &info) == 0) {
+            return std::to_string(info.st_size) + "." + std::to_string(info.st_mtim.tv_sec) + "." +
+                   std::to_string(info.st_mtim.tv_nsec);
+        }
+#endif
+        return std::string(__DATE__ " " __TIME__);
+    }();
+    return id;
+}
+
+class Writer {
+public:
+    std::string bytes;
+
+    template <typename T>
+    void put(T value) {
+        bytes.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+    void putString(const std::string& text) {
+        put(static_cast<uint32_t>(text.size()));
+        bytes += text;
+    }
+};
+
+class Reader {
+public:
+    Reader(const uint8_t* data, size_t size) : cursor(data), end(data + size) {}
+
+    template <typename T>
+    bool get(T& value) {
+        if (static_cast<size_t>(end - cursor) < sizeof(T)) return false;
+        std::memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return true;
+    }
+    bool getBytes(size_t size, const uint8_t*& data) {
+        if (static_cast<size_t>(end - cursor) < size) return false;
+        data = cursor;
+        cursor += size;
+        return true;
+    }
+    bool getString(std::string& text) {
+        uint32_t size;
+        const uint8_t* data;
+        if (!get(size) || !getBytes(size, data)) return false;
+        text.assign(reinterpret_cast<const char*>(data), size);
+        return true;
+    }
+    bool atEnd() const { return cursor == end; }
+    // Whether `count` records of at least `minSize` bytes each can still
+    // follow. Counts are checked with this before anything is allocated
+    // for them, so a corrupt count fails the load instead of exhausting
+    // memory.
+    bool canHold(uint64_t count, size_t minSize) const {
+        return count <= static_cast<size_t>(end - cursor) / minSize;
+    }
+
+private:
+    const uint8_t* cursor;
+    const uint8_t* end;
+};
+
+// Read-only view of a whole file: mapped where the platform can, read into
+// memory elsewhere.
+class FileView {
+public:
+    explicit FileView(const std::string& path) {
+#ifdef PENGUIN_CACHE_MMAP
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                data = static_cast<const uint8_t*>(mapped);
+                size = static_cast<size_t>(info.st_size);
+            }
+        }
+        close(fd);
+#else
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return;
+        buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        data = reinterpret_cast<const uint8_t*>(buffer.data());
+        size = buffer.size();
+#endif
+    }
+    ~FileView() {
+#ifdef PENGUIN_CACHE_MMAP
+        if (data) munmap(const_cast<uint8_t*>(data), size);
+#endif
+    }
+    FileView(const FileView&) = delete;
+    FileView& operator=(const FileView&) = delete;
+
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+private:
+#ifndef PENGUIN_CACHE_MMAP
+    std::string buffer;
+#endif
+};
+
+// Unique per writer, so concurrent runs of one script never share a file.
+std::string temporaryPath(const std::string& path) {
+#ifdef PENGUIN_CACHE_MMAP
+    return path + ".tmp" + std::to_string(static_cast<long>(getpid()));
+#else
+    return path + ".tmp" + std::to_string(std::rand());
+#endif
+}
+
+bool isScalar(ValueType type) {
+    return type == ValueType::NIL || type == ValueType::BOOL || type == ValueType::CHAR ||
+           type == ValueType::INT || type == ValueType::FLOAT;
+}
+
+// Table index of every object a file refers to.
+struct SaveTables {
+    std::unordered_map<const FunctionObject*, uint32_t> functions;
+    std::unordered_map<const ClassObject*, uint32_t> classes;
+};
+
+bool putValue(Writer& out, const Value& value, const SaveTables& tables) {
+    out.put(static_cast<uint8_t>(value.type));
+    if (isScalar(value.type)) {
+        out.put(value.as.integer);
+    } else if (value.isString()) {
+        out.putString(value.as.string->chars);
+    } else if (value.isFunction() && tables.functions.count(value.as.function)) {
+        out.put(tables.functions.at(value.as.function));
+    } else if (value.isClass() && tables.classes.count(value.as.klass)) {
+        out.put(tables.classes.at(value.as.klass));
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool getValue(Reader& in, Value& value, const std::vector<std::unique_ptr<FunctionObject>>& functions,
+              const std::vector<std::unique_ptr<ClassObject>>& classes) {
+    uint8_t tag;
+    if (!in.get(tag)) return false;
+    auto type = static_cast<ValueType>(tag);
+    uint32_t index;
+    if (isScalar(type)) {
+        value.type = type;
+        return in.get(value.as.integer);
+    } else if (type == ValueType::STRING) {
+        std::string text;
+        if (!in.getString(text)) return false;
+        value = Value(text);
+        return true;
+    } else if (type == ValueType::FUNCTION) {
+        if (!in.get(index) || index >= functions.size()) return false;
+        value = Value(functions[index].get());
+        return true;
+    } else if (type == ValueType::CLASS) {
+        if (!in.get(index) || index >= classes.size()) return false;
+        value = Value(classes[index].get());
+        return true;
+    }
+    return false;
+}
+
+// Parents before their subclasses, each class once.
+void collectClass(ClassObject* klass, std::vector<ClassObject*>& order, SaveTables& tables) {
+    if (!klass || tables.classes.count(klass)) return;
+    collectClass(klass->parent, order, tables);
+    tables.classes.emplace(klass, static_cast<uint32_t>(order.size()));
+    order.push_back(klass);
+}
+
+// Whether the VM can run `chunk` from `entry` without reading outside it or
+// the program's tables: every opcode is known and complete, every constant,
+// global slot and property cache operand is in range, names and direct
+// callees have the type their handlers assume, every jump lands on an
+// instruction, and the code ends in a return or halt. Only checked on load;
+// the compiler's own output is trusted.
+bool validCode(const Chunk& chunk, size_t globalCount, size_t entry) {
+    const std::vector<uint8_t>& code = chunk.code;
+    auto u16 = [&code](size_t at) { return static_cast<size_t>((code[at] << 8) | code[at + 1]); };
+    auto isConstant = [&chunk](size_t index) { return index < chunk.constants.size(); };
+    auto isName = [&chunk](size_t index) {
+        return index < chunk.constants.size() && chunk.constants[index].isString();
+    };
+    auto isCache = [&chunk](size_t index) { return index < chunk.propertyCaches.size(); };
+
+    std::vector<bool> starts(code.size(), false);
+    std::vector<size_t> targets;
+    uint8_t last = OP_COUNT;
+    for (size_t offset = 0; offset < code.size();) {
+        uint8_t op = code[offset];
+        size_t next = offset + static_cast<size_t>(instructionLength(op));
+        if (op >= OP_COUNT || next > code.size()) return false;
+        starts[offset] = true;
+        bool valid = true;
+        switch (op) {
+            case OP_CONSTANT:
+                valid = isConstant(code[offset + 1]);
+                break;
+            case OP_CLASS:
+            case OP_METHOD:
+            case OP_FIELD:
+                valid = isName(code[offset + 1]);
+                break;
+            case OP_GET_GLOBAL:
+            case OP_SET_GLOBAL:
+                valid = u16(offset + 1) < globalCount;
+                break;
+            case OP_GET_PROPERTY:
+            case OP_SET_PROPERTY:
+                valid = isName(code[offset + 1]) && isCache(u16(offset + 2));
+                break;
+            case OP_GET_PROPERTY_OR_GLOBAL:
+            case OP_SET_PROPERTY_OR_LOCAL:
+                valid = isName(code[offset + 1]) && u16(offset + 2) < globalCount && isCache(u16(offset + 4));
+                break;
+            case OP_INVOKE:
+                valid = isName(code[offset + 1]) && isCache(u16(offset + 3));
+                break;
+            case OP_TAIL_INVOKE:
+                valid = isName(code[offset + 1]) && isCache(u16(offset + 3)) && next < code.size() &&
+                        code[next] == OP_RETURN;
+                break;
+            case OP_CALL_DIRECT: {
+                size_t index = code[offset + 1];
+                valid = isConstant(index) && chunk.constants[index].isFunction() &&
+                        chunk.constants[index].as.function->arity == code[offset + 2];
+                break;
+            }
+            case OP_TAIL_CALL:
+                valid = next < code.size() && code[next] == OP_RETURN;
+                break;
+            case OP_INC_LOCAL_CONST:
+                valid = isConstant(code[offset + 2]);
+                break;
+            case OP_JUMP:
+            case OP_JUMP_IF_FALSE:
+            case OP_JUMP_IF_TRUE:
+                targets.push_back(next + u16(offset + 1));
+                break;
+            case OP_LOOP:
+                valid = u16(offset + 1) <= next;
+                targets.push_back(next - u16(offset + 1));
+                break;
+            case OP_JUMP_IF_NOT_LT_CONST:
+                valid = isConstant(code[offset + 2]);
+                targets.push_back(next + u16(offset + 3));
+                break;
+            case OP_JUMP_IF_NOT_LT_LOCAL:
+                targets.push_back(next + u16(offset + 3));
+                break;
+            default:
+                break;
+        }
+        if (!valid) return false;
+        last = op;
+        offset = next;
+    }
+    if (last != OP_RETURN && last != OP_HALT) return false;
+    targets.push_back(entry);
+    for (size_t target : targets) {
+        if (target >= code.size() || !starts[target]) return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+uint64_t cacheKey(std::string_view source, std::string_view options) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto mix = [&hash](std::string_view text) {
+        hash = fnv1a(reinterpret_cast<const uint8_t*>(text.data()), text.size(), hash);
+        hash ^= 0xff;  // separates the parts
+    };
+    mix(source);
+    mix(options);
+    mix(buildId());
+    return hash;
+}
+
+std::string cachePath(uint64_t key) {
+    std::string dir;
+    if (const char* custom = std::getenv("PENGUIN_CACHE_DIR"); custom && *custom) {
+        dir = custom;
+    } else if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+        dir = std::string(xdg) + "/penguin";
+    } else if (const char* home = std::getenv("HOME"); home && *home) {
+        dir = std::string(home) + "/.cache/penguin";
+    } else {
+        return "";
+    }
+    char name[32];
+    std::snprintf(name, sizeof(name), "/%016llx.pgc", static_cast<unsigned long long>(key));
+    return dir + name;
+}
+
+bool saveProgram(const CompiledProgram& program, uint64_t key, const std::string& path) {
+    std::vector<FunctionObject*> functions = {program.script};
+    functions.insert(functions.end(), program.functions.begin(), program.functions.end());
+    SaveTables tables;
+    for (size_t i = 0; i < functions.size(); ++i) {
+        tables.functions.emplace(functions[i], static_cast<uint32_t>(i));
+    }
+    bool snapshot = program.hasSnapshot;
+    std::vector<ClassObject*> classes;
+    if (snapshot) {
+        if (program.globals.size() != program.globalNames.size()) return false;
+        for (const Value& global : program.globals) {
+            if (global.isClass()) collectClass(global.as.klass, classes, tables);
+        }
+        for (FunctionObject* function : functions) {
+            collectClass(function->ownerClass, classes, tables);
+        }
+    }
+
+    Writer out;
+    out.bytes.resize(sizeof(Header));
+    out.put(static_cast<uint32_t>(program.globalNames.size()));
+    for (const std::string& name : program.globalNames) {
+        out.putString(name);
+    }
+
+    for (const FunctionObject* function : functions) {
+        const Chunk& chunk = function->chunk;
+        out.putString(function->name);
+        out.put(static_cast<int32_t>(function->arity));
+        out.put(static_cast<uint8_t>(function->isMethod));
+        out.put(static_cast<uint32_t>(chunk.code.size()));
+        out.bytes.append(reinterpret_cast<const char*>(chunk.code.data()), chunk.code.size());
+
+        out.put(static_cast<uint32_t>(chunk.constants.size()));
+        for (const Value& constant : chunk.constants) {
+            // Classes only exist at run time; the compiler never makes one a constant.
+            if (constant.isClass() || !putValue(out, constant, tables)) return false;
+        }
+        out.put(static_cast<uint32_t>(chunk.propertyCaches.size()));
+    }
+
+    out.put(static_cast<uint32_t>(program.mainOffset));
+    out.put(static_cast<uint8_t>(snapshot));
+    if (snapshot) {
+        out.put(static_cast<uint32_t>(classes.size()));
+        for (const ClassObject* klass : classes) {
+            out.putString(klass->name);
+            out.put(klass->parent ? static_cast<int32_t>(tables.classes.at(klass->parent)) : int32_t(-1));
+            out.put(klass->version);
+            out.put(static_cast<uint32_t>(klass->fieldLayout.size()));
+            for (const FieldSlot& field : klass->fieldLayout) {
+                out.putString(field.name);
+                out.put(static_cast<uint8_t>(field.access));
+            }
+            out.put(static_cast<uint32_t>(klass->methods.size()));
+            for (const auto& [name, overloads] : klass->methods) {
+                out.putString(name);
+                out.put(static_cast<uint32_t>(overloads.size()));
+                for (const FunctionObject* method : overloads) {
+                    if (!tables.functions.count(method)) return false;
+                    out.put(tables.functions.at(method));
+                }
+            }
+            out.put(static_cast<uint32_t>(klass->methodAccess.size()));
+            for (const auto& [name, access] : klass->methodAccess) {
+                out.putString(name);
+                out.put(static_cast<uint8_t>(access));
+            }
+        }
+        for (const FunctionObject* function : functions) {
+            out.put(function->ownerClass ? static_cast<int32_t>(tables.classes.at(function->ownerClass))
+                                         : int32_t(-1));
+        }
+        for (const Value& global : program.globals) {
+            if (!putValue(out, global, tables)) return false;
+        }
+    }
+
+    Header header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = FORMAT_VERSION;
+    header.opcodeCount = OP_COUNT;
+    header.functionCount = static_cast<uint32_t>(functions.size());
+    header.key = key;
+    header.size = out.bytes.size();
+    header.checksum = fnv1a(reinterpret_cast<const uint8_t*>(out.bytes.data()) + sizeof(Header),
+                            out.bytes.size() - sizeof(Header));
+    std::memcpy(&out.bytes[0], &header, sizeof(Header));
+
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+    std::string temporary = temporaryPath(path);
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file.write(out.bytes.data(), static_cast<std::streamsize>(out.bytes.size()))) {
+            file.close();
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool loadProgram(const std::string& path, uint64_t key, CompiledProgram& program) {
+    FileView file(path);
+    if (!file.data) return false;
+
+    Reader in(file.data, file.size);
+    Header header;
+    if (!in.get(header) || std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header.version != FORMAT_VERSION || header.opcodeCount != OP_COUNT || header.key != key ||
+        header.size != file.size || header.functionCount == 0 ||
+        header.checksum != fnv1a(file.data + sizeof(Header), file.size - sizeof(Header))) {
+        return false;
+    }
+
+    std::vector<std::string> globalNames;
+    uint32_t globalCount;
+    if (!in.get(globalCount) || !in.canHold(globalCount, sizeof(uint32_t))) return false;
+    for (uint32_t i = 0; i < globalCount; ++i) {
+        std::string name;
+        if (!in.getString(name)) return false;
+        globalNames.push_back(std::move(name));
+    }
+
+    std::vector<std::unique_ptr<FunctionObject>> functions;
+    std::vector<std::unique_ptr<ClassObject>> classes;
+    // name length, arity, isMethod, code size, constant and cache counts
+    constexpr size_t MIN_FUNCTION_SIZE = 4 + 4 + 1 + 4 + 4 + 4;
+    if (!in.canHold(header.functionCount, MIN_FUNCTION_SIZE)) return false;
+    for (uint32_t i = 0; i < header.functionCount; ++i) {
+        functions.push_back(std::make_unique<FunctionObject>("", 0));
+    }
+    for (auto& function : functions) {
+        int32_t arity;
+        uint8_t isMethod;
+        uint32_t codeSize;
+        const uint8_t* code;
+        uint32_t constantCount;
+        if (!in.getString(function->name) || !in.get(arity) || !in.get(isMethod) || !in.get(codeSize) ||
+            !in.getBytes(codeSize, code) || !in.get(constantCount) || !in.canHold(constantCount, 1)) {
+            return false;
+        }
+        function->arity = arity;
+        function->isMethod = isMethod != 0;
+        Chunk& chunk = function->chunk;
+        chunk.code.assign(code, code + codeSize);
+        chunk.constants.resize(constantCount);
+        for (Value& constant : chunk.constants) {
+            if (!getValue(in, constant, functions, classes)) return false;
+        }
+        uint32_t cacheCount;
+        // Every cache belongs to one multi-byte property instruction.
+        if (!in.get(cacheCount) || cacheCount > codeSize) return false;
+        chunk.propertyCaches.resize(cacheCount);
+    }
+
+    uint32_t mainOffset;
+    uint8_t snapshot;
+    if (!in.get(mainOffset) || !in.get(snapshot)) return false;
+    for (size_t i = 0; i < functions.size(); ++i) {
+        if (!validCode(functions[i]->chunk, globalCount, i == 0 ? mainOffset : 0)) return false;
+    }
+    std::vector<Value> globals;
+    if (snapshot) {
+        uint32_t classCount;
+        // name length, parent, version and the field, method and access counts
+        constexpr size_t MIN_CLASS_SIZE = 4 + 4 + 4 + 4 + 4 + 4;
+        if (!in.get(classCount) || !in.canHold(classCount, MIN_CLASS_SIZE)) return false;
+        for (uint32_t i = 0; i < classCount; ++i) {
+            classes.push_back(std::make_unique<ClassObject>(""));
+        }
+        for (size_t index = 0; index < classes.size(); ++index) {
+            ClassObject* klass = classes[index].get();
+            int32_t parent;
+            uint32_t count;
+            // Parents come first, so the chain cannot loop.
+            if (!in.getString(klass->name) || !in.get(parent) || parent >= static_cast<int64_t>(index) ||
+                !in.get(klass->version) || !in.get(count)) {
+                return false;
+            }
+            klass->parent = parent < 0 ? nullptr : classes[parent].get();
+            for (uint32_t i = 0; i < count; ++i) {
+                FieldSlot field;
+                uint8_t access;
+                if (!in.getString(field.name) || !in.get(access)) return false;
+                field.access = static_cast<AccessModifier>(access);
+                klass->fieldSlots.emplace(field.name, static_cast<uint32_t>(klass->fieldLayout.size()));
+                klass->fieldLayout.push_back(std::move(field));
+            }
+            if (!in.get(count)) return false;
+            for (uint32_t i = 0; i < count; ++i) {
+                std::string name;
+                uint32_t overloads;
+                if (!in.getString(name) || !in.get(overloads)) return false;
+                std::vector<FunctionObject*>& methods = klass->methods[name];
+                for (uint32_t j = 0; j < overloads; ++j) {
+                    uint32_t index;
+                    if (!in.get(index) || index >= functions.size()) return false;
+                    methods.push_back(functions[index].get());
+                }
+            }
+            if (!in.get(count)) return false;
+            for (uint32_t i = 0; i < count; ++i) {
+                std::string name;
+                uint8_t access;
+                if (!in.getString(name) || !in.get(access)) return false;
+                klass->methodAccess[name] = static_cast<AccessModifier>(access);
+            }
+        }
+        for (auto& function : functions) {
+            int32_t owner;
+            if (!in.get(owner) || owner >= static_cast<int32_t>(classCount)) return false;
+            function->ownerClass = owner < 0 ? nullptr : classes[owner].get();
+        }
+        globals.resize(globalCount);
+        for (Value& global : globals) {
+            if (!getValue(in, global, functions, classes)) return false;
+        }
+    }
+    if (!in.atEnd()) return false;
+
+    program.script = functions[0].release();
+    program.functions.clear();
+    for (size_t i = 1; i < functions.size(); ++i) {
+        program.functions.push_back(functions[i].release());
+    }
+    for (auto& klass : classes) {
+        klass.release();
+    }
+    program.globalNames = std::move(globalNames);
+    program.mainOffset = mainOffset;
+    program.hasSnapshot = snapshot != 0;
+    program.globals = std::move(globals);
+    return true;
+}
+
+}  // namespace vm
@@ -10,12 +10,20 @@ void Compiler::emit(uint8_t byte) {
     currentChunk().write(byte);
 }
 
+void Compiler::emitShort(uint16_t value) {
+    currentChunk().write16(value);
+}
+
 void Compiler::emitConstant(Value value) {
     int idx = currentChunk().addConstant(value);
     emit(OP_CONSTANT);
     emit(idx);
 }
 
+void Compiler::emitPropertyCache() {
+    emitShort(currentChunk().addPropertyCache());
+}
+
 int Compiler::emitJump(uint8_t instruction) {
     emit(instruction);
     emit(0xff);
@@ -42,6 +50,92 @@ void Compiler::emitLoop(int loopStart) {
     emit(offset & 0xff);
 }
 
+bool Compiler::parseNumber(const std::string& text, Value& out) {
+    try {
+        const bool isInt =
+            text.find('.') == std::string::npos &&
+            text.find('e') == std::string::npos &&
+            text.find('E') == std::string::npos;
+        if (isInt) {
+            out = static_cast<int64_t>(std::stoll(text));
+        } else {
+            out = std::stod(text);
+        }
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+// Superinstructions. The emitters below recognise the shapes that dominate
+// loop bodies and headers and emit one fused opcode in place of the generic
+// sequence; anything else falls back to the plain encoding.
+
+int Compiler::emitJumpIfFalse(Expr* condition, bool& leavesValue) {
+    // local < local  /  local < number
+    //   GET_LOCAL a, GET_LOCAL b, LESSER, JUMP_IF_FALSE, POP (and POP at the target)
+    //   => JUMP_IF_NOT_LT_LOCAL a b  /  JUMP_IF_NOT_LT_CONST a k
+    if (auto* bin = dynamic_cast<BinaryExpr*>(condition); bin && bin->op == "<") {
+        auto* left = dynamic_cast<VarExpr*>(bin->left.get());
+        int leftSlot = left ? resolveLocal(left->name) : -1;
+
+        if (leftSlot != -1) {
+            Value number;
+            if (auto* right = dynamic_cast<VarExpr*>(bin->right.get())) {
+                int rightSlot = resolveLocal(right->name);
+                if (rightSlot != -1) {
+                    emit(OP_JUMP_IF_NOT_LT_LOCAL);
+                    emit(leftSlot);
+                    emit(rightSlot);
+                    emit(0xff);
+                    emit(0xff);
+                    leavesValue = false;
+                    return currentChunk().code.size() - 2;
+                }
+            } else if (auto* right = dynamic_cast<NumberExpr*>(bin->right.get());
+                       right && parseNumber(right->value, number)) {
+                emit(OP_JUMP_IF_NOT_LT_CONST);
+                emit(leftSlot);
+                emit(currentChunk().addConstant(number));
+                emit(0xff);
+                emit(0xff);
+                leavesValue = false;
+                return currentChunk().code.size() - 2;
+            }
+        }
+    }
+
+    compileExpr(condition);
+    leavesValue = true;
+    return emitJump(OP_JUMP_IF_FALSE);
+}
+
+bool Compiler::emitLocalIncrement(int slot, const Assignment& assign) {
+    // x += number  /  x = x + number
+    //   GET_LOCAL x, CONSTANT k, ADD, SET_LOCAL x, POP  =>  INC_LOCAL_CONST x k
+    NumberExpr* step = nullptr;
+    if (assign.op == TokenType::PLUS_EQUAL) {
+        step = dynamic_cast<NumberExpr*>(assign.value.get());
+    } else if (assign.op == TokenType::EQUAL) {
+        auto* bin = dynamic_cast<BinaryExpr*>(assign.value.get());
+        if (bin && bin->op == "+") {
+            auto* var = dynamic_cast<VarExpr*>(bin->left.get());
+            if (var && resolveLocal(var->name) == slot) {
+                step = dynamic_cast<NumberExpr*>(bin->right.get());
+            }
+        }
+    }
+
+    Value number;
+    if (!step || !parseNumber(step->value, number)) {
+        return false;
+    }
+    emit(OP_INC_LOCAL_CONST);
+    emit(slot);
+    emit(currentChunk().addConstant(number));
+    return true;
+}
+
 void Compiler::beginScope() {
     scopeDepth++;
 }
@@ -67,40 +161,92 @@ int Compiler::resolveLocal(const std::string& name) {
     return -1;
 }
 
+int Compiler::resolveGlobal(const std::string& name) {
+    auto it = globalSlots.find(name);
+    if (it != globalSlots.end()) {
+        return it->second;
+    }
+    int slot = static_cast<int>(globalNames.size());
+    globalNames.push_back(name);
+    globalSlots.emplace(name, slot);
+    return slot;
+}
+
+int Compiler::directCall(const std::string& name, size_t argCount) {
+    auto it = directFunctions.find(name);
+    if (it == directFunctions.end() || it->second->arity != static_cast<int>(argCount)) {
+        return -1;  // an arity mismatch is left to report itself at run time
+    }
+    return currentChunk().addConstant(it->second);
+}
+
 void Compiler::compileFunction(Function* func) {
-    auto* fnObj = new FunctionObject(func->name, func->params.size());
+    auto direct = directFunctions.find(func->name);
+    auto* fnObj = direct != directFunctions.end() ? direct->second
+                                                  : new FunctionObject(func->name, func->params.size());
 
     FunctionObject* enclosingFunction = currentFunction;
     std::vector<Local> enclosingLocals = std::move(locals);
+    auto enclosingLocalTypes = std::move(localTypes);
     int enclosingScopeDepth = scopeDepth;
 
     currentFunction = fnObj;
     locals.clear();
     scopeDepth = 0;
+    inferLocalTypes(func->body->statements, func->params, false);
+    currentReturnType = StaticType::NONE;
 
-    beginScope();
-    addLocal("");  // Reserve slot 0 for callee.
+    if (!compileIR(func->body->statements, func->params, false)) {
+        beginScope();
+        addLocal("");  // Reserve slot 0 for callee.
 
-    for (const auto& param : func->params) {
-        addLocal(param.name);
-    }
+        for (const auto& param : func->params) {
+            addLocal(param.name);
+        }
 
-    for (const auto& stmt : func->body->statements) {
-        compileStmt(stmt.get());
-    }
+        for (const auto& stmt : func->body->statements) {
+            compileStmt(stmt.get());
+        }
 
-    emit(OP_NULL);
-    emit(OP_RETURN);
+        // Falling off the end returns null.
+        const auto& statements = func->body->statements;
+        if (statements.empty() || !dynamic_cast<ReturnStmt*>(statements.back().get())) {
+            currentReturnType = joinTypes(currentReturnType, StaticType::UNKNOWN);
+        }
+
+        emit(OP_NULL);
+        emit(OP_RETURN);
+    }
+    returnTypes[func->name] = currentReturnType;
 
     currentFunction = enclosingFunction;
     locals = std::move(enclosingLocals);
+    localTypes = std::move(enclosingLocalTypes);
     scopeDepth = enclosingScopeDepth;
 
     compiledFunctions.push_back(fnObj);
 }
 
 FunctionObject* Compiler::compile(ASTNode* node) {
+    foldConstants(node);
+
     if (auto* program = dynamic_cast<Program*>(node)) {
+        std::unordered_map<std::string, int> declarations;
+        for (const auto& func : program->functions) {
+            if (func->name != "main") {
+                resolveGlobal(func->name);
+                ++declarations[func->name];
+            }
+        }
+        for (const auto& cls : program->classes) {
+            ++declarations[cls->name];
+        }
+        for (const auto& func : program->functions) {
+            if (func->name != "main" && declarations[func->name] == 1) {
+                directFunctions[func->name] = new FunctionObject(func->name, func->params.size());
+            }
+        }
+
         for (const auto& func : program->functions) {
             if (func->name != "main") {
                 compileFunction(func.get());
@@ -115,27 +261,43 @@ FunctionObject* Compiler::compile(ASTNode* node) {
         for (const auto& cls : program->classes) {
             compileStmt(cls.get());
         }
+        mainOffset = scriptFn->chunk.code.size();
 
         for (const auto& func : program->functions) {
             if (func->name == "main") {
-                beginScope();
-                for (const auto& stmt : func->body->statements) {
-                    compileStmt(stmt.get());
+                // Class names live in the script's first local slots, which
+                // the IR does not know about.
+                if (!locals.empty() || !compileIR(func->body->statements, {}, true)) {
+                    inferLocalTypes(func->body->statements, {}, false);
+                    beginScope();
+                    for (const auto& stmt : func->body->statements) {
+                        compileStmt(stmt.get());
+                    }
+                    endScope();
                 }
-                endScope();
                 break;
             }
         }
 
         emit(OP_HALT);
-        return scriptFn;
+        return optimize(scriptFn);
     }
 
     auto* scriptFn = new FunctionObject("__script__", 0);
     currentFunction = scriptFn;
+    mainOffset = 0;
     compileStmt(node);
     emit(OP_RETURN);
-    return scriptFn;
+    return optimize(scriptFn);
+}
+
+// Runs once every chunk is complete, so no jump is still waiting to be patched.
+FunctionObject* Compiler::optimize(FunctionObject* script) {
+    for (auto* fn : compiledFunctions) {
+        optimizeChunk(fn->chunk, peepholeStats);
+    }
+    optimizeChunk(script->chunk, peepholeStats, &mainOffset);
+    return script;
 }
 
 }  // namespace vm
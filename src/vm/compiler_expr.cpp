@@ -7,18 +7,9 @@ namespace vm {
 
 void Compiler::compileExpr(ASTNode* node) {
     if (auto* num = dynamic_cast<NumberExpr*>(node)) {
-        try {
-            const std::string& s = num->value;
-            const bool isInt =
-                s.find('.') == std::string::npos &&
-                s.find('e') == std::string::npos &&
-                s.find('E') == std::string::npos;
-            if (isInt) {
-                emitConstant(static_cast<int64_t>(std::stoll(s)));
-            } else {
-                emitConstant(std::stod(s));
-            }
-        } catch (...) {
+        Value value;
+        if (parseNumber(num->value, value)) {
+            emitConstant(value);
         }
     } else if (auto* b = dynamic_cast<BoolExpr*>(node)) {
         if (b->value) emit(OP_TRUE);
@@ -27,7 +18,7 @@ void Compiler::compileExpr(ASTNode* node) {
         const std::string& str = s->value;
         const bool hasInterpolation = (str.find('{') != std::string::npos);
         if (!hasInterpolation) {
-            emitConstant(str);
+            emitConstant(Value(str));
         } else {
             int partCount = 0;
             size_t i = 0;
@@ -38,8 +29,7 @@ void Compiler::compileExpr(ASTNode* node) {
                     if (j < str.length()) {
                         std::string exprStr = str.substr(i + 1, j - i - 1);
                         Lexer lexer(exprStr);
-                        auto tokens = lexer.tokenize();
-                        Parser parser(tokens);
+                        Parser parser(lexer);
                         auto expr = parser.parseExpression();
                         compileExpr(expr.get());
                         partCount++;
@@ -54,7 +44,7 @@ void Compiler::compileExpr(ASTNode* node) {
                     i++;
                 }
                 if (!literal.empty()) {
-                    emitConstant(literal);
+                    emitConstant(Value(literal));
                     partCount++;
                 }
             }
@@ -70,17 +60,19 @@ void Compiler::compileExpr(ASTNode* node) {
             emit(arg);
         } else {
             int thisArg = resolveLocal("this");
-            Value nameVal = var->name;
-            int idx = currentChunk().addConstant(nameVal);
+            int slot = resolveGlobal(var->name);
 
             if (thisArg != -1) {
+                int idx = currentChunk().addConstant(Value(var->name));
                 emit(OP_GET_LOCAL);
                 emit(thisArg);
                 emit(OP_GET_PROPERTY_OR_GLOBAL);
                 emit(idx);
+                emitShort(slot);
+                emitPropertyCache();
             } else {
                 emit(OP_GET_GLOBAL);
-                emit(idx);
+                emitShort(slot);
             }
         }
     } else if (auto* call = dynamic_cast<CallExpr*>(node)) {
@@ -166,25 +158,40 @@ void Compiler::compileExpr(ASTNode* node) {
             }
 
             compileExpr(mem->object.get());
-            int nameIdx = currentChunk().addConstant(mem->name);
-            emit(OP_GET_PROPERTY);
-            emit(nameIdx);
-
             for (const auto& arg : call->arguments) {
                 compileExpr(arg.get());
             }
 
-            emit(OP_CALL);
+            int nameIdx = currentChunk().addConstant(Value(mem->name));
+            emit(call == tailCall ? OP_TAIL_INVOKE : OP_INVOKE);
+            emit(nameIdx);
             emit(static_cast<uint8_t>(call->arguments.size()));
+            emitPropertyCache();
             return;
         }
 
+        bool tail = call == tailCall;
         compileExpr(call->callee.get());
         for (const auto& arg : call->arguments) {
             compileExpr(arg.get());
         }
-        emit(OP_CALL);
-        emit(static_cast<uint8_t>(call->arguments.size()));
+        auto argCount = static_cast<uint8_t>(call->arguments.size());
+        int direct = -1;
+        if (auto* callee = dynamic_cast<VarExpr*>(call->callee.get());
+            callee && !tail && resolveLocal(callee->name) == -1 && resolveLocal("this") == -1) {
+            direct = directCall(callee->name, call->arguments.size());
+        }
+        if (tail) {
+            emit(OP_TAIL_CALL);
+            emit(argCount);
+        } else if (direct != -1) {
+            emit(OP_CALL_DIRECT);
+            emit(direct);
+            emit(argCount);
+        } else {
+            emit(OP_CALL);
+            emit(argCount);
+        }
     } else if (auto* arr = dynamic_cast<ArrayExpr*>(node)) {
         for (const auto& el : arr->elements) {
             compileExpr(el.get());
@@ -217,40 +224,26 @@ void Compiler::compileExpr(ASTNode* node) {
             return;
         }
 
+        if (emitSimplifiedBinary(bin)) {
+            return;
+        }
+
         compileExpr(bin->left.get());
         compileExpr(bin->right.get());
 
-        if (bin->op == "+") emit(OP_ADD);
-        else if (bin->op == "-") emit(OP_SUB);
-        else if (bin->op == "*") emit(OP_MUL);
-        else if (bin->op == "/") emit(OP_DIV);
-        else if (bin->op == "%") emit(OP_MOD);
-        else if (bin->op == ">") emit(OP_GREATER);
-        else if (bin->op == ">=") emit(OP_GREATER_EQUAL);
-        else if (bin->op == "<") emit(OP_LESSER);
-        else if (bin->op == "<=") emit(OP_LESSER_EQUAL);
-        else if (bin->op == ">>") emit(OP_RIGHT_SHIFT);
-        else if (bin->op == "<<") emit(OP_LEFT_SHIFT);
-        else if (bin->op == "|") emit(OP_BITWISE_OR);
-        else if (bin->op == "&") emit(OP_BITWISE_AND);
-        else if (bin->op == "==") emit(OP_EQUAL);
-        else if (bin->op == "!=") emit(OP_NOT_EQUAL);
-        else if (bin->op == "^") emit(OP_XOR);
-        else if (bin->op == "+=") emit(OP_PLUS_EQUAL);
-        else if (bin->op == "-=") emit(OP_MINUS_EQUAL);
-        else if (bin->op == "*=") emit(OP_MULTIPLY_EQUAL);
-        else if (bin->op == "/=") emit(OP_DIVIDE_EQUAL);
-        else if (bin->op == "%=") emit(OP_MODULO_EQUAL);
-        else if (bin->op == "<<=") emit(OP_LEFT_SHIFT_EQUAL);
-        else if (bin->op == ">>=") emit(OP_RIGHT_SHIFT_EQUAL);
-        else if (bin->op == "&=") emit(OP_BITWISE_AND_EQUAL);
-        else if (bin->op == "|=") emit(OP_BITWISE_OR_EQUAL);
-        else if (bin->op == "^=") emit(OP_XOR_EQUAL);
+        emitBinaryOp(bin->op, typeOf(bin->left.get()), typeOf(bin->right.get()));
+    } else if (auto* unary = dynamic_cast<UnaryExpr*>(node)) {
+        if (emitSimplifiedUnary(unary)) {
+            return;
+        }
+        compileExpr(unary->right.get());
+        emit(unary->op == "-" ? OP_NEGATE : OP_NOT);
     } else if (auto* mem = dynamic_cast<MemberExpr*>(node)) {
         compileExpr(mem->object.get());
-        int nameIdx = currentChunk().addConstant(mem->name);
+        int nameIdx = currentChunk().addConstant(Value(mem->name));
         emit(OP_GET_PROPERTY);
         emit(nameIdx);
+        emitPropertyCache();
     }
 }
 
@@ -0,0 +1,348 @@
+#include "vm/compiler.h"
+
+#include "vm/utils/arith_utils.h"
+#include "vm/utils/value_utils.h"
+
+#include <cmath>
+#include <cstdio>
+
+namespace vm {
+
+// Constant folding. Runs over the AST before code generation and replaces
+// every operator whose operands are literals with the literal the VM would
+// have computed, using the runtime's own arithmetic helpers so folded and
+// unfolded code always agree. Anything the literal syntax cannot express
+// (non-finite floats, strings with `{`, which would be interpolated) or
+// that would fault at run time (division by zero) is left alone.
+
+namespace {
+
+struct Constant {
+    Value value;       // numbers and bools; a default Value for strings
+    std::string text;  // string literals
+    bool isString = false;
+};
+
+bool constantOf(Expr* expr, Constant& out) {
+    if (auto* num = dynamic_cast<NumberExpr*>(expr)) {
+        return Compiler::parseNumber(num->value, out.value);
+    }
+    if (auto* b = dynamic_cast<BoolExpr*>(expr)) {
+        out.value = b->value;
+        return true;
+    }
+    if (auto* str = dynamic_cast<StringExpr*>(expr)) {
+        if (str->value.find('{') != std::string::npos) return false;
+        out.text = str->value;
+        out.isString = true;
+        return true;
+    }
+    return false;
+}
+
+std::unique_ptr<Expr> literalFor(const Value& value) {
+    if (value.isBool()) {
+        return std::make_unique<BoolExpr>(value.as.boolean);
+    }
+    if (value.isInt()) {
+        return std::make_unique<NumberExpr>(std::to_string(value.as.integer));
+    }
+    if (value.isFloat() && std::isfinite(value.as.number)) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.17g", value.as.number);
+        std::string text = buffer;
+        // Keep it a float literal: parseNumber reads "2" as an int.
+        if (text.find_first_of(".eE") == std::string::npos) text += ".0";
+        return std::make_unique<NumberExpr>(text);
+    }
+    return nullptr;
+}
+
+bool isIntPair(const Value& a, const Value& b) {
+    return a.isInt() && b.isInt();
+}
+
+// Result of `left op right` for two literals, or nullptr if it must be
+// computed at run time.
+std::unique_ptr<Expr> foldBinary(const std::string& op, const Constant& left, const Constant& right) {
+    if (op == "+" && (left.isString || right.isString)) {
+        std::string text = (left.isString ? left.text : valueToString(left.value)) +
+                           (right.isString ? right.text : valueToString(right.value));
+        if (text.find('{') != std::string::npos) return nullptr;
+        return std::make_unique<StringExpr>(text);
+    }
+
+    // Every other operator sees a string through asDouble/asInt/asBool,
+    // which treat it like a default Value.
+    const Value& a = left.value;
+    const Value& b = right.value;
+    int64_t result;
+
+    if (op == "+") {
+        if (isIntPair(a, b) && __builtin_add_overflow(a.as.integer, b.as.integer, &result)) return nullptr;
+        return literalFor(addValues(a, b));
+    }
+    if (op == "-") {
+        if (isIntPair(a, b) && __builtin_sub_overflow(a.as.integer, b.as.integer, &result)) return nullptr;
+        return literalFor(subValues(a, b));
+    }
+    if (op == "*") {
+        if (isIntPair(a, b) && __builtin_mul_overflow(a.as.integer, b.as.integer, &result)) return nullptr;
+        return literalFor(mulValues(a, b));
+    }
+    if (op == "/") return literalFor(divValues(a, b));
+    if (op == "%") {
+        int64_t divisor = isIntPair(a, b) ? b.as.integer : asInt(b);
+        if (divisor == 0 || divisor == -1) return nullptr;
+        return literalFor(modValues(a, b));
+    }
+    if (op == "&") return literalFor(bitAndValues(a, b));
+    if (op == "|") return literalFor(bitOrValues(a, b));
+    if (op == "^") return literalFor(xorValues(a, b));
+    if (op == "<<" || op == ">>") {
+        // Only the int64 path defines every shift count.
+        if (!isIntPair(a, b)) return nullptr;
+        return literalFor(op == "<<" ? shiftLeftValues(a, b) : shiftRightValues(a, b));
+    }
+    if (op == "<") return literalFor(Value(asDouble(a) < asDouble(b)));
+    if (op == "<=") return literalFor(Value(asDouble(a) <= asDouble(b)));
+    if (op == ">") return literalFor(Value(asDouble(a) > asDouble(b)));
+    if (op == ">=") return literalFor(Value(asDouble(a) >= asDouble(b)));
+    if (op == "==") return literalFor(Value(asDouble(a) == asDouble(b)));
+    if (op == "!=") return literalFor(Value(asDouble(a) != asDouble(b)));
+    return nullptr;
+}
+
+bool isTruthy(const Constant& constant) {
+    return !constant.isString && asBool(constant.value);
+}
+
+void foldExpr(std::unique_ptr<Expr>& expr);
+void foldStatements(std::vector<std::unique_ptr<Stmt>>& statements);
+
+void foldExprs(std::vector<std::unique_ptr<Expr>>& exprs) {
+    for (auto& expr : exprs) foldExpr(expr);
+}
+
+void foldExpr(std::unique_ptr<Expr>& expr) {
+    if (!expr) return;
+
+    if (auto* bin = dynamic_cast<BinaryExpr*>(expr.get())) {
+        foldExpr(bin->left);
+        foldExpr(bin->right);
+
+        Constant left;
+        if (!constantOf(bin->left.get(), left)) return;
+
+        // `a && b` is a when a is falsy and b otherwise; `||` the reverse.
+        if (bin->op == "&&" || bin->op == "||") {
+            bool keepLeft = isTruthy(left) == (bin->op == "||");
+            std::unique_ptr<Expr> operand = std::move(keepLeft ? bin->left : bin->right);
+            expr = std::move(operand);
+            return;
+        }
+
+        Constant right;
+        if (!constantOf(bin->right.get(), right)) return;
+        if (auto folded = foldBinary(bin->op, left, right)) {
+            expr = std::move(folded);
+        }
+    } else if (auto* unary = dynamic_cast<UnaryExpr*>(expr.get())) {
+        foldExpr(unary->right);
+        Constant operand;
+        if (!constantOf(unary->right.get(), operand)) return;
+        Value value = operand.isString ? Value() : operand.value;
+        auto folded = unary->op == "-" ? literalFor(Value(-asDouble(value)))
+                                       : literalFor(Value(!asBool(value)));
+        if (folded) expr = std::move(folded);
+    } else if (auto* call = dynamic_cast<CallExpr*>(expr.get())) {
+        foldExpr(call->callee);
+        foldExprs(call->arguments);
+    } else if (auto* array = dynamic_cast<ArrayExpr*>(expr.get())) {
+        foldExprs(array->elements);
+    } else if (auto* index = dynamic_cast<IndexExpr*>(expr.get())) {
+        foldExpr(index->array);
+        foldExpr(index->index);
+    } else if (auto* member = dynamic_cast<MemberExpr*>(expr.get())) {
+        foldExpr(member->object);
+    }
+}
+
+void foldAssignments(AssignmentStmt* stmt) {
+    if (!stmt) return;
+    for (auto& assign : stmt->assignments) {
+        foldExpr(assign.target);
+        foldExpr(assign.value);
+    }
+}
+
+void foldBlock(Block* block) {
+    if (block) foldStatements(block->statements);
+}
+
+void foldClass(ClassStmt* classStmt) {
+    for (auto& section : classStmt->sections) {
+        for (auto& member : section->members) {
+            if (auto* method = dynamic_cast<MethodDef*>(member.get())) {
+                foldBlock(method->body.get());
+            }
+        }
+    }
+}
+
+// Folds `stmt` in place. Returns false if the statement can never run and
+// should be dropped.
+bool foldStmt(std::unique_ptr<Stmt>& stmt) {
+    if (auto* ifStmt = dynamic_cast<IfStmt*>(stmt.get())) {
+        foldExpr(ifStmt->condition);
+        foldBlock(ifStmt->thenBranch.get());
+        if (ifStmt->elseBranch && !foldStmt(ifStmt->elseBranch)) {
+            ifStmt->elseBranch.reset();
+        }
+
+        Constant condition;
+        if (!constantOf(ifStmt->condition.get(), condition)) return true;
+        if (isTruthy(condition)) {
+            stmt = std::move(ifStmt->thenBranch);
+            return true;
+        }
+        if (!ifStmt->elseBranch) return false;
+        stmt = std::move(ifStmt->elseBranch);
+        return true;
+    }
+    if (auto* whileStmt = dynamic_cast<WhileStmt*>(stmt.get())) {
+        foldExpr(whileStmt->condition);
+        foldBlock(whileStmt->body.get());
+        Constant condition;
+        return !constantOf(whileStmt->condition.get(), condition) || isTruthy(condition);
+    }
+    if (auto* forStmt = dynamic_cast<ForStmt*>(stmt.get())) {
+        foldAssignments(forStmt->init.get());
+        foldExpr(forStmt->condition);
+        foldAssignments(forStmt->increment.get());
+        foldBlock(forStmt->body.get());
+    } else if (auto* block = dynamic_cast<Block*>(stmt.get())) {
+        foldBlock(block);
+    } else if (auto* assignStmt = dynamic_cast<AssignmentStmt*>(stmt.get())) {
+        foldAssignments(assignStmt);
+    } else if (auto* print = dynamic_cast<PrintStmt*>(stmt.get())) {
+        foldExpr(print->expression);
+    } else if (auto* println = dynamic_cast<PrintlnStmt*>(stmt.get())) {
+        foldExpr(println->expression);
+    } else if (auto* exprStmt = dynamic_cast<ExprStmt*>(stmt.get())) {
+        foldExpr(exprStmt->expression);
+    } else if (auto* returnStmt = dynamic_cast<ReturnStmt*>(stmt.get())) {
+        foldExpr(returnStmt->value);
+    } else if (auto* classStmt = dynamic_cast<ClassStmt*>(stmt.get())) {
+        foldClass(classStmt);
+    }
+    return true;
+}
+
+void foldStatements(std::vector<std::unique_ptr<Stmt>>& statements) {
+    for (auto it = statements.begin(); it != statements.end();) {
+        if (foldStmt(*it)) {
+            ++it;
+        } else {
+            it = statements.erase(it);
+        }
+    }
+}
+
+}  // namespace
+
+void Compiler::foldConstants(ASTNode* node) {
+    if (auto* program = dynamic_cast<Program*>(node)) {
+        for (auto& func : program->functions) {
+            foldBlock(func->body.get());
+        }
+        for (auto& cls : program->classes) {
+            foldClass(cls.get());
+        }
+    } else if (auto* block = dynamic_cast<Block*>(node)) {
+        foldBlock(block);
+    }
+}
+
+// Algebraic simplification and strength reduction. These depend on operand
+// types (`x + 0` is a concatenation when x is a string), so they run during
+// code generation where the inferred local types are known. Only literal
+// operands are dropped, so no side effect is lost.
+
+static bool isIntLiteral(Expr* expr, int64_t expected) {
+    Constant constant;
+    return constantOf(expr, constant) && constant.value.isInt() && constant.value.as.integer == expected;
+}
+
+static bool isOneLiteral(Expr* expr) {
+    Constant constant;
+    if (!constantOf(expr, constant)) return false;
+    return (constant.value.isInt() && constant.value.as.integer == 1) ||
+           (constant.value.isFloat() && constant.value.as.number == 1.0);
+}
+
+// log2 of a power-of-two int literal greater than 1, or -1.
+static int powerOfTwoLiteral(Expr* expr) {
+    Constant constant;
+    if (!constantOf(expr, constant) || !constant.value.isInt()) return -1;
+    int64_t n = constant.value.as.integer;
+    if (n < 2 || (n & (n - 1)) != 0) return -1;
+    return __builtin_ctzll(static_cast<uint64_t>(n));
+}
+
+bool Compiler::emitSimplifiedBinary(BinaryExpr* bin) {
+    const std::string& op = bin->op;
+    Expr* left = bin->left.get();
+    Expr* right = bin->right.get();
+    StaticType leftType = typeOf(left);
+    StaticType rightType = typeOf(right);
+    bool leftInt = leftType == StaticType::INT;
+    bool rightInt = rightType == StaticType::INT;
+
+    Expr* result = nullptr;
+    if (op == "+" || op == "|" || op == "^") {
+        if (leftInt && isIntLiteral(right, 0)) result = left;
+        else if (rightInt && isIntLiteral(left, 0)) result = right;
+    } else if (op == "-" || op == "<<" || op == ">>") {
+        if (leftInt && isIntLiteral(right, 0)) result = left;
+    } else if (op == "*") {
+        bool leftNumeric = leftInt || leftType == StaticType::FLOAT;
+        bool rightNumeric = rightInt || rightType == StaticType::FLOAT;
+        // An int times 1.0 becomes a float, so ints need the int literal.
+        if (leftNumeric && (leftInt ? isIntLiteral(right, 1) : isOneLiteral(right))) {
+            result = left;
+        } else if (rightNumeric && (rightInt ? isIntLiteral(left, 1) : isOneLiteral(left))) {
+            result = right;
+        } else {
+            // x * 2^k  =>  x << k (both wrap the same way in int64).
+            Expr* operand = nullptr;
+            int shift = -1;
+            if (leftInt && (shift = powerOfTwoLiteral(right)) > 0) operand = left;
+            else if (rightInt && (shift = powerOfTwoLiteral(left)) > 0) operand = right;
+            if (operand) {
+                compileExpr(operand);
+                emitConstant(static_cast<int64_t>(shift));
+                emit(OP_SHL_INT);
+                return true;
+            }
+        }
+    } else if (op == "/") {
+        if (leftType == StaticType::FLOAT && isOneLiteral(right)) result = left;
+    }
+
+    if (!result) return false;
+    compileExpr(result);
+    return true;
+}
+
+bool Compiler::emitSimplifiedUnary(UnaryExpr* unary) {
+    // !!b  =>  b for a bool b.
+    auto* inner = dynamic_cast<UnaryExpr*>(unary->right.get());
+    if (unary->op == "!" && inner && inner->op == "!" && typeOf(inner->right.get()) == StaticType::BOOL) {
+        compileExpr(inner->right.get());
+        return true;
+    }
+    return false;
+}
+
+}  // namespace vm
@@ -0,0 +1,417 @@
+#include "vm/compiler.h"
+
+#include <cstring>
+#include <map>
+#include <tuple>
+
+namespace vm {
+
+// Lowers an optimized IRFunction into the current chunk.
+//
+// Blocks are laid out in reverse postorder. Every phi, and every value
+// that cannot be recomputed where it is used, gets a frame slot of its own
+// after the parameters; the prologue pushes a null for each. A value used
+// exactly once, later in its own block, is not stored at all: it is emitted
+// as part of its user's operand tree, the way the direct compiler nests
+// expressions. Phi copies run at the end of each predecessor, all operands
+// pushed before any slot is written, so copies that read each other's
+// phis see the old values.
+class IRLowering {
+public:
+    IRLowering(Compiler& compiler, IRFunction& fn, int firstSlot)
+        : compiler(compiler), fn(fn), firstSlot(firstSlot) {}
+
+    bool run() {
+        countUses();
+        for (IRBlock* block : fn.rpo) {
+            planBlock(block);
+        }
+        assignSlots();
+        if (failed) return false;
+
+        for (int i = 0; i < slotCount; ++i) {
+            compiler.emit(OP_NULL);
+        }
+        label.assign(fn.blocks.size(), -1);
+        for (size_t i = 0; i < fn.rpo.size(); ++i) {
+            IRBlock* next = i + 1 < fn.rpo.size() ? fn.rpo[i + 1] : nullptr;
+            emitBlock(fn.rpo[i], next);
+        }
+        for (const Stub& stub : stubs) {
+            patch(stub.operand, code().size());
+            if (stub.pop) compiler.emit(OP_POP);
+            emitLoop(label[stub.target->id]);
+        }
+        for (const auto& [operand, target] : forwardJumps) {
+            patch(operand, label[target->id]);
+        }
+        return !failed;
+    }
+
+private:
+    struct Stub {
+        int operand;
+        IRBlock* target;
+        bool pop;
+    };
+
+    Compiler& compiler;
+    IRFunction& fn;
+    int firstSlot;
+    int slotCount = 0;
+    bool failed = false;
+
+    std::vector<int> uses;      // by value id
+    std::vector<int> useBlock;  // by value id: block of the (last) use
+    std::vector<IRValue*> user; // by value id: value of the (last) use, if any
+    std::vector<bool> deferred; // by value id: emitted inside its user
+    IRValue* tailCall = nullptr; // value of the RETURN being emitted
+    std::vector<int> slot;      // by value id
+    std::vector<bool> popOnEntry;
+    std::vector<int> label;
+    std::vector<std::pair<int, IRBlock*>> forwardJumps;
+    std::vector<Stub> stubs;
+    std::map<std::tuple<int, int64_t, std::string>, int> constantIndex;
+
+    Chunk& chunk() { return compiler.currentChunk(); }
+    std::vector<uint8_t>& code() { return compiler.currentChunk().code; }
+
+    void countUses() {
+        uses.assign(fn.values.size(), 0);
+        useBlock.assign(fn.values.size(), -1);
+        user.assign(fn.values.size(), nullptr);
+        deferred.assign(fn.values.size(), false);
+        slot.assign(fn.values.size(), -1);
+        popOnEntry.assign(fn.blocks.size(), false);
+
+        auto use = [&](IRValue* value, IRBlock* at, IRValue* by) {
+            if (!value->block) return;
+            ++uses[value->id];
+            useBlock[value->id] = at->id;
+            user[value->id] = by;
+        };
+        for (IRBlock* block : fn.rpo) {
+            for (IRValue* phi : block->phis) {
+                for (size_t i = 0; i < phi->operands.size(); ++i) {
+                    use(phi->operands[i], block->preds[i], nullptr);
+                }
+            }
+            for (IRValue* value : block->values) {
+                for (IRValue* operand : value->operands) use(operand, block, value);
+            }
+            if (block->value) use(block->value, block, nullptr);
+        }
+    }
+
+    // Decides which of the block's values are emitted inside their single
+    // user. A value with side effects may only move down to where its user
+    // is emitted if every side effect in between moves into the same operand
+    // tree: the builder creates values in the order their tree evaluates
+    // them, so their relative order is kept. The phi copies at the end of a
+    // JUMP block are separate trees, pushed in phi order, so there nothing
+    // with side effects may be in between.
+    void planBlock(IRBlock* block) {
+        const auto& values = block->values;
+        int end = static_cast<int>(values.size());
+        bool singleTreeAtEnd = block->terminator != IRTerminator::JUMP;
+
+        // Where each value ends up emitted: its own position, or that of
+        // the value it is nested in; the end of the block stands for the
+        // terminator and the phi copies.
+        std::vector<int> root(end + 1, end);
+        std::vector<int> position(fn.values.size(), end);
+        for (int i = 0; i < end; ++i) position[values[i]->id] = i;
+
+        for (int i = end - 1; i >= 0; --i) {
+            IRValue* value = values[i];
+            root[i] = i;
+            if (uses[value->id] != 1 || useBlock[value->id] != block->id) continue;
+
+            IRValue* by = user[value->id];
+            int target = by ? root[position[by->id]] : end;
+            bool movable = isPure(value);
+            if (!movable) {
+                movable = true;
+                for (int j = i + 1; j < target && movable; ++j) {
+                    if (isPure(values[j])) continue;
+                    movable = deferred[values[j]->id] && root[j] == target && (target < end || singleTreeAtEnd);
+                }
+            }
+            if (target > i && movable) {
+                deferred[value->id] = true;
+                root[i] = target;
+            }
+        }
+    }
+
+    void assignSlots() {
+        int next = firstSlot;
+        for (IRBlock* block : fn.rpo) {
+            for (IRValue* phi : block->phis) slot[phi->id] = next++;
+            for (IRValue* value : block->values) {
+                if (!deferred[value->id] && uses[value->id] > 0) slot[value->id] = next++;
+            }
+        }
+        slotCount = next - firstSlot;
+        if (next > 256) failed = true;
+        for (const auto& value : fn.values) {
+            if (value->kind == IRKind::PARAM) slot[value->id] = value->slot;
+        }
+    }
+
+    // ---- emission ----
+
+    void emitBlock(IRBlock* block, IRBlock* next) {
+        label[block->id] = static_cast<int>(code().size());
+        if (popOnEntry[block->id]) compiler.emit(OP_POP);
+
+        for (IRValue* value : block->values) {
+            if (deferred[value->id]) continue;
+            emitValue(value);
+            if (slot[value->id] >= 0) {
+                compiler.emit(OP_SET_LOCAL_POP);
+                compiler.emit(static_cast<uint8_t>(slot[value->id]));
+            } else if (value->kind != IRKind::VM || value->pushesResult) {
+                compiler.emit(OP_POP);
+            }
+        }
+
+        switch (block->terminator) {
+            case IRTerminator::JUMP:
+                emitCopies(block, block->succs[0]);
+                emitGoto(block, block->succs[0], next);
+                break;
+            case IRTerminator::BRANCH:
+                emitBranch(block, next);
+                break;
+            case IRTerminator::RETURN:
+                tailCall = block->value;
+                emitOperand(block->value);
+                tailCall = nullptr;
+                compiler.emit(OP_RETURN);
+                break;
+            case IRTerminator::HALT:
+            case IRTerminator::NONE:
+                compiler.emit(OP_HALT);
+                break;
+        }
+    }
+
+    void emitOperand(IRValue* value) {
+        if (value->kind == IRKind::CONST) {
+            emitConstant(value);
+        } else if (slot[value->id] >= 0 && !deferred[value->id]) {
+            compiler.emit(OP_GET_LOCAL);
+            compiler.emit(static_cast<uint8_t>(slot[value->id]));
+        } else {
+            emitValue(value);
+        }
+    }
+
+    void emitValue(IRValue* value) {
+        for (IRValue* operand : value->operands) {
+            emitOperand(operand);
+        }
+        switch (value->kind) {
+            case IRKind::BINARY:
+                compiler.emitBinaryOp(value->op, known(value->operands[0]->type), known(value->operands[1]->type));
+                break;
+            case IRKind::UNARY:
+                compiler.emit(value->op == "-" ? OP_NEGATE : OP_NOT);
+                break;
+            case IRKind::VM:
+                if (value == tailCall && (value->opcode == OP_CALL || value->opcode == OP_CALL_DIRECT)) {
+                    compiler.emit(OP_TAIL_CALL);
+                    compiler.emit(value->immediates.back());
+                    break;
+                }
+                compiler.emit(value->opcode);
+                for (uint8_t byte : value->immediates) compiler.emit(byte);
+                break;
+            default:
+                break;
+        }
+    }
+
+    static StaticType known(StaticType type) {
+        return type == StaticType::NONE ? StaticType::UNKNOWN : type;
+    }
+
+    void emitConstant(const IRValue* value) {
+        if (!value->isString) {
+            if (value->constant.isNull()) return compiler.emit(OP_NULL);
+            if (value->constant.isBool()) return compiler.emit(value->constant.as.boolean ? OP_TRUE : OP_FALSE);
+        }
+        compiler.emit(OP_CONSTANT);
+        compiler.emit(static_cast<uint8_t>(constant(value)));
+    }
+
+    int constant(const IRValue* value) {
+        int64_t bits = value->constant.as.integer;
+        if (value->constant.isFloat()) std::memcpy(&bits, &value->constant.as.number, sizeof(bits));
+        auto key = std::make_tuple(value->isString ? -1 : static_cast<int>(value->constant.type), bits,
+                                   value->isString ? value->text : std::string());
+        auto it = constantIndex.find(key);
+        if (it != constantIndex.end()) return it->second;
+
+        int index = value->isString ? chunk().addConstant(Value(value->text)) : chunk().addConstant(value->constant);
+        if (index > 255) failed = true;
+        constantIndex.emplace(key, index);
+        return index;
+    }
+
+    // Parallel copy into the phis of `target` along the edge from `block`:
+    // push every source, then store them in reverse. `p = p + k` becomes an
+    // INC_LOCAL_CONST between the two, after the other sources have read p.
+    void emitCopies(IRBlock* block, IRBlock* target) {
+        size_t edge = std::find(target->preds.begin(), target->preds.end(), block) - target->preds.begin();
+        std::vector<std::pair<IRValue*, IRValue*>> copies;
+        std::vector<std::pair<IRValue*, IRValue*>> increments;
+        for (IRValue* phi : target->phis) {
+            IRValue* source = phi->operands[edge];
+            if (source == phi) continue;
+            const IRValue* step = source->operands.size() == 2 ? source->operands[1] : nullptr;
+            bool increment = source->kind == IRKind::BINARY && source->op == "+" && deferred[source->id] &&
+                             source->operands[0] == phi && step->kind == IRKind::CONST && !step->isString &&
+                             (step->constant.isInt() || step->constant.isFloat());
+            (increment ? increments : copies).push_back({phi, source});
+        }
+
+        for (const auto& copy : copies) {
+            emitOperand(copy.second);
+        }
+        for (const auto& [phi, source] : increments) {
+            compiler.emit(OP_INC_LOCAL_CONST);
+            compiler.emit(static_cast<uint8_t>(slot[phi->id]));
+            compiler.emit(static_cast<uint8_t>(constant(source->operands[1])));
+        }
+        for (size_t i = copies.size(); i-- > 0;) {
+            compiler.emit(OP_SET_LOCAL_POP);
+            compiler.emit(static_cast<uint8_t>(slot[copies[i].first->id]));
+        }
+    }
+
+    bool inSlot(const IRValue* value) const {
+        return value->kind != IRKind::CONST && slot[value->id] >= 0 && !deferred[value->id];
+    }
+
+    void emitBranch(IRBlock* block, IRBlock* next) {
+        IRBlock* ifTrue = block->succs[0];
+        IRBlock* ifFalse = block->succs[1];
+        IRValue* condition = block->value;
+
+        // local < local  /  local < number  =>  JUMP_IF_NOT_LT_LOCAL / _CONST
+        if (condition->kind == IRKind::BINARY && condition->op == "<" && deferred[condition->id] &&
+            inSlot(condition->operands[0])) {
+            IRValue* right = condition->operands[1];
+            bool constant = right->kind == IRKind::CONST && !right->isString &&
+                            (right->constant.isInt() || right->constant.isFloat());
+            if (constant || inSlot(right)) {
+                compiler.emit(constant ? OP_JUMP_IF_NOT_LT_CONST : OP_JUMP_IF_NOT_LT_LOCAL);
+                compiler.emit(static_cast<uint8_t>(slot[condition->operands[0]->id]));
+                compiler.emit(static_cast<uint8_t>(constant ? this->constant(right) : slot[right->id]));
+                emitConditionalJump(block, ifFalse, false);
+                emitGoto(block, ifTrue, next);
+                return;
+            }
+        }
+
+        emitOperand(condition);
+        compiler.emit(OP_JUMP_IF_FALSE);
+        emitConditionalJump(block, ifFalse, true);
+        compiler.emit(OP_POP);
+        emitGoto(block, ifTrue, next);
+    }
+
+    // Writes the offset of a forward conditional jump whose opcode (and
+    // slot operands) are already emitted. `pop`: the jump leaves the tested
+    // value on the stack for the target to drop.
+    void emitConditionalJump(IRBlock* block, IRBlock* target, bool pop) {
+        int operand = static_cast<int>(code().size());
+        compiler.emit(0xff);
+        compiler.emit(0xff);
+        bool direct = target->order > block->order && (!pop || target->preds.size() == 1);
+        if (direct) {
+            if (pop) popOnEntry[target->id] = true;
+            forwardJumps.push_back({operand, target});
+        } else {
+            stubs.push_back({operand, target, pop});
+        }
+    }
+
+    void emitGoto(IRBlock* block, IRBlock* target, IRBlock* next) {
+        if (target == next) return;
+        if (target->order <= block->order) {
+            emitLoop(label[target->id]);
+            return;
+        }
+        compiler.emit(OP_JUMP);
+        forwardJumps.push_back({static_cast<int>(code().size()), target});
+        compiler.emit(0xff);
+        compiler.emit(0xff);
+    }
+
+    void emitLoop(int start) {
+        if (static_cast<int>(code().size()) + 3 - start > 0xffff) failed = true;
+        compiler.emitLoop(start);
+    }
+
+    void patch(int operand, int target) {
+        int jump = target - operand - 2;
+        if (jump > 0xffff) failed = true;
+        code()[operand] = (jump >> 8) & 0xff;
+        code()[operand + 1] = jump & 0xff;
+    }
+};
+
+bool Compiler::compileIR(const std::vector<std::unique_ptr<Stmt>>& body, const std::vector<Param>& params,
+                         bool isScript) {
+    if (!useIR) return false;
+
+    IRContext context;
+    context.globalSlot = [this](const std::string& name) { return resolveGlobal(name); };
+    context.returnType = [this](const std::string& name) { return callReturnType(name); };
+    context.directCall = [this](const std::string& name, size_t argCount) { return directCall(name, argCount); };
+
+    // Building the IR already adds constants (direct callees) and global
+    // slots; a fallback must start from the state before any of it.
+    size_t codeSize = currentChunk().code.size();
+    size_t constantCount = currentChunk().constants.size();
+    size_t globalCount = globalNames.size();
+    auto rollback = [&]() {
+        currentChunk().code.resize(codeSize);
+        currentChunk().constants.resize(constantCount);
+        for (size_t slot = globalCount; slot < globalNames.size(); ++slot) {
+            globalSlots.erase(globalNames[slot]);
+        }
+        globalNames.resize(globalCount);
+        ++irStats.fallbacks;
+    };
+
+    std::string unsupported;
+    std::unique_ptr<IRFunction> function = buildIR(body, params, isScript, context, unsupported);
+    if (!function) {
+        rollback();
+        return false;
+    }
+
+    IRStats stats = irStats;
+    optimizeIR(*function, stats);
+
+    int firstSlot = isScript ? static_cast<int>(locals.size()) : 1 + static_cast<int>(params.size());
+    if (!IRLowering(*this, *function, firstSlot).run()) {
+        rollback();
+        return false;
+    }
+
+    irStats = stats;
+    ++irStats.functions;
+    for (IRBlock* block : function->rpo) {
+        if (block->terminator == IRTerminator::RETURN) {
+            currentReturnType = joinTypes(currentReturnType, block->value->type);
+        }
+    }
+    return true;
+}
+
+}  // namespace vm
@@ -14,21 +14,25 @@ void Compiler::compileStmt(ASTNode* node) {
         emit(OP_POP);
     } else if (auto* returnStmt = dynamic_cast<ReturnStmt*>(node)) {
         if (returnStmt->value) {
+            currentReturnType = joinTypes(currentReturnType, typeOf(returnStmt->value.get()));
+            tailCall = dynamic_cast<CallExpr*>(returnStmt->value.get());
             compileExpr(returnStmt->value.get());
+            tailCall = nullptr;
         } else {
+            currentReturnType = joinTypes(currentReturnType, StaticType::UNKNOWN);
             emit(OP_NULL);
         }
         emit(OP_RETURN);
     } else if (auto* ifStmt = dynamic_cast<IfStmt*>(node)) {
-        compileExpr(ifStmt->condition.get());
-        int thenJump = emitJump(OP_JUMP_IF_FALSE);
-        emit(OP_POP);
+        bool leavesValue;
+        int thenJump = emitJumpIfFalse(ifStmt->condition.get(), leavesValue);
+        if (leavesValue) emit(OP_POP);
 
         compileStmt(ifStmt->thenBranch.get());
 
         int elseJump = emitJump(OP_JUMP);
         patchJump(thenJump);
-        emit(OP_POP);
+        if (leavesValue) emit(OP_POP);
 
         if (ifStmt->elseBranch) {
             compileStmt(ifStmt->elseBranch.get());
@@ -39,15 +43,15 @@ void Compiler::compileStmt(ASTNode* node) {
         int loopStart = currentChunk().code.size();
         loopStack.push_back({loopStart, {}});
 
-        compileExpr(whileStmt->condition.get());
-        int exitJump = emitJump(OP_JUMP_IF_FALSE);
-        emit(OP_POP);
+        bool leavesValue;
+        int exitJump = emitJumpIfFalse(whileStmt->condition.get(), leavesValue);
+        if (leavesValue) emit(OP_POP);
 
         compileStmt(whileStmt->body.get());
         emitLoop(loopStart);
 
         patchJump(exitJump);
-        emit(OP_POP);
+        if (leavesValue) emit(OP_POP);
 
         for (int breakJump : loopStack.back().breakJumps) {
             patchJump(breakJump);
@@ -62,11 +66,11 @@ void Compiler::compileStmt(ASTNode* node) {
 
         int loopStart = currentChunk().code.size();
         int exitJump = -1;
+        bool leavesValue = false;
 
         if (forStmt->condition) {
-            compileExpr(forStmt->condition.get());
-            exitJump = emitJump(OP_JUMP_IF_FALSE);
-            emit(OP_POP);
+            exitJump = emitJumpIfFalse(forStmt->condition.get(), leavesValue);
+            if (leavesValue) emit(OP_POP);
         }
 
         loopStack.push_back({-1, {}, {}});
@@ -84,7 +88,7 @@ void Compiler::compileStmt(ASTNode* node) {
 
         if (exitJump != -1) {
             patchJump(exitJump);
-            emit(OP_POP);
+            if (leavesValue) emit(OP_POP);
         }
 
         for (int breakJump : loopStack.back().breakJumps) {
@@ -103,8 +107,8 @@ void Compiler::compileStmt(ASTNode* node) {
                 if (arg == -1 && scopeDepth > 0) {
                     int thisArg = resolveLocal("this");
                     if (thisArg != -1) {
-                        Value nameVal = var->name;
-                        int idx = currentChunk().addConstant(nameVal);
+                        int idx = currentChunk().addConstant(Value(var->name));
+                        int slot = resolveGlobal(var->name);
 
                         compileExpr(assign.value.get());
 
@@ -113,6 +117,8 @@ void Compiler::compileStmt(ASTNode* node) {
                             emit(thisArg);
                             emit(OP_GET_PROPERTY_OR_GLOBAL);
                             emit(idx);
+                            emitShort(slot);
+                            emitPropertyCache();
 
                             switch (assign.op) {
                                 case TokenType::PLUS_EQUAL: emit(OP_PLUS_EQUAL); break;
@@ -131,6 +137,8 @@ void Compiler::compileStmt(ASTNode* node) {
                         emit(thisArg);
                         emit(OP_SET_PROPERTY_OR_LOCAL);
                         emit(idx);
+                        emitShort(slot);
+                        emitPropertyCache();
                         continue;
                     }
 
@@ -139,8 +147,11 @@ void Compiler::compileStmt(ASTNode* node) {
                     isNewLocal = true;
                 } else if (arg == -1 && scopeDepth == 0) {
                     isLocal = false;
-                    Value nameVal = var->name;
-                    arg = currentChunk().addConstant(nameVal);
+                    arg = resolveGlobal(var->name);
+                }
+
+                if (isLocal && !isNewLocal && emitLocalIncrement(arg, assign)) {
+                    continue;
                 }
 
                 if (assign.op != TokenType::EQUAL) {
@@ -149,21 +160,25 @@ void Compiler::compileStmt(ASTNode* node) {
                         emit(arg);
                     } else {
                         emit(OP_GET_GLOBAL);
-                        emit(arg);
+                        emitShort(arg);
                     }
                     compileExpr(assign.value.get());
 
+                    const char* op = nullptr;
                     switch (assign.op) {
-                        case TokenType::PLUS_EQUAL: emit(OP_PLUS_EQUAL); break;
-                        case TokenType::MINUS_EQUAL: emit(OP_MINUS_EQUAL); break;
-                        case TokenType::STAR_EQUAL: emit(OP_MULTIPLY_EQUAL); break;
-                        case TokenType::SLASH_EQUAL: emit(OP_DIVIDE_EQUAL); break;
-                        case TokenType::MOD_OP_EQUAL: emit(OP_MODULO_EQUAL); break;
-                        case TokenType::BITWISE_AND_EQUAL: emit(OP_BITWISE_AND_EQUAL); break;
-                        case TokenType::BITWISE_OR_EQUAL: emit(OP_BITWISE_OR_EQUAL); break;
-                        case TokenType::XOR_EQUAL: emit(OP_XOR_EQUAL); break;
+                        case TokenType::PLUS_EQUAL: op = "+="; break;
+                        case TokenType::MINUS_EQUAL: op = "-="; break;
+                        case TokenType::STAR_EQUAL: op = "*="; break;
+                        case TokenType::SLASH_EQUAL: op = "/="; break;
+                        case TokenType::MOD_OP_EQUAL: op = "%="; break;
+                        case TokenType::BITWISE_AND_EQUAL: op = "&="; break;
+                        case TokenType::BITWISE_OR_EQUAL: op = "|="; break;
+                        case TokenType::XOR_EQUAL: op = "^="; break;
                         default: break;
                     }
+                    if (op) {
+                        emitBinaryOp(op, typeOf(var), typeOf(assign.value.get()));
+                    }
                 } else {
                     compileExpr(assign.value.get());
                 }
@@ -171,12 +186,11 @@ void Compiler::compileStmt(ASTNode* node) {
                 if (isNewLocal) {
                     // No-op.
                 } else if (isLocal) {
-                    emit(OP_SET_LOCAL);
+                    emit(OP_SET_LOCAL_POP);
                     emit(arg);
-                    emit(OP_POP);
                 } else {
                     emit(OP_SET_GLOBAL);
-                    emit(arg);
+                    emitShort(arg);
                     emit(OP_POP);
                 }
             } else if (auto* idx = dynamic_cast<IndexExpr*>(assign.target.get())) {
@@ -187,7 +201,7 @@ void Compiler::compileStmt(ASTNode* node) {
             } else if (auto* mem = dynamic_cast<MemberExpr*>(assign.target.get())) {
                 compileExpr(mem->object.get());
                 compileExpr(assign.value.get());
-                int nameIdx = currentChunk().addConstant(mem->name);
+                int nameIdx = currentChunk().addConstant(Value(mem->name));
 
                 if (assign.op != TokenType::EQUAL) {
                     // No-op.
@@ -195,6 +209,7 @@ void Compiler::compileStmt(ASTNode* node) {
 
                 emit(OP_SET_PROPERTY);
                 emit(nameIdx);
+                emitPropertyCache();
             }
         }
     } else if (auto* block = dynamic_cast<Block*>(node)) {
@@ -222,7 +237,7 @@ void Compiler::compileStmt(ASTNode* node) {
         compileExpr(node);
         emit(OP_POP);
     } else if (auto* classStmt = dynamic_cast<ClassStmt*>(node)) {
-        int nameIdx = currentChunk().addConstant(classStmt->name);
+        int nameIdx = currentChunk().addConstant(Value(classStmt->name));
         emit(OP_CLASS);
         emit(nameIdx);
 
@@ -233,7 +248,7 @@ void Compiler::compileStmt(ASTNode* node) {
             arg = locals.size() - 1;
         } else if (arg == -1 && scopeDepth == 0) {
             isLocal = false;
-            arg = currentChunk().addConstant(classStmt->name);
+            arg = resolveGlobal(classStmt->name);
         }
 
         if (isLocal) {
@@ -241,7 +256,7 @@ void Compiler::compileStmt(ASTNode* node) {
             emit(arg);
         } else {
             emit(OP_SET_GLOBAL);
-            emit(arg);
+            emitShort(arg);
         }
 
         if (!classStmt->parentName.empty()) {
@@ -250,9 +265,8 @@ void Compiler::compileStmt(ASTNode* node) {
                 emit(OP_GET_LOCAL);
                 emit(parentArg);
             } else {
-                int parentIdx = currentChunk().addConstant(classStmt->parentName);
                 emit(OP_GET_GLOBAL);
-                emit(parentIdx);
+                emitShort(resolveGlobal(classStmt->parentName));
             }
             emit(OP_INHERIT);
         }
@@ -260,7 +274,7 @@ void Compiler::compileStmt(ASTNode* node) {
         for (const auto& section : classStmt->sections) {
             for (const auto& member : section->members) {
                 if (auto* field = dynamic_cast<FieldDecl*>(member.get())) {
-                    int fieldNameIdx = currentChunk().addConstant(field->name);
+                    int fieldNameIdx = currentChunk().addConstant(Value(field->name));
                     emit(OP_FIELD);
                     emit(fieldNameIdx);
                     emit(static_cast<uint8_t>(section->modifier));
@@ -270,11 +284,13 @@ void Compiler::compileStmt(ASTNode* node) {
                     auto* fnObj = new FunctionObject(method->name, method->params.size() + 1, true);
                     FunctionObject* enclosingFunction = currentFunction;
                     std::vector<Local> enclosingLocals = std::move(locals);
+                    auto enclosingLocalTypes = std::move(localTypes);
                     int enclosingScopeDepth = scopeDepth;
 
                     currentFunction = fnObj;
                     locals.clear();
                     scopeDepth = 0;
+                    inferLocalTypes(method->body->statements, method->params, true);
 
                     beginScope();
                     addLocal("this");
@@ -296,12 +312,13 @@ void Compiler::compileStmt(ASTNode* node) {
 
                     currentFunction = enclosingFunction;
                     locals = std::move(enclosingLocals);
+                    localTypes = std::move(enclosingLocalTypes);
                     scopeDepth = enclosingScopeDepth;
 
                     compiledFunctions.push_back(fnObj);
 
                     emitConstant(fnObj);
-                    int methodNameIdx = currentChunk().addConstant(method->name);
+                    int methodNameIdx = currentChunk().addConstant(Value(method->name));
                     emit(OP_METHOD);
                     emit(methodNameIdx);
                     emit(static_cast<uint8_t>(section->modifier));
@@ -0,0 +1,320 @@
+#include "vm/compiler.h"
+
+#include <functional>
+#include <unordered_set>
+
+namespace vm {
+
+// Static type inference for the specialized arithmetic opcodes. The rules
+// below mirror the generic operator semantics in utils/arith_utils.h: a type
+// is only reported when every value the expression can produce has it.
+
+using TypeLookup = std::function<StaticType(const std::string&)>;
+
+StaticType joinTypes(StaticType a, StaticType b) {
+    if (a == StaticType::NONE) return b;
+    if (b == StaticType::NONE || a == b) return a;
+    return StaticType::UNKNOWN;
+}
+
+static bool isNumeric(StaticType type) {
+    return type == StaticType::INT || type == StaticType::FLOAT;
+}
+
+// `x op= y` and `x op y` produce the same value.
+static std::string baseOperator(const std::string& op) {
+    if (op.size() >= 2 && op.back() == '=' && op != "==" && op != "!=" && op != "<=" && op != ">=") {
+        return op.substr(0, op.size() - 1);
+    }
+    return op;
+}
+
+StaticType binaryType(const std::string& rawOp, StaticType left, StaticType right) {
+    const std::string op = baseOperator(rawOp);
+    if (op == "<" || op == "<=" || op == ">" || op == ">=" || op == "==" || op == "!=") {
+        return StaticType::BOOL;
+    }
+    if (op == "/") return StaticType::FLOAT;
+    if (op == "%") return StaticType::INT;
+    if (op == "&&" || op == "||") return joinTypes(left, right);
+
+    if (op == "+" && (left == StaticType::STRING || right == StaticType::STRING)) {
+        return StaticType::STRING;
+    }
+    if (left == StaticType::UNKNOWN || right == StaticType::UNKNOWN) return StaticType::UNKNOWN;
+    if (left == StaticType::NONE || right == StaticType::NONE) return StaticType::NONE;
+    if (left == StaticType::INT && right == StaticType::INT) return StaticType::INT;
+
+    // The generic operators turn every other non-string pair into a double.
+    if (op == "+" || op == "-" || op == "*" || op == "&" || op == "|" || op == "^" ||
+        op == "<<" || op == ">>") {
+        return StaticType::FLOAT;
+    }
+    return StaticType::UNKNOWN;
+}
+
+StaticType castType(StaticType arg, StaticType result) {
+    if (arg == StaticType::NONE) return StaticType::NONE;
+    if (isNumeric(arg) || arg == StaticType::BOOL || arg == StaticType::STRING) return result;
+    return StaticType::UNKNOWN;
+}
+
+static StaticType exprType(Expr* expr, const TypeLookup& variable, const TypeLookup& call) {
+    if (auto* num = dynamic_cast<NumberExpr*>(expr)) {
+        Value value;
+        if (!Compiler::parseNumber(num->value, value)) return StaticType::UNKNOWN;
+        return value.isInt() ? StaticType::INT : StaticType::FLOAT;
+    }
+    if (dynamic_cast<BoolExpr*>(expr)) {
+        return StaticType::BOOL;
+    }
+    if (auto* str = dynamic_cast<StringExpr*>(expr)) {
+        // "{x}" alone compiles to just x.
+        return str->value.find('{') == std::string::npos ? StaticType::STRING : StaticType::UNKNOWN;
+    }
+    if (auto* var = dynamic_cast<VarExpr*>(expr)) {
+        return variable(var->name);
+    }
+    if (auto* bin = dynamic_cast<BinaryExpr*>(expr)) {
+        return binaryType(bin->op, exprType(bin->left.get(), variable, call),
+                          exprType(bin->right.get(), variable, call));
+    }
+    if (auto* unary = dynamic_cast<UnaryExpr*>(expr)) {
+        // OP_NEGATE always yields a float, OP_NOT a bool.
+        return unary->op == "-" ? StaticType::FLOAT : StaticType::BOOL;
+    }
+    if (auto* callExpr = dynamic_cast<CallExpr*>(expr)) {
+        auto* callee = dynamic_cast<VarExpr*>(callExpr->callee.get());
+        if (!callee) return StaticType::UNKNOWN;
+        const std::string& name = callee->name;
+        if (name == "fixed" || name == "push" || name == "readline" || name == "char") {
+            return StaticType::UNKNOWN;
+        }
+        if (name == "length") return StaticType::FLOAT;
+        if (name == "type") return StaticType::STRING;
+        if (name == "int" || name == "float" || name == "string" || name == "bool") {
+            if (callExpr->arguments.size() != 1) return StaticType::UNKNOWN;
+            if (name == "string") return StaticType::STRING;
+            StaticType arg = exprType(callExpr->arguments[0].get(), variable, call);
+            if (name == "int") return castType(arg, StaticType::INT);
+            if (name == "float") return castType(arg, StaticType::FLOAT);
+            return castType(arg, StaticType::BOOL);
+        }
+        return call(name);
+    }
+    return StaticType::UNKNOWN;
+}
+
+std::string Compiler::compoundOperator(TokenType op) {
+    switch (op) {
+        case TokenType::PLUS_EQUAL: return "+";
+        case TokenType::MINUS_EQUAL: return "-";
+        case TokenType::STAR_EQUAL: return "*";
+        case TokenType::SLASH_EQUAL: return "/";
+        case TokenType::MOD_OP_EQUAL: return "%";
+        case TokenType::BITWISE_AND_EQUAL: return "&";
+        case TokenType::BITWISE_OR_EQUAL: return "|";
+        case TokenType::XOR_EQUAL: return "^";
+        default: return "";
+    }
+}
+
+namespace {
+
+// Walks a function body in source order with the compiler's scoping rules
+// (an assignment to an undeclared name declares a local, unless a method's
+// `this` turns it into a property store) and joins the type of every value
+// assigned to each local name. Re-run until nothing changes, since a
+// later assignment can widen a type an earlier one depended on.
+class LocalTypeInference {
+public:
+    LocalTypeInference(std::unordered_map<std::string, StaticType>& types, bool hasThis,
+                       const TypeLookup& returnType)
+        : types(types), hasThis(hasThis), returnType(returnType) {}
+
+    bool changed = false;
+
+    void walkBody(const std::vector<std::unique_ptr<Stmt>>& body, const std::vector<std::string>& params) {
+        scopes.assign(1, {});
+        for (const auto& param : params) scopes.back().insert(param);
+        for (const auto& stmt : body) walk(stmt.get());
+    }
+
+private:
+    std::unordered_map<std::string, StaticType>& types;
+    bool hasThis;
+    const TypeLookup& returnType;
+    std::vector<std::unordered_set<std::string>> scopes;
+
+    bool declared(const std::string& name) const {
+        for (const auto& scope : scopes) {
+            if (scope.count(name)) return true;
+        }
+        return false;
+    }
+
+    StaticType typeOf(Expr* expr) {
+        return exprType(expr,
+            [this](const std::string& name) {
+                return declared(name) ? types[name] : StaticType::UNKNOWN;
+            },
+            [this](const std::string& name) {
+                return declared(name) || hasThis ? StaticType::UNKNOWN : returnType(name);
+            });
+    }
+
+    void assign(const std::string& name, StaticType type) {
+        StaticType joined = joinTypes(types[name], type);
+        if (joined != types[name]) {
+            types[name] = joined;
+            changed = true;
+        }
+    }
+
+    void walkAssignments(const AssignmentStmt* stmt) {
+        for (const auto& a : stmt->assignments) {
+            auto* var = dynamic_cast<VarExpr*>(a.target.get());
+            if (!var) continue;
+
+            bool isDeclared = declared(var->name);
+            if (!isDeclared && hasThis) continue;  // property store
+
+            StaticType type;
+            if (a.op == TokenType::EQUAL) {
+                type = typeOf(a.value.get());
+            } else if (!isDeclared) {
+                type = StaticType::UNKNOWN;  // compound assignment to a fresh slot
+            } else {
+                type = binaryType(Compiler::compoundOperator(a.op), types[var->name], typeOf(a.value.get()));
+            }
+
+            if (!isDeclared) scopes.back().insert(var->name);
+            assign(var->name, type);
+        }
+    }
+
+    void walk(ASTNode* node) {
+        if (auto* assignStmt = dynamic_cast<AssignmentStmt*>(node)) {
+            walkAssignments(assignStmt);
+        } else if (auto* block = dynamic_cast<Block*>(node)) {
+            scopes.emplace_back();
+            for (const auto& stmt : block->statements) walk(stmt.get());
+            scopes.pop_back();
+        } else if (auto* forStmt = dynamic_cast<ForStmt*>(node)) {
+            scopes.emplace_back();
+            if (forStmt->init) walkAssignments(forStmt->init.get());
+            walk(forStmt->body.get());
+            if (forStmt->increment) walkAssignments(forStmt->increment.get());
+            scopes.pop_back();
+        } else if (auto* whileStmt = dynamic_cast<WhileStmt*>(node)) {
+            walk(whileStmt->body.get());
+        } else if (auto* ifStmt = dynamic_cast<IfStmt*>(node)) {
+            walk(ifStmt->thenBranch.get());
+            if (ifStmt->elseBranch) walk(ifStmt->elseBranch.get());
+        } else if (auto* classStmt = dynamic_cast<ClassStmt*>(node)) {
+            if (!declared(classStmt->name)) scopes.back().insert(classStmt->name);
+            assign(classStmt->name, StaticType::UNKNOWN);
+        }
+    }
+};
+
+}  // namespace
+
+void Compiler::inferLocalTypes(const std::vector<std::unique_ptr<Stmt>>& body,
+                               const std::vector<Param>& params, bool hasThis) {
+    localTypes.clear();
+    std::vector<std::string> paramNames;
+    for (const auto& param : params) {
+        paramNames.push_back(param.name);
+        localTypes[param.name] = StaticType::UNKNOWN;
+    }
+    if (hasThis) {
+        paramNames.push_back("this");
+        localTypes["this"] = StaticType::UNKNOWN;
+    }
+
+    TypeLookup returnType = [this](const std::string& name) { return callReturnType(name); };
+    LocalTypeInference inference(localTypes, hasThis, returnType);
+    do {
+        inference.changed = false;
+        inference.walkBody(body, paramNames);
+    } while (inference.changed);
+
+    for (auto& entry : localTypes) {
+        if (entry.second == StaticType::NONE) entry.second = StaticType::UNKNOWN;
+    }
+}
+
+StaticType Compiler::callReturnType(const std::string& name) {
+    auto it = returnTypes.find(name);
+    return it == returnTypes.end() ? StaticType::UNKNOWN : it->second;
+}
+
+StaticType Compiler::typeOf(Expr* expr) {
+    return exprType(expr,
+        [this](const std::string& name) {
+            if (resolveLocal(name) == -1) return StaticType::UNKNOWN;
+            auto it = localTypes.find(name);
+            return it == localTypes.end() ? StaticType::UNKNOWN : it->second;
+        },
+        [this](const std::string& name) {
+            if (resolveLocal(name) != -1 || resolveLocal("this") != -1) return StaticType::UNKNOWN;
+            return callReturnType(name);
+        });
+}
+
+void Compiler::emitBinaryOp(const std::string& op, StaticType left, StaticType right) {
+    const std::string base = baseOperator(op);
+    if (left == StaticType::INT && right == StaticType::INT) {
+        if (base == "+") return emit(OP_ADD_INT);
+        if (base == "-") return emit(OP_SUB_INT);
+        if (base == "*") return emit(OP_MUL_INT);
+        if (base == "%") return emit(OP_MOD_INT);
+        if (base == "&") return emit(OP_BITAND_INT);
+        if (base == "|") return emit(OP_BITOR_INT);
+        if (base == "^") return emit(OP_XOR_INT);
+        if (base == "<<") return emit(OP_SHL_INT);
+        if (base == ">>") return emit(OP_SHR_INT);
+        if (base == "<") return emit(OP_LT_INT);
+        if (base == "<=") return emit(OP_LE_INT);
+        if (base == ">") return emit(OP_GT_INT);
+        if (base == ">=") return emit(OP_GE_INT);
+        if (base == "==") return emit(OP_EQ_INT);
+        if (base == "!=") return emit(OP_NE_INT);
+    }
+    if (left == StaticType::FLOAT && right == StaticType::FLOAT) {
+        if (base == "+") return emit(OP_ADD_F64);
+        if (base == "-") return emit(OP_SUB_F64);
+        if (base == "*") return emit(OP_MUL_F64);
+        if (base == "/") return emit(OP_DIV_F64);
+    }
+
+    if (op == "+") emit(OP_ADD);
+    else if (op == "-") emit(OP_SUB);
+    else if (op == "*") emit(OP_MUL);
+    else if (op == "/") emit(OP_DIV);
+    else if (op == "%") emit(OP_MOD);
+    else if (op == ">") emit(OP_GREATER);
+    else if (op == ">=") emit(OP_GREATER_EQUAL);
+    else if (op == "<") emit(OP_LESSER);
+    else if (op == "<=") emit(OP_LESSER_EQUAL);
+    else if (op == ">>") emit(OP_RIGHT_SHIFT);
+    else if (op == "<<") emit(OP_LEFT_SHIFT);
+    else if (op == "|") emit(OP_BITWISE_OR);
+    else if (op == "&") emit(OP_BITWISE_AND);
+    else if (op == "==") emit(OP_EQUAL);
+    else if (op == "!=") emit(OP_NOT_EQUAL);
+    else if (op == "^") emit(OP_XOR);
+    else if (op == "+=") emit(OP_PLUS_EQUAL);
+    else if (op == "-=") emit(OP_MINUS_EQUAL);
+    else if (op == "*=") emit(OP_MULTIPLY_EQUAL);
+    else if (op == "/=") emit(OP_DIVIDE_EQUAL);
+    else if (op == "%=") emit(OP_MODULO_EQUAL);
+    else if (op == "<<=") emit(OP_LEFT_SHIFT_EQUAL);
+    else if (op == ">>=") emit(OP_RIGHT_SHIFT_EQUAL);
+    else if (op == "&=") emit(OP_BITWISE_AND_EQUAL);
+    else if (op == "|=") emit(OP_BITWISE_OR_EQUAL);
+    else if (op == "^=") emit(OP_XOR_EQUAL);
+}
+
+}  // namespace vm
@@ -0,0 +1,279 @@
+#include "vm/disassembler.h"
+
+#include "vm/utils/value_utils.h"
+
+#include <iomanip>
+
+namespace vm {
+
+const char* opcodeName(uint8_t op) {
+    switch (op) {
+#define OPCODE_NAME(op) case op: return #op;
+        OPCODE_NAME(OP_CONSTANT)
+        OPCODE_NAME(OP_GET_GLOBAL)
+        OPCODE_NAME(OP_SET_GLOBAL)
+        OPCODE_NAME(OP_GET_LOCAL)
+        OPCODE_NAME(OP_SET_LOCAL)
+        OPCODE_NAME(OP_POP)
+        OPCODE_NAME(OP_ADD)
+        OPCODE_NAME(OP_SUB)
+        OPCODE_NAME(OP_MUL)
+        OPCODE_NAME(OP_DIV)
+        OPCODE_NAME(OP_MOD)
+        OPCODE_NAME(OP_GREATER)
+        OPCODE_NAME(OP_LESSER)
+        OPCODE_NAME(OP_GREATER_EQUAL)
+        OPCODE_NAME(OP_LESSER_EQUAL)
+        OPCODE_NAME(OP_NOT)
+        OPCODE_NAME(OP_PRINT)
+        OPCODE_NAME(OP_HALT)
+        OPCODE_NAME(OP_NOT_EQUAL)
+        OPCODE_NAME(OP_TRUE)
+        OPCODE_NAME(OP_FALSE)
+        OPCODE_NAME(OP_NULL)
+        OPCODE_NAME(OP_LEFT_SHIFT)
+        OPCODE_NAME(OP_RIGHT_SHIFT)
+        OPCODE_NAME(OP_BITWISE_AND)
+        OPCODE_NAME(OP_BITWISE_OR)
+        OPCODE_NAME(OP_XOR)
+        OPCODE_NAME(OP_LOGICAL_AND)
+        OPCODE_NAME(OP_LOGICAL_OR)
+        OPCODE_NAME(OP_EQUAL)
+        OPCODE_NAME(OP_PLUS_EQUAL)
+        OPCODE_NAME(OP_MINUS_EQUAL)
+        OPCODE_NAME(OP_MULTIPLY_EQUAL)
+        OPCODE_NAME(OP_DIVIDE_EQUAL)
+        OPCODE_NAME(OP_MODULO_EQUAL)
+        OPCODE_NAME(OP_LEFT_SHIFT_EQUAL)
+        OPCODE_NAME(OP_RIGHT_SHIFT_EQUAL)
+        OPCODE_NAME(OP_BITWISE_AND_EQUAL)
+        OPCODE_NAME(OP_BITWISE_OR_EQUAL)
+        OPCODE_NAME(OP_LOGICAL_AND_EQUAL)
+        OPCODE_NAME(OP_LOGICAL_OR_EQUAL)
+        OPCODE_NAME(OP_XOR_EQUAL)
+        OPCODE_NAME(OP_NEGATE)
+        OPCODE_NAME(OP_JUMP)
+        OPCODE_NAME(OP_JUMP_IF_FALSE)
+        OPCODE_NAME(OP_LOOP)
+        OPCODE_NAME(OP_JUMP_IF_TRUE)
+        OPCODE_NAME(OP_RETURN)
+        OPCODE_NAME(OP_CALL)
+        OPCODE_NAME(OP_NEW_ARRAY)
+        OPCODE_NAME(OP_INDEX_GET)
+        OPCODE_NAME(OP_INDEX_SET)
+        OPCODE_NAME(OP_FIXED_ARRAY)
+        OPCODE_NAME(OP_ARRAY_PUSH)
+        OPCODE_NAME(OP_ARRAY_LENGTH)
+        OPCODE_NAME(OP_PRINTLN)
+        OPCODE_NAME(OP_CLASS)
+        OPCODE_NAME(OP_METHOD)
+        OPCODE_NAME(OP_GET_PROPERTY)
+        OPCODE_NAME(OP_SET_PROPERTY)
+        OPCODE_NAME(OP_GET_PROPERTY_OR_GLOBAL)
+        OPCODE_NAME(OP_SET_PROPERTY_OR_LOCAL)
+        OPCODE_NAME(OP_INHERIT)
+        OPCODE_NAME(OP_CAST_INT)
+        OPCODE_NAME(OP_CAST_FLOAT)
+        OPCODE_NAME(OP_CAST_STRING)
+        OPCODE_NAME(OP_CAST_BOOL)
+        OPCODE_NAME(OP_CAST_CHAR)
+        OPCODE_NAME(OP_TYPEOF)
+        OPCODE_NAME(OP_READLINE)
+        OPCODE_NAME(OP_FIELD)
+        OPCODE_NAME(OP_SET_LOCAL_POP)
+        OPCODE_NAME(OP_INC_LOCAL_CONST)
+        OPCODE_NAME(OP_JUMP_IF_NOT_LT_LOCAL)
+        OPCODE_NAME(OP_JUMP_IF_NOT_LT_CONST)
+        OPCODE_NAME(OP_INVOKE)
+        OPCODE_NAME(OP_TAIL_INVOKE)
+        OPCODE_NAME(OP_TAIL_CALL)
+        OPCODE_NAME(OP_CALL_DIRECT)
+        OPCODE_NAME(OP_ADD_INT)
+        OPCODE_NAME(OP_SUB_INT)
+        OPCODE_NAME(OP_MUL_INT)
+        OPCODE_NAME(OP_MOD_INT)
+        OPCODE_NAME(OP_BITAND_INT)
+        OPCODE_NAME(OP_BITOR_INT)
+        OPCODE_NAME(OP_XOR_INT)
+        OPCODE_NAME(OP_SHL_INT)
+        OPCODE_NAME(OP_SHR_INT)
+        OPCODE_NAME(OP_LT_INT)
+        OPCODE_NAME(OP_LE_INT)
+        OPCODE_NAME(OP_GT_INT)
+        OPCODE_NAME(OP_GE_INT)
+        OPCODE_NAME(OP_EQ_INT)
+        OPCODE_NAME(OP_NE_INT)
+        OPCODE_NAME(OP_ADD_F64)
+        OPCODE_NAME(OP_SUB_F64)
+        OPCODE_NAME(OP_MUL_F64)
+        OPCODE_NAME(OP_DIV_F64)
+        OPCODE_NAME(OP_ADD_INT_GUARDED)
+        OPCODE_NAME(OP_SUB_INT_GUARDED)
+        OPCODE_NAME(OP_MUL_INT_GUARDED)
+        OPCODE_NAME(OP_LT_INT_GUARDED)
+        OPCODE_NAME(OP_LE_INT_GUARDED)
+        OPCODE_NAME(OP_GT_INT_GUARDED)
+        OPCODE_NAME(OP_GE_INT_GUARDED)
+        OPCODE_NAME(OP_EQ_INT_GUARDED)
+        OPCODE_NAME(OP_NE_INT_GUARDED)
+        OPCODE_NAME(OP_ADD_F64_GUARDED)
+        OPCODE_NAME(OP_SUB_F64_GUARDED)
+        OPCODE_NAME(OP_MUL_F64_GUARDED)
+        OPCODE_NAME(OP_DIV_F64_GUARDED)
+#undef OPCODE_NAME
+        default:
+            return "OP_UNKNOWN";
+    }
+}
+
+int instructionLength(uint8_t op) {
+    switch (op) {
+        case OP_CONSTANT:
+        case OP_GET_LOCAL:
+        case OP_SET_LOCAL:
+        case OP_SET_LOCAL_POP:
+        case OP_CALL:
+        case OP_TAIL_CALL:
+        case OP_NEW_ARRAY:
+        case OP_FIXED_ARRAY:
+        case OP_CLASS:
+            return 2;
+
+        case OP_GET_GLOBAL:
+        case OP_SET_GLOBAL:
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_TRUE:
+        case OP_LOOP:
+        case OP_METHOD:
+        case OP_FIELD:
+        case OP_INC_LOCAL_CONST:
+        case OP_CALL_DIRECT:
+            return 3;
+
+        case OP_GET_PROPERTY:
+        case OP_SET_PROPERTY:
+            return 4;
+
+        case OP_JUMP_IF_NOT_LT_LOCAL:
+        case OP_JUMP_IF_NOT_LT_CONST:
+        case OP_INVOKE:
+        case OP_TAIL_INVOKE:
+            return 5;
+
+        case OP_GET_PROPERTY_OR_GLOBAL:
+        case OP_SET_PROPERTY_OR_LOCAL:
+            return 6;
+
+        default:
+            return 1;
+    }
+}
+
+static uint16_t readShortAt(const Chunk& chunk, int offset) {
+    return static_cast<uint16_t>((chunk.code[offset] << 8) | chunk.code[offset + 1]);
+}
+
+int disassembleInstruction(const Chunk& chunk, int offset, std::ostream& out) {
+    uint8_t op = chunk.code[offset];
+    int length = instructionLength(op);
+    int next = offset + length;
+
+    out << std::setw(5) << std::setfill('0') << offset << std::setfill(' ') << "  "
+        << std::left << std::setw(26) << opcodeName(op) << std::right;
+
+    if (next > static_cast<int>(chunk.code.size())) {
+        out << "<truncated>\n";
+        return static_cast<int>(chunk.code.size());
+    }
+
+    switch (op) {
+        case OP_CONSTANT:
+        case OP_CLASS: {
+            uint8_t idx = chunk.code[offset + 1];
+            out << static_cast<int>(idx) << " '" << valueToString(chunk.constants[idx]) << "'";
+            break;
+        }
+        case OP_GET_PROPERTY:
+        case OP_SET_PROPERTY: {
+            uint8_t idx = chunk.code[offset + 1];
+            out << static_cast<int>(idx) << " '" << valueToString(chunk.constants[idx]) << "' cache "
+                << readShortAt(chunk, offset + 2);
+            break;
+        }
+        case OP_GET_GLOBAL:
+        case OP_SET_GLOBAL:
+            out << "slot " << readShortAt(chunk, offset + 1);
+            break;
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_TRUE:
+            out << "-> " << next + readShortAt(chunk, offset + 1);
+            break;
+        case OP_LOOP:
+            out << "-> " << next - readShortAt(chunk, offset + 1);
+            break;
+        case OP_METHOD:
+        case OP_FIELD: {
+            uint8_t idx = chunk.code[offset + 1];
+            out << "'" << valueToString(chunk.constants[idx]) << "' access "
+                << static_cast<int>(chunk.code[offset + 2]);
+            break;
+        }
+        case OP_GET_PROPERTY_OR_GLOBAL:
+        case OP_SET_PROPERTY_OR_LOCAL: {
+            uint8_t idx = chunk.code[offset + 1];
+            out << "'" << valueToString(chunk.constants[idx]) << "' slot "
+                << readShortAt(chunk, offset + 2) << " cache " << readShortAt(chunk, offset + 4);
+            break;
+        }
+        case OP_INC_LOCAL_CONST: {
+            uint8_t idx = chunk.code[offset + 2];
+            out << "local " << static_cast<int>(chunk.code[offset + 1])
+                << " += " << valueToString(chunk.constants[idx]);
+            break;
+        }
+        case OP_JUMP_IF_NOT_LT_LOCAL:
+            out << "local " << static_cast<int>(chunk.code[offset + 1])
+                << " < local " << static_cast<int>(chunk.code[offset + 2])
+                << " else -> " << next + readShortAt(chunk, offset + 3);
+            break;
+        case OP_INVOKE:
+        case OP_TAIL_INVOKE: {
+            uint8_t idx = chunk.code[offset + 1];
+            out << "'" << valueToString(chunk.constants[idx]) << "' argc "
+                << static_cast<int>(chunk.code[offset + 2]) << " cache " << readShortAt(chunk, offset + 3);
+            break;
+        }
+        case OP_CALL_DIRECT: {
+            uint8_t idx = chunk.code[offset + 1];
+            out << "'" << chunk.constants[idx].as.function->name << "' argc " << static_cast<int>(chunk.code[offset + 2]);
+            break;
+        }
+        case OP_JUMP_IF_NOT_LT_CONST: {
+            uint8_t idx = chunk.code[offset + 2];
+            out << "local " << static_cast<int>(chunk.code[offset + 1])
+                << " < " << valueToString(chunk.constants[idx])
+                << " else -> " << next + readShortAt(chunk, offset + 3);
+            break;
+        }
+        default:
+            if (length == 2) {
+                out << static_cast<int>(chunk.code[offset + 1]);
+            }
+            break;
+    }
+
+    out << "\n";
+    return next;
+}
+
+void disassembleChunk(const Chunk& chunk, const std::string& name, std::ostream& out) {
+    out << "== " << name << " ==\n";
+    int offset = 0;
+    while (offset < static_cast<int>(chunk.code.size())) {
+        offset = disassembleInstruction(chunk, offset, out);
+    }
+}
+
+}  // namespace vm
@@ -0,0 +1,654 @@
+#include "vm/ir.h"
+
+#include "lexer/lexer.h"
+#include "parser/parser.h"
+#include "vm/compiler.h"
+#include "vm/opcode.h"
+
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_map>
+
+namespace vm {
+
+IRBlock* IRFunction::newBlock() {
+    blocks.push_back(std::make_unique<IRBlock>());
+    blocks.back()->id = static_cast<int>(blocks.size()) - 1;
+    return blocks.back().get();
+}
+
+IRValue* IRFunction::newValue(IRKind kind, IRBlock* block) {
+    values.push_back(std::make_unique<IRValue>());
+    IRValue* value = values.back().get();
+    value->kind = kind;
+    value->id = static_cast<int>(values.size()) - 1;
+    value->block = block;
+    if (block) {
+        (kind == IRKind::PHI ? block->phis : block->values).push_back(value);
+    }
+    return value;
+}
+
+IRValue* resolveValue(IRValue* value) {
+    while (value && value->replacement) value = value->replacement;
+    return value;
+}
+
+// SSA construction follows Braun et al., "Simple and Efficient Construction
+// of Static Single Assignment Form": each block maps the variables assigned
+// in it to their current value, a read in a block without a definition asks
+// its predecessors, and blocks whose predecessors are not all known yet (loop
+// headers) get placeholder phis that are completed once the block is sealed.
+
+namespace {
+
+// Thrown for constructs outside the IR's subset.
+struct Unsupported : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+bool mentions(Expr* expr, const std::string& name) {
+    if (!expr) return false;
+    if (auto* var = dynamic_cast<VarExpr*>(expr)) return var->name == name;
+    if (auto* str = dynamic_cast<StringExpr*>(expr)) {
+        return str->value.find('{') != std::string::npos && str->value.find(name) != std::string::npos;
+    }
+    if (auto* bin = dynamic_cast<BinaryExpr*>(expr)) {
+        return mentions(bin->left.get(), name) || mentions(bin->right.get(), name);
+    }
+    if (auto* unary = dynamic_cast<UnaryExpr*>(expr)) return mentions(unary->right.get(), name);
+    if (auto* index = dynamic_cast<IndexExpr*>(expr)) {
+        return mentions(index->array.get(), name) || mentions(index->index.get(), name);
+    }
+    if (auto* mem = dynamic_cast<MemberExpr*>(expr)) return mentions(mem->object.get(), name);
+    if (auto* arr = dynamic_cast<ArrayExpr*>(expr)) {
+        for (const auto& el : arr->elements) {
+            if (mentions(el.get(), name)) return true;
+        }
+        return false;
+    }
+    if (auto* call = dynamic_cast<CallExpr*>(expr)) {
+        if (mentions(call->callee.get(), name)) return true;
+        for (const auto& arg : call->arguments) {
+            if (mentions(arg.get(), name)) return true;
+        }
+        return false;
+    }
+    return false;
+}
+
+bool isBinaryOperator(const std::string& op) {
+    static const char* const ops[] = {"+", "-", "*", "/", "%", "<", "<=", ">", ">=",
+                                      "==", "!=", "&", "|", "^", "<<", ">>"};
+    for (const char* candidate : ops) {
+        if (op == candidate) return true;
+    }
+    return false;
+}
+
+class IRBuilder {
+public:
+    IRBuilder(IRFunction& function, const IRContext& context) : fn(function), context(context) {}
+
+    void build(const std::vector<std::unique_ptr<Stmt>>& body, const std::vector<Param>& params,
+               bool isScript) {
+        fn.entry = newBlock();
+        seal(fn.entry);
+        current = fn.entry;
+
+        beginScope();
+        for (size_t i = 0; i < params.size(); ++i) {
+            if (params[i].isRef) throw Unsupported("reference parameters");
+            IRValue* param = fn.newValue(IRKind::PARAM);
+            param->slot = static_cast<int>(i) + 1;
+            param->type = StaticType::UNKNOWN;
+            write(declare(params[i].name), current, param);
+        }
+        if (params.size() > 255) throw Unsupported("too many parameters");
+
+        for (const auto& stmt : body) {
+            statement(stmt.get());
+        }
+        if (current->terminator == IRTerminator::NONE) {
+            if (isScript) {
+                current->terminator = IRTerminator::HALT;
+            } else {
+                current->terminator = IRTerminator::RETURN;
+                current->value = constant(Value());
+            }
+        }
+    }
+
+private:
+    struct Variable {
+        std::string name;
+        int depth;
+        int id;
+    };
+
+    struct Loop {
+        IRBlock* breakTarget;
+        IRBlock* continueTarget;
+    };
+
+    IRFunction& fn;
+    const IRContext& context;
+    IRBlock* current = nullptr;
+
+    std::vector<Variable> scope;
+    int depth = 0;
+    int variableCount = 0;
+    std::vector<Loop> loops;
+
+    std::vector<std::unordered_map<int, IRValue*>> definitions;  // by block id
+    std::vector<bool> sealed;                                      // by block id
+    std::vector<std::vector<std::pair<int, IRValue*>>> incomplete; // by block id
+
+    std::map<std::tuple<int, int64_t, std::string>, IRValue*> constants;
+
+    // ---- blocks and variables ----
+
+    IRBlock* newBlock() {
+        IRBlock* block = fn.newBlock();
+        definitions.emplace_back();
+        sealed.push_back(false);
+        incomplete.emplace_back();
+        return block;
+    }
+
+    void seal(IRBlock* block) {
+        for (auto& [variable, phi] : incomplete[block->id]) {
+            addPhiOperands(variable, phi);
+        }
+        incomplete[block->id].clear();
+        sealed[block->id] = true;
+    }
+
+    void beginScope() {
+        ++depth;
+    }
+
+    void endScope() {
+        --depth;
+        while (!scope.empty() && scope.back().depth > depth) {
+            scope.pop_back();
+        }
+    }
+
+    int declare(const std::string& name) {
+        scope.push_back({name, depth, variableCount});
+        return variableCount++;
+    }
+
+    int resolve(const std::string& name) const {
+        for (auto it = scope.rbegin(); it != scope.rend(); ++it) {
+            if (it->name == name) return it->id;
+        }
+        return -1;
+    }
+
+    void write(int variable, IRBlock* block, IRValue* value) {
+        definitions[block->id][variable] = value;
+    }
+
+    IRValue* read(int variable, IRBlock* block) {
+        auto it = definitions[block->id].find(variable);
+        if (it != definitions[block->id].end()) {
+            return resolveValue(it->second);
+        }
+
+        IRValue* value;
+        if (!sealed[block->id]) {
+            value = fn.newValue(IRKind::PHI, block);
+            incomplete[block->id].push_back({variable, value});
+        } else if (block->preds.size() == 1) {
+            value = read(variable, block->preds[0]);
+        } else if (block->preds.empty()) {
+            value = constant(Value());  // unreachable code
+        } else {
+            IRValue* phi = fn.newValue(IRKind::PHI, block);
+            write(variable, block, phi);
+            value = addPhiOperands(variable, phi);
+        }
+        write(variable, block, value);
+        return value;
+    }
+
+    IRValue* addPhiOperands(int variable, IRValue* phi) {
+        for (IRBlock* pred : phi->block->preds) {
+            phi->operands.push_back(read(variable, pred));
+        }
+        return removeTrivialPhi(phi);
+    }
+
+    // A phi whose operands are all one value (or itself) is that value.
+    // Phis that used it are cleaned up by optimizeIR().
+    IRValue* removeTrivialPhi(IRValue* phi) {
+        IRValue* same = nullptr;
+        for (IRValue* operand : phi->operands) {
+            operand = resolveValue(operand);
+            if (operand == same || operand == phi) continue;
+            if (same) return phi;
+            same = operand;
+        }
+        if (!same) same = constant(Value());
+
+        auto& phis = phi->block->phis;
+        phis.erase(std::find(phis.begin(), phis.end(), phi));
+        phi->replacement = same;
+        return same;
+    }
+
+    // ---- terminators ----
+
+    void jump(IRBlock* target) {
+        current->terminator = IRTerminator::JUMP;
+        current->succs[0] = target;
+        target->preds.push_back(current);
+    }
+
+    void branch(IRValue* condition, IRBlock* ifTrue, IRBlock* ifFalse) {
+        current->terminator = IRTerminator::BRANCH;
+        current->value = condition;
+        current->succs[0] = ifTrue;
+        current->succs[1] = ifFalse;
+        ifTrue->preds.push_back(current);
+        ifFalse->preds.push_back(current);
+    }
+
+    // Code after return/break/continue still gets compiled, into a block
+    // nothing jumps to.
+    void startUnreachable() {
+        current = newBlock();
+        seal(current);
+    }
+
+    // ---- values ----
+
+    IRValue* constant(const Value& value) {
+        int64_t bits = value.as.integer;
+        if (value.isFloat()) std::memcpy(&bits, &value.as.number, sizeof(bits));
+        if (value.isBool()) bits = value.as.boolean;
+        auto key = std::make_tuple(static_cast<int>(value.type), bits, std::string());
+        IRValue*& slot = constants[key];
+        if (!slot) {
+            slot = fn.newValue(IRKind::CONST);
+            slot->constant = value;
+            slot->type = value.isInt()     ? StaticType::INT
+                         : value.isFloat() ? StaticType::FLOAT
+                         : value.isBool()  ? StaticType::BOOL
+                                           : StaticType::UNKNOWN;
+        }
+        return slot;
+    }
+
+    IRValue* stringConstant(const std::string& text) {
+        auto key = std::make_tuple(static_cast<int>(ValueType::STRING), int64_t{0}, text);
+        IRValue*& slot = constants[key];
+        if (!slot) {
+            slot = fn.newValue(IRKind::CONST);
+            slot->isString = true;
+            slot->text = text;
+            slot->type = StaticType::STRING;
+        }
+        return slot;
+    }
+
+    IRValue* binary(const std::string& op, IRValue* left, IRValue* right) {
+        IRValue* value = fn.newValue(IRKind::BINARY, current);
+        value->op = op;
+        value->operands = {left, right};
+        return value;
+    }
+
+    IRValue* vmOp(uint8_t opcode, std::vector<IRValue*> operands, bool pushesResult = true) {
+        IRValue* value = fn.newValue(IRKind::VM, current);
+        value->opcode = opcode;
+        value->operands = std::move(operands);
+        value->pushesResult = pushesResult;
+        value->type = StaticType::UNKNOWN;
+        return value;
+    }
+
+    std::vector<IRValue*> arguments(CallExpr* call) {
+        std::vector<IRValue*> values;
+        for (const auto& arg : call->arguments) {
+            values.push_back(expression(arg.get()));
+        }
+        return values;
+    }
+
+    IRValue* expression(Expr* expr) {
+        if (auto* num = dynamic_cast<NumberExpr*>(expr)) {
+            Value value;
+            if (!Compiler::parseNumber(num->value, value)) throw Unsupported("malformed number");
+            return constant(value);
+        }
+        if (auto* b = dynamic_cast<BoolExpr*>(expr)) {
+            return constant(Value(b->value));
+        }
+        if (auto* s = dynamic_cast<StringExpr*>(expr)) {
+            return string(s->value);
+        }
+        if (auto* var = dynamic_cast<VarExpr*>(expr)) {
+            int variable = resolve(var->name);
+            if (variable != -1) return read(variable, current);
+            IRValue* value = vmOp(OP_GET_GLOBAL, {});
+            int slot = context.globalSlot(var->name);
+            value->immediates = {static_cast<uint8_t>((slot >> 8) & 0xff), static_cast<uint8_t>(slot & 0xff)};
+            return value;
+        }
+        if (auto* call = dynamic_cast<CallExpr*>(expr)) {
+            return callExpression(call);
+        }
+        if (auto* arr = dynamic_cast<ArrayExpr*>(expr)) {
+            if (arr->elements.size() > 255) throw Unsupported("array literal too long");
+            std::vector<IRValue*> elements;
+            for (const auto& el : arr->elements) {
+                elements.push_back(expression(el.get()));
+            }
+            IRValue* value = vmOp(OP_NEW_ARRAY, std::move(elements));
+            value->immediates = {static_cast<uint8_t>(arr->elements.size())};
+            return value;
+        }
+        if (auto* idx = dynamic_cast<IndexExpr*>(expr)) {
+            IRValue* array = expression(idx->array.get());
+            IRValue* index = expression(idx->index.get());
+            return vmOp(OP_INDEX_GET, {array, index});
+        }
+        if (auto* bin = dynamic_cast<BinaryExpr*>(expr)) {
+            if (bin->op == "&&" || bin->op == "||") {
+                return shortCircuit(bin);
+            }
+            if (!isBinaryOperator(bin->op)) throw Unsupported("operator " + bin->op);
+            IRValue* left = expression(bin->left.get());
+            IRValue* right = expression(bin->right.get());
+            return binary(bin->op, left, right);
+        }
+        if (auto* unary = dynamic_cast<UnaryExpr*>(expr)) {
+            IRValue* operand = expression(unary->right.get());
+            IRValue* value = fn.newValue(IRKind::UNARY, current);
+            value->op = unary->op == "-" ? "-" : "!";
+            value->operands = {operand};
+            return value;
+        }
+        throw Unsupported("member access");
+    }
+
+    // Interpolated parts are added right to left, as the stack compiler's
+    // trailing run of OP_ADDs does.
+    IRValue* string(const std::string& str) {
+        if (str.find('{') == std::string::npos) {
+            return stringConstant(str);
+        }
+
+        std::vector<IRValue*> parts;
+        size_t i = 0;
+        while (i < str.length()) {
+            if (str[i] == '{') {
+                size_t j = str.find('}', i + 1);
+                if (j == std::string::npos || j == i + 1) throw Unsupported("empty or unterminated interpolation");
+                Lexer lexer(str.substr(i + 1, j - i - 1));
+                Parser parser(lexer);
+                auto expr = parser.parseExpression();
+                parts.push_back(expression(expr.get()));
+                i = j + 1;
+                continue;
+            }
+            size_t end = str.find('{', i);
+            if (end == std::string::npos) end = str.length();
+            parts.push_back(stringConstant(str.substr(i, end - i)));
+            i = end;
+        }
+
+        IRValue* value = parts.back();
+        for (size_t p = parts.size() - 1; p-- > 0;) {
+            value = binary("+", parts[p], value);
+        }
+        return value;
+    }
+
+    IRValue* shortCircuit(BinaryExpr* bin) {
+        IRValue* left = expression(bin->left.get());
+        IRBlock* leftEnd = current;
+        IRBlock* rhs = newBlock();
+        IRBlock* join = newBlock();
+        if (bin->op == "&&") {
+            branch(left, rhs, join);
+        } else {
+            branch(left, join, rhs);
+        }
+        seal(rhs);
+
+        current = rhs;
+        IRValue* right = expression(bin->right.get());
+        jump(join);
+        seal(join);
+
+        current = join;
+        IRValue* phi = fn.newValue(IRKind::PHI, join);
+        for (IRBlock* pred : join->preds) {
+            phi->operands.push_back(pred == leftEnd ? left : right);
+        }
+        return removeTrivialPhi(phi);
+    }
+
+    IRValue* callExpression(CallExpr* call) {
+        if (dynamic_cast<MemberExpr*>(call->callee.get())) throw Unsupported("method calls");
+
+        auto* callee = dynamic_cast<VarExpr*>(call->callee.get());
+        if (callee) {
+            const std::string& name = callee->name;
+            size_t argc = call->arguments.size();
+            auto builtin = [&](uint8_t opcode, size_t expected, StaticType type = StaticType::UNKNOWN) {
+                if (argc != expected) throw Unsupported(name + "() with " + std::to_string(argc) + " arguments");
+                IRValue* value = vmOp(opcode, arguments(call));
+                value->type = type;
+                return value;
+            };
+            if (name == "fixed") {
+                if (argc != 1 && argc != 2) throw Unsupported("fixed() arguments");
+                IRValue* value = vmOp(OP_FIXED_ARRAY, arguments(call));
+                value->immediates = {static_cast<uint8_t>(argc)};
+                return value;
+            }
+            if (name == "push") return builtin(OP_ARRAY_PUSH, 2);
+            if (name == "length") return builtin(OP_ARRAY_LENGTH, 1, StaticType::FLOAT);
+            if (name == "int") return builtin(OP_CAST_INT, 1);
+            if (name == "float") return builtin(OP_CAST_FLOAT, 1);
+            if (name == "string") return builtin(OP_CAST_STRING, 1, StaticType::STRING);
+            if (name == "bool") return builtin(OP_CAST_BOOL, 1);
+            if (name == "char") return builtin(OP_CAST_CHAR, 1);
+            if (name == "type") return builtin(OP_TYPEOF, 1, StaticType::STRING);
+            if (name == "readline") return vmOp(OP_READLINE, {});
+        }
+
+        if (call->arguments.size() > 255) throw Unsupported("too many arguments");
+        std::vector<IRValue*> operands = {expression(call->callee.get())};
+        for (IRValue* arg : arguments(call)) {
+            operands.push_back(arg);
+        }
+        auto argCount = static_cast<uint8_t>(call->arguments.size());
+        int direct = callee && resolve(callee->name) == -1 ? context.directCall(callee->name, argCount) : -1;
+        IRValue* value = vmOp(direct == -1 ? OP_CALL : OP_CALL_DIRECT, std::move(operands));
+        value->immediates = {argCount};
+        if (direct != -1) value->immediates.insert(value->immediates.begin(), static_cast<uint8_t>(direct));
+        if (callee && resolve(callee->name) == -1) {
+            value->type = context.returnType(callee->name);
+        }
+        return value;
+    }
+
+    // Branches to ifTrue/ifFalse on the truthiness of `expr`, with `&&`,
+    // `||` and `!` turned into control flow instead of a value.
+    void condition(Expr* expr, IRBlock* ifTrue, IRBlock* ifFalse) {
+        if (auto* bin = dynamic_cast<BinaryExpr*>(expr); bin && (bin->op == "&&" || bin->op == "||")) {
+            IRBlock* rhs = newBlock();
+            if (bin->op == "&&") {
+                condition(bin->left.get(), rhs, ifFalse);
+            } else {
+                condition(bin->left.get(), ifTrue, rhs);
+            }
+            seal(rhs);
+            current = rhs;
+            condition(bin->right.get(), ifTrue, ifFalse);
+            return;
+        }
+        if (auto* unary = dynamic_cast<UnaryExpr*>(expr); unary && unary->op != "-") {
+            condition(unary->right.get(), ifFalse, ifTrue);
+            return;
+        }
+        branch(expression(expr), ifTrue, ifFalse);
+    }
+
+    // ---- statements ----
+
+    void statement(ASTNode* node) {
+        if (auto* printStmt = dynamic_cast<PrintStmt*>(node)) {
+            vmOp(OP_PRINT, {expression(printStmt->expression.get())}, false);
+        } else if (auto* printlnStmt = dynamic_cast<PrintlnStmt*>(node)) {
+            vmOp(OP_PRINTLN, {expression(printlnStmt->expression.get())}, false);
+        } else if (auto* exprStmt = dynamic_cast<ExprStmt*>(node)) {
+            expression(exprStmt->expression.get());
+        } else if (auto* returnStmt = dynamic_cast<ReturnStmt*>(node)) {
+            IRValue* value = returnStmt->value ? expression(returnStmt->value.get()) : constant(Value());
+            current->terminator = IRTerminator::RETURN;
+            current->value = value;
+            startUnreachable();
+        } else if (auto* ifStmt = dynamic_cast<IfStmt*>(node)) {
+            IRBlock* thenBlock = newBlock();
+            IRBlock* elseBlock = newBlock();
+            IRBlock* join = newBlock();
+            condition(ifStmt->condition.get(), thenBlock, elseBlock);
+            seal(thenBlock);
+            seal(elseBlock);
+
+            current = thenBlock;
+            statement(ifStmt->thenBranch.get());
+            jump(join);
+
+            current = elseBlock;
+            if (ifStmt->elseBranch) {
+                statement(ifStmt->elseBranch.get());
+            }
+            jump(join);
+
+            seal(join);
+            current = join;
+        } else if (auto* whileStmt = dynamic_cast<WhileStmt*>(node)) {
+            loop(whileStmt->condition.get(), whileStmt->body.get(), nullptr);
+        } else if (auto* forStmt = dynamic_cast<ForStmt*>(node)) {
+            beginScope();
+            if (forStmt->init) {
+                statement(forStmt->init.get());
+            }
+            loop(forStmt->condition.get(), forStmt->body.get(), forStmt->increment.get());
+            endScope();
+        } else if (auto* assignStmt = dynamic_cast<AssignmentStmt*>(node)) {
+            for (const auto& assign : assignStmt->assignments) {
+                assignment(assign);
+            }
+        } else if (auto* block = dynamic_cast<Block*>(node)) {
+            beginScope();
+            for (const auto& stmt : block->statements) {
+                statement(stmt.get());
+            }
+            endScope();
+        } else if (dynamic_cast<BreakStmt*>(node)) {
+            if (!loops.empty()) {
+                jump(loops.back().breakTarget);
+                startUnreachable();
+            }
+        } else if (dynamic_cast<ContinueStmt*>(node)) {
+            if (!loops.empty()) {
+                jump(loops.back().continueTarget);
+                startUnreachable();
+            }
+        } else {
+            throw Unsupported("classes");
+        }
+    }
+
+    // while (condition) body  /  for (...; condition; increment) body
+    void loop(Expr* cond, Block* body, AssignmentStmt* increment) {
+        IRBlock* header = newBlock();
+        IRBlock* bodyBlock = newBlock();
+        IRBlock* exit = newBlock();
+        IRBlock* latch = increment ? newBlock() : header;
+        jump(header);
+
+        current = header;
+        if (cond) {
+            condition(cond, bodyBlock, exit);
+        } else {
+            jump(bodyBlock);
+        }
+        seal(bodyBlock);
+
+        loops.push_back({exit, latch});
+        current = bodyBlock;
+        statement(body);
+        jump(latch);
+        loops.pop_back();
+
+        if (increment) {
+            seal(latch);
+            current = latch;
+            statement(increment);
+            jump(header);
+        }
+        seal(header);
+        seal(exit);
+        current = exit;
+    }
+
+    void assignment(const Assignment& assign) {
+        if (auto* idx = dynamic_cast<IndexExpr*>(assign.target.get())) {
+            // The stack compiler stores the right-hand side for every
+            // assignment operator here.
+            IRValue* array = expression(idx->array.get());
+            IRValue* index = expression(idx->index.get());
+            IRValue* value = expression(assign.value.get());
+            vmOp(OP_INDEX_SET, {array, index, value}, false);
+            return;
+        }
+        auto* var = dynamic_cast<VarExpr*>(assign.target.get());
+        if (!var) throw Unsupported("member assignment");
+
+        int variable = resolve(var->name);
+        if (assign.op == TokenType::EQUAL) {
+            if (variable == -1 && mentions(assign.value.get(), var->name)) {
+                throw Unsupported("a new local read in its own initializer");
+            }
+            IRValue* value = expression(assign.value.get());
+            if (variable == -1) variable = declare(var->name);
+            write(variable, current, value);
+            return;
+        }
+
+        std::string op = Compiler::compoundOperator(assign.op);
+        if (variable == -1 || op.empty()) throw Unsupported("compound assignment");
+        IRValue* left = read(variable, current);
+        IRValue* right = expression(assign.value.get());
+        write(variable, current, binary(op, left, right));
+    }
+};
+
+}  // namespace
+
+std::unique_ptr<IRFunction> buildIR(const std::vector<std::unique_ptr<Stmt>>& body,
+                                    const std::vector<Param>& params, bool isScript,
+                                    const IRContext& context, std::string& unsupported) {
+    auto function = std::make_unique<IRFunction>();
+    try {
+        IRBuilder(*function, context).build(body, params, isScript);
+    } catch (const Unsupported& e) {
+        unsupported = e.what();
+        return nullptr;
+    }
+    return function;
+}
+
+}  // namespace vm
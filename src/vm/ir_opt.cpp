@@ -0,0 +1,566 @@
+#include "vm/ir.h"
+
+#include "vm/opcode.h"
+#include "vm/utils/value_utils.h"
+
+#include <algorithm>
+#include <map>
+#include <tuple>
+
+namespace vm {
+
+void IRFunction::analyze() {
+    for (auto& block : blocks) {
+        block->order = -1;
+        block->idom = nullptr;
+    }
+
+    // Depth-first search visiting succs[1] before succs[0], so that in
+    // reverse postorder a branch is followed by its true successor.
+    std::vector<bool> visited(blocks.size(), false);
+    std::vector<IRBlock*> postorder;
+    std::vector<std::pair<IRBlock*, int>> stack;
+    visited[entry->id] = true;
+    stack.push_back({entry, entry->succCount()});
+    while (!stack.empty()) {
+        if (stack.back().second == 0) {
+            postorder.push_back(stack.back().first);
+            stack.pop_back();
+            continue;
+        }
+        IRBlock* succ = stack.back().first->succs[--stack.back().second];
+        if (!visited[succ->id]) {
+            visited[succ->id] = true;
+            stack.push_back({succ, succ->succCount()});
+        }
+    }
+
+    rpo.assign(postorder.rbegin(), postorder.rend());
+    for (size_t i = 0; i < rpo.size(); ++i) {
+        rpo[i]->order = static_cast<int>(i);
+    }
+
+    for (IRBlock* block : rpo) {
+        for (size_t i = block->preds.size(); i-- > 0;) {
+            if (block->preds[i]->order >= 0) continue;
+            block->preds.erase(block->preds.begin() + i);
+            for (IRValue* phi : block->phis) {
+                phi->operands.erase(phi->operands.begin() + i);
+            }
+        }
+    }
+
+    // Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm".
+    auto intersect = [](IRBlock* a, IRBlock* b) {
+        while (a != b) {
+            while (a->order > b->order) a = a->idom;
+            while (b->order > a->order) b = b->idom;
+        }
+        return a;
+    };
+    entry->idom = entry;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 1; i < rpo.size(); ++i) {
+            IRBlock* idom = nullptr;
+            for (IRBlock* pred : rpo[i]->preds) {
+                if (!pred->idom) continue;
+                idom = idom ? intersect(pred, idom) : pred;
+            }
+            if (rpo[i]->idom != idom) {
+                rpo[i]->idom = idom;
+                changed = true;
+            }
+        }
+    }
+}
+
+bool IRFunction::dominates(const IRBlock* a, const IRBlock* b) const {
+    while (b != a && b != entry) b = b->idom;
+    return b == a;
+}
+
+// The arithmetic helpers never fail, except that `%` traps on a zero
+// divisor (and on INT64_MIN % -1).
+bool isPure(const IRValue* value) {
+    if (value->kind == IRKind::UNARY) return true;
+    if (value->kind != IRKind::BINARY) return false;
+    if (value->op != "%") return true;
+    const IRValue* divisor = value->operands[1];
+    return divisor->kind == IRKind::CONST && !divisor->isString && divisor->constant.isInt() &&
+           divisor->constant.as.integer != 0 && divisor->constant.as.integer != -1;
+}
+
+namespace {
+
+bool isConstInt(const IRValue* value) {
+    return value->kind == IRKind::CONST && !value->isString && value->constant.isInt();
+}
+
+IRValue* intConstant(IRFunction& fn, int64_t number) {
+    IRValue* value = fn.newValue(IRKind::CONST);
+    value->constant = Value(number);
+    value->type = StaticType::INT;
+    return value;
+}
+
+void removePred(IRBlock* block, IRBlock* pred) {
+    auto it = std::find(block->preds.begin(), block->preds.end(), pred);
+    size_t index = it - block->preds.begin();
+    block->preds.erase(it);
+    for (IRValue* phi : block->phis) {
+        phi->operands.erase(phi->operands.begin() + index);
+    }
+}
+
+// BRANCH on a constant => JUMP.
+bool foldBranches(IRFunction& fn) {
+    bool changed = false;
+    for (IRBlock* block : fn.rpo) {
+        if (block->terminator != IRTerminator::BRANCH) continue;
+        IRValue* condition = resolveValue(block->value);
+        if (condition->kind != IRKind::CONST || condition->isString) continue;
+
+        int taken = asBool(condition->constant) ? 0 : 1;
+        removePred(block->succs[1 - taken], block);
+        block->terminator = IRTerminator::JUMP;
+        block->succs[0] = block->succs[taken];
+        block->succs[1] = nullptr;
+        block->value = nullptr;
+        changed = true;
+    }
+    return changed;
+}
+
+// Points every operand at its current value and removes phis that have
+// become trivial, until nothing changes.
+void canonicalize(IRFunction& fn) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (IRBlock* block : fn.rpo) {
+            for (size_t i = 0; i < block->phis.size();) {
+                IRValue* phi = block->phis[i];
+                IRValue* same = nullptr;
+                bool trivial = true;
+                for (IRValue*& operand : phi->operands) {
+                    operand = resolveValue(operand);
+                    if (operand == phi || operand == same) continue;
+                    if (same) trivial = false;
+                    same = operand;
+                }
+                if (trivial && same) {
+                    phi->replacement = same;
+                    block->phis.erase(block->phis.begin() + i);
+                    changed = true;
+                } else {
+                    ++i;
+                }
+            }
+            for (IRValue* value : block->values) {
+                for (IRValue*& operand : value->operands) {
+                    operand = resolveValue(operand);
+                }
+            }
+            block->value = resolveValue(block->value);
+        }
+    }
+}
+
+// B: ...; JUMP S  where S has no other predecessor  =>  one block.
+bool mergeBlocks(IRFunction& fn) {
+    bool changed = false;
+    for (IRBlock* block : fn.rpo) {
+        while (block->terminator == IRTerminator::JUMP) {
+            IRBlock* next = block->succs[0];
+            if (next == block || next == fn.entry || next->preds.size() != 1 || !next->phis.empty()) break;
+
+            for (IRValue* value : next->values) {
+                value->block = block;
+            }
+            block->values.insert(block->values.end(), next->values.begin(), next->values.end());
+            next->values.clear();
+            block->terminator = next->terminator;
+            block->value = next->value;
+            block->succs[0] = next->succs[0];
+            block->succs[1] = next->succs[1];
+            for (int i = 0; i < block->succCount(); ++i) {
+                auto& preds = block->succs[i]->preds;
+                *std::find(preds.begin(), preds.end(), next) = block;
+            }
+            next->terminator = IRTerminator::NONE;
+            next->preds.clear();
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+StaticType inferredType(const IRValue* value) {
+    auto operandType = [&](size_t i) { return value->operands[i]->type; };
+    switch (value->kind) {
+        case IRKind::PHI: {
+            StaticType type = StaticType::NONE;
+            for (const IRValue* operand : value->operands) {
+                type = joinTypes(type, operand->type);
+            }
+            return type;
+        }
+        case IRKind::BINARY:
+            return binaryType(value->op, operandType(0), operandType(1));
+        case IRKind::UNARY:
+            // OP_NEGATE always yields a float, OP_NOT a bool.
+            return value->op == "-" ? StaticType::FLOAT : StaticType::BOOL;
+        case IRKind::VM:
+            switch (value->opcode) {
+                case OP_CAST_INT: return castType(operandType(0), StaticType::INT);
+                case OP_CAST_FLOAT: return castType(operandType(0), StaticType::FLOAT);
+                case OP_CAST_BOOL: return castType(operandType(0), StaticType::BOOL);
+                default: return value->type;  // fixed when the value was built
+            }
+        default:
+            return value->type;
+    }
+}
+
+// Same rules as the AST-level inference in compiler_types.cpp, over SSA
+// values: iterate from NONE to a fixpoint, then treat what is still NONE
+// (values only reachable through themselves) as UNKNOWN.
+void inferTypes(IRFunction& fn) {
+    std::vector<IRValue*> values;
+    for (IRBlock* block : fn.rpo) {
+        values.insert(values.end(), block->phis.begin(), block->phis.end());
+        values.insert(values.end(), block->values.begin(), block->values.end());
+    }
+    auto inferred = [](const IRValue* value) {
+        if (value->kind != IRKind::VM) return true;
+        return value->opcode == OP_CAST_INT || value->opcode == OP_CAST_FLOAT || value->opcode == OP_CAST_BOOL;
+    };
+    values.erase(std::remove_if(values.begin(), values.end(), [&](IRValue* value) { return !inferred(value); }),
+                 values.end());
+    for (IRValue* value : values) {
+        value->type = StaticType::NONE;
+    }
+
+    bool changed = true;
+    for (int round = 0; changed && round < 64; ++round) {
+        changed = false;
+        for (IRValue* value : values) {
+            StaticType type = inferredType(value);
+            if (type != value->type) {
+                value->type = type;
+                changed = true;
+            }
+        }
+    }
+    for (IRValue* value : values) {
+        if (changed || value->type == StaticType::NONE) value->type = StaticType::UNKNOWN;
+    }
+}
+
+// Merges a pure value into an equal one computed in a dominating position,
+// walking the dominator tree with a scoped table of available values.
+void eliminateCommonSubexpressions(IRFunction& fn, IRStats& stats) {
+    using Key = std::tuple<IRKind, std::string, std::vector<int>>;
+    std::vector<std::vector<IRBlock*>> children(fn.blocks.size());
+    for (IRBlock* block : fn.rpo) {
+        if (block != fn.entry) children[block->idom->id].push_back(block);
+    }
+
+    std::map<Key, IRValue*> available;
+    std::vector<Key> added;
+
+    auto enter = [&](IRBlock* block) {
+        for (size_t i = 0; i < block->values.size();) {
+            IRValue* value = block->values[i];
+            for (IRValue*& operand : value->operands) {
+                operand = resolveValue(operand);
+            }
+            if (!isPure(value)) {
+                ++i;
+                continue;
+            }
+            Key key{value->kind, value->op, {}};
+            for (const IRValue* operand : value->operands) {
+                std::get<2>(key).push_back(operand->id);
+            }
+            auto [it, inserted] = available.emplace(key, value);
+            if (inserted) {
+                added.push_back(key);
+                ++i;
+                continue;
+            }
+            value->replacement = it->second;
+            block->values.erase(block->values.begin() + i);
+            ++stats.cse;
+        }
+    };
+
+    struct Frame {
+        IRBlock* block;
+        size_t scope;
+        size_t next;
+    };
+    std::vector<Frame> stack;
+    stack.push_back({fn.entry, added.size(), 0});
+    enter(fn.entry);
+    while (!stack.empty()) {
+        Frame& frame = stack.back();
+        if (frame.next < children[frame.block->id].size()) {
+            IRBlock* child = children[frame.block->id][frame.next++];
+            stack.push_back({child, added.size(), 0});
+            enter(child);
+            continue;
+        }
+        while (added.size() > frame.scope) {
+            available.erase(added.back());
+            added.pop_back();
+        }
+        stack.pop_back();
+    }
+}
+
+struct Loop {
+    IRBlock* header;
+    std::vector<IRBlock*> latches;
+    std::vector<bool> body;  // by block id
+    size_t size = 0;
+};
+
+std::vector<Loop> findLoops(IRFunction& fn) {
+    std::vector<Loop> loops;
+    for (IRBlock* header : fn.rpo) {
+        Loop loop;
+        loop.header = header;
+        for (IRBlock* pred : header->preds) {
+            if (fn.dominates(header, pred)) loop.latches.push_back(pred);
+        }
+        if (loop.latches.empty()) continue;
+
+        loop.body.assign(fn.blocks.size(), false);
+        loop.body[header->id] = true;
+        std::vector<IRBlock*> work = loop.latches;
+        while (!work.empty()) {
+            IRBlock* block = work.back();
+            work.pop_back();
+            if (loop.body[block->id]) continue;
+            loop.body[block->id] = true;
+            work.insert(work.end(), block->preds.begin(), block->preds.end());
+        }
+        loop.size = std::count(loop.body.begin(), loop.body.end(), true);
+        loops.push_back(std::move(loop));
+    }
+    // Inner loops first, so that what they hoist can move further out.
+    std::stable_sort(loops.begin(), loops.end(), [](const Loop& a, const Loop& b) { return a.size < b.size; });
+    return loops;
+}
+
+// The single block entering the loop from outside, if it only leads there.
+IRBlock* preheader(const Loop& loop, int& index) {
+    IRBlock* found = nullptr;
+    for (size_t i = 0; i < loop.header->preds.size(); ++i) {
+        IRBlock* pred = loop.header->preds[i];
+        if (loop.body[pred->id]) continue;
+        if (found) return nullptr;
+        found = pred;
+        index = static_cast<int>(i);
+    }
+    return found && found->terminator == IRTerminator::JUMP ? found : nullptr;
+}
+
+bool isInvariant(const Loop& loop, const IRValue* value) {
+    return !value->block || !loop.body[value->block->id];
+}
+
+void hoistInvariants(IRFunction& fn, const Loop& loop, IRBlock* preheader, IRStats& stats) {
+    for (IRBlock* block : fn.rpo) {
+        if (!loop.body[block->id]) continue;
+        for (size_t i = 0; i < block->values.size();) {
+            IRValue* value = block->values[i];
+            bool invariant = isPure(value) && std::all_of(value->operands.begin(), value->operands.end(),
+                                                          [&](const IRValue* operand) {
+                                                              return isInvariant(loop, operand);
+                                                          });
+            if (!invariant) {
+                ++i;
+                continue;
+            }
+            block->values.erase(block->values.begin() + i);
+            preheader->values.push_back(value);
+            value->block = preheader;
+            ++stats.hoisted;
+        }
+    }
+}
+
+// For an int induction variable p = phi(init, p + c), rewrites p * k and
+// p << k (k a constant) inside the loop as a second induction variable
+// q = phi(init * k, q + c * k), trading the multiply for an add.
+void reduceInductions(IRFunction& fn, const Loop& loop, IRBlock* preheader, int entryIndex, IRStats& stats) {
+    IRBlock* header = loop.header;
+    for (size_t p = 0; p < header->phis.size(); ++p) {
+        IRValue* phi = header->phis[p];
+        if (phi->type != StaticType::INT) continue;
+
+        IRValue* next = nullptr;
+        bool consistent = true;
+        for (size_t i = 0; i < header->preds.size(); ++i) {
+            if (static_cast<int>(i) == entryIndex) continue;
+            if (next && phi->operands[i] != next) consistent = false;
+            next = phi->operands[i];
+        }
+        if (!consistent || !next || next->kind != IRKind::BINARY || !next->block) continue;
+
+        uint64_t step;
+        if (next->op == "+" && next->operands[0] == phi && isConstInt(next->operands[1])) {
+            step = static_cast<uint64_t>(next->operands[1]->constant.as.integer);
+        } else if (next->op == "+" && next->operands[1] == phi && isConstInt(next->operands[0])) {
+            step = static_cast<uint64_t>(next->operands[0]->constant.as.integer);
+        } else if (next->op == "-" && next->operands[0] == phi && isConstInt(next->operands[1])) {
+            step = 0 - static_cast<uint64_t>(next->operands[1]->constant.as.integer);
+        } else {
+            continue;
+        }
+
+        for (IRBlock* block : fn.rpo) {
+            if (!loop.body[block->id]) continue;
+            for (size_t i = 0; i < block->values.size();) {
+                IRValue* value = block->values[i];
+                IRValue* factor = nullptr;
+                if (value->kind == IRKind::BINARY && value->op == "*") {
+                    if (value->operands[0] == phi && isConstInt(value->operands[1])) factor = value->operands[1];
+                    if (value->operands[1] == phi && isConstInt(value->operands[0])) factor = value->operands[0];
+                } else if (value->kind == IRKind::BINARY && value->op == "<<") {
+                    if (value->operands[0] == phi && isConstInt(value->operands[1])) factor = value->operands[1];
+                }
+                if (!factor) {
+                    ++i;
+                    continue;
+                }
+
+                uint64_t k = static_cast<uint64_t>(factor->constant.as.integer);
+                auto scale = [&](uint64_t n) { return value->op == "*" ? n * k : n << (k & 63); };
+
+                IRValue* init = phi->operands[entryIndex];
+                IRValue* start;
+                if (isConstInt(init)) {
+                    start = intConstant(fn, static_cast<int64_t>(scale(static_cast<uint64_t>(init->constant.as.integer))));
+                } else {
+                    start = fn.newValue(IRKind::BINARY, preheader);
+                    start->op = value->op;
+                    start->operands = {init, factor};
+                    start->type = StaticType::INT;
+                }
+
+                IRValue* reduced = fn.newValue(IRKind::PHI, header);
+                reduced->type = StaticType::INT;
+                IRValue* advance = fn.newValue(IRKind::BINARY);
+                advance->op = "+";
+                advance->operands = {reduced, intConstant(fn, static_cast<int64_t>(scale(step)))};
+                advance->type = StaticType::INT;
+                advance->block = next->block;
+                auto& values = next->block->values;
+                values.insert(std::find(values.begin(), values.end(), next) + 1, advance);
+
+                for (size_t j = 0; j < header->preds.size(); ++j) {
+                    reduced->operands.push_back(static_cast<int>(j) == entryIndex ? start : advance);
+                }
+
+                // Inserting into the block being scanned shifts `value`.
+                auto& scanned = block->values;
+                scanned.erase(std::find(scanned.begin(), scanned.end(), value));
+                value->replacement = reduced;
+                ++stats.inductions;
+                i = 0;
+            }
+        }
+    }
+}
+
+void optimizeLoops(IRFunction& fn, IRStats& stats) {
+    for (const Loop& loop : findLoops(fn)) {
+        int entryIndex = -1;
+        IRBlock* pre = preheader(loop, entryIndex);
+        if (!pre) continue;
+        hoistInvariants(fn, loop, pre, stats);
+        canonicalize(fn);
+        reduceInductions(fn, loop, pre, entryIndex, stats);
+        canonicalize(fn);
+    }
+}
+
+// Keeps what has an effect and what it depends on. Everything else is gone,
+// including locals that are assigned and never read again.
+void eliminateDeadValues(IRFunction& fn, IRStats& stats) {
+    std::vector<bool> live(fn.values.size(), false);
+    std::vector<IRValue*> work;
+    auto mark = [&](IRValue* value) {
+        if (value && !live[value->id]) {
+            live[value->id] = true;
+            work.push_back(value);
+        }
+    };
+    for (IRBlock* block : fn.rpo) {
+        for (IRValue* value : block->values) {
+            if (!isPure(value)) mark(value);
+        }
+        mark(block->value);
+    }
+    while (!work.empty()) {
+        IRValue* value = work.back();
+        work.pop_back();
+        for (IRValue* operand : value->operands) mark(operand);
+    }
+
+    for (IRBlock* block : fn.rpo) {
+        auto dead = [&](IRValue* value) {
+            if (live[value->id]) return false;
+            ++stats.dead;
+            return true;
+        };
+        block->phis.erase(std::remove_if(block->phis.begin(), block->phis.end(), dead), block->phis.end());
+        block->values.erase(std::remove_if(block->values.begin(), block->values.end(), dead), block->values.end());
+    }
+}
+
+// Lowering places phi copies at the end of each predecessor, which needs a
+// block of its own on edges out of a BRANCH.
+void splitCriticalEdges(IRFunction& fn) {
+    std::vector<IRBlock*> rpo = fn.rpo;
+    for (IRBlock* block : rpo) {
+        if (block->terminator != IRTerminator::BRANCH) continue;
+        for (IRBlock*& succ : block->succs) {
+            if (succ->preds.size() < 2 || succ->phis.empty()) continue;
+            IRBlock* edge = fn.newBlock();
+            edge->terminator = IRTerminator::JUMP;
+            edge->succs[0] = succ;
+            edge->preds.push_back(block);
+            *std::find(succ->preds.begin(), succ->preds.end(), block) = edge;
+            succ = edge;
+        }
+    }
+    fn.analyze();
+}
+
+}  // namespace
+
+void optimizeIR(IRFunction& fn, IRStats& stats) {
+    fn.analyze();
+    while (foldBranches(fn)) {
+        fn.analyze();
+    }
+    canonicalize(fn);
+    if (mergeBlocks(fn)) {
+        fn.analyze();
+    }
+    inferTypes(fn);
+
+    eliminateCommonSubexpressions(fn, stats);
+    canonicalize(fn);
+    optimizeLoops(fn, stats);
+    eliminateDeadValues(fn, stats);
+    splitCriticalEdges(fn);
+}
+
+}  // namespace vm
@@ -0,0 +1,795 @@
+#include "vm/jit.h"
+
+#include "vm/disassembler.h"
+#include "vm/utils/value_utils.h"
+#include "vm/vm.h"
+
+#include <cstddef>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define PENGUIN_JIT_X64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace vm {
+
+#ifdef PENGUIN_JIT_X64
+
+namespace {
+
+// Just enough of an x86-64 encoder for the templates below. Memory operands
+// are always [base + disp].
+enum Reg : uint8_t { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+struct Mem {
+    Reg base;
+    int32_t disp;
+};
+
+enum Cond : uint8_t {
+    CC_E = 0x4,
+    CC_NE = 0x5,
+    CC_L = 0xc,
+    CC_GE = 0xd,
+    CC_LE = 0xe,
+    CC_G = 0xf,
+};
+
+// The /digit of the 0x81 immediate group; `digit * 8 + 3` is the
+// `op reg, r/m` form.
+enum Alu : uint8_t { ADD = 0, OR = 1, AND = 4, SUB = 5, XOR = 6, CMP = 7 };
+
+// Scalar double opcodes (after an F2 prefix), used with xmm0.
+enum Sse : uint8_t { SD_LOAD = 0x10, SD_STORE = 0x11, SD_ADD = 0x58, SD_MUL = 0x59, SD_SUB = 0x5c, SD_DIV = 0x5e };
+
+class Assembler {
+public:
+    std::vector<uint8_t> code;
+
+    size_t size() const { return code.size(); }
+
+    void push(Reg r) {
+        rex(false, 0, r);
+        byte(0x50 + (r & 7));
+    }
+    void pop(Reg r) {
+        rex(false, 0, r);
+        byte(0x58 + (r & 7));
+    }
+    void ret() { byte(0xc3); }
+
+    void mov(Reg dst, Reg src) {
+        rex(true, src, dst);
+        byte(0x89);
+        byte(0xc0 | (src & 7) << 3 | (dst & 7));
+    }
+    void load(Reg dst, Mem src) { memOp(true, 0x8b, dst, src); }
+    void store(Mem dst, Reg src) { memOp(true, 0x89, src, dst); }
+    void lea(Reg dst, Mem src) { memOp(true, 0x8d, dst, src); }
+    void movImm(Reg dst, uint64_t imm) {
+        if (imm <= UINT32_MAX) {
+            rex(false, 0, dst);
+            byte(0xb8 + (dst & 7));
+            u32(static_cast<uint32_t>(imm));
+            return;
+        }
+        rex(true, 0, dst);
+        byte(0xb8 + (dst & 7));
+        u64(imm);
+    }
+    void storeImm(Mem dst, int32_t imm) {  // sign-extended to 64 bits
+        memOp(true, 0xc7, 0, dst);
+        u32(static_cast<uint32_t>(imm));
+    }
+    void cmpByte(Mem m, uint8_t imm) {
+        memOp(false, 0x80, CMP, m);
+        byte(imm);
+    }
+    void alu(Alu op, Reg dst, Mem src) { memOp(true, static_cast<uint8_t>(op * 8 + 3), dst, src); }
+    void alu(Alu op, Mem dst, Reg src) { memOp(true, static_cast<uint8_t>(op * 8 + 1), src, dst); }
+    void alu(Alu op, Mem dst, int32_t imm) {
+        memOp(true, 0x81, op, dst);
+        u32(static_cast<uint32_t>(imm));
+    }
+    void alu(Alu op, Reg dst, int32_t imm) {
+        rex(true, 0, dst);
+        byte(0x81);
+        byte(0xc0 | op << 3 | (dst & 7));
+        u32(static_cast<uint32_t>(imm));
+    }
+    void alu(Alu op, Reg dst, Reg src) {
+        rex(true, src, dst);
+        byte(static_cast<uint8_t>(op * 8 + 1));
+        byte(0xc0 | (src & 7) << 3 | (dst & 7));
+    }
+    void imul(Reg dst, Mem src) { memOp(true, {0x0f, 0xaf}, dst, src); }
+    void shl(Reg r) { shift(4, r); }  // by cl
+    void sar(Reg r) { shift(7, r); }
+    void cqo() {
+        byte(0x48);
+        byte(0x99);
+    }
+    void idiv(Mem divisor) { memOp(true, 0xf7, 7, divisor); }
+    void setccEax(Cond cc) {  // eax = cc ? 1 : 0
+        byte(0x0f);
+        byte(0x90 + cc);
+        byte(0xc0);
+        byte(0x0f);
+        byte(0xb6);
+        byte(0xc0);
+    }
+    void testEax() {
+        byte(0x85);
+        byte(0xc0);
+    }
+    void cmpEax(int8_t imm) {
+        byte(0x83);
+        byte(0xf8);
+        byte(static_cast<uint8_t>(imm));
+    }
+    void sse(Sse op, Mem m) {  // scalar double: op xmm0, [m] (or [m] = xmm0)
+        byte(0xf2);
+        memOp(false, {0x0f, op}, 0, m);
+    }
+    void callRax() {
+        byte(0xff);
+        byte(0xd0);
+    }
+    void jmp(Reg r) {
+        rex(false, 0, r);
+        byte(0xff);
+        byte(0xe0 | (r & 7));
+    }
+
+    // Jumps with a 32-bit displacement. The forward forms return the
+    // position to patch() once the target is known.
+    size_t jcc(Cond cc) {
+        byte(0x0f);
+        byte(0x80 + cc);
+        u32(0);
+        return size() - 4;
+    }
+    size_t jmp() {
+        byte(0xe9);
+        u32(0);
+        return size() - 4;
+    }
+    void jcc(Cond cc, size_t target) { patch(jcc(cc), target); }
+    void jmp(size_t target) { patch(jmp(), target); }
+    void bind(size_t at) { patch(at, size()); }
+    void patch(size_t at, size_t target) {
+        uint32_t rel = static_cast<uint32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4));
+        std::memcpy(&code[at], &rel, 4);
+    }
+
+private:
+    void byte(uint8_t b) { code.push_back(b); }
+    void u32(uint32_t v) {
+        for (int i = 0; i < 4; ++i) byte(static_cast<uint8_t>(v >> (8 * i)));
+    }
+    void u64(uint64_t v) {
+        for (int i = 0; i < 8; ++i) byte(static_cast<uint8_t>(v >> (8 * i)));
+    }
+    void rex(bool wide, int reg, int base) {
+        uint8_t prefix = 0x40 | (wide ? 8 : 0) | ((reg & 8) >> 1) | ((base & 8) >> 3);
+        if (prefix != 0x40) byte(prefix);
+    }
+    void memOp(bool wide, std::initializer_list<uint8_t> opcode, int reg, Mem m) {
+        rex(wide, reg, m.base);
+        for (uint8_t b : opcode) byte(b);
+        int base = m.base & 7;
+        bool disp8 = m.disp >= -128 && m.disp <= 127;
+        int mod = m.disp == 0 && base != RBP ? 0 : disp8 ? 1 : 2;
+        byte(static_cast<uint8_t>(mod << 6 | (reg & 7) << 3 | base));
+        if (base == RSP) byte(0x24);  // SIB: no index (rsp and r12 as base)
+        if (mod == 1) byte(static_cast<uint8_t>(m.disp));
+        if (mod == 2) u32(static_cast<uint32_t>(m.disp));
+    }
+    void memOp(bool wide, uint8_t opcode, int reg, Mem m) { memOp(wide, {opcode}, reg, m); }
+    void shift(int digit, Reg r) {
+        rex(true, 0, r);
+        byte(0xd3);
+        byte(static_cast<uint8_t>(0xc0 | digit << 3 | (r & 7)));
+    }
+};
+
+// Register use in generated code (all callee-saved, so they survive the
+// helper calls):
+//   rbx  stack top (VM::stackTop, written back around helper calls)
+//   r12  frame slots
+//   r13  VM*
+//   r14  globals
+//   r15  &VM::stackTop
+constexpr Reg SP = RBX;
+constexpr Reg SLOTS = R12;
+constexpr Reg VMREG = R13;
+constexpr Reg GLOBALS = R14;
+constexpr Reg TOP = R15;
+
+constexpr int32_t VALUE_SIZE = sizeof(Value);
+constexpr int32_t PAYLOAD = offsetof(Value, as);
+
+constexpr Mem TOS_TAG{SP, -VALUE_SIZE};
+constexpr Mem TOS{SP, -VALUE_SIZE + PAYLOAD};
+constexpr Mem NOS_TAG{SP, -2 * VALUE_SIZE};
+constexpr Mem NOS{SP, -2 * VALUE_SIZE + PAYLOAD};
+
+constexpr uint8_t tagOf(ValueType type) { return static_cast<uint8_t>(type); }
+
+Mem slot(Reg base, uint32_t index, int32_t field = 0) {
+    return {base, static_cast<int32_t>(index) * VALUE_SIZE + field};
+}
+
+// Out-of-line pieces that do not touch the VM.
+int truthy(const Value* value) {
+    return asBool(*value);
+}
+
+int lessThan(const Value* a, const Value* b) {
+    return asDouble(*a) < asDouble(*b);
+}
+
+using EntryStub = int (*)(VM* vm, Value** stackTop, Value* slots, Value* globals, const uint8_t* target);
+
+template <typename Fn>
+uint64_t address(Fn* fn) {
+    return reinterpret_cast<uint64_t>(fn);
+}
+
+// The VM's entry points for generated code (VM::jitOperator, ...), which
+// only Jit may name.
+struct Helpers {
+    uint64_t operation;
+    uint64_t increment;
+    uint64_t safepoint;
+    uint64_t call;
+    uint64_t tailCall;
+    uint64_t callDirect;
+    uint64_t invoke;
+    uint64_t tailInvoke;
+    uint64_t execute;
+};
+
+// Inline code for an arithmetic or comparison opcode: `kind` applied to two
+// int (or two float) payloads. A generic or quickened opcode checks both
+// tags first and runs `generic` through the VM otherwise; a typed opcode
+// (OP_ADD_INT, ...) has no check.
+enum class Inline { INT, FLOAT };
+enum class Kind { ADD, SUB, MUL, DIV, AND, OR, XOR, COMPARE };
+
+struct OperatorTemplate {
+    uint8_t generic;
+    Inline path;
+    Kind kind;
+    Cond compare = CC_E;  // Kind::COMPARE
+};
+
+class CodeGenerator {
+public:
+    CodeGenerator(FunctionObject& function, const Helpers& helpers)
+        : chunk(function.chunk), entries(chunk.code.size(), UINT32_MAX), helpers(helpers) {}
+
+    bool generate();
+
+    Assembler as;
+    Chunk& chunk;
+    std::vector<uint32_t> entries;
+
+private:
+    const Helpers& helpers;
+    size_t epilogue = 0;
+    size_t errorExit = 0;
+    std::vector<std::pair<size_t, size_t>> jumps;  // displacement to patch, bytecode target
+
+    void prologue();
+    bool instruction(size_t offset);
+
+    void jumpTo(size_t target) { jumps.emplace_back(as.jmp(), target); }
+    void jumpTo(Cond cc, size_t target) { jumps.emplace_back(as.jcc(cc), target); }
+    void exitWith(JitStatus status) {
+        as.movImm(RAX, static_cast<uint64_t>(status));
+        as.jmp(epilogue);
+    }
+
+    void callVM(uint64_t helper, uint64_t arg1, uint64_t arg2 = 0);
+    void callPure(uint64_t helper);
+
+    void pushValue(const Value& value);
+    void storePayload(Mem dst, uint64_t bits);
+    // Values move as two 8-byte words, and tags are stored as whole words,
+    // so every load can be forwarded from the store that wrote it.
+    void copy(Mem dst, Mem src) {
+        as.load(RAX, src);
+        as.load(RCX, {src.base, src.disp + PAYLOAD});
+        as.store(dst, RAX);
+        as.store({dst.base, dst.disp + PAYLOAD}, RCX);
+    }
+    void storeTag(Mem dst, ValueType type) { as.storeImm(dst, tagOf(type)); }
+    void drop() { as.alu(SUB, SP, VALUE_SIZE); }
+
+    void intOperator(const OperatorTemplate& op);
+    void floatOperator(const OperatorTemplate& op);
+    void guardedOperator(const OperatorTemplate& op);
+    void branchOnTruth(bool jumpIfTrue, size_t target);
+    void branchUnlessLess(Mem a, const Value* constant, Mem b, size_t target);
+};
+
+// Entry stub: entry(vm, &vm->stackTop, slots, globals, target) saves the
+// callee-saved registers, loads the VM state and jumps to `target`, the code
+// of the instruction the frame is at. Every exit goes through the epilogue
+// with a JitStatus in eax.
+void CodeGenerator::prologue() {
+    for (Reg r : {RBX, RBP, R12, R13, R14, R15}) as.push(r);
+    as.alu(SUB, RSP, 8);  // keeps calls 16-byte aligned
+    as.mov(VMREG, RDI);
+    as.mov(TOP, RSI);
+    as.mov(SLOTS, RDX);
+    as.mov(GLOBALS, RCX);
+    as.load(SP, {TOP, 0});
+    as.jmp(R8);
+
+    epilogue = as.size();
+    as.store({TOP, 0}, SP);
+    as.alu(ADD, RSP, 8);
+    for (Reg r : {R15, R14, R13, R12, RBP, RBX}) as.pop(r);
+    as.ret();
+
+    errorExit = as.size();
+    exitWith(JitStatus::ERROR);
+}
+
+// VM helpers see the current stack top and may move it (calls, handlers).
+void CodeGenerator::callVM(uint64_t helper, uint64_t arg1, uint64_t arg2) {
+    as.store({TOP, 0}, SP);
+    as.mov(RDI, VMREG);
+    as.movImm(RSI, arg1);
+    as.movImm(RDX, arg2);
+    as.movImm(RAX, helper);
+    as.callRax();
+    as.load(SP, {TOP, 0});
+    as.testEax();
+    as.jcc(CC_E, errorExit);
+}
+
+// Arguments already in rdi/rsi; the result is left in eax.
+void CodeGenerator::callPure(uint64_t helper) {
+    as.movImm(RAX, helper);
+    as.callRax();
+}
+
+void CodeGenerator::storePayload(Mem dst, uint64_t bits) {
+    int64_t value = static_cast<int64_t>(bits);
+    if (value >= INT32_MIN && value <= INT32_MAX) {
+        as.storeImm(dst, static_cast<int32_t>(value));
+        return;
+    }
+    as.movImm(RAX, bits);
+    as.store(dst, RAX);
+}
+
+// Constants are never collected, so their payload (object pointers
+// included) is baked into the code.
+void CodeGenerator::pushValue(const Value& value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value.as, sizeof(bits));
+    storeTag({SP, 0}, value.type);
+    storePayload({SP, PAYLOAD}, bits);
+    as.alu(ADD, SP, VALUE_SIZE);
+}
+
+// Both operands are ints: payload op payload, as the typed opcodes do.
+void CodeGenerator::intOperator(const OperatorTemplate& op) {
+    as.load(RAX, NOS);
+    switch (op.kind) {
+        case Kind::COMPARE:
+            as.alu(CMP, RAX, TOS);
+            as.setccEax(op.compare);
+            storeTag(NOS_TAG, ValueType::BOOL);
+            break;
+        case Kind::MUL: as.imul(RAX, TOS); break;
+        case Kind::SUB: as.alu(SUB, RAX, TOS); break;
+        case Kind::AND: as.alu(AND, RAX, TOS); break;
+        case Kind::OR: as.alu(OR, RAX, TOS); break;
+        case Kind::XOR: as.alu(XOR, RAX, TOS); break;
+        default: as.alu(ADD, RAX, TOS); break;
+    }
+    as.store(NOS, RAX);
+    drop();
+}
+
+void CodeGenerator::floatOperator(const OperatorTemplate& op) {
+    Sse arith = op.kind == Kind::SUB ? SD_SUB : op.kind == Kind::MUL ? SD_MUL : op.kind == Kind::DIV ? SD_DIV : SD_ADD;
+    as.sse(SD_LOAD, NOS);
+    as.sse(arith, TOS);
+    as.sse(SD_STORE, NOS);
+    drop();
+}
+
+void CodeGenerator::guardedOperator(const OperatorTemplate& op) {
+    uint8_t tag = tagOf(op.path == Inline::INT ? ValueType::INT : ValueType::FLOAT);
+    as.cmpByte(NOS_TAG, tag);
+    size_t slowA = as.jcc(CC_NE);
+    as.cmpByte(TOS_TAG, tag);
+    size_t slowB = as.jcc(CC_NE);
+    if (op.path == Inline::INT) {
+        intOperator(op);
+    } else {
+        floatOperator(op);
+    }
+    size_t done = as.jmp();
+    as.bind(slowA);
+    as.bind(slowB);
+    callVM(helpers.operation, op.generic);
+    as.bind(done);
+}
+
+// JUMP_IF_FALSE/JUMP_IF_TRUE: bools are tested inline; the value stays on
+// the stack.
+void CodeGenerator::branchOnTruth(bool jumpIfTrue, size_t target) {
+    as.cmpByte(TOS_TAG, tagOf(ValueType::BOOL));
+    size_t slow = as.jcc(CC_NE);
+    as.cmpByte(TOS, 0);
+    jumpTo(jumpIfTrue ? CC_NE : CC_E, target);
+    size_t done = as.jmp();
+    as.bind(slow);
+    as.lea(RDI, TOS_TAG);
+    callPure(address(&truthy));
+    as.testEax();
+    jumpTo(jumpIfTrue ? CC_NE : CC_E, target);
+    as.bind(done);
+}
+
+// JUMP_IF_NOT_LT_*: compares int payloads inline when both sides are ints.
+// `constant`, if set, is the right-hand side instead of `b`.
+void CodeGenerator::branchUnlessLess(Mem a, const Value* constant, Mem b, size_t target) {
+    std::vector<size_t> slow;
+    size_t done = SIZE_MAX;
+    if (!constant || constant->isInt()) {
+        as.cmpByte(a, tagOf(ValueType::INT));
+        slow.push_back(as.jcc(CC_NE));
+        as.load(RAX, {a.base, a.disp + PAYLOAD});
+        if (constant) {
+            as.movImm(RCX, static_cast<uint64_t>(constant->as.integer));
+        } else {
+            as.cmpByte(b, tagOf(ValueType::INT));
+            slow.push_back(as.jcc(CC_NE));
+            as.load(RCX, {b.base, b.disp + PAYLOAD});
+        }
+        as.alu(CMP, RAX, RCX);
+        jumpTo(CC_GE, target);
+        done = as.jmp();
+    }
+    for (size_t at : slow) as.bind(at);
+    as.lea(RDI, a);
+    if (constant) {
+        as.movImm(RSI, reinterpret_cast<uint64_t>(constant));
+    } else {
+        as.lea(RSI, b);
+    }
+    callPure(address(&lessThan));
+    as.testEax();
+    jumpTo(CC_E, target);
+    if (done != SIZE_MAX) as.bind(done);
+}
+
+const OperatorTemplate* operatorTemplate(uint8_t op) {
+    using I = Inline;
+    static const OperatorTemplate add{OP_ADD, I::INT, Kind::ADD}, addF{OP_ADD, I::FLOAT, Kind::ADD},
+        sub{OP_SUB, I::INT, Kind::SUB}, subF{OP_SUB, I::FLOAT, Kind::SUB}, mul{OP_MUL, I::INT, Kind::MUL},
+        mulF{OP_MUL, I::FLOAT, Kind::MUL}, divF{OP_DIV, I::FLOAT, Kind::DIV},
+        lt{OP_LESSER, I::INT, Kind::COMPARE, CC_L}, le{OP_LESSER_EQUAL, I::INT, Kind::COMPARE, CC_LE},
+        gt{OP_GREATER, I::INT, Kind::COMPARE, CC_G}, ge{OP_GREATER_EQUAL, I::INT, Kind::COMPARE, CC_GE},
+        eq{OP_EQUAL, I::INT, Kind::COMPARE, CC_E}, ne{OP_NOT_EQUAL, I::INT, Kind::COMPARE, CC_NE},
+        bitAnd{OP_BITAND_INT, I::INT, Kind::AND}, bitOr{OP_BITOR_INT, I::INT, Kind::OR},
+        bitXor{OP_XOR_INT, I::INT, Kind::XOR};
+
+    switch (op) {
+        case OP_ADD: case OP_PLUS_EQUAL: case OP_ADD_INT_GUARDED: case OP_ADD_INT: return &add;
+        case OP_ADD_F64_GUARDED: case OP_ADD_F64: return &addF;
+        case OP_SUB: case OP_MINUS_EQUAL: case OP_SUB_INT_GUARDED: case OP_SUB_INT: return &sub;
+        case OP_SUB_F64_GUARDED: case OP_SUB_F64: return &subF;
+        case OP_MUL: case OP_MULTIPLY_EQUAL: case OP_MUL_INT_GUARDED: case OP_MUL_INT: return &mul;
+        case OP_MUL_F64_GUARDED: case OP_MUL_F64: return &mulF;
+        case OP_DIV: case OP_DIVIDE_EQUAL: case OP_DIV_F64_GUARDED: case OP_DIV_F64: return &divF;
+        case OP_LESSER: case OP_LT_INT_GUARDED: case OP_LT_INT: return &lt;
+        case OP_LESSER_EQUAL: case OP_LE_INT_GUARDED: case OP_LE_INT: return &le;
+        case OP_GREATER: case OP_GT_INT_GUARDED: case OP_GT_INT: return &gt;
+        case OP_GREATER_EQUAL: case OP_GE_INT_GUARDED: case OP_GE_INT: return &ge;
+        case OP_EQUAL: case OP_EQ_INT_GUARDED: case OP_EQ_INT: return &eq;
+        case OP_NOT_EQUAL: case OP_NE_INT_GUARDED: case OP_NE_INT: return &ne;
+        case OP_BITAND_INT: return &bitAnd;
+        case OP_BITOR_INT: return &bitOr;
+        case OP_XOR_INT: return &bitXor;
+        default: return nullptr;
+    }
+}
+
+bool isTypedOperator(uint8_t op) {
+    return op >= OP_ADD_INT && op <= OP_DIV_F64;
+}
+
+bool CodeGenerator::generate() {
+    prologue();
+    for (size_t offset = 0; offset < chunk.code.size();) {
+        size_t length = static_cast<size_t>(instructionLength(chunk.code[offset]));
+        if (offset + length > chunk.code.size()) return false;
+        entries[offset] = static_cast<uint32_t>(as.size());
+        if (!instruction(offset)) return false;
+        offset += length;
+    }
+    // Falling off the end of the bytecode is not possible; stop anyway.
+    exitWith(JitStatus::ERROR);
+
+    for (const auto& [at, target] : jumps) {
+        if (target >= entries.size() || entries[target] == UINT32_MAX) return false;
+        as.patch(at, entries[target]);
+    }
+    return true;
+}
+
+bool CodeGenerator::instruction(size_t offset) {
+    uint8_t* ip = chunk.code.data() + offset;
+    uint8_t op = ip[0];
+    auto short16 = [&](int at) { return static_cast<uint16_t>(ip[at] << 8 | ip[at + 1]); };
+
+    if (const OperatorTemplate* t = operatorTemplate(op)) {
+        if (isTypedOperator(op)) {
+            if (t->path == Inline::INT) {
+                intOperator(*t);
+            } else {
+                floatOperator(*t);
+            }
+        } else {
+            guardedOperator(*t);
+        }
+        return true;
+    }
+
+    switch (op) {
+        case OP_CONSTANT:
+            pushValue(chunk.constants[ip[1]]);
+            return true;
+        case OP_TRUE:
+            pushValue(Value(true));
+            return true;
+        case OP_FALSE:
+            pushValue(Value(false));
+            return true;
+        case OP_NULL:
+            pushValue(Value());
+            return true;
+        case OP_GET_LOCAL:
+            copy({SP, 0}, slot(SLOTS, ip[1]));
+            as.alu(ADD, SP, VALUE_SIZE);
+            return true;
+        case OP_SET_LOCAL:
+            copy(slot(SLOTS, ip[1]), TOS_TAG);
+            return true;
+        case OP_SET_LOCAL_POP:
+            drop();
+            copy(slot(SLOTS, ip[1]), {SP, 0});
+            return true;
+        case OP_GET_GLOBAL:
+            copy({SP, 0}, slot(GLOBALS, short16(1)));
+            as.alu(ADD, SP, VALUE_SIZE);
+            return true;
+        case OP_SET_GLOBAL:
+            copy(slot(GLOBALS, short16(1)), TOS_TAG);
+            return true;
+        case OP_POP:
+            drop();
+            return true;
+
+        case OP_MOD_INT:  // same trap as the interpreter's `%` on a zero divisor
+            as.load(RAX, NOS);
+            as.cqo();
+            as.idiv(TOS);
+            as.store(NOS, RDX);
+            drop();
+            return true;
+        case OP_SHL_INT:
+        case OP_SHR_INT:  // the hardware masks the count to 6 bits, like shiftCount()
+            as.load(RAX, NOS);
+            as.load(RCX, TOS);
+            if (op == OP_SHL_INT) {
+                as.shl(RAX);
+            } else {
+                as.sar(RAX);
+            }
+            as.store(NOS, RAX);
+            drop();
+            return true;
+
+        case OP_MOD:
+        case OP_MODULO_EQUAL:
+        case OP_BITWISE_AND:
+        case OP_BITWISE_AND_EQUAL:
+        case OP_BITWISE_OR:
+        case OP_BITWISE_OR_EQUAL:
+        case OP_XOR:
+        case OP_XOR_EQUAL:
+        case OP_LEFT_SHIFT:
+        case OP_LEFT_SHIFT_EQUAL:
+        case OP_RIGHT_SHIFT:
+        case OP_RIGHT_SHIFT_EQUAL:
+        case OP_LOGICAL_AND:
+        case OP_LOGICAL_AND_EQUAL:
+        case OP_LOGICAL_OR:
+        case OP_LOGICAL_OR_EQUAL:
+        case OP_NOT:
+        case OP_NEGATE:
+            callVM(helpers.operation, op);
+            return true;
+
+        case OP_JUMP:
+            jumpTo(offset + 3 + short16(1));
+            return true;
+        case OP_LOOP:
+            callVM(helpers.safepoint, 0);
+            jumpTo(offset + 3 - short16(1));
+            return true;
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_TRUE:
+            branchOnTruth(op == OP_JUMP_IF_TRUE, offset + 3 + short16(1));
+            return true;
+        case OP_JUMP_IF_NOT_LT_LOCAL:
+            branchUnlessLess(slot(SLOTS, ip[1]), nullptr, slot(SLOTS, ip[2]), offset + 5 + short16(3));
+            return true;
+        case OP_JUMP_IF_NOT_LT_CONST:
+            branchUnlessLess(slot(SLOTS, ip[1]), &chunk.constants[ip[2]], {}, offset + 5 + short16(3));
+            return true;
+
+        case OP_INC_LOCAL_CONST: {
+            const Value& step = chunk.constants[ip[2]];
+            size_t done = SIZE_MAX;
+            if (step.isInt()) {
+                as.cmpByte(slot(SLOTS, ip[1]), tagOf(ValueType::INT));
+                size_t slow = as.jcc(CC_NE);
+                if (step.as.integer >= INT32_MIN && step.as.integer <= INT32_MAX) {
+                    as.alu(ADD, slot(SLOTS, ip[1], PAYLOAD), static_cast<int32_t>(step.as.integer));
+                } else {
+                    as.movImm(RAX, static_cast<uint64_t>(step.as.integer));
+                    as.alu(ADD, slot(SLOTS, ip[1], PAYLOAD), RAX);
+                }
+                done = as.jmp();
+                as.bind(slow);
+            }
+            callVM(helpers.increment, ip[1], reinterpret_cast<uint64_t>(&step));
+            if (done != SIZE_MAX) as.bind(done);
+            return true;
+        }
+
+        case OP_CALL:
+            callVM(helpers.call, ip[1]);
+            return true;
+        case OP_CALL_DIRECT:
+            callVM(helpers.callDirect, reinterpret_cast<uint64_t>(ip));
+            return true;
+        case OP_TAIL_CALL:
+        case OP_TAIL_INVOKE: {
+            // Leaves this code if the frame now runs the callee; otherwise
+            // the call has returned and the OP_RETURN after it follows.
+            callVM(op == OP_TAIL_CALL ? helpers.tailCall : helpers.tailInvoke, reinterpret_cast<uint64_t>(ip));
+            as.cmpEax(2);
+            size_t called = as.jcc(CC_NE);
+            exitWith(JitStatus::TAIL_CALLED);
+            as.bind(called);
+            return true;
+        }
+        case OP_INVOKE:
+            callVM(helpers.invoke, reinterpret_cast<uint64_t>(ip));
+            return true;
+        case OP_RETURN:
+            copy(slot(SLOTS, 0), TOS_TAG);
+            as.lea(SP, slot(SLOTS, 1));
+            exitWith(JitStatus::RETURNED);
+            return true;
+        case OP_HALT:
+            exitWith(JitStatus::HALTED);
+            return true;
+
+        default:
+            callVM(helpers.execute, reinterpret_cast<uint64_t>(ip));
+            return true;
+    }
+}
+
+}  // namespace
+
+bool Jit::supported() {
+    return true;
+}
+
+Jit::Jit(bool writePerfMap) : writePerfMap(writePerfMap) {}
+
+Jit::~Jit() {
+    for (FunctionObject* function : functions) {
+        function->jitCode = nullptr;
+        function->hotness = 0;
+    }
+    for (const auto& compiled : code) {
+        munmap(compiled->code, compiled->size);
+    }
+    if (perfMap) std::fclose(perfMap);
+}
+
+bool Jit::compile(FunctionObject& function) {
+    static const Helpers helpers = {
+        address(&VM::jitOperator), address(&VM::jitIncrement), address(&VM::jitSafepoint),
+        address(&VM::jitCall),     address(&VM::jitTailCall),  address(&VM::jitCallDirect),
+        address(&VM::jitInvoke),   address(&VM::jitTailInvoke), address(&VM::jitExecute),
+    };
+    CodeGenerator generator(function, helpers);
+    void* memory = MAP_FAILED;
+    size_t size = 0;
+    if (generator.generate()) {
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size = (generator.as.size() + page - 1) / page * page;
+        memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (memory == MAP_FAILED) {
+        function.hotness = 0;
+        return false;
+    }
+    std::memcpy(memory, generator.as.code.data(), generator.as.size());
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        function.hotness = 0;
+        return false;
+    }
+
+    auto compiled = std::make_unique<JitCode>();
+    compiled->code = static_cast<uint8_t*>(memory);
+    compiled->size = size;
+    compiled->entries = std::move(generator.entries);
+    function.jitCode = compiled.get();
+    functions.push_back(&function);
+    code.push_back(std::move(compiled));
+
+    ++stats.functions;
+    stats.codeBytes += generator.as.size();
+    if (writePerfMap && !perfMap) {  // opened with the first function, so runs that compile nothing leave no file
+        char path[64];
+        std::snprintf(path, sizeof(path), "/tmp/perf-%d.map", static_cast<int>(getpid()));
+        perfMap = std::fopen(path, "w");
+    }
+    if (perfMap) {
+        std::string name = function.ownerClass ? function.ownerClass->name + "." + function.name : function.name;
+        std::fprintf(perfMap, "%lx %zx penguin:%s\n", reinterpret_cast<unsigned long>(memory),
+                     generator.as.size(), name.c_str());
+        std::fflush(perfMap);
+    }
+    return true;
+}
+
+JitStatus Jit::execute(VM& vm, CallFrame& frame) {
+    const JitCode& compiled = *frame.function->jitCode;
+    uint32_t target = compiled.entries[frame.ip - frame.function->chunk.code.data()];
+    auto entry = reinterpret_cast<EntryStub>(compiled.code);
+    return static_cast<JitStatus>(entry(&vm, &vm.stackTop, frame.slots, vm.globals.data(), compiled.code + target));
+}
+
+#else  // no code generator for this host
+
+bool Jit::supported() {
+    return false;
+}
+
+Jit::Jit(bool) : writePerfMap(false) {}
+
+Jit::~Jit() = default;
+
+bool Jit::compile(FunctionObject& function) {
+    function.hotness = 0;
+    return false;
+}
+
+JitStatus Jit::execute(VM&, CallFrame&) {
+    return JitStatus::ERROR;
+}
+
+#endif
+
+}  // namespace vm
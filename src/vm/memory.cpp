@@ -0,0 +1,275 @@
+#include "vm/memory.h"
+
+#include "vm/value.h"
+
+#include <algorithm>
+
+namespace vm {
+
+static Heap* activeHeap = nullptr;
+
+Heap* Heap::active() {
+    return activeHeap;
+}
+
+Heap::Scope::Scope(Heap* heap) : previous(activeHeap) {
+    activeHeap = heap;
+}
+
+Heap::Scope::~Scope() {
+    activeHeap = previous;
+}
+
+Heap::~Heap() {
+    while (objects) {
+        Obj* next = objects->next;
+        freeObject(objects);
+        objects = next;
+    }
+    for (void* block : arenaBlocks) {
+        ::operator delete(block);
+    }
+}
+
+void* Heap::allocate(size_t size) {
+    if (size > MAX_SMALL_OBJECT) {
+        return ::operator new(size);
+    }
+
+    size_t sizeClass = (size + SIZE_CLASS - 1) / SIZE_CLASS;
+    if (FreeSlot* slot = freeLists[sizeClass - 1]) {
+        freeLists[sizeClass - 1] = slot->next;
+        return slot;
+    }
+
+    size_t bytes = sizeClass * SIZE_CLASS;
+    if (static_cast<size_t>(bumpEnd - bumpNext) < bytes) {
+        // The tail of the old block is abandoned; it is smaller than any object.
+        bumpNext = static_cast<char*>(::operator new(ARENA_BLOCK_SIZE));
+        bumpEnd = bumpNext + ARENA_BLOCK_SIZE;
+        arenaBlocks.push_back(bumpNext);
+        gcStats.arenaBytes += ARENA_BLOCK_SIZE;
+    }
+    void* memory = bumpNext;
+    bumpNext += bytes;
+    return memory;
+}
+
+void Heap::release(void* memory, size_t size) {
+    if (size > MAX_SMALL_OBJECT) {
+        ::operator delete(memory);
+        return;
+    }
+
+    size_t sizeClass = (size + SIZE_CLASS - 1) / SIZE_CLASS;
+    auto* slot = static_cast<FreeSlot*>(memory);
+    slot->next = freeLists[sizeClass - 1];
+    freeLists[sizeClass - 1] = slot;
+}
+
+size_t objectSize(const Obj* object) {
+    switch (object->objType) {
+        case ObjType::STRING:
+            return sizeof(StringObject) + static_cast<const StringObject*>(object)->chars.capacity();
+        case ObjType::ARRAY:
+            return sizeof(ArrayObject) + static_cast<const ArrayObject*>(object)->capacity * sizeof(Value);
+        case ObjType::FUNCTION:
+            return sizeof(FunctionObject);
+        case ObjType::CLASS:
+            return sizeof(ClassObject);
+        case ObjType::INSTANCE: {
+            auto* instance = static_cast<const InstanceObject*>(object);
+            size_t size = sizeof(InstanceObject) + instance->slotCount * sizeof(Value);
+            if (instance->overflow) {
+                size += instance->overflow->size() * (sizeof(std::string) + sizeof(Value));
+            }
+            return size;
+        }
+        case ObjType::BOUND_METHOD:
+            return sizeof(BoundMethod) +
+                   static_cast<const BoundMethod*>(object)->methods.capacity() * sizeof(FunctionObject*);
+    }
+    return 0;
+}
+
+template <typename T>
+void Heap::destroy(Obj* object) {
+    T* typed = static_cast<T*>(object);
+    typed->~T();
+    release(typed, sizeof(T));
+}
+
+void Heap::freeObject(Obj* object) {
+    switch (object->objType) {
+        case ObjType::STRING:
+            destroy<StringObject>(object);
+            break;
+        case ObjType::ARRAY:
+            destroy<ArrayObject>(object);
+            break;
+        case ObjType::FUNCTION:
+            destroy<FunctionObject>(object);
+            break;
+        case ObjType::CLASS:
+            destroy<ClassObject>(object);
+            break;
+        case ObjType::INSTANCE:
+            destroy<InstanceObject>(object);
+            break;
+        case ObjType::BOUND_METHOD:
+            destroy<BoundMethod>(object);
+            break;
+    }
+}
+
+void Heap::track(Obj* object) {
+    object->next = objects;
+    objects = object;
+    ++trackedObjects;
+    noteAllocation(objectSize(object));
+}
+
+void Heap::noteAllocation(size_t bytes) {
+    bytesSinceCollection += bytes;
+    gcStats.bytesAllocated += bytes;
+}
+
+void Heap::beginCollection() {
+    collectionStart = std::chrono::steady_clock::now();
+    ++epoch;
+}
+
+void Heap::markValue(const Value& value) {
+    switch (value.type) {
+        case ValueType::STRING:
+            markObject(value.as.string);
+            break;
+        case ValueType::ARRAY:
+            markObject(value.as.array);
+            break;
+        case ValueType::FUNCTION:
+            markObject(value.as.function);
+            break;
+        case ValueType::CLASS:
+            markObject(value.as.klass);
+            break;
+        case ValueType::INSTANCE:
+            markObject(value.as.instance);
+            break;
+        case ValueType::BOUND_METHOD:
+            markObject(value.as.bound);
+            break;
+        default:
+            break;
+    }
+}
+
+void Heap::markObject(Obj* object) {
+    if (!object || object->markEpoch == epoch) {
+        return;
+    }
+    object->markEpoch = epoch;
+    // Strings hold no references, so they never need to be traced.
+    if (object->objType != ObjType::STRING) {
+        grayStack.push_back(object);
+    }
+}
+
+void Heap::blacken(Obj* object) {
+    switch (object->objType) {
+        case ObjType::STRING:
+            break;
+        case ObjType::ARRAY: {
+            auto* array = static_cast<ArrayObject*>(object);
+            for (size_t i = 0; i < array->length; ++i) {
+                markValue(array->data[i]);
+            }
+            break;
+        }
+        case ObjType::FUNCTION: {
+            auto* function = static_cast<FunctionObject*>(object);
+            markObject(function->ownerClass);
+            for (const Value& constant : function->chunk.constants) {
+                markValue(constant);
+            }
+            // Cached classes must outlive the cache: a new class allocated at
+            // a freed one's address would otherwise hit its stale entries.
+            for (const PropertyCache& cache : function->chunk.propertyCaches) {
+                for (const PropertyCacheEntry& entry : cache.entries) {
+                    markObject(entry.klass);
+                }
+            }
+            break;
+        }
+        case ObjType::CLASS: {
+            auto* klass = static_cast<ClassObject*>(object);
+            markObject(klass->parent);
+            for (const auto& overloads : klass->methods) {
+                for (FunctionObject* method : overloads.second) {
+                    markObject(method);
+                }
+            }
+            break;
+        }
+        case ObjType::INSTANCE: {
+            auto* instance = static_cast<InstanceObject*>(object);
+            markObject(instance->klass);
+            for (uint32_t i = 0; i < instance->slotCount; ++i) {
+                markValue(instance->slots[i]);
+            }
+            if (instance->overflow) {
+                for (const auto& field : *instance->overflow) {
+                    markValue(field.second);
+                }
+            }
+            break;
+        }
+        case ObjType::BOUND_METHOD: {
+            auto* bound = static_cast<BoundMethod*>(object);
+            markObject(bound->instance);
+            for (FunctionObject* method : bound->methods) {
+                markObject(method);
+            }
+            break;
+        }
+    }
+}
+
+void Heap::sweep() {
+    size_t liveBytes = 0;
+    Obj** link = &objects;
+    while (Obj* object = *link) {
+        size_t size = objectSize(object);
+        if (object->markEpoch == epoch) {
+            liveBytes += size;
+            link = &object->next;
+            continue;
+        }
+        *link = object->next;
+        freeObject(object);
+        --trackedObjects;
+        ++gcStats.objectsFreed;
+        gcStats.bytesReclaimed += size;
+    }
+
+    gcStats.liveBytes = liveBytes;
+    bytesSinceCollection = 0;
+    nextCollection = std::max(liveBytes * 2, minimumThreshold);
+}
+
+void Heap::finishCollection() {
+    while (!grayStack.empty()) {
+        Obj* object = grayStack.back();
+        grayStack.pop_back();
+        blacken(object);
+    }
+    sweep();
+
+    auto pause = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - collectionStart);
+    ++gcStats.collections;
+    gcStats.totalPause += pause;
+    gcStats.maxPause = std::max(gcStats.maxPause, pause);
+}
+
+}  // namespace vm
@@ -0,0 +1,349 @@
+#include "vm/peephole.h"
+
+#include "vm/disassembler.h"
+
+#include <vector>
+
+namespace vm {
+
+// The chunk is decoded into a list of instructions whose jump operands are
+// instruction indices rather than byte offsets. The passes below rewrite
+// or delete instructions in that list until none of them applies, and the
+// list is then encoded again with fresh offsets.
+
+namespace {
+
+struct Instruction {
+    uint8_t op;
+    std::vector<uint8_t> operands;  // everything after the opcode byte
+    int target = -1;                // jumps: index of the destination instruction
+    bool removed = false;
+};
+
+// Byte position of the 16-bit jump offset within the operands, or -1.
+int jumpOperand(uint8_t op) {
+    switch (op) {
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_TRUE:
+        case OP_LOOP:
+            return 0;
+        case OP_JUMP_IF_NOT_LT_LOCAL:
+        case OP_JUMP_IF_NOT_LT_CONST:
+            return 2;
+        default:
+            return -1;
+    }
+}
+
+bool isUnconditionalJump(uint8_t op) {
+    return op == OP_JUMP || op == OP_LOOP;
+}
+
+// JUMP_IF_FALSE and JUMP_IF_TRUE, which test the value on top of the stack.
+bool isTest(uint8_t op) {
+    return op == OP_JUMP_IF_FALSE || op == OP_JUMP_IF_TRUE;
+}
+
+bool endsBlock(uint8_t op) {
+    return isUnconditionalJump(op) || op == OP_RETURN || op == OP_HALT;
+}
+
+// Pushes one value and has no other effect.
+bool isPurePush(uint8_t op) {
+    switch (op) {
+        case OP_CONSTANT:
+        case OP_GET_LOCAL:
+        case OP_GET_GLOBAL:
+        case OP_TRUE:
+        case OP_FALSE:
+        case OP_NULL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+class Peephole {
+public:
+    Peephole(const Chunk& chunk, PeepholeStats& stats, const size_t* entry) : stats(stats) {
+        const std::vector<uint8_t>& code = chunk.code;
+        std::vector<int> indexAt(code.size() + 1, -1);
+        std::vector<int> targetOffset;
+
+        size_t offset = 0;
+        while (offset < code.size()) {
+            int length = instructionLength(code[offset]);
+            if (offset + length > code.size()) {
+                valid = false;
+                return;
+            }
+            Instruction instruction;
+            instruction.op = code[offset];
+            instruction.operands.assign(code.begin() + offset + 1, code.begin() + offset + length);
+
+            int at = jumpOperand(instruction.op);
+            int destination = -1;
+            if (at >= 0) {
+                int jump = (instruction.operands[at] << 8) | instruction.operands[at + 1];
+                int next = static_cast<int>(offset) + length;
+                destination = instruction.op == OP_LOOP ? next - jump : next + jump;
+            }
+
+            indexAt[offset] = static_cast<int>(instructions.size());
+            targetOffset.push_back(destination);
+            instructions.push_back(std::move(instruction));
+            offset += length;
+        }
+        indexAt[code.size()] = static_cast<int>(instructions.size());
+
+        for (size_t i = 0; i < instructions.size(); ++i) {
+            int destination = targetOffset[i];
+            if (destination < 0) continue;
+            if (destination > static_cast<int>(code.size()) || indexAt[destination] < 0) {
+                valid = false;  // not an instruction boundary; leave the chunk alone
+                return;
+            }
+            instructions[i].target = indexAt[destination];
+        }
+        if (entry) {
+            if (*entry > code.size() || indexAt[*entry] < 0) {
+                valid = false;
+                return;
+            }
+            entryIndex = indexAt[*entry];
+        }
+    }
+
+    bool valid = true;
+
+    void run() {
+        stats.instructionsBefore += instructions.size();
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            computeTargets();
+            changed |= threadJumps();
+            changed |= removeUnreachable();
+            computeTargets();
+            changed |= fuseJumpIfTrue();
+            computeTargets();
+            changed |= foldStoreLoad();
+            compact();
+        }
+        stats.instructionsAfter += instructions.size();
+    }
+
+    bool encode(std::vector<uint8_t>& code, size_t* entry) const {
+        std::vector<int> offsets(instructions.size() + 1);
+        int offset = 0;
+        for (size_t i = 0; i < instructions.size(); ++i) {
+            offsets[i] = offset;
+            offset += 1 + static_cast<int>(instructions[i].operands.size());
+        }
+        offsets[instructions.size()] = offset;
+
+        std::vector<uint8_t> out;
+        out.reserve(offset);
+        for (size_t i = 0; i < instructions.size(); ++i) {
+            Instruction instruction = instructions[i];
+            int at = jumpOperand(instruction.op);
+            if (at >= 0) {
+                int next = offsets[i + 1];
+                int destination = offsets[instruction.target];
+                // Threading can turn a forward jump into a backward one and back.
+                if (isUnconditionalJump(instruction.op)) {
+                    instruction.op = destination < next ? OP_LOOP : OP_JUMP;
+                }
+                int jump = instruction.op == OP_LOOP ? next - destination : destination - next;
+                if (jump < 0 || jump > 0xffff) return false;
+                instruction.operands[at] = static_cast<uint8_t>((jump >> 8) & 0xff);
+                instruction.operands[at + 1] = static_cast<uint8_t>(jump & 0xff);
+            }
+            out.push_back(instruction.op);
+            out.insert(out.end(), instruction.operands.begin(), instruction.operands.end());
+        }
+        code = std::move(out);
+        if (entry) *entry = static_cast<size_t>(offsets[entryIndex]);
+        return true;
+    }
+
+private:
+    std::vector<Instruction> instructions;
+    std::vector<bool> isTarget;
+    int entryIndex = -1;  // the caller's entry point, kept like a jump destination
+    PeepholeStats& stats;
+
+    void computeTargets() {
+        isTarget.assign(instructions.size() + 1, false);
+        for (const Instruction& instruction : instructions) {
+            if (!instruction.removed && instruction.target >= 0) {
+                isTarget[instruction.target] = true;
+            }
+        }
+        if (entryIndex >= 0) isTarget[entryIndex] = true;
+    }
+
+    void remove(size_t i) {
+        instructions[i].removed = true;
+    }
+
+    // Jumps whose destination is itself a jump land on the final destination
+    // instead. JUMP_IF_FALSE/JUMP_IF_TRUE leave the tested value on the
+    // stack, so one landing on another test of the same value already knows
+    // its outcome: it follows a test of the same sense and skips one of the
+    // opposite sense. Conditional jumps are only forward, so they never
+    // thread to a backward destination.
+    bool threadJumps() {
+        bool changed = false;
+        for (size_t i = 0; i < instructions.size(); ++i) {
+            Instruction& instruction = instructions[i];
+            if (instruction.removed || instruction.target < 0) continue;
+
+            int target = instruction.target;
+            for (int hops = 0; hops < 16; ++hops) {
+                if (target >= static_cast<int>(instructions.size())) break;
+                const Instruction& next = instructions[target];
+                if (isTest(instruction.op) && isTest(next.op) && next.op != instruction.op) {
+                    // The opposite test cannot be taken: go straight past it.
+                    target = target + 1;
+                    break;
+                }
+                bool follow = isUnconditionalJump(next.op) || (isTest(instruction.op) && next.op == instruction.op);
+                if (!follow || next.target == target) break;
+                if (!isUnconditionalJump(instruction.op) && next.target <= static_cast<int>(i)) break;
+                target = next.target;
+            }
+            if (target != instruction.target) {
+                instruction.target = target;
+                ++stats.jumpThreading;
+                changed = true;
+            }
+
+            // A jump to the very next instruction does nothing.
+            if (instruction.op == OP_JUMP && nextLive(i) == instruction.target) {
+                remove(i);
+                ++stats.jumpToNext;
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    // Nothing falls through past RETURN/JUMP/LOOP/HALT, so what follows is
+    // dead up to the next jump destination.
+    bool removeUnreachable() {
+        bool changed = false;
+        for (size_t i = 0; i < instructions.size(); ++i) {
+            if (instructions[i].removed || !endsBlock(instructions[i].op)) continue;
+            for (size_t j = i + 1; j < instructions.size() && !isTarget[j]; ++j) {
+                if (instructions[j].removed) continue;
+                remove(j);
+                ++stats.unreachable;
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    // JUMP_IF_FALSE a; JUMP b; a:  =>  JUMP_IF_TRUE b; a:   (the `||` lowering)
+    bool fuseJumpIfTrue() {
+        bool changed = false;
+        for (size_t i = 0; i < instructions.size(); ++i) {
+            Instruction& test = instructions[i];
+            if (test.removed || test.op != OP_JUMP_IF_FALSE) continue;
+            int j = nextLive(i);
+            if (j >= static_cast<int>(instructions.size()) || isTarget[j]) continue;
+            Instruction& jump = instructions[j];
+            if (jump.op != OP_JUMP || test.target != nextLive(j)) continue;
+
+            test.op = OP_JUMP_IF_TRUE;
+            test.target = jump.target;
+            remove(j);
+            ++stats.jumpIfTrue;
+            changed = true;
+        }
+        return changed;
+    }
+
+    // SET_LOCAL_POP x; GET_LOCAL x  =>  SET_LOCAL x
+    // SET_GLOBAL x; POP; GET_GLOBAL x  =>  SET_GLOBAL x
+    // <pure push>; POP  =>  (nothing)
+    bool foldStoreLoad() {
+        bool changed = false;
+        for (size_t i = 0; i < instructions.size(); ++i) {
+            Instruction& first = instructions[i];
+            if (first.removed) continue;
+            int j = nextLive(i);
+            if (j >= static_cast<int>(instructions.size()) || isTarget[j]) continue;
+            Instruction& second = instructions[j];
+
+            if (first.op == OP_SET_LOCAL_POP && second.op == OP_GET_LOCAL && first.operands == second.operands) {
+                first.op = OP_SET_LOCAL;
+                remove(j);
+                ++stats.storeLoad;
+                changed = true;
+            } else if (isPurePush(first.op) && second.op == OP_POP && !isTarget[i]) {
+                remove(i);
+                remove(j);
+                stats.storeLoad += 2;
+                changed = true;
+            } else if (first.op == OP_SET_GLOBAL && second.op == OP_POP) {
+                int k = nextLive(j);
+                if (k >= static_cast<int>(instructions.size()) || isTarget[k]) continue;
+                Instruction& third = instructions[k];
+                if (third.op == OP_GET_GLOBAL && third.operands == first.operands) {
+                    remove(j);
+                    remove(k);
+                    stats.storeLoad += 2;
+                    changed = true;
+                }
+            }
+        }
+        return changed;
+    }
+
+    int nextLive(size_t i) const {
+        size_t j = i + 1;
+        while (j < instructions.size() && instructions[j].removed) ++j;
+        return static_cast<int>(j);
+    }
+
+    // Drops removed instructions. A jump to a removed instruction goes to the
+    // next surviving one: removed jumps-to-next fall through to it, and no
+    // other removed instruction is a jump destination.
+    void compact() {
+        std::vector<int> newIndex(instructions.size() + 1);
+        int live = 0;
+        for (size_t i = 0; i < instructions.size(); ++i) {
+            newIndex[i] = live;
+            if (!instructions[i].removed) ++live;
+        }
+        newIndex[instructions.size()] = live;
+
+        std::vector<Instruction> kept;
+        kept.reserve(live);
+        for (Instruction& instruction : instructions) {
+            if (instruction.removed) continue;
+            if (instruction.target >= 0) instruction.target = newIndex[instruction.target];
+            kept.push_back(std::move(instruction));
+        }
+        instructions = std::move(kept);
+        if (entryIndex >= 0) entryIndex = newIndex[entryIndex];
+    }
+};
+
+}  // namespace
+
+void optimizeChunk(Chunk& chunk, PeepholeStats& stats, size_t* entry) {
+    Peephole peephole(chunk, stats, entry);
+    if (!peephole.valid) return;
+
+    PeepholeStats before = stats;
+    peephole.run();
+    if (!peephole.encode(chunk.code, entry)) {
+        stats = before;
+    }
+}
+
+}  // namespace vm
@@ -0,0 +1,522 @@
+#include "vm/reg_compiler.h"
+
+#include "lexer/lexer.h"
+#include "parser/parser.h"
+
+#include <stdexcept>
+
+namespace vm {
+
+namespace {
+
+// Thrown for constructs outside the register backend's subset.
+struct Unsupported : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+bool isBuiltinCall(const std::string& name) {
+    return name == "fixed" || name == "push" || name == "length" || name == "int" ||
+           name == "float" || name == "string" || name == "bool" || name == "char" ||
+           name == "type" || name == "readline";
+}
+
+}  // namespace
+
+RegChunk& RegCompiler::currentChunk() {
+    return *currentFunction->regCode;
+}
+
+int RegCompiler::emit(uint8_t op, int a, int b, int c) {
+    return currentChunk().emit(op, static_cast<uint8_t>(a), static_cast<uint16_t>(b),
+                               static_cast<uint16_t>(c));
+}
+
+uint16_t RegCompiler::constant(Value value) {
+    int idx = currentChunk().addConstant(value);
+    if (idx >= RK_CONSTANT) {
+        throw Unsupported("more than 32767 constants in one function");
+    }
+    return static_cast<uint16_t>(idx | RK_CONSTANT);
+}
+
+int RegCompiler::emitJump(uint8_t op, int a, int b, int c) {
+    return emit(op, a, b, c);
+}
+
+void RegCompiler::patchJump(int jump) {
+    patchJumpTo(jump, static_cast<int>(currentChunk().code.size()));
+}
+
+void RegCompiler::patchJumpTo(int jump, int target) {
+    int offset = target - (jump + 1);
+    if (offset < INT16_MIN || offset > INT16_MAX) {
+        throw Unsupported("jump too far");
+    }
+    currentChunk().code[jump].sbx = static_cast<int16_t>(offset);
+}
+
+int RegCompiler::allocRegister() {
+    if (freeReg >= REG_MAX) {
+        throw Unsupported("more than 256 registers in one function");
+    }
+    int reg = freeReg++;
+    if (freeReg > currentChunk().registerCount) {
+        currentChunk().registerCount = freeReg;
+    }
+    return reg;
+}
+
+bool RegCompiler::isLocalRegister(int reg) const {
+    return reg < static_cast<int>(locals.size());
+}
+
+void RegCompiler::beginScope() {
+    scopeDepth++;
+}
+
+void RegCompiler::endScope() {
+    scopeDepth--;
+    while (!locals.empty() && locals.back().depth > scopeDepth) {
+        locals.pop_back();
+    }
+    freeReg = static_cast<int>(locals.size());
+}
+
+int RegCompiler::resolveLocal(const std::string& name) {
+    for (int i = static_cast<int>(locals.size()) - 1; i >= 0; i--) {
+        if (locals[i].name == name) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int RegCompiler::resolveGlobal(const std::string& name) {
+    auto it = globalSlots.find(name);
+    if (it != globalSlots.end()) {
+        return it->second;
+    }
+    int slot = static_cast<int>(globalNames.size());
+    globalNames.push_back(name);
+    globalSlots.emplace(name, slot);
+    return slot;
+}
+
+FunctionObject* RegCompiler::compile(Program* program) {
+    try {
+        if (!program->classes.empty()) {
+            throw Unsupported("classes");
+        }
+
+        for (const auto& func : program->functions) {
+            if (func->name != "main") {
+                resolveGlobal(func->name);
+            }
+        }
+        for (const auto& func : program->functions) {
+            if (func->name != "main") {
+                compileFunction(func.get());
+            }
+        }
+
+        auto* scriptFn = new FunctionObject("__script__", 0);
+        scriptFn->regCode = new RegChunk();
+        currentFunction = scriptFn;
+        locals.clear();
+        scopeDepth = 0;
+
+        for (const auto& func : program->functions) {
+            if (func->name == "main") {
+                beginScope();
+                locals.push_back({"", scopeDepth});  // R0 is the callee slot, as in every frame
+                freeReg = 1;
+                for (const auto& stmt : func->body->statements) {
+                    compileStmt(stmt.get());
+                }
+                endScope();
+                break;
+            }
+        }
+
+        emit(ROP_HALT);
+        return scriptFn;
+    } catch (const Unsupported& e) {
+        unsupportedFeature = e.what();
+        return nullptr;
+    }
+}
+
+void RegCompiler::compileFunction(Function* func) {
+    auto* fnObj = new FunctionObject(func->name, func->params.size());
+    fnObj->regCode = new RegChunk();
+
+    FunctionObject* enclosingFunction = currentFunction;
+    std::vector<Local> enclosingLocals = std::move(locals);
+    int enclosingScopeDepth = scopeDepth;
+    int enclosingFreeReg = freeReg;
+
+    currentFunction = fnObj;
+    locals.clear();
+    scopeDepth = 0;
+
+    beginScope();
+    locals.push_back({"", scopeDepth});  // R0 holds the callee.
+    for (const auto& param : func->params) {
+        locals.push_back({param.name, scopeDepth});
+    }
+    if (locals.size() > static_cast<size_t>(REG_MAX)) {
+        throw Unsupported("too many parameters");
+    }
+    freeReg = static_cast<int>(locals.size());
+    currentChunk().registerCount = freeReg;
+
+    for (const auto& stmt : func->body->statements) {
+        compileStmt(stmt.get());
+    }
+    emit(ROP_RETURN, 0, constant(Value()));
+
+    currentFunction = enclosingFunction;
+    locals = std::move(enclosingLocals);
+    scopeDepth = enclosingScopeDepth;
+    freeReg = enclosingFreeReg;
+
+    compiledFunctions.push_back(fnObj);
+}
+
+void RegCompiler::compileStmt(ASTNode* node) {
+    // Temporaries never outlive the statement that created them.
+    freeReg = static_cast<int>(locals.size());
+
+    if (auto* printStmt = dynamic_cast<PrintStmt*>(node)) {
+        emit(ROP_PRINT, 0, operand(printStmt->expression.get()));
+    } else if (auto* printlnStmt = dynamic_cast<PrintlnStmt*>(node)) {
+        emit(ROP_PRINTLN, 0, operand(printlnStmt->expression.get()));
+    } else if (auto* exprStmt = dynamic_cast<ExprStmt*>(node)) {
+        compileExpr(exprStmt->expression.get(), allocRegister());
+    } else if (auto* returnStmt = dynamic_cast<ReturnStmt*>(node)) {
+        uint16_t value = returnStmt->value ? operand(returnStmt->value.get()) : constant(Value());
+        emit(ROP_RETURN, 0, value);
+    } else if (auto* ifStmt = dynamic_cast<IfStmt*>(node)) {
+        int thenJump = compileConditionJump(ifStmt->condition.get(), false);
+        compileStmt(ifStmt->thenBranch.get());
+
+        if (ifStmt->elseBranch) {
+            int elseJump = emitJump(ROP_JMP);
+            patchJump(thenJump);
+            compileStmt(ifStmt->elseBranch.get());
+            patchJump(elseJump);
+        } else {
+            patchJump(thenJump);
+        }
+    } else if (auto* whileStmt = dynamic_cast<WhileStmt*>(node)) {
+        compileLoop(whileStmt->condition.get(), whileStmt->body.get(), nullptr);
+    } else if (auto* forStmt = dynamic_cast<ForStmt*>(node)) {
+        beginScope();
+        if (forStmt->init) {
+            compileStmt(forStmt->init.get());
+        }
+        compileLoop(forStmt->condition.get(), forStmt->body.get(), forStmt->increment.get());
+        endScope();
+    } else if (auto* assignStmt = dynamic_cast<AssignmentStmt*>(node)) {
+        for (const auto& assign : assignStmt->assignments) {
+            compileAssignment(assign);
+            freeReg = static_cast<int>(locals.size());
+        }
+    } else if (auto* block = dynamic_cast<Block*>(node)) {
+        beginScope();
+        for (const auto& stmt : block->statements) {
+            compileStmt(stmt.get());
+        }
+        endScope();
+    } else if (dynamic_cast<BreakStmt*>(node)) {
+        if (!loopStack.empty()) {
+            loopStack.back().breakJumps.push_back(emitJump(ROP_JMP));
+        }
+    } else if (dynamic_cast<ContinueStmt*>(node)) {
+        if (!loopStack.empty()) {
+            loopStack.back().continueJumps.push_back(emitJump(ROP_JMP));
+        }
+    } else if (auto* expr = dynamic_cast<Expr*>(node)) {
+        compileExpr(expr, allocRegister());
+    } else {
+        throw Unsupported("statement");
+    }
+}
+
+void RegCompiler::compileAssignment(const Assignment& assign) {
+    auto* var = dynamic_cast<VarExpr*>(assign.target.get());
+    if (!var) {
+        throw Unsupported("assignment to an element or property");
+    }
+
+    int reg = resolveLocal(var->name);
+    if (reg == -1) {
+        if (scopeDepth == 0) {
+            throw Unsupported("global assignment");
+        }
+        if (static_cast<int>(locals.size()) >= REG_MAX) {
+            throw Unsupported("more than 256 registers in one function");
+        }
+        locals.push_back({var->name, scopeDepth});
+        reg = static_cast<int>(locals.size()) - 1;
+        freeReg = static_cast<int>(locals.size());
+        if (freeReg > currentChunk().registerCount) {
+            currentChunk().registerCount = freeReg;
+        }
+    }
+
+    uint8_t op;
+    switch (assign.op) {
+        case TokenType::EQUAL:
+            compileExpr(assign.value.get(), reg);
+            return;
+        case TokenType::PLUS_EQUAL: op = ROP_ADD; break;
+        case TokenType::MINUS_EQUAL: op = ROP_SUB; break;
+        case TokenType::STAR_EQUAL: op = ROP_MUL; break;
+        case TokenType::SLASH_EQUAL: op = ROP_DIV; break;
+        case TokenType::MOD_OP_EQUAL: op = ROP_MOD; break;
+        case TokenType::BITWISE_AND_EQUAL: op = ROP_BAND; break;
+        case TokenType::BITWISE_OR_EQUAL: op = ROP_BOR; break;
+        case TokenType::XOR_EQUAL: op = ROP_BXOR; break;
+        default:
+            throw Unsupported("compound assignment operator");
+    }
+    emit(op, reg, reg, operand(assign.value.get()));
+}
+
+// Loops are laid out with the test at the bottom, so each iteration runs a
+// single conditional branch:
+//
+//       JMP test
+//   top:  body
+//   cont: increment
+//   test: if (condition) goto top
+void RegCompiler::compileLoop(Expr* condition, ASTNode* body, ASTNode* increment) {
+    int entryJump = condition ? emitJump(ROP_JMP) : -1;
+    int top = static_cast<int>(currentChunk().code.size());
+
+    loopStack.push_back({-1, {}, {}});
+    compileStmt(body);
+
+    for (int continueJump : loopStack.back().continueJumps) {
+        patchJump(continueJump);
+    }
+    if (increment) {
+        compileStmt(increment);
+    }
+
+    freeReg = static_cast<int>(locals.size());
+    if (condition) {
+        patchJump(entryJump);
+        patchJumpTo(compileConditionJump(condition, true), top);
+    } else {
+        patchJumpTo(emitJump(ROP_JMP), top);
+    }
+
+    for (int breakJump : loopStack.back().breakJumps) {
+        patchJump(breakJump);
+    }
+    loopStack.pop_back();
+}
+
+// Emits a branch taken when `condition` is truthy (jumpWhen) or falsy
+// (!jumpWhen) and returns it for patching. Comparisons fuse into the branch.
+int RegCompiler::compileConditionJump(Expr* condition, bool jumpWhen) {
+    if (auto* bin = dynamic_cast<BinaryExpr*>(condition)) {
+        uint8_t op = 0;
+        bool swap = false;
+        bool negate = false;
+        if (bin->op == "<") op = ROP_JLT;
+        else if (bin->op == "<=") op = ROP_JLE;
+        else if (bin->op == ">") { op = ROP_JLT; swap = true; }
+        else if (bin->op == ">=") { op = ROP_JLE; swap = true; }
+        else if (bin->op == "==") op = ROP_JEQ;
+        else if (bin->op == "!=") { op = ROP_JEQ; negate = true; }
+
+        if (op) {
+            uint16_t left = operand(bin->left.get());
+            uint16_t right = operand(bin->right.get());
+            if (swap) std::swap(left, right);
+            return emitJump(op, jumpWhen != negate, left, right);
+        }
+    }
+
+    return emitJump(jumpWhen ? ROP_JMPIF : ROP_JMPIFNOT, 0, operand(condition));
+}
+
+void RegCompiler::compileExpr(Expr* expr, int target) {
+    if (auto* num = dynamic_cast<NumberExpr*>(expr)) {
+        Value value;
+        if (!Compiler::parseNumber(num->value, value)) {
+            throw Unsupported("malformed number literal");
+        }
+        emit(ROP_LOADK, target, constant(value) & ~RK_CONSTANT);
+    } else if (auto* b = dynamic_cast<BoolExpr*>(expr)) {
+        emit(ROP_LOADBOOL, target, b->value ? 1 : 0);
+    } else if (auto* s = dynamic_cast<StringExpr*>(expr)) {
+        if (s->value.find('{') == std::string::npos) {
+            emit(ROP_LOADK, target, constant(Value(s->value)) & ~RK_CONSTANT);
+        } else {
+            compileInterpolation(s->value, target);
+        }
+    } else if (auto* var = dynamic_cast<VarExpr*>(expr)) {
+        int reg = resolveLocal(var->name);
+        if (reg != -1) {
+            if (reg != target) emit(ROP_MOVE, target, reg);
+        } else {
+            emit(ROP_GETGLOBAL, target, resolveGlobal(var->name));
+        }
+    } else if (auto* call = dynamic_cast<CallExpr*>(expr)) {
+        compileCall(call, target);
+    } else if (auto* bin = dynamic_cast<BinaryExpr*>(expr)) {
+        if (bin->op == "&&" || bin->op == "||") {
+            // The left value is the result when it short-circuits, so build
+            // it in a scratch register if the right side may read `target`.
+            int dest = isLocalRegister(target) ? allocRegister() : target;
+            compileExpr(bin->left.get(), dest);
+            int endJump = emitJump(bin->op == "&&" ? ROP_JMPIFNOT : ROP_JMPIF, 0, dest);
+            compileExpr(bin->right.get(), dest);
+            patchJump(endJump);
+            if (dest != target) emit(ROP_MOVE, target, dest);
+            return;
+        }
+
+        uint8_t op;
+        bool swap = false;
+        if (bin->op == "+") op = ROP_ADD;
+        else if (bin->op == "-") op = ROP_SUB;
+        else if (bin->op == "*") op = ROP_MUL;
+        else if (bin->op == "/") op = ROP_DIV;
+        else if (bin->op == "%") op = ROP_MOD;
+        else if (bin->op == "&") op = ROP_BAND;
+        else if (bin->op == "|") op = ROP_BOR;
+        else if (bin->op == "^") op = ROP_BXOR;
+        else if (bin->op == "<<") op = ROP_SHL;
+        else if (bin->op == ">>") op = ROP_SHR;
+        else if (bin->op == "<") op = ROP_LT;
+        else if (bin->op == "<=") op = ROP_LE;
+        else if (bin->op == ">") { op = ROP_LT; swap = true; }
+        else if (bin->op == ">=") { op = ROP_LE; swap = true; }
+        else if (bin->op == "==") op = ROP_EQ;
+        else if (bin->op == "!=") op = ROP_NE;
+        else throw Unsupported("operator " + bin->op);
+
+        int mark = freeReg;
+        uint16_t left = operand(bin->left.get());
+        uint16_t right = operand(bin->right.get());
+        if (swap) std::swap(left, right);
+        emit(op, target, left, right);
+        freeReg = mark;
+    } else if (dynamic_cast<UnaryExpr*>(expr)) {
+        throw Unsupported("unary operators");
+    } else if (dynamic_cast<ArrayExpr*>(expr) || dynamic_cast<IndexExpr*>(expr)) {
+        throw Unsupported("arrays");
+    } else if (dynamic_cast<MemberExpr*>(expr)) {
+        throw Unsupported("properties");
+    } else {
+        throw Unsupported("expression");
+    }
+}
+
+void RegCompiler::compileCall(CallExpr* call, int target) {
+    auto* calleeName = dynamic_cast<VarExpr*>(call->callee.get());
+    if (!calleeName) {
+        throw Unsupported("method call");
+    }
+    if (isBuiltinCall(calleeName->name) && resolveLocal(calleeName->name) == -1) {
+        throw Unsupported("builtin " + calleeName->name + "()");
+    }
+    if (call->arguments.size() >= static_cast<size_t>(REG_MAX)) {
+        throw Unsupported("too many arguments");
+    }
+
+    // The callee and its arguments occupy a fresh register window that
+    // becomes the callee's frame (R0 = callee, R1.. = parameters).
+    int mark = freeReg;
+    int base = (target == freeReg - 1 && !isLocalRegister(target)) ? target : allocRegister();
+    compileExpr(calleeName, base);
+    for (const auto& arg : call->arguments) {
+        compileExpr(arg.get(), allocRegister());
+    }
+    emit(ROP_CALL, base, static_cast<int>(call->arguments.size()));
+    if (base != target) emit(ROP_MOVE, target, base);
+    freeReg = mark;
+}
+
+// "a{x}b{y}" evaluates every part, then folds right to left exactly as the
+// stack compiler's trailing chain of OP_ADDs does: a + (x + (b + y)).
+void RegCompiler::compileInterpolation(const std::string& str, int target) {
+    std::vector<std::unique_ptr<Expr>> parsed;
+    std::vector<uint16_t> parts;
+    int mark = freeReg;
+
+    size_t i = 0;
+    while (i < str.length()) {
+        if (str[i] == '{') {
+            size_t j = i + 1;
+            while (j < str.length() && str[j] != '}') j++;
+            if (j < str.length()) {
+                Lexer lexer(str.substr(i + 1, j - i - 1));
+                Parser parser(lexer);
+                parsed.push_back(parser.parseExpression());
+                parts.push_back(operand(parsed.back().get()));
+                i = j + 1;
+                continue;
+            }
+        }
+
+        std::string literal;
+        while (i < str.length() && str[i] != '{') {
+            literal += str[i];
+            i++;
+        }
+        if (!literal.empty()) {
+            parts.push_back(constant(Value(literal)));
+        }
+    }
+
+    if (parts.empty()) {
+        throw Unsupported("empty interpolation");
+    }
+
+    uint16_t acc = parts.back();
+    for (int p = static_cast<int>(parts.size()) - 2; p >= 0; p--) {
+        int dest = p == 0 ? target : allocRegister();
+        emit(ROP_ADD, dest, parts[p], acc);
+        acc = static_cast<uint16_t>(dest);
+    }
+    if (parts.size() == 1) {
+        moveOperand(target, acc);
+    }
+    freeReg = mark;
+}
+
+// Returns an RK operand for `expr`: locals and literals are used in place,
+// anything else is evaluated into a fresh temporary.
+uint16_t RegCompiler::operand(Expr* expr) {
+    if (auto* var = dynamic_cast<VarExpr*>(expr)) {
+        int reg = resolveLocal(var->name);
+        if (reg != -1) return static_cast<uint16_t>(reg);
+    } else if (auto* num = dynamic_cast<NumberExpr*>(expr)) {
+        Value value;
+        if (Compiler::parseNumber(num->value, value)) return constant(value);
+    } else if (auto* s = dynamic_cast<StringExpr*>(expr)) {
+        if (s->value.find('{') == std::string::npos) return constant(Value(s->value));
+    } else if (auto* b = dynamic_cast<BoolExpr*>(expr)) {
+        return constant(b->value);
+    }
+
+    int temp = allocRegister();
+    compileExpr(expr, temp);
+    return static_cast<uint16_t>(temp);
+}
+
+void RegCompiler::moveOperand(int target, uint16_t rk) {
+    if (rk & RK_CONSTANT) {
+        emit(ROP_LOADK, target, rk & ~RK_CONSTANT);
+    } else if (rk != target) {
+        emit(ROP_MOVE, target, rk);
+    }
+}
+
+}  // namespace vm
@@ -0,0 +1,291 @@
+#include "vm/reg_vm.h"
+
+#include "vm/utils/arith_utils.h"
+#include "vm/utils/value_utils.h"
+
+#include <iostream>
+
+#if defined(__GNUC__) && !defined(PENGUIN_VM_NO_COMPUTED_GOTO)
+#define PENGUIN_COMPUTED_GOTO 1
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+namespace vm {
+
+RegVM::RegVM() : registers(allocateValueBlock(REGISTERS_MAX)) {
+    frames.reserve(FRAMES_MAX);
+}
+
+void RegVM::defineGlobals(const std::vector<std::string>& names) {
+    globalNames = names;
+    globals.resize(names.size());
+}
+
+Value* RegVM::findGlobal(const std::string& name) {
+    for (size_t slot = 0; slot < globalNames.size(); ++slot) {
+        if (globalNames[slot] == name) {
+            return &globals[slot];
+        }
+    }
+    return nullptr;
+}
+
+bool RegVM::pushFrame(FunctionObject* function, Value* base) {
+    if (frames.size() == FRAMES_MAX ||
+        base + function->regCode->registerCount > registers.get() + REGISTERS_MAX) {
+        std::cerr << "Runtime error: stack overflow calling " << function->name << "." << std::endl;
+        return false;
+    }
+    frames.push_back({function, function->regCode->code.data(), base});
+    return true;
+}
+
+void RegVM::run(FunctionObject* script) {
+    frames.clear();
+    if (!pushFrame(script, registers.get())) {
+        return;
+    }
+
+    RegFrame* frame;
+    const RegInstr* ip;
+    const Value* constants;
+    Value* base;
+    RegInstr instr;
+
+#define LOAD_FRAME()                                             \
+    do {                                                         \
+        frame = &frames.back();                                  \
+        ip = frame->ip;                                          \
+        constants = frame->function->regCode->constants.data();  \
+        base = frame->base;                                      \
+    } while (0)
+#define SAVE_IP() (frame->ip = ip)
+#define RK(x) (((x) & RK_CONSTANT) ? constants[(x) & ~RK_CONSTANT] : base[x])
+
+    LOAD_FRAME();
+
+#ifdef PENGUIN_COMPUTED_GOTO
+    static void* dispatchTable[256];
+    static bool dispatchTableReady = false;
+    if (!dispatchTableReady) {
+        for (auto& target : dispatchTable) target = &&op_unknown;
+#define SET_TARGET(op) dispatchTable[op] = &&op_##op
+        SET_TARGET(ROP_MOVE);
+        SET_TARGET(ROP_LOADK);
+        SET_TARGET(ROP_LOADBOOL);
+        SET_TARGET(ROP_GETGLOBAL);
+        SET_TARGET(ROP_ADD);
+        SET_TARGET(ROP_SUB);
+        SET_TARGET(ROP_MUL);
+        SET_TARGET(ROP_DIV);
+        SET_TARGET(ROP_MOD);
+        SET_TARGET(ROP_BAND);
+        SET_TARGET(ROP_BOR);
+        SET_TARGET(ROP_BXOR);
+        SET_TARGET(ROP_SHL);
+        SET_TARGET(ROP_SHR);
+        SET_TARGET(ROP_LT);
+        SET_TARGET(ROP_LE);
+        SET_TARGET(ROP_EQ);
+        SET_TARGET(ROP_NE);
+        SET_TARGET(ROP_JMP);
+        SET_TARGET(ROP_JMPIF);
+        SET_TARGET(ROP_JMPIFNOT);
+        SET_TARGET(ROP_JLT);
+        SET_TARGET(ROP_JLE);
+        SET_TARGET(ROP_JEQ);
+        SET_TARGET(ROP_CALL);
+        SET_TARGET(ROP_RETURN);
+        SET_TARGET(ROP_PRINT);
+        SET_TARGET(ROP_PRINTLN);
+        SET_TARGET(ROP_HALT);
+#undef SET_TARGET
+        dispatchTableReady = true;
+    }
+
+#define TARGET(op) op_##op
+#define TARGET_UNKNOWN op_unknown
+#define DISPATCH()                              \
+    do {                                        \
+        instr = *ip++;                          \
+        goto* dispatchTable[instr.op];          \
+    } while (0)
+
+    DISPATCH();
+#else
+#define TARGET(op) case op
+#define TARGET_UNKNOWN default
+#define DISPATCH() continue
+
+    for (;;) {
+        instr = *ip++;
+        switch (instr.op) {
+#endif
+
+    TARGET(ROP_MOVE): {
+        base[instr.a] = base[instr.b];
+        DISPATCH();
+    }
+    TARGET(ROP_LOADK): {
+        base[instr.a] = constants[instr.b];
+        DISPATCH();
+    }
+    TARGET(ROP_LOADBOOL): {
+        base[instr.a] = instr.b != 0;
+        DISPATCH();
+    }
+    TARGET(ROP_GETGLOBAL): {
+        base[instr.a] = globals[instr.b];
+        DISPATCH();
+    }
+
+#define BINARY_OP(fn)                                        \
+    do {                                                     \
+        base[instr.a] = fn(RK(instr.b), RK(instr.c));        \
+    } while (0)
+
+    TARGET(ROP_ADD): {
+        BINARY_OP(addValues);
+        DISPATCH();
+    }
+    TARGET(ROP_SUB): {
+        BINARY_OP(subValues);
+        DISPATCH();
+    }
+    TARGET(ROP_MUL): {
+        BINARY_OP(mulValues);
+        DISPATCH();
+    }
+    TARGET(ROP_DIV): {
+        BINARY_OP(divValues);
+        DISPATCH();
+    }
+    TARGET(ROP_MOD): {
+        BINARY_OP(modValues);
+        DISPATCH();
+    }
+    TARGET(ROP_BAND): {
+        BINARY_OP(bitAndValues);
+        DISPATCH();
+    }
+    TARGET(ROP_BOR): {
+        BINARY_OP(bitOrValues);
+        DISPATCH();
+    }
+    TARGET(ROP_BXOR): {
+        BINARY_OP(xorValues);
+        DISPATCH();
+    }
+    TARGET(ROP_SHL): {
+        BINARY_OP(shiftLeftValues);
+        DISPATCH();
+    }
+    TARGET(ROP_SHR): {
+        BINARY_OP(shiftRightValues);
+        DISPATCH();
+    }
+#undef BINARY_OP
+
+#define COMPARE(op) (asDouble(RK(instr.b)) op asDouble(RK(instr.c)))
+
+    TARGET(ROP_LT): {
+        base[instr.a] = COMPARE(<);
+        DISPATCH();
+    }
+    TARGET(ROP_LE): {
+        base[instr.a] = COMPARE(<=);
+        DISPATCH();
+    }
+    TARGET(ROP_EQ): {
+        base[instr.a] = COMPARE(==);
+        DISPATCH();
+    }
+    TARGET(ROP_NE): {
+        base[instr.a] = COMPARE(!=);
+        DISPATCH();
+    }
+
+    TARGET(ROP_JMP): {
+        ip += instr.sbx;
+        DISPATCH();
+    }
+    TARGET(ROP_JMPIF): {
+        if (asBool(RK(instr.b))) ip += instr.sbx;
+        DISPATCH();
+    }
+    TARGET(ROP_JMPIFNOT): {
+        if (!asBool(RK(instr.b))) ip += instr.sbx;
+        DISPATCH();
+    }
+    TARGET(ROP_JLT): {
+        if (COMPARE(<) == (instr.a != 0)) ip += instr.sbx;
+        DISPATCH();
+    }
+    TARGET(ROP_JLE): {
+        if (COMPARE(<=) == (instr.a != 0)) ip += instr.sbx;
+        DISPATCH();
+    }
+    TARGET(ROP_JEQ): {
+        if (COMPARE(==) == (instr.a != 0)) ip += instr.sbx;
+        DISPATCH();
+    }
+#undef COMPARE
+
+    TARGET(ROP_CALL): {
+        Value* callee = base + instr.a;
+        if (!callee->isFunction() || !callee->as.function->regCode) {
+            std::cerr << "Runtime error: tried to call a non-function" << std::endl;
+            return;
+        }
+        FunctionObject* function = callee->as.function;
+        if (instr.b != function->arity) {
+            std::cerr << "Runtime error: in function " << function->name
+                      << " expected " << function->arity << " arguments but got "
+                      << instr.b << std::endl;
+            return;
+        }
+        SAVE_IP();
+        if (!pushFrame(function, callee)) return;
+        LOAD_FRAME();
+        DISPATCH();
+    }
+    TARGET(ROP_RETURN): {
+        Value result = RK(instr.b);
+        frames.pop_back();
+        if (frames.empty()) return;
+
+        base[0] = result;
+        LOAD_FRAME();
+        DISPATCH();
+    }
+
+    TARGET(ROP_PRINT): {
+        std::cout << valueToString(RK(instr.b));
+        DISPATCH();
+    }
+    TARGET(ROP_PRINTLN): {
+        std::cout << valueToString(RK(instr.b)) << std::endl;
+        DISPATCH();
+    }
+
+    TARGET(ROP_HALT):
+        return;
+
+    TARGET_UNKNOWN:
+        std::cerr << "Runtime error: unknown register opcode " << static_cast<int>(instr.op) << std::endl;
+        return;
+
+#ifndef PENGUIN_COMPUTED_GOTO
+        }
+    }
+#endif
+
+#undef TARGET
+#undef TARGET_UNKNOWN
+#undef DISPATCH
+#undef LOAD_FRAME
+#undef SAVE_IP
+#undef RK
+}
+
+}  // namespace vm
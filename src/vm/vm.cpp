@@ -1,27 +1,108 @@
 #include "vm/vm.h"
 
+#include "vm/jit.h"
 #include "vm/utils/value_utils.h"
 
 #include <iostream>
+#include <utility>
 
 namespace vm {
 
-void VM::push(Value value) {
-    stack.push_back(value);
+VM::VM()
+    : stack(allocateValueBlock(STACK_MAX)),
+      stackTop(stack.get()),
+      stackLimit(stack.get() + STACK_MAX - FRAME_SLOTS) {
+    frames.reserve(FRAMES_MAX);
 }
 
-Value VM::pop() {
-    Value value = stack.back();
-    stack.pop_back();
-    return value;
+void VM::defineGlobals(const std::vector<std::string>& names) {
+    globalNames = names;
+    globals.resize(names.size());
 }
 
-void VM::run(FunctionObject* script) {
-    frames.push_back({script, 0, 0});
+Value* VM::findGlobal(const std::string& name) {
+    for (size_t slot = 0; slot < globalNames.size(); ++slot) {
+        if (globalNames[slot] == name) {
+            return &globals[slot];
+        }
+    }
+    return nullptr;
+}
+
+bool VM::pushFrame(FunctionObject* function, Value* slots) {
+    if (frames.size() == FRAMES_MAX || slots > stackLimit) {
+        std::cerr << "Runtime error: stack overflow calling " << function->name << "." << std::endl;
+        return false;
+    }
+    frames.push_back({function, function->chunk.code.data(), slots});
+    countCall(function);
+    return true;
+}
+
+void VM::countCall(FunctionObject* function) {
+    if (jit && !function->jitCode && ++function->hotness >= jit->threshold) {
+        jit->compile(*function);
+    }
+}
+
+void VM::run(FunctionObject* script, size_t entry) {
+    Heap::Scope heapScope(&heap);
+    stackTop = stack.get();
+    frames.clear();
+    baseDepth = 0;
+    if (!pushFrame(script, stackTop)) {
+        return;
+    }
+    frames.back().ip += entry;
+    interpret();
+}
+
+// The instruction at `offset` is swapped for a HALT while the script runs.
+// The JIT is kept out, so no machine code is generated from that copy.
+bool VM::runUntil(FunctionObject* script, size_t offset) {
+    uint8_t* stop = script->chunk.code.data() + offset;
+    uint8_t saved = std::exchange(*stop, static_cast<uint8_t>(OP_HALT));
+    Jit* savedJit = std::exchange(jit, nullptr);
+    try {
+        run(script);
+    } catch (...) {
+        *stop = saved;
+        jit = savedJit;
+        throw;
+    }
+    *stop = saved;
+    jit = savedJit;
+    return frames.size() == 1 && frames.back().ip == stop + 1;
+}
+
+void VM::interpret() {
+#ifdef PENGUIN_VM_HANDLER_DISPATCH
+    runHandlers();
+#else
+    runThreaded();
+#endif
+}
 
+void VM::collectGarbage() {
+    heap.beginCollection();
+    for (Value* slot = stack.get(); slot < stackTop; ++slot) {
+        heap.markValue(*slot);
+    }
+    for (const CallFrame& frame : frames) {
+        heap.markObject(frame.function);
+    }
+    for (const Value& global : globals) {
+        heap.markValue(global);
+    }
+    heap.finishCollection();
+}
+
+// Reference dispatch path: one switch per category handler. Selected with
+// -DPENGUIN_VM_HANDLER_DISPATCH=ON to compare against the threaded loop.
+void VM::runHandlers() {
     while (true) {
         auto& frame = frames.back();
-        uint8_t instruction = frame.function->chunk.code[frame.ip++];
+        uint8_t instruction = frame.readByte();
         if (!executeInstruction(frame, instruction)) {
             return;
         }
@@ -31,8 +112,7 @@ void VM::run(FunctionObject* script) {
 bool VM::executeInstruction(CallFrame& frame, uint8_t instruction) {
     switch (instruction) {
         case OP_CONSTANT: {
-            uint8_t idx = frame.function->chunk.code[frame.ip++];
-            push(frame.function->chunk.constants[idx]);
+            push(frame.readConstant());
             return true;
         }
         case OP_TRUE:
@@ -42,32 +122,30 @@ bool VM::executeInstruction(CallFrame& frame, uint8_t instruction) {
             push(false);
             return true;
         case OP_NULL:
-            push(std::monostate{});
+            push(Value());
             return true;
         case OP_GET_LOCAL: {
-            uint8_t slot = frame.function->chunk.code[frame.ip++];
-            push(stack[frame.base + slot]);
+            uint8_t slot = frame.readByte();
+            push(frame.slots[slot]);
             return true;
         }
         case OP_SET_LOCAL: {
-            uint8_t slot = frame.function->chunk.code[frame.ip++];
-            stack[frame.base + slot] = stack.back();
+            uint8_t slot = frame.readByte();
+            frame.slots[slot] = peek();
             return true;
         }
         case OP_GET_GLOBAL: {
-            uint8_t nameIdx = frame.function->chunk.code[frame.ip++];
-            std::string name = std::get<std::string>(frame.function->chunk.constants[nameIdx]);
-            push(globals[name]);
+            uint16_t slot = frame.readShort();
+            push(globals[slot]);
             return true;
         }
         case OP_SET_GLOBAL: {
-            uint8_t nameIdx = frame.function->chunk.code[frame.ip++];
-            std::string name = std::get<std::string>(frame.function->chunk.constants[nameIdx]);
-            globals[name] = stack.back();
+            uint16_t slot = frame.readShort();
+            globals[slot] = peek();
             return true;
         }
         case OP_POP:
-            pop();
+            drop();
             return true;
 
         case OP_ADD:
@@ -94,6 +172,7 @@ bool VM::executeInstruction(CallFrame& frame, uint8_t instruction) {
         case OP_LOGICAL_AND_EQUAL:
         case OP_LOGICAL_OR:
         case OP_LOGICAL_OR_EQUAL:
+            observeOperands(frame);
             return handleArithmetic(instruction);
 
         case OP_GREATER:
@@ -102,15 +181,60 @@ bool VM::executeInstruction(CallFrame& frame, uint8_t instruction) {
         case OP_LESSER_EQUAL:
         case OP_EQUAL:
         case OP_NOT_EQUAL:
+            observeOperands(frame);
+            return handleComparison(instruction);
         case OP_NOT:
         case OP_NEGATE:
             return handleComparison(instruction);
 
+        case OP_ADD_INT:
+        case OP_SUB_INT:
+        case OP_MUL_INT:
+        case OP_MOD_INT:
+        case OP_BITAND_INT:
+        case OP_BITOR_INT:
+        case OP_XOR_INT:
+        case OP_SHL_INT:
+        case OP_SHR_INT:
+        case OP_LT_INT:
+        case OP_LE_INT:
+        case OP_GT_INT:
+        case OP_GE_INT:
+        case OP_EQ_INT:
+        case OP_NE_INT:
+        case OP_ADD_F64:
+        case OP_SUB_F64:
+        case OP_MUL_F64:
+        case OP_DIV_F64:
+            return handleTypedOp(instruction);
+
+        case OP_ADD_INT_GUARDED:
+        case OP_SUB_INT_GUARDED:
+        case OP_MUL_INT_GUARDED:
+        case OP_LT_INT_GUARDED:
+        case OP_LE_INT_GUARDED:
+        case OP_GT_INT_GUARDED:
+        case OP_GE_INT_GUARDED:
+        case OP_EQ_INT_GUARDED:
+        case OP_NE_INT_GUARDED:
+        case OP_ADD_F64_GUARDED:
+        case OP_SUB_F64_GUARDED:
+        case OP_MUL_F64_GUARDED:
+        case OP_DIV_F64_GUARDED:
+            return handleGuardedOp(frame, instruction);
+
         case OP_JUMP:
         case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_TRUE:
         case OP_LOOP:
             return handleJump(frame, instruction);
 
+        case OP_SET_LOCAL_POP:
+        case OP_INC_LOCAL_CONST:
+        case OP_JUMP_IF_NOT_LT_LOCAL:
+        case OP_JUMP_IF_NOT_LT_CONST:
+            return handleSuperinstruction(frame, instruction);
+
         case OP_PRINT: {
             Value value = pop();
             std::cout << valueToString(value);
@@ -123,7 +247,15 @@ bool VM::executeInstruction(CallFrame& frame, uint8_t instruction) {
         }
 
         case OP_CALL:
-            return handleCall(frame);
+            return handleCall(frame) && enterCompiled();
+        case OP_INVOKE:
+            return handleInvoke(frame) && enterCompiled();
+        case OP_TAIL_INVOKE:
+            return handleInvoke(frame, true) && enterCompiled();
+        case OP_TAIL_CALL:
+            return handleTailCall(frame) && enterCompiled();
+        case OP_CALL_DIRECT:
+            return handleCallDirect(frame) && enterCompiled();
         case OP_RETURN:
             return handleReturn(frame);
 
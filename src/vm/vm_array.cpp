@@ -3,62 +3,59 @@
 #include "vm/utils/value_utils.h"
 
 #include <iostream>
-#include <vector>
 
 namespace vm {
 
 bool VM::handleArrayOp(CallFrame& frame, uint8_t instruction) {
     switch (instruction) {
         case OP_NEW_ARRAY: {
-            uint8_t count = frame.function->chunk.code[frame.ip++];
-            std::vector<Value> elements(count);
-            for (int i = count - 1; i >= 0; i--) {
-                elements[i] = pop();
-            }
+            uint8_t count = frame.readByte();
+            Value* elements = stackTop - count;
 
-            if (count == 1 && std::holds_alternative<ArrayObject*>(elements[0])) {
-                push(elements[0]);
+            if (count == 1 && elements[0].isArray()) {
                 return true;
             }
 
-            ArrayObject* arr = new ArrayObject();
+            ArrayObject* arr = newObject<ArrayObject>();
             arr->length = count;
             arr->capacity = count;
             arr->data = new Value[count];
             for (int i = 0; i < count; i++) {
                 arr->data[i] = elements[i];
             }
+            drop(count);
             push(arr);
             return true;
         }
 
         case OP_INDEX_GET: {
-            Value idxValue = pop();
-            Value arrValue = pop();
-            if (!std::holds_alternative<ArrayObject*>(arrValue)) {
+            const Value& idxValue = peek();
+            Value& arrValue = peek(1);
+            if (!arrValue.isArray()) {
                 std::cerr << "Runtime error: index operation expects an array." << std::endl;
                 return false;
             }
-            ArrayObject* arr = std::get<ArrayObject*>(arrValue);
+            ArrayObject* arr = arrValue.as.array;
             int idx = asInt(idxValue);
             if (idx < 0 || static_cast<size_t>(idx) >= arr->length) {
                 std::cerr << "Runtime error: array index " << idx
                           << " out of bounds (length " << arr->length << ")." << std::endl;
                 return false;
             }
-            push(arr->data[idx]);
+            arrValue = arr->data[idx];
+            drop();
             return true;
         }
 
         case OP_INDEX_SET: {
-            Value value = pop();
-            Value idxValue = pop();
-            Value arrValue = pop();
-            if (!std::holds_alternative<ArrayObject*>(arrValue)) {
+            const Value& value = peek();
+            const Value& idxValue = peek(1);
+            const Value& arrValue = peek(2);
+            if (!arrValue.isArray()) {
                 std::cerr << "Runtime error: index operation expects an array." << std::endl;
                 return false;
             }
-            ArrayObject* arr = std::get<ArrayObject*>(arrValue);
+            ArrayObject* arr = arrValue.as.array;
             int idx = asInt(idxValue);
             if (idx < 0 || static_cast<size_t>(idx) >= arr->length) {
                 std::cerr << "Runtime error: array index " << idx
@@ -66,16 +63,17 @@ bool VM::handleArrayOp(CallFrame& frame, uint8_t instruction) {
                 return false;
             }
             arr->data[idx] = value;
+            drop(3);
             return true;
         }
 
         case OP_FIXED_ARRAY: {
-            uint8_t argCount = frame.function->chunk.code[frame.ip++];
-            Value initValue = std::monostate{};
+            uint8_t argCount = frame.readByte();
+            Value initValue;
             if (argCount == 2) {
                 initValue = pop();
-                if (std::holds_alternative<ArrayObject*>(initValue)) {
-                    ArrayObject* initArr = std::get<ArrayObject*>(initValue);
+                if (initValue.isArray()) {
+                    ArrayObject* initArr = initValue.as.array;
                     if (initArr->length == 1) {
                         initValue = initArr->data[0];
                     }
@@ -88,7 +86,7 @@ bool VM::handleArrayOp(CallFrame& frame, uint8_t instruction) {
                 return false;
             }
 
-            ArrayObject* arr = new ArrayObject();
+            ArrayObject* arr = newObject<ArrayObject>();
             arr->isFixed = true;
             arr->length = size;
             arr->capacity = size;
@@ -101,14 +99,14 @@ bool VM::handleArrayOp(CallFrame& frame, uint8_t instruction) {
         }
 
         case OP_ARRAY_PUSH: {
-            Value value = pop();
-            Value arrValue = pop();
-            if (!std::holds_alternative<ArrayObject*>(arrValue)) {
+            const Value& value = peek();
+            Value& arrValue = peek(1);
+            if (!arrValue.isArray()) {
                 std::cerr << "Runtime error: push expects an array." << std::endl;
                 return false;
             }
 
-            ArrayObject* arr = std::get<ArrayObject*>(arrValue);
+            ArrayObject* arr = arrValue.as.array;
             if (arr->isFixed) {
                 std::cerr << "Runtime error: Cannot push to fixed array." << std::endl;
                 return false;
@@ -121,23 +119,24 @@ bool VM::handleArrayOp(CallFrame& frame, uint8_t instruction) {
                     newData[i] = arr->data[i];
                 }
                 if (arr->data) delete[] arr->data;
+                heap.noteAllocation((newCap - arr->capacity) * sizeof(Value));
                 arr->data = newData;
                 arr->capacity = newCap;
             }
 
             arr->data[arr->length++] = value;
-            push(std::monostate{});
+            arrValue = Value();
+            drop();
             return true;
         }
 
         case OP_ARRAY_LENGTH: {
-            Value arrValue = pop();
-            if (!std::holds_alternative<ArrayObject*>(arrValue)) {
+            Value& arrValue = peek();
+            if (!arrValue.isArray()) {
                 std::cerr << "Runtime error: length() expects an array." << std::endl;
                 return false;
             }
-            ArrayObject* arr = std::get<ArrayObject*>(arrValue);
-            push(static_cast<double>(arr->length));
+            arrValue = static_cast<double>(arrValue.as.array->length);
             return true;
         }
 
@@ -1,16 +1,58 @@
 #include "vm/vm.h"
 
+#include <algorithm>
 #include <iostream>
 
 namespace vm {
 
 bool VM::handleCall(CallFrame& frame) {
-    uint8_t argCount = frame.function->chunk.code[frame.ip++];
-    Value calleeValue = stack[stack.size() - argCount - 1];
+    uint8_t argCount = frame.readByte();
+    safepoint();
+    return callValue(stackTop - argCount - 1, argCount);
+}
+
+// OP_CALL_DIRECT const argc: the compiler bound the call to the function in
+// the constant and checked its arity, so this is only the frame push. The
+// callee value below the arguments is that same function.
+bool VM::handleCallDirect(CallFrame& frame) {
+    FunctionObject* function = frame.readConstant().as.function;
+    uint8_t argCount = frame.readByte();
+    safepoint();
+    return pushFrame(function, stackTop - argCount - 1);
+}
+
+// OP_TAIL_CALL argc, always followed by OP_RETURN. Calling a function
+// reuses the frame: the callee and its arguments move down over the frame's
+// slots and the frame restarts at the callee's first instruction, so
+// recursion through `return f(...)` runs in constant stack. Any other callee
+// is called normally and the OP_RETURN returns its result.
+bool VM::handleTailCall(CallFrame& frame) {
+    uint8_t argCount = frame.readByte();
+    safepoint();
+    Value* callee = stackTop - argCount - 1;
+    if (!callee->isFunction() || callee->as.function->arity != argCount) {
+        return callValue(callee, argCount);
+    }
+    reuseFrame(frame, callee->as.function, callee);
+    return true;
+}
+
+// Moves `callee` (a function, or a method's receiver) and the arguments
+// above it down over `frame`'s slots and restarts the frame in `function`.
+void VM::reuseFrame(CallFrame& frame, FunctionObject* function, Value* callee) {
+    stackTop = std::copy(callee, stackTop, frame.slots);
+    frame.function = function;
+    frame.ip = function->chunk.code.data();
+    countCall(function);
+}
+
+// Calls *callee with the argCount values above it on the stack.
+bool VM::callValue(Value* callee, uint8_t argCount) {
+    Value calleeValue = *callee;
 
-    if (std::holds_alternative<ClassObject*>(calleeValue)) {
-        ClassObject* klass = std::get<ClassObject*>(calleeValue);
-        InstanceObject* instance = new InstanceObject(klass);
+    if (calleeValue.isClass()) {
+        ClassObject* klass = calleeValue.as.klass;
+        InstanceObject* instance = newObject<InstanceObject>(klass);
 
         if (klass->methods.count(klass->name)) {
             auto& initMethods = klass->methods[klass->name];
@@ -23,10 +65,8 @@ bool VM::handleCall(CallFrame& frame) {
             }
 
             if (matchingInit) {
-                stack[stack.size() - argCount - 1] = instance;
-                size_t base = stack.size() - argCount - 1;
-                frames.push_back({matchingInit, 0, base});
-                return true;
+                *callee = instance;
+                return pushFrame(matchingInit, callee);
             }
 
             std::cerr << "Runtime error: no matching constructor for "
@@ -40,15 +80,14 @@ bool VM::handleCall(CallFrame& frame) {
             return false;
         }
 
-        for (int i = 0; i < argCount; i++) pop();
-        pop();
+        drop(argCount + 1);
         push(instance);
         return true;
     }
 
-    if (std::holds_alternative<BoundMethod*>(calleeValue)) {
-        BoundMethod* bound = std::get<BoundMethod*>(calleeValue);
-        stack[stack.size() - argCount - 1] = bound->instance;
+    if (calleeValue.isBoundMethod()) {
+        BoundMethod* bound = calleeValue.as.bound;
+        *callee = bound->instance;
 
         FunctionObject* matchingMethod = nullptr;
         for (auto* func : bound->methods) {
@@ -63,41 +102,33 @@ bool VM::handleCall(CallFrame& frame) {
             return false;
         }
 
-        size_t base = stack.size() - argCount - 1;
-        frames.push_back({matchingMethod, 0, base});
-        return true;
+        return pushFrame(matchingMethod, callee);
     }
 
-    if (!std::holds_alternative<FunctionObject*>(calleeValue)) {
+    if (!calleeValue.isFunction()) {
         std::cerr << "Runtime error: tried to call a non-function" << std::endl;
         return false;
     }
 
-    FunctionObject* callee = std::get<FunctionObject*>(calleeValue);
-    if (argCount != callee->arity) {
-        std::cerr << "Runtime error: in function " << callee->name
-                  << " expected " << callee->arity << " arguments but got "
+    FunctionObject* function = calleeValue.as.function;
+    if (argCount != function->arity) {
+        std::cerr << "Runtime error: in function " << function->name
+                  << " expected " << function->arity << " arguments but got "
                   << static_cast<int>(argCount) << std::endl;
         return false;
     }
 
-    size_t base = stack.size() - argCount - 1;
-    frames.push_back({callee, 0, base});
-    return true;
+    return pushFrame(function, callee);
 }
 
 bool VM::handleReturn(CallFrame& frame) {
     Value result = pop();
-    size_t base = frame.base;
+    Value* slots = frame.slots;
 
     frames.pop_back();
-    if (frames.empty()) {
-        return false;
-    }
-
-    stack.resize(base);
+    stackTop = slots;
     push(result);
-    return true;
+    return frames.size() > baseDepth;
 }
 
 }  // namespace vm
@@ -7,30 +7,105 @@
 
 namespace vm {
 
+// Finds field `name` on `instance`: its declared slot (with the declared
+// access) or an undeclared overflow field (always public). Returns nullptr
+// if the instance has neither.
+static Value* findField(InstanceObject* instance, const std::string& name, AccessModifier& access) {
+    int slot = instance->klass->findField(name);
+    if (slot >= 0) {
+        if (static_cast<uint32_t>(slot) >= instance->slotCount) {
+            instance->growSlots(instance->klass->fieldLayout.size());
+        }
+        access = instance->klass->fieldLayout[slot].access;
+        return &instance->slots[slot];
+    }
+    if (instance->overflow) {
+        auto it = instance->overflow->find(name);
+        if (it != instance->overflow->end()) {
+            access = AccessModifier::PUBLIC;
+            return &it->second;
+        }
+    }
+    return nullptr;
+}
+
+// Like findField, but creates an overflow field for undeclared names.
+static Value& fieldForStore(InstanceObject* instance, const std::string& name, AccessModifier& access) {
+    if (Value* field = findField(instance, name, access)) {
+        return *field;
+    }
+    if (!instance->overflow) {
+        instance->overflow = new std::unordered_map<std::string, Value>();
+    }
+    access = AccessModifier::PUBLIC;
+    return (*instance->overflow)[name];
+}
+
+// Slot index of a field returned by findField, or -1 for an overflow field.
+static int declaredSlot(const InstanceObject* instance, const Value* field) {
+    if (field >= instance->slots && field < instance->slots + instance->slotCount) {
+        return static_cast<int>(field - instance->slots);
+    }
+    return -1;
+}
+
+static PropertyCacheEntry cacheEntry(ClassObject* klass, PropertyCacheEntry::Kind kind) {
+    PropertyCacheEntry entry;
+    entry.klass = klass;
+    entry.version = klass->version;
+    entry.kind = kind;
+    return entry;
+}
+
+// Caches a field that passed its access check at this site.
+static void cacheField(PropertyCache& cache, const InstanceObject* instance, const Value* field) {
+    int slot = declaredSlot(instance, field);
+    if (slot >= 0) {
+        PropertyCacheEntry entry = cacheEntry(instance->klass, PropertyCacheEntry::FIELD);
+        entry.slot = static_cast<uint32_t>(slot);
+        cache.add(entry);
+    }
+}
+
+// Caches a method lookup, unless an overflow field could shadow it.
+static void cacheMethods(PropertyCache& cache, const InstanceObject* instance,
+                         const std::vector<FunctionObject*>& methods) {
+    if (!instance->overflow) {
+        PropertyCacheEntry entry = cacheEntry(instance->klass, PropertyCacheEntry::METHOD);
+        entry.methods = &methods;
+        cache.add(entry);
+    }
+}
+
+// Caches that an *_OR_GLOBAL / *_OR_LOCAL site falls through to the global.
+static void cacheGlobal(PropertyCache& cache, const InstanceObject* instance) {
+    if (!instance->overflow) {
+        cache.add(cacheEntry(instance->klass, PropertyCacheEntry::GLOBAL));
+    }
+}
+
 bool VM::handleClassOp(CallFrame& frame, uint8_t instruction) {
     switch (instruction) {
         case OP_CLASS: {
-            uint8_t nameIdx = frame.function->chunk.code[frame.ip++];
-            std::string name = std::get<std::string>(frame.function->chunk.constants[nameIdx]);
-            ClassObject* klass = new ClassObject(name);
+            const std::string& name = frame.readConstant().str();
+            ClassObject* klass = newObject<ClassObject>(name);
             push(klass);
             return true;
         }
 
         case OP_METHOD: {
-            uint8_t nameIdx = frame.function->chunk.code[frame.ip++];
-            std::string name = std::get<std::string>(frame.function->chunk.constants[nameIdx]);
-            uint8_t modifier = frame.function->chunk.code[frame.ip++];
+            const std::string& name = frame.readConstant().str();
+            uint8_t modifier = frame.readByte();
 
             Value methodValue = pop();
-            Value klassValue = stack.back();
-            if (!std::holds_alternative<ClassObject*>(klassValue)) {
+            Value klassValue = peek();
+            if (!klassValue.isClass()) {
                 std::cerr << "Runtime error: OP_METHOD expects class on stack." << std::endl;
                 return false;
             }
 
-            ClassObject* klass = std::get<ClassObject*>(klassValue);
-            FunctionObject* func = std::get<FunctionObject*>(methodValue);
+            ClassObject* klass = klassValue.as.klass;
+            FunctionObject* func = methodValue.as.function;
             func->ownerClass = klass;
 
             bool overridden = false;
@@ -46,49 +121,54 @@ bool VM::handleClassOp(CallFrame& frame, uint8_t instruction) {
             }
 
             klass->methodAccess[name] = static_cast<AccessModifier>(modifier);
+            ++klass->version;
             return true;
         }
 
         case OP_GET_PROPERTY: {
-            uint8_t nameIdx = frame.function->chunk.code[frame.ip++];
-            std::string name = std::get<std::string>(frame.function->chunk.constants[nameIdx]);
-            Value objectValue = pop();
-            if (!std::holds_alternative<InstanceObject*>(objectValue)) {
+            const std::string& name = frame.readConstant().str();
+            PropertyCache& cache = frame.function->chunk.propertyCaches[frame.readShort()];
+            Value& objectValue = peek();
+            if (!objectValue.isInstance()) {
                 std::cerr << "Runtime error: OP_GET_PROPERTY expects an instance. Got: "
                           << valueToString(objectValue) << std::endl;
                 return false;
             }
 
-            InstanceObject* instance = std::get<InstanceObject*>(objectValue);
+            InstanceObject* instance = objectValue.as.instance;
+            if (const PropertyCacheEntry* entry = cache.find(instance)) {
+                if (entry->kind == PropertyCacheEntry::FIELD) {
+                    objectValue = instance->slots[entry->slot];
+                } else {
+                    objectValue = newObject<BoundMethod>(instance, *entry->methods);
+                }
+                return true;
+            }
+
             ClassObject* contextClass = frame.function->isMethod ? frame.function->ownerClass : nullptr;
 
-            if (instance->fields.count(name) || instance->klass->fields.count(name)) {
-                AccessModifier access = AccessModifier::PUBLIC;
-                if (instance->klass->fields.count(name)) {
-                    access = instance->klass->fields[name];
-                }
+            AccessModifier access;
+            if (Value* field = findField(instance, name, access)) {
                 if (!checkAccess(instance->klass, contextClass, access)) {
                     std::cerr << "Runtime error: Access denied to field '" << name << "'." << std::endl;
                     return false;
                 }
-                if (instance->fields.count(name)) {
-                    push(instance->fields[name]);
-                } else {
-                    push(std::monostate{});
-                }
+                cacheField(cache, instance, field);
+                objectValue = *field;
                 return true;
             }
 
-            if (instance->klass->methods.count(name)) {
+            auto methodsIt = instance->klass->methods.find(name);
+            if (methodsIt != instance->klass->methods.end()) {
                 AccessModifier access = instance->klass->methodAccess[name];
                 if (!checkAccess(instance->klass, contextClass, access)) {
                     std::cerr << "Runtime error: Access denied to method '" << name << "'." << std::endl;
                     return false;
                 }
 
-                std::vector<FunctionObject*> methods = instance->klass->methods[name];
-                BoundMethod* bound = new BoundMethod(instance, methods);
-                push(bound);
+                cacheMethods(cache, instance, methodsIt->second);
+                BoundMethod* bound = newObject<BoundMethod>(instance, methodsIt->second);
+                objectValue = bound;
                 return true;
             }
 
@@ -97,104 +177,132 @@ bool VM::handleClassOp(CallFrame& frame, uint8_t instruction) {
         }
 
         case OP_SET_PROPERTY: {
-            uint8_t nameIdx = frame.function->chunk.code[frame.ip++];
-            std::string name = std::get<std::string>(frame.function->chunk.constants[nameIdx]);
-            Value value = pop();
-            Value objectValue = pop();
-            if (!std::holds_alternative<InstanceObject*>(objectValue)) {
+            const std::string& name = frame.readConstant().str();
+            PropertyCache& cache = frame.function->chunk.propertyCaches[frame.readShort()];
+            const Value& value = peek();
+            Value& objectValue = peek(1);
+            if (!objectValue.isInstance()) {
                 std::cerr << "Runtime error: OP_SET_PROPERTY expects an instance." << std::endl;
                 return false;
             }
 
-            InstanceObject* instance = std::get<InstanceObject*>(objectValue);
+            InstanceObject* instance = objectValue.as.instance;
+            const PropertyCacheEntry* entry = cache.find(instance);
+            if (entry && entry->kind == PropertyCacheEntry::FIELD) {
+                instance->slots[entry->slot] = value;
+                objectValue = value;
+                drop();
+                return true;
+            }
+
             ClassObject* contextClass = frame.function->isMethod ? frame.function->ownerClass : nullptr;
-            if (instance->klass->fields.count(name)) {
-                AccessModifier access = instance->klass->fields[name];
-                if (!checkAccess(instance->klass, contextClass, access)) {
-                    std::cerr << "Runtime error: Access denied to field '" << name << "'." << std::endl;
-                    return false;
-                }
+
+            AccessModifier access;
+            Value& field = fieldForStore(instance, name, access);
+            if (!checkAccess(instance->klass, contextClass, access)) {
+                std::cerr << "Runtime error: Access denied to field '" << name << "'." << std::endl;
+                return false;
             }
 
-            instance->fields[name] = value;
-            push(value);
+            cacheField(cache, instance, &field);
+            field = value;
+            objectValue = value;
+            drop();
             return true;
         }
 
         case OP_GET_PROPERTY_OR_GLOBAL: {
-            uint8_t nameIdx = frame.function->chunk.code[frame.ip++];
-            std::string name = std::get<std::string>(frame.function->chunk.constants[nameIdx]);
-            Value objectValue = pop();
+            const std::string& name = frame.readConstant().str();
+            uint16_t slot = frame.readShort();
+            PropertyCache& cache = frame.function->chunk.propertyCaches[frame.readShort()];
+            Value& objectValue = peek();
+
+            if (objectValue.isInstance()) {
+                InstanceObject* instance = objectValue.as.instance;
+                if (const PropertyCacheEntry* entry = cache.find(instance)) {
+                    switch (entry->kind) {
+                        case PropertyCacheEntry::FIELD:
+                            objectValue = instance->slots[entry->slot];
+                            return true;
+                        case PropertyCacheEntry::METHOD:
+                            objectValue = newObject<BoundMethod>(instance, *entry->methods);
+                            return true;
+                        default:
+                            objectValue = globals[slot];
+                            return true;
+                    }
+                }
 
-            if (std::holds_alternative<InstanceObject*>(objectValue)) {
-                InstanceObject* instance = std::get<InstanceObject*>(objectValue);
                 ClassObject* contextClass = frame.function->isMethod ? frame.function->ownerClass : nullptr;
 
-                if (instance->fields.count(name) || instance->klass->fields.count(name)) {
-                    AccessModifier access = AccessModifier::PUBLIC;
-                    if (instance->klass->fields.count(name)) {
-                        access = instance->klass->fields[name];
-                    }
+                AccessModifier access;
+                auto methodsIt = instance->klass->methods.find(name);
+                if (Value* field = findField(instance, name, access)) {
                     if (checkAccess(instance->klass, contextClass, access)) {
-                        if (instance->fields.count(name)) {
-                            push(instance->fields[name]);
-                        } else {
-                            push(std::monostate{});
-                        }
+                        cacheField(cache, instance, field);
+                        objectValue = *field;
                         return true;
                     }
-                } else if (instance->klass->methods.count(name)) {
+                } else if (methodsIt != instance->klass->methods.end()) {
                     AccessModifier access = instance->klass->methodAccess[name];
                     if (checkAccess(instance->klass, contextClass, access)) {
-                        std::vector<FunctionObject*> methods = instance->klass->methods[name];
-                        BoundMethod* bound = new BoundMethod(instance, methods);
-                        push(bound);
+                        cacheMethods(cache, instance, methodsIt->second);
+                        BoundMethod* bound = newObject<BoundMethod>(instance, methodsIt->second);
+                        objectValue = bound;
                         return true;
                     }
                 }
+                cacheGlobal(cache, instance);
             }
 
-            push(globals[name]);
+            objectValue = globals[slot];
             return true;
         }
 
         case OP_SET_PROPERTY_OR_LOCAL: {
-            uint8_t nameIdx = frame.function->chunk.code[frame.ip++];
-            std::string name = std::get<std::string>(frame.function->chunk.constants[nameIdx]);
+            const std::string& name = frame.readConstant().str();
+            uint16_t slot = frame.readShort();
+            PropertyCache& cache = frame.function->chunk.propertyCaches[frame.readShort()];
             Value objectValue = pop();
-            Value value = pop();
+            const Value& value = peek();
+
+            if (objectValue.isInstance()) {
+                InstanceObject* instance = objectValue.as.instance;
+                if (const PropertyCacheEntry* entry = cache.find(instance)) {
+                    if (entry->kind == PropertyCacheEntry::FIELD) {
+                        instance->slots[entry->slot] = value;
+                    } else {
+                        globals[slot] = value;
+                    }
+                    return true;
+                }
 
-            if (std::holds_alternative<InstanceObject*>(objectValue)) {
-                InstanceObject* instance = std::get<InstanceObject*>(objectValue);
                 ClassObject* contextClass = frame.function->isMethod ? frame.function->ownerClass : nullptr;
 
-                bool allowed = true;
-                if (instance->klass->fields.count(name)) {
-                    AccessModifier access = instance->klass->fields[name];
-                    allowed = checkAccess(instance->klass, contextClass, access);
-                }
-                if (allowed) {
-                    instance->fields[name] = value;
-                    push(value);
+                AccessModifier access;
+                Value& field = fieldForStore(instance, name, access);
+                if (checkAccess(instance->klass, contextClass, access)) {
+                    cacheField(cache, instance, &field);
+                    field = value;
                     return true;
                 }
+                cacheGlobal(cache, instance);
             }
 
-            globals[name] = value;
-            push(value);
+            globals[slot] = value;
             return true;
         }
 
         case OP_INHERIT: {
             Value superValue = pop();
-            if (!std::holds_alternative<ClassObject*>(superValue)) {
+            if (!superValue.isClass()) {
                 std::cerr << "Runtime error: Superclass must be a class." << std::endl;
                 return false;
             }
-            ClassObject* superclass = std::get<ClassObject*>(superValue);
+            ClassObject* superclass = superValue.as.klass;
 
-            Value subclassValue = stack.back();
-            ClassObject* subclass = std::get<ClassObject*>(subclassValue);
+            Value subclassValue = peek();
+            ClassObject* subclass = subclassValue.as.klass;
             subclass->parent = superclass;
 
             for (const auto& methodPair : superclass->methods) {
@@ -204,23 +312,23 @@ bool VM::handleClassOp(CallFrame& frame, uint8_t instruction) {
                 subclass->methods[methodPair.first] = methodPair.second;
                 subclass->methodAccess[methodPair.first] = superclass->methodAccess[methodPair.first];
             }
-            for (const auto& fieldPair : superclass->fields) {
-                if (fieldPair.second == AccessModifier::PRIVATE) {
+            ++subclass->version;
+            for (const auto& field : superclass->fieldLayout) {
+                if (field.access == AccessModifier::PRIVATE) {
                     continue;
                 }
-                subclass->fields[fieldPair.first] = fieldPair.second;
+                subclass->declareField(field.name, field.access);
             }
             return true;
         }
 
         case OP_FIELD: {
-            uint8_t nameIdx = frame.function->chunk.code[frame.ip++];
-            std::string name = std::get<std::string>(frame.function->chunk.constants[nameIdx]);
-            uint8_t modifier = frame.function->chunk.code[frame.ip++];
+            const std::string& name = frame.readConstant().str();
+            uint8_t modifier = frame.readByte();
 
-            Value klassValue = stack.back();
-            ClassObject* klass = std::get<ClassObject*>(klassValue);
-            klass->fields[name] = static_cast<AccessModifier>(modifier);
+            Value klassValue = peek();
+            ClassObject* klass = klassValue.as.klass;
+            klass->declareField(name, static_cast<AccessModifier>(modifier));
             return true;
         }
 
@@ -229,4 +337,79 @@ bool VM::handleClassOp(CallFrame& frame, uint8_t instruction) {
     }
 }
 
+// OP_INVOKE name argc cache: receiver.name(args...) with the receiver and
+// arguments already on the stack. Resolves like OP_GET_PROPERTY followed by
+// OP_CALL, but a method is entered directly with the receiver as slot 0, and
+// the overload picked for this site's argc is cached per receiver class.
+// OP_TAIL_INVOKE (`tail`), always followed by OP_RETURN, enters a method in
+// the current frame like OP_TAIL_CALL; a callable field is called normally.
+bool VM::handleInvoke(CallFrame& frame, bool tail) {
+    const std::string& name = frame.readConstant().str();
+    uint8_t argCount = frame.readByte();
+    PropertyCache& cache = frame.function->chunk.propertyCaches[frame.readShort()];
+    safepoint();
+    Value* receiver = stackTop - argCount - 1;
+    auto enter = [this, &frame, receiver, tail](FunctionObject* method) {
+        if (!tail) return pushFrame(method, receiver);
+        reuseFrame(frame, method, receiver);
+        return true;
+    };
+    if (!receiver->isInstance()) {
+        std::cerr << "Runtime error: OP_GET_PROPERTY expects an instance. Got: "
+                  << valueToString(*receiver) << std::endl;
+        return false;
+    }
+
+    InstanceObject* instance = receiver->as.instance;
+    if (const PropertyCacheEntry* entry = cache.find(instance)) {
+        if (entry->kind == PropertyCacheEntry::FIELD) {
+            *receiver = instance->slots[entry->slot];
+            return callValue(receiver, argCount);
+        }
+        return enter(entry->method);
+    }
+
+    ClassObject* contextClass = frame.function->isMethod ? frame.function->ownerClass : nullptr;
+
+    AccessModifier access;
+    if (Value* field = findField(instance, name, access)) {
+        if (!checkAccess(instance->klass, contextClass, access)) {
+            std::cerr << "Runtime error: Access denied to field '" << name << "'." << std::endl;
+            return false;
+        }
+        cacheField(cache, instance, field);
+        *receiver = *field;
+        return callValue(receiver, argCount);
+    }
+
+    auto methodsIt = instance->klass->methods.find(name);
+    if (methodsIt == instance->klass->methods.end()) {
+        std::cerr << "Runtime error: Undefined property '" << name << "'." << std::endl;
+        return false;
+    }
+    if (!checkAccess(instance->klass, contextClass, instance->klass->methodAccess[name])) {
+        std::cerr << "Runtime error: Access denied to method '" << name << "'." << std::endl;
+        return false;
+    }
+
+    FunctionObject* method = nullptr;
+    for (auto* func : methodsIt->second) {
+        if (argCount == func->arity - 1) {
+            method = func;
+            break;
+        }
+    }
+    if (!method) {
+        std::cerr << "Runtime error: expected method arguments did not match any overloaded method." << std::endl;
+        return false;
+    }
+
+    if (!instance->overflow) {
+        PropertyCacheEntry entry = cacheEntry(instance->klass, PropertyCacheEntry::METHOD);
+        entry.method = method;
+        cache.add(entry);
+    }
+    return enter(method);
+}
+
 }  // namespace vm
@@ -0,0 +1,772 @@
+#include "vm/vm.h"
+
+#include "vm/utils/arith_utils.h"
+#include "vm/utils/value_utils.h"
+
+#include <iostream>
+
+// Direct-threaded dispatch uses the GNU labels-as-values extension. Other
+// compilers (or -DPENGUIN_VM_COMPUTED_GOTO=OFF) get a single switch instead.
+#if defined(__GNUC__) && !defined(PENGUIN_VM_NO_COMPUTED_GOTO)
+#define PENGUIN_COMPUTED_GOTO 1
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+namespace vm {
+
+void VM::runThreaded() {
+    // The decode state lives in locals so each operand fetch is a single load.
+    // It is written back to the frame only before code that reads or changes
+    // frames (calls, returns and the out-of-line category handlers).
+    CallFrame* frame;
+    uint8_t* ip;
+    const Value* constants;
+    PropertyCache* caches;
+    Value* slots;
+    uint8_t instruction;
+
+#define LOAD_FRAME()                                             \
+    do {                                                         \
+        frame = &frames.back();                                  \
+        ip = frame->ip;                                          \
+        constants = frame->function->chunk.constants.data();     \
+        caches = frame->function->chunk.propertyCaches.data();   \
+        slots = frame->slots;                                    \
+    } while (0)
+#define SAVE_IP() (frame->ip = ip)
+#define READ_BYTE() (*ip++)
+#define READ_SHORT() (ip += 2, static_cast<uint16_t>((ip[-2] << 8) | ip[-1]))
+#define READ_CONSTANT() (constants[READ_BYTE()])
+#define PEEK_SHORT(offset) static_cast<uint16_t>((ip[offset] << 8) | ip[(offset) + 1])
+#define CALL_HANDLER(call)         \
+    do {                           \
+        SAVE_IP();                 \
+        if (!(call)) return;       \
+        ip = frame->ip;            \
+    } while (0)
+
+    LOAD_FRAME();
+
+#ifdef PENGUIN_COMPUTED_GOTO
+    static void* dispatchTable[256];
+    static bool dispatchTableReady = false;
+    if (!dispatchTableReady) {
+        for (auto& target : dispatchTable) target = &&op_unknown;
+#define SET_TARGET(op) dispatchTable[op] = &&op_##op
+        SET_TARGET(OP_CONSTANT);
+        SET_TARGET(OP_GET_GLOBAL);
+        SET_TARGET(OP_SET_GLOBAL);
+        SET_TARGET(OP_GET_LOCAL);
+        SET_TARGET(OP_SET_LOCAL);
+        SET_TARGET(OP_POP);
+        SET_TARGET(OP_ADD);
+        SET_TARGET(OP_SUB);
+        SET_TARGET(OP_MUL);
+        SET_TARGET(OP_DIV);
+        SET_TARGET(OP_MOD);
+        SET_TARGET(OP_GREATER);
+        SET_TARGET(OP_LESSER);
+        SET_TARGET(OP_GREATER_EQUAL);
+        SET_TARGET(OP_LESSER_EQUAL);
+        SET_TARGET(OP_NOT);
+        SET_TARGET(OP_PRINT);
+        SET_TARGET(OP_HALT);
+        SET_TARGET(OP_NOT_EQUAL);
+        SET_TARGET(OP_TRUE);
+        SET_TARGET(OP_FALSE);
+        SET_TARGET(OP_NULL);
+        SET_TARGET(OP_LEFT_SHIFT);
+        SET_TARGET(OP_RIGHT_SHIFT);
+        SET_TARGET(OP_BITWISE_AND);
+        SET_TARGET(OP_BITWISE_OR);
+        SET_TARGET(OP_XOR);
+        SET_TARGET(OP_LOGICAL_AND);
+        SET_TARGET(OP_LOGICAL_OR);
+        SET_TARGET(OP_EQUAL);
+        SET_TARGET(OP_PLUS_EQUAL);
+        SET_TARGET(OP_MINUS_EQUAL);
+        SET_TARGET(OP_MULTIPLY_EQUAL);
+        SET_TARGET(OP_DIVIDE_EQUAL);
+        SET_TARGET(OP_MODULO_EQUAL);
+        SET_TARGET(OP_LEFT_SHIFT_EQUAL);
+        SET_TARGET(OP_RIGHT_SHIFT_EQUAL);
+        SET_TARGET(OP_BITWISE_AND_EQUAL);
+        SET_TARGET(OP_BITWISE_OR_EQUAL);
+        SET_TARGET(OP_LOGICAL_AND_EQUAL);
+        SET_TARGET(OP_LOGICAL_OR_EQUAL);
+        SET_TARGET(OP_XOR_EQUAL);
+        SET_TARGET(OP_NEGATE);
+        SET_TARGET(OP_JUMP);
+        SET_TARGET(OP_JUMP_IF_FALSE);
+        SET_TARGET(OP_LOOP);
+        SET_TARGET(OP_JUMP_IF_TRUE);
+        SET_TARGET(OP_RETURN);
+        SET_TARGET(OP_CALL);
+        SET_TARGET(OP_INVOKE);
+        SET_TARGET(OP_TAIL_INVOKE);
+        SET_TARGET(OP_TAIL_CALL);
+        SET_TARGET(OP_CALL_DIRECT);
+        SET_TARGET(OP_NEW_ARRAY);
+        SET_TARGET(OP_INDEX_GET);
+        SET_TARGET(OP_INDEX_SET);
+        SET_TARGET(OP_FIXED_ARRAY);
+        SET_TARGET(OP_ARRAY_PUSH);
+        SET_TARGET(OP_ARRAY_LENGTH);
+        SET_TARGET(OP_PRINTLN);
+        SET_TARGET(OP_CLASS);
+        SET_TARGET(OP_METHOD);
+        SET_TARGET(OP_GET_PROPERTY);
+        SET_TARGET(OP_SET_PROPERTY);
+        SET_TARGET(OP_GET_PROPERTY_OR_GLOBAL);
+        SET_TARGET(OP_SET_PROPERTY_OR_LOCAL);
+        SET_TARGET(OP_INHERIT);
+        SET_TARGET(OP_CAST_INT);
+        SET_TARGET(OP_CAST_FLOAT);
+        SET_TARGET(OP_CAST_STRING);
+        SET_TARGET(OP_CAST_BOOL);
+        SET_TARGET(OP_CAST_CHAR);
+        SET_TARGET(OP_TYPEOF);
+        SET_TARGET(OP_READLINE);
+        SET_TARGET(OP_FIELD);
+        SET_TARGET(OP_SET_LOCAL_POP);
+        SET_TARGET(OP_INC_LOCAL_CONST);
+        SET_TARGET(OP_JUMP_IF_NOT_LT_LOCAL);
+        SET_TARGET(OP_JUMP_IF_NOT_LT_CONST);
+        SET_TARGET(OP_ADD_INT);
+        SET_TARGET(OP_SUB_INT);
+        SET_TARGET(OP_MUL_INT);
+        SET_TARGET(OP_MOD_INT);
+        SET_TARGET(OP_BITAND_INT);
+        SET_TARGET(OP_BITOR_INT);
+        SET_TARGET(OP_XOR_INT);
+        SET_TARGET(OP_SHL_INT);
+        SET_TARGET(OP_SHR_INT);
+        SET_TARGET(OP_LT_INT);
+        SET_TARGET(OP_LE_INT);
+        SET_TARGET(OP_GT_INT);
+        SET_TARGET(OP_GE_INT);
+        SET_TARGET(OP_EQ_INT);
+        SET_TARGET(OP_NE_INT);
+        SET_TARGET(OP_ADD_F64);
+        SET_TARGET(OP_SUB_F64);
+        SET_TARGET(OP_MUL_F64);
+        SET_TARGET(OP_DIV_F64);
+        SET_TARGET(OP_ADD_INT_GUARDED);
+        SET_TARGET(OP_SUB_INT_GUARDED);
+        SET_TARGET(OP_MUL_INT_GUARDED);
+        SET_TARGET(OP_LT_INT_GUARDED);
+        SET_TARGET(OP_LE_INT_GUARDED);
+        SET_TARGET(OP_GT_INT_GUARDED);
+        SET_TARGET(OP_GE_INT_GUARDED);
+        SET_TARGET(OP_EQ_INT_GUARDED);
+        SET_TARGET(OP_NE_INT_GUARDED);
+        SET_TARGET(OP_ADD_F64_GUARDED);
+        SET_TARGET(OP_SUB_F64_GUARDED);
+        SET_TARGET(OP_MUL_F64_GUARDED);
+        SET_TARGET(OP_DIV_F64_GUARDED);
+#undef SET_TARGET
+        dispatchTableReady = true;
+    }
+
+#define TARGET(op) op_##op
+#define TARGET_UNKNOWN op_unknown
+#define DISPATCH()                              \
+    do {                                        \
+        instruction = READ_BYTE();              \
+        goto* dispatchTable[instruction];       \
+    } while (0)
+
+    DISPATCH();
+#else
+#define TARGET(op) case op
+#define TARGET_UNKNOWN default
+#define DISPATCH() continue
+
+    for (;;) {
+        instruction = READ_BYTE();
+        switch (instruction) {
+#endif
+
+    TARGET(OP_CONSTANT): {
+        push(READ_CONSTANT());
+        DISPATCH();
+    }
+    TARGET(OP_TRUE): {
+        push(true);
+        DISPATCH();
+    }
+    TARGET(OP_FALSE): {
+        push(false);
+        DISPATCH();
+    }
+    TARGET(OP_NULL): {
+        push(Value());
+        DISPATCH();
+    }
+    TARGET(OP_GET_LOCAL): {
+        uint8_t slot = READ_BYTE();
+        push(slots[slot]);
+        DISPATCH();
+    }
+    TARGET(OP_SET_LOCAL): {
+        uint8_t slot = READ_BYTE();
+        slots[slot] = peek();
+        DISPATCH();
+    }
+    TARGET(OP_GET_GLOBAL): {
+        uint16_t slot = READ_SHORT();
+        push(globals[slot]);
+        DISPATCH();
+    }
+    TARGET(OP_SET_GLOBAL): {
+        uint16_t slot = READ_SHORT();
+        globals[slot] = peek();
+        DISPATCH();
+    }
+    TARGET(OP_POP): {
+        drop();
+        DISPATCH();
+    }
+
+#define BINARY_OP(fn)                                   \
+    do {                                                \
+        stackTop[-2] = fn(stackTop[-2], stackTop[-1]);  \
+        drop();                                         \
+    } while (0)
+// Counts the site towards quickening when both operands are ints or floats.
+#define OBSERVE_OPERANDS()                                                          \
+    do {                                                                            \
+        if (stackTop[-2].type == stackTop[-1].type &&                               \
+            (stackTop[-1].isInt() || stackTop[-1].isFloat())) {                     \
+            quicken(frame->function->chunk, ip - 1);                                \
+        }                                                                           \
+    } while (0)
+
+    TARGET(OP_ADD):
+    TARGET(OP_PLUS_EQUAL): {
+        OBSERVE_OPERANDS();
+        BINARY_OP(addValues);
+        DISPATCH();
+    }
+    TARGET(OP_SUB):
+    TARGET(OP_MINUS_EQUAL): {
+        OBSERVE_OPERANDS();
+        BINARY_OP(subValues);
+        DISPATCH();
+    }
+    TARGET(OP_MUL):
+    TARGET(OP_MULTIPLY_EQUAL): {
+        OBSERVE_OPERANDS();
+        BINARY_OP(mulValues);
+        DISPATCH();
+    }
+    TARGET(OP_DIV):
+    TARGET(OP_DIVIDE_EQUAL): {
+        OBSERVE_OPERANDS();
+        BINARY_OP(divValues);
+        DISPATCH();
+    }
+    TARGET(OP_MOD):
+    TARGET(OP_MODULO_EQUAL): {
+        BINARY_OP(modValues);
+        DISPATCH();
+    }
+    TARGET(OP_BITWISE_AND):
+    TARGET(OP_BITWISE_AND_EQUAL): {
+        BINARY_OP(bitAndValues);
+        DISPATCH();
+    }
+    TARGET(OP_BITWISE_OR):
+    TARGET(OP_BITWISE_OR_EQUAL): {
+        BINARY_OP(bitOrValues);
+        DISPATCH();
+    }
+    TARGET(OP_XOR):
+    TARGET(OP_XOR_EQUAL): {
+        BINARY_OP(xorValues);
+        DISPATCH();
+    }
+    TARGET(OP_LEFT_SHIFT):
+    TARGET(OP_LEFT_SHIFT_EQUAL): {
+        BINARY_OP(shiftLeftValues);
+        DISPATCH();
+    }
+    TARGET(OP_RIGHT_SHIFT):
+    TARGET(OP_RIGHT_SHIFT_EQUAL): {
+        BINARY_OP(shiftRightValues);
+        DISPATCH();
+    }
+    TARGET(OP_LOGICAL_AND):
+    TARGET(OP_LOGICAL_AND_EQUAL): {
+        stackTop[-2] = asBool(stackTop[-2]) && asBool(stackTop[-1]);
+        drop();
+        DISPATCH();
+    }
+    TARGET(OP_LOGICAL_OR):
+    TARGET(OP_LOGICAL_OR_EQUAL): {
+        stackTop[-2] = asBool(stackTop[-2]) || asBool(stackTop[-1]);
+        drop();
+        DISPATCH();
+    }
+#undef BINARY_OP
+
+#define COMPARE_OP(op)                                                  \
+    do {                                                                \
+        stackTop[-2] = Value(asDouble(stackTop[-2]) op asDouble(stackTop[-1])); \
+        drop();                                                         \
+    } while (0)
+
+    TARGET(OP_GREATER): {
+        OBSERVE_OPERANDS();
+        COMPARE_OP(>);
+        DISPATCH();
+    }
+    TARGET(OP_LESSER): {
+        OBSERVE_OPERANDS();
+        COMPARE_OP(<);
+        DISPATCH();
+    }
+    TARGET(OP_GREATER_EQUAL): {
+        OBSERVE_OPERANDS();
+        COMPARE_OP(>=);
+        DISPATCH();
+    }
+    TARGET(OP_LESSER_EQUAL): {
+        OBSERVE_OPERANDS();
+        COMPARE_OP(<=);
+        DISPATCH();
+    }
+    TARGET(OP_EQUAL): {
+        OBSERVE_OPERANDS();
+        COMPARE_OP(==);
+        DISPATCH();
+    }
+    TARGET(OP_NOT_EQUAL): {
+        OBSERVE_OPERANDS();
+        COMPARE_OP(!=);
+        DISPATCH();
+    }
+#undef COMPARE_OP
+#undef OBSERVE_OPERANDS
+
+    // The compiler only emits these when both operands are known to be ints
+    // (or both floats), so the result is written straight into the payload.
+#define INT_OP(expr)                                    \
+    do {                                                \
+        int64_t a = stackTop[-2].as.integer;            \
+        int64_t b = stackTop[-1].as.integer;            \
+        stackTop[-2].as.integer = (expr);               \
+        drop();                                         \
+    } while (0)
+#define INT_COMPARE_OP(op)                                                      \
+    do {                                                                        \
+        stackTop[-2] = Value(stackTop[-2].as.integer op stackTop[-1].as.integer); \
+        drop();                                                                 \
+    } while (0)
+#define F64_OP(op)                                                      \
+    do {                                                                \
+        stackTop[-2].as.number = stackTop[-2].as.number op stackTop[-1].as.number; \
+        drop();                                                         \
+    } while (0)
+
+    TARGET(OP_ADD_INT): {
+        INT_OP(a + b);
+        DISPATCH();
+    }
+    TARGET(OP_SUB_INT): {
+        INT_OP(a - b);
+        DISPATCH();
+    }
+    TARGET(OP_MUL_INT): {
+        INT_OP(a * b);
+        DISPATCH();
+    }
+    TARGET(OP_MOD_INT): {
+        INT_OP(a % b);
+        DISPATCH();
+    }
+    TARGET(OP_BITAND_INT): {
+        INT_OP(a & b);
+        DISPATCH();
+    }
+    TARGET(OP_BITOR_INT): {
+        INT_OP(a | b);
+        DISPATCH();
+    }
+    TARGET(OP_XOR_INT): {
+        INT_OP(a ^ b);
+        DISPATCH();
+    }
+    TARGET(OP_SHL_INT): {
+        INT_OP(static_cast<int64_t>(static_cast<uint64_t>(a) << shiftCount(b)));
+        DISPATCH();
+    }
+    TARGET(OP_SHR_INT): {
+        INT_OP(a >> shiftCount(b));
+        DISPATCH();
+    }
+    TARGET(OP_LT_INT): {
+        INT_COMPARE_OP(<);
+        DISPATCH();
+    }
+    TARGET(OP_LE_INT): {
+        INT_COMPARE_OP(<=);
+        DISPATCH();
+    }
+    TARGET(OP_GT_INT): {
+        INT_COMPARE_OP(>);
+        DISPATCH();
+    }
+    TARGET(OP_GE_INT): {
+        INT_COMPARE_OP(>=);
+        DISPATCH();
+    }
+    TARGET(OP_EQ_INT): {
+        INT_COMPARE_OP(==);
+        DISPATCH();
+    }
+    TARGET(OP_NE_INT): {
+        INT_COMPARE_OP(!=);
+        DISPATCH();
+    }
+    TARGET(OP_ADD_F64): {
+        F64_OP(+);
+        DISPATCH();
+    }
+    TARGET(OP_SUB_F64): {
+        F64_OP(-);
+        DISPATCH();
+    }
+    TARGET(OP_MUL_F64): {
+        F64_OP(*);
+        DISPATCH();
+    }
+    TARGET(OP_DIV_F64): {
+        F64_OP(/);
+        DISPATCH();
+    }
+
+    // Quickened sites: same fast paths behind a tag check. On a miss the site
+    // goes back to its generic opcode, which then runs this instruction.
+// Not wrapped in do/while: in the switch build DISPATCH() is `continue`,
+// which must reach the dispatch loop.
+#define GUARD(check)                                           \
+    if (!(stackTop[-2].check() && stackTop[-1].check())) {     \
+        deoptimize(frame->function->chunk, ip - 1);            \
+        --ip;                                                  \
+        DISPATCH();                                            \
+    }
+
+    TARGET(OP_ADD_INT_GUARDED): {
+        GUARD(isInt);
+        INT_OP(a + b);
+        DISPATCH();
+    }
+    TARGET(OP_SUB_INT_GUARDED): {
+        GUARD(isInt);
+        INT_OP(a - b);
+        DISPATCH();
+    }
+    TARGET(OP_MUL_INT_GUARDED): {
+        GUARD(isInt);
+        INT_OP(a * b);
+        DISPATCH();
+    }
+    TARGET(OP_LT_INT_GUARDED): {
+        GUARD(isInt);
+        INT_COMPARE_OP(<);
+        DISPATCH();
+    }
+    TARGET(OP_LE_INT_GUARDED): {
+        GUARD(isInt);
+        INT_COMPARE_OP(<=);
+        DISPATCH();
+    }
+    TARGET(OP_GT_INT_GUARDED): {
+        GUARD(isInt);
+        INT_COMPARE_OP(>);
+        DISPATCH();
+    }
+    TARGET(OP_GE_INT_GUARDED): {
+        GUARD(isInt);
+        INT_COMPARE_OP(>=);
+        DISPATCH();
+    }
+    TARGET(OP_EQ_INT_GUARDED): {
+        GUARD(isInt);
+        INT_COMPARE_OP(==);
+        DISPATCH();
+    }
+    TARGET(OP_NE_INT_GUARDED): {
+        GUARD(isInt);
+        INT_COMPARE_OP(!=);
+        DISPATCH();
+    }
+    TARGET(OP_ADD_F64_GUARDED): {
+        GUARD(isFloat);
+        F64_OP(+);
+        DISPATCH();
+    }
+    TARGET(OP_SUB_F64_GUARDED): {
+        GUARD(isFloat);
+        F64_OP(-);
+        DISPATCH();
+    }
+    TARGET(OP_MUL_F64_GUARDED): {
+        GUARD(isFloat);
+        F64_OP(*);
+        DISPATCH();
+    }
+    TARGET(OP_DIV_F64_GUARDED): {
+        GUARD(isFloat);
+        F64_OP(/);
+        DISPATCH();
+    }
+#undef GUARD
+#undef INT_OP
+#undef INT_COMPARE_OP
+#undef F64_OP
+
+    TARGET(OP_NOT): {
+        peek() = !asBool(peek());
+        DISPATCH();
+    }
+    TARGET(OP_NEGATE): {
+        peek() = -asDouble(peek());
+        DISPATCH();
+    }
+
+    TARGET(OP_JUMP): {
+        uint16_t offset = READ_SHORT();
+        ip += offset;
+        DISPATCH();
+    }
+    TARGET(OP_JUMP_IF_FALSE): {
+        uint16_t offset = READ_SHORT();
+        if (!asBool(peek())) {
+            ip += offset;
+        }
+        DISPATCH();
+    }
+    TARGET(OP_JUMP_IF_TRUE): {
+        uint16_t offset = READ_SHORT();
+        if (asBool(peek())) {
+            ip += offset;
+        }
+        DISPATCH();
+    }
+    TARGET(OP_LOOP): {
+        uint16_t offset = READ_SHORT();
+        ip -= offset;
+        safepoint();
+        if (jit) {
+            SAVE_IP();
+            if (!jitBackEdge(*frame)) return;
+            LOAD_FRAME();
+        }
+        DISPATCH();
+    }
+
+    TARGET(OP_SET_LOCAL_POP): {
+        uint8_t slot = READ_BYTE();
+        slots[slot] = pop();
+        DISPATCH();
+    }
+    TARGET(OP_INC_LOCAL_CONST): {
+        uint8_t slot = READ_BYTE();
+        const Value& step = READ_CONSTANT();
+        slots[slot] = addValues(slots[slot], step);
+        DISPATCH();
+    }
+    TARGET(OP_JUMP_IF_NOT_LT_LOCAL): {
+        const Value& a = slots[READ_BYTE()];
+        const Value& b = slots[READ_BYTE()];
+        uint16_t offset = READ_SHORT();
+        if (!(asDouble(a) < asDouble(b))) {
+            ip += offset;
+        }
+        DISPATCH();
+    }
+    TARGET(OP_JUMP_IF_NOT_LT_CONST): {
+        const Value& a = slots[READ_BYTE()];
+        const Value& b = READ_CONSTANT();
+        uint16_t offset = READ_SHORT();
+        if (!(asDouble(a) < asDouble(b))) {
+            ip += offset;
+        }
+        DISPATCH();
+    }
+
+    TARGET(OP_PRINT): {
+        std::cout << valueToString(peek());
+        drop();
+        DISPATCH();
+    }
+    TARGET(OP_PRINTLN): {
+        std::cout << valueToString(peek()) << std::endl;
+        drop();
+        DISPATCH();
+    }
+
+    TARGET(OP_CALL): {
+        SAVE_IP();
+        if (!handleCall(*frame) || !enterCompiled()) return;
+        LOAD_FRAME();
+        DISPATCH();
+    }
+    TARGET(OP_INVOKE): {
+        // Warm method calls: a class/version compare, then straight into the
+        // cached overload with the receiver as slot 0.
+        uint8_t argCount = ip[1];
+        Value* receiver = stackTop - argCount - 1;
+        safepoint();
+        if (receiver->isInstance()) {
+            const PropertyCacheEntry* entry = caches[PEEK_SHORT(2)].find(receiver->as.instance);
+            if (entry && entry->kind == PropertyCacheEntry::METHOD) {
+                ip += 4;
+                SAVE_IP();
+                if (!pushFrame(entry->method, receiver) || !enterCompiled()) return;
+                LOAD_FRAME();
+                DISPATCH();
+            }
+        }
+        SAVE_IP();
+        if (!handleInvoke(*frame) || !enterCompiled()) return;
+        LOAD_FRAME();
+        DISPATCH();
+    }
+    TARGET(OP_CALL_DIRECT): {
+        // Bound and arity-checked by the compiler: just the frame push.
+        FunctionObject* function = READ_CONSTANT().as.function;
+        uint8_t argCount = READ_BYTE();
+        safepoint();
+        SAVE_IP();
+        if (!pushFrame(function, stackTop - argCount - 1) || !enterCompiled()) return;
+        LOAD_FRAME();
+        DISPATCH();
+    }
+    TARGET(OP_TAIL_CALL): {
+        SAVE_IP();
+        if (!handleTailCall(*frame) || !enterCompiled()) return;
+        LOAD_FRAME();
+        DISPATCH();
+    }
+    TARGET(OP_TAIL_INVOKE): {
+        SAVE_IP();
+        if (!handleInvoke(*frame, true) || !enterCompiled()) return;
+        LOAD_FRAME();
+        DISPATCH();
+    }
+    TARGET(OP_RETURN): {
+        Value result = pop();
+        frames.pop_back();
+        stackTop = slots;
+        push(result);
+        if (frames.size() == baseDepth) return;
+        LOAD_FRAME();
+        DISPATCH();
+    }
+
+    TARGET(OP_NEW_ARRAY):
+    TARGET(OP_INDEX_GET):
+    TARGET(OP_INDEX_SET):
+    TARGET(OP_FIXED_ARRAY):
+    TARGET(OP_ARRAY_PUSH):
+    TARGET(OP_ARRAY_LENGTH): {
+        CALL_HANDLER(handleArrayOp(*frame, instruction));
+        DISPATCH();
+    }
+
+    // Warm field accesses are served from the site's inline cache here; the
+    // operands are only peeked so a miss can hand the whole instruction to
+    // handleClassOp, which resolves the property and fills the cache.
+    TARGET(OP_GET_PROPERTY): {
+        Value& object = peek();
+        if (object.isInstance()) {
+            const PropertyCacheEntry* entry = caches[PEEK_SHORT(1)].find(object.as.instance);
+            if (entry && entry->kind == PropertyCacheEntry::FIELD) {
+                object = object.as.instance->slots[entry->slot];
+                ip += 3;
+                DISPATCH();
+            }
+        }
+        CALL_HANDLER(handleClassOp(*frame, OP_GET_PROPERTY));
+        DISPATCH();
+    }
+    TARGET(OP_SET_PROPERTY): {
+        Value& object = peek(1);
+        if (object.isInstance()) {
+            const PropertyCacheEntry* entry = caches[PEEK_SHORT(1)].find(object.as.instance);
+            if (entry && entry->kind == PropertyCacheEntry::FIELD) {
+                object = object.as.instance->slots[entry->slot] = peek();
+                drop();
+                ip += 3;
+                DISPATCH();
+            }
+        }
+        CALL_HANDLER(handleClassOp(*frame, OP_SET_PROPERTY));
+        DISPATCH();
+    }
+    TARGET(OP_GET_PROPERTY_OR_GLOBAL): {
+        Value& object = peek();
+        if (object.isInstance()) {
+            const PropertyCacheEntry* entry = caches[PEEK_SHORT(3)].find(object.as.instance);
+            if (entry && entry->kind == PropertyCacheEntry::FIELD) {
+                object = object.as.instance->slots[entry->slot];
+                ip += 5;
+                DISPATCH();
+            }
+        }
+        CALL_HANDLER(handleClassOp(*frame, OP_GET_PROPERTY_OR_GLOBAL));
+        DISPATCH();
+    }
+
+    TARGET(OP_CLASS):
+    TARGET(OP_METHOD):
+    TARGET(OP_SET_PROPERTY_OR_LOCAL):
+    TARGET(OP_INHERIT):
+    TARGET(OP_FIELD): {
+        CALL_HANDLER(handleClassOp(*frame, instruction));
+        DISPATCH();
+    }
+
+    TARGET(OP_CAST_INT):
+    TARGET(OP_CAST_FLOAT):
+    TARGET(OP_CAST_STRING):
+    TARGET(OP_CAST_BOOL):
+    TARGET(OP_CAST_CHAR):
+    TARGET(OP_TYPEOF): {
+        if (!handleCastOp(instruction)) return;
+        DISPATCH();
+    }
+    TARGET(OP_READLINE): {
+        if (!handleInputOp(instruction)) return;
+        DISPATCH();
+    }
+
+    TARGET(OP_HALT):
+        SAVE_IP();
+        return;
+
+    TARGET_UNKNOWN:
+        std::cerr << "Runtime error: unknown opcode " << static_cast<int>(instruction) << std::endl;
+        return;
+
+#ifndef PENGUIN_COMPUTED_GOTO
+        }
+    }
+#endif
+
+#undef TARGET
+#undef TARGET_UNKNOWN
+#undef DISPATCH
+#undef LOAD_FRAME
+#undef SAVE_IP
+#undef READ_BYTE
+#undef READ_SHORT
+#undef READ_CONSTANT
+#undef PEEK_SHORT
+#undef CALL_HANDLER
+}
+
+}  // namespace vm
@@ -0,0 +1,187 @@
+#include "vm/vm.h"
+
+#include "vm/jit.h"
+#include "vm/utils/arith_utils.h"
+
+#include <utility>
+
+namespace vm {
+
+// Runs the top frame in its function's machine code. The code only writes
+// the result into the frame's first slot on a return; the frame is popped
+// here.
+bool VM::runCompiled() {
+    // Restored on the way out of a rethrown exception as well.
+    struct Nesting {
+        size_t& depth;
+        explicit Nesting(size_t& counter) : depth(++counter) {}
+        ~Nesting() { --depth; }
+    } nesting(jitNesting);
+    for (;;) {
+        JitStatus status = Jit::execute(*this, frames.back());
+        if (jitException) {
+            std::rethrow_exception(std::exchange(jitException, nullptr));
+        }
+        switch (status) {
+            case JitStatus::RETURNED:
+                frames.pop_back();
+                return frames.size() > baseDepth;
+            case JitStatus::TAIL_CALLED:
+                // The interpreter takes over if the new function has no code.
+                if (!frames.back().function->jitCode) return true;
+                break;
+            default:
+                return false;
+        }
+    }
+}
+
+// OP_LOOP with a JIT: counts the back-edge and, once the function has
+// machine code, moves the rest of this call into it.
+bool VM::jitBackEdge(CallFrame& frame) {
+    FunctionObject* function = frame.function;
+    if (!function->jitCode &&
+        (++function->hotness < jit->threshold || !jit->compile(*function))) {
+        return true;
+    }
+    if (jitNesting >= JIT_NESTING_MAX) return true;
+    ++jit->stats.loopEntries;
+    return runCompiled();
+}
+
+// Runs the frame a call from machine code just pushed, compiled or not,
+// until it returns to `depth` frames. True if it did.
+bool VM::runCallee(size_t depth) {
+    size_t outer = baseDepth;
+    baseDepth = depth;
+    if (enterCompiled()) {
+        interpret();
+    }
+    baseDepth = outer;
+    return frames.size() == depth;
+}
+
+int VM::jitOperator(VM* vm, uint32_t instruction) {
+    try {
+        switch (instruction) {
+            case OP_GREATER:
+            case OP_LESSER:
+            case OP_GREATER_EQUAL:
+            case OP_LESSER_EQUAL:
+            case OP_EQUAL:
+            case OP_NOT_EQUAL:
+            case OP_NOT:
+            case OP_NEGATE:
+                return vm->handleComparison(instruction);
+            default:
+                return vm->handleArithmetic(instruction);
+        }
+    } catch (...) {
+        vm->jitException = std::current_exception();
+        return 0;
+    }
+}
+
+int VM::jitIncrement(VM* vm, uint32_t slot, const Value* step) {
+    try {
+        Value& value = vm->frames.back().slots[slot];
+        value = addValues(value, *step);
+        return 1;
+    } catch (...) {
+        vm->jitException = std::current_exception();
+        return 0;
+    }
+}
+
+int VM::jitSafepoint(VM* vm) {
+    try {
+        vm->safepoint();
+        return 1;
+    } catch (...) {
+        vm->jitException = std::current_exception();
+        return 0;
+    }
+}
+
+int VM::jitCall(VM* vm, uint32_t argCount) {
+    try {
+        size_t depth = vm->frames.size();
+        vm->safepoint();
+        if (!vm->callValue(vm->stackTop - argCount - 1, static_cast<uint8_t>(argCount))) return 0;
+        return vm->frames.size() == depth || vm->runCallee(depth);
+    } catch (...) {
+        vm->jitException = std::current_exception();
+        return 0;
+    }
+}
+
+int VM::jitCallDirect(VM* vm, uint8_t* ip) {
+    try {
+        CallFrame& frame = vm->frames.back();
+        frame.ip = ip + 1;
+        size_t depth = vm->frames.size();
+        return vm->handleCallDirect(frame) && vm->runCallee(depth);
+    } catch (...) {
+        vm->jitException = std::current_exception();
+        return 0;
+    }
+}
+
+// 2 when the frame was reused for a function callee: the machine code then
+// stops and runCompiled() continues the frame in the callee.
+int VM::jitTailCall(VM* vm, uint8_t* ip) {
+    try {
+        CallFrame& frame = vm->frames.back();
+        frame.ip = ip + 1;
+        size_t depth = vm->frames.size();
+        if (!vm->handleTailCall(frame)) return 0;
+        if (frame.ip == frame.function->chunk.code.data()) return 2;
+        return vm->frames.size() == depth || vm->runCallee(depth);
+    } catch (...) {
+        vm->jitException = std::current_exception();
+        return 0;
+    }
+}
+
+// Like jitTailCall: 2 when a method now runs in the reused frame.
+int VM::jitTailInvoke(VM* vm, uint8_t* ip) {
+    try {
+        CallFrame& frame = vm->frames.back();
+        frame.ip = ip + 1;
+        size_t depth = vm->frames.size();
+        if (!vm->handleInvoke(frame, true)) return 0;
+        if (frame.ip == frame.function->chunk.code.data()) return 2;
+        return vm->frames.size() == depth || vm->runCallee(depth);
+    } catch (...) {
+        vm->jitException = std::current_exception();
+        return 0;
+    }
+}
+
+int VM::jitInvoke(VM* vm, uint8_t* ip) {
+    try {
+        CallFrame& frame = vm->frames.back();
+        frame.ip = ip + 1;
+        size_t depth = vm->frames.size();
+        if (!vm->handleInvoke(frame)) return 0;
+        return vm->frames.size() == depth || vm->runCallee(depth);
+    } catch (...) {
+        vm->jitException = std::current_exception();
+        return 0;
+    }
+}
+
+// Any opcode without a machine-code template: the handler reads its
+// operands through frame.ip, so that is pointed at them first.
+int VM::jitExecute(VM* vm, uint8_t* ip) {
+    try {
+        CallFrame& frame = vm->frames.back();
+        frame.ip = ip + 1;
+        return vm->executeInstruction(frame, *ip);
+    } catch (...) {
+        vm->jitException = std::current_exception();
+        return 0;
+    }
+}
+
+}  // namespace vm
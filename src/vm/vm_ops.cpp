@@ -1,110 +1,64 @@
 #include "vm/vm.h"
 
+#include "vm/utils/arith_utils.h"
 #include "vm/utils/value_utils.h"
 #include <iostream>
 
 namespace vm {
 
 bool VM::handleArithmetic(uint8_t instruction) {
+    Value b = pop();
+    Value a = pop();
+
     switch (instruction) {
         case OP_ADD:
-        case OP_PLUS_EQUAL: {
-            Value b = pop();
-            Value a = pop();
-            if (std::holds_alternative<std::string>(a) || std::holds_alternative<std::string>(b)) {
-                push(valueToString(a) + valueToString(b));
-            } else if (std::holds_alternative<int64_t>(a) && std::holds_alternative<int64_t>(b)) {
-                push(std::get<int64_t>(a) + std::get<int64_t>(b));
-            } else {
-                push(asDouble(a) + asDouble(b));
-            }
+        case OP_PLUS_EQUAL:
+            push(addValues(a, b));
             return true;
-        }
         case OP_SUB:
-        case OP_MINUS_EQUAL: {
-            Value b = pop();
-            Value a = pop();
-            if (std::holds_alternative<int64_t>(a) && std::holds_alternative<int64_t>(b)) {
-                push(std::get<int64_t>(a) - std::get<int64_t>(b));
-            } else {
-                push(asDouble(a) - asDouble(b));
-            }
+        case OP_MINUS_EQUAL:
+            push(subValues(a, b));
             return true;
-        }
         case OP_MUL:
-        case OP_MULTIPLY_EQUAL: {
-            Value b = pop();
-            Value a = pop();
-            if (std::holds_alternative<int64_t>(a) && std::holds_alternative<int64_t>(b)) {
-                push(std::get<int64_t>(a) * std::get<int64_t>(b));
-            } else {
-                push(asDouble(a) * asDouble(b));
-            }
+        case OP_MULTIPLY_EQUAL:
+            push(mulValues(a, b));
             return true;
-        }
         case OP_DIV:
-        case OP_DIVIDE_EQUAL: {
-            double b = asDouble(pop());
-            double a = asDouble(pop());
-            push(a / b);
+        case OP_DIVIDE_EQUAL:
+            push(divValues(a, b));
             return true;
-        }
         case OP_MOD:
-        case OP_MODULO_EQUAL: {
-            int64_t b = asInt(pop());
-            int64_t a = asInt(pop());
-            push(static_cast<int64_t>(a % b));
+        case OP_MODULO_EQUAL:
+            push(modValues(a, b));
             return true;
-        }
         case OP_BITWISE_AND:
-        case OP_BITWISE_AND_EQUAL: {
-            int b = asInt(pop());
-            int a = asInt(pop());
-            push(static_cast<double>(a & b));
+        case OP_BITWISE_AND_EQUAL:
+            push(bitAndValues(a, b));
             return true;
-        }
         case OP_BITWISE_OR:
-        case OP_BITWISE_OR_EQUAL: {
-            int b = asInt(pop());
-            int a = asInt(pop());
-            push(static_cast<double>(a | b));
+        case OP_BITWISE_OR_EQUAL:
+            push(bitOrValues(a, b));
             return true;
-        }
         case OP_XOR:
-        case OP_XOR_EQUAL: {
-            int b = asInt(pop());
-            int a = asInt(pop());
-            push(static_cast<double>(a ^ b));
+        case OP_XOR_EQUAL:
+            push(xorValues(a, b));
             return true;
-        }
         case OP_LEFT_SHIFT:
-        case OP_LEFT_SHIFT_EQUAL: {
-            int b = asInt(pop());
-            int a = asInt(pop());
-            push(static_cast<double>(a << b));
+        case OP_LEFT_SHIFT_EQUAL:
+            push(shiftLeftValues(a, b));
             return true;
-        }
         case OP_RIGHT_SHIFT:
-        case OP_RIGHT_SHIFT_EQUAL: {
-            int b = asInt(pop());
-            int a = asInt(pop());
-            push(static_cast<double>(a >> b));
+        case OP_RIGHT_SHIFT_EQUAL:
+            push(shiftRightValues(a, b));
             return true;
-        }
         case OP_LOGICAL_AND:
-        case OP_LOGICAL_AND_EQUAL: {
-            bool b = asBool(pop());
-            bool a = asBool(pop());
-            push(a && b);
+        case OP_LOGICAL_AND_EQUAL:
+            push(asBool(a) && asBool(b));
             return true;
-        }
         case OP_LOGICAL_OR:
-        case OP_LOGICAL_OR_EQUAL: {
-            bool b = asBool(pop());
-            bool a = asBool(pop());
-            push(a || b);
+        case OP_LOGICAL_OR_EQUAL:
+            push(asBool(a) || asBool(b));
             return true;
-        }
         default:
             return false;
     }
@@ -163,32 +117,99 @@ bool VM::handleComparison(uint8_t instruction) {
     }
 }
 
+bool VM::handleTypedOp(uint8_t instruction) {
+    Value b = pop();
+    Value a = pop();
+
+    if (instruction >= OP_ADD_F64) {
+        double x = a.as.number;
+        double y = b.as.number;
+        switch (instruction) {
+            case OP_ADD_F64: push(x + y); return true;
+            case OP_SUB_F64: push(x - y); return true;
+            case OP_MUL_F64: push(x * y); return true;
+            case OP_DIV_F64: push(x / y); return true;
+            default: return false;
+        }
+    }
+
+    int64_t x = a.as.integer;
+    int64_t y = b.as.integer;
+    switch (instruction) {
+        case OP_ADD_INT: push(x + y); return true;
+        case OP_SUB_INT: push(x - y); return true;
+        case OP_MUL_INT: push(x * y); return true;
+        case OP_MOD_INT: push(x % y); return true;
+        case OP_BITAND_INT: push(x & y); return true;
+        case OP_BITOR_INT: push(x | y); return true;
+        case OP_XOR_INT: push(x ^ y); return true;
+        case OP_SHL_INT: push(static_cast<int64_t>(static_cast<uint64_t>(x) << shiftCount(y))); return true;
+        case OP_SHR_INT: push(x >> shiftCount(y)); return true;
+        case OP_LT_INT: push(x < y); return true;
+        case OP_LE_INT: push(x <= y); return true;
+        case OP_GT_INT: push(x > y); return true;
+        case OP_GE_INT: push(x >= y); return true;
+        case OP_EQ_INT: push(x == y); return true;
+        case OP_NE_INT: push(x != y); return true;
+        default: return false;
+    }
+}
+
 bool VM::handleJump(CallFrame& frame, uint8_t instruction) {
     switch (instruction) {
         case OP_JUMP: {
-            uint16_t offset =
-                (frame.function->chunk.code[frame.ip] << 8) |
-                frame.function->chunk.code[frame.ip + 1];
-            frame.ip += 2;
+            uint16_t offset = frame.readShort();
             frame.ip += offset;
             return true;
         }
         case OP_JUMP_IF_FALSE: {
-            uint16_t offset =
-                (frame.function->chunk.code[frame.ip] << 8) |
-                frame.function->chunk.code[frame.ip + 1];
-            frame.ip += 2;
-            if (!asBool(stack.back())) {
+            uint16_t offset = frame.readShort();
+            if (!asBool(peek())) {
+                frame.ip += offset;
+            }
+            return true;
+        }
+        case OP_JUMP_IF_TRUE: {
+            uint16_t offset = frame.readShort();
+            if (asBool(peek())) {
                 frame.ip += offset;
             }
             return true;
         }
         case OP_LOOP: {
-            uint16_t offset =
-                (frame.function->chunk.code[frame.ip] << 8) |
-                frame.function->chunk.code[frame.ip + 1];
-            frame.ip += 2;
+            uint16_t offset = frame.readShort();
             frame.ip -= offset;
+            safepoint();
+            return !jit || jitBackEdge(frame);
+        }
+        default:
+            return false;
+    }
+}
+
+bool VM::handleSuperinstruction(CallFrame& frame, uint8_t instruction) {
+    switch (instruction) {
+        case OP_SET_LOCAL_POP: {
+            uint8_t slot = frame.readByte();
+            frame.slots[slot] = pop();
+            return true;
+        }
+        case OP_INC_LOCAL_CONST: {
+            uint8_t slot = frame.readByte();
+            const Value& step = frame.readConstant();
+            frame.slots[slot] = addValues(frame.slots[slot], step);
+            return true;
+        }
+        case OP_JUMP_IF_NOT_LT_LOCAL:
+        case OP_JUMP_IF_NOT_LT_CONST: {
+            const Value& a = frame.slots[frame.readByte()];
+            const Value& b = instruction == OP_JUMP_IF_NOT_LT_LOCAL
+                ? frame.slots[frame.readByte()]
+                : frame.readConstant();
+            uint16_t offset = frame.readShort();
+            if (!(asDouble(a) < asDouble(b))) {
+                frame.ip += offset;
+            }
             return true;
         }
         default:
@@ -201,18 +222,18 @@ bool VM::handleCastOp(uint8_t instruction) {
 
     switch (instruction) {
         case OP_CAST_INT:
-            if (std::holds_alternative<std::string>(value)) push(Value(static_cast<int64_t>(std::stoll(std::get<std::string>(value)))));
-            else if (std::holds_alternative<double>(value)) push(Value(static_cast<int64_t>(std::get<double>(value))));
-            else if (std::holds_alternative<bool>(value)) push(Value(static_cast<int64_t>(std::get<bool>(value))));
-            else if (std::holds_alternative<char>(value)) push(Value(static_cast<int64_t>(std::get<char>(value))));
+            if (value.isString()) push(Value(static_cast<int64_t>(std::stoll(value.str()))));
+            else if (value.isFloat()) push(Value(static_cast<int64_t>(value.as.number)));
+            else if (value.isBool()) push(Value(static_cast<int64_t>(value.as.boolean)));
+            else if (value.isChar()) push(Value(static_cast<int64_t>(value.as.character)));
             else push(value);
             return true;
 
         case OP_CAST_FLOAT:
-            if (std::holds_alternative<std::string>(value)) push(Value(static_cast<double>(std::stod(std::get<std::string>(value)))));
-            else if (std::holds_alternative<int64_t>(value)) push(Value(static_cast<double>(std::get<int64_t>(value))));
-            else if (std::holds_alternative<bool>(value)) push(Value(static_cast<double>(std::get<bool>(value))));
-            else if (std::holds_alternative<char>(value)) push(Value(static_cast<double>(std::get<char>(value))));
+            if (value.isString()) push(Value(static_cast<double>(std::stod(value.str()))));
+            else if (value.isInt()) push(Value(static_cast<double>(value.as.integer)));
+            else if (value.isBool()) push(Value(static_cast<double>(value.as.boolean)));
+            else if (value.isChar()) push(Value(static_cast<double>(value.as.character)));
             else push(value);
             return true;
 
@@ -221,28 +242,28 @@ bool VM::handleCastOp(uint8_t instruction) {
             return true;
 
         case OP_CAST_BOOL:
-            if (std::holds_alternative<int64_t>(value)) push(Value(static_cast<bool>(std::get<int64_t>(value))));
-            else if (std::holds_alternative<double>(value)) push(Value(static_cast<bool>(std::get<double>(value))));
-            else if (std::holds_alternative<std::string>(value)) push(Value(!std::get<std::string>(value).empty()));
-            else if (std::holds_alternative<char>(value)) push(Value(static_cast<bool>(std::get<char>(value))));
+            if (value.isInt()) push(Value(static_cast<bool>(value.as.integer)));
+            else if (value.isFloat()) push(Value(static_cast<bool>(value.as.number)));
+            else if (value.isString()) push(Value(!value.str().empty()));
+            else if (value.isChar()) push(Value(static_cast<bool>(value.as.character)));
             else push(value);
             return true;
 
         case OP_CAST_CHAR:
-            if (std::holds_alternative<int64_t>(value)) push(Value(static_cast<char>(std::get<int64_t>(value))));
-            else if (std::holds_alternative<double>(value)) push(Value(static_cast<char>(std::get<double>(value))));
-            else if (std::holds_alternative<std::string>(value)) {
-                const std::string str = std::get<std::string>(value);
+            if (value.isInt()) push(Value(static_cast<char>(value.as.integer)));
+            else if (value.isFloat()) push(Value(static_cast<char>(value.as.number)));
+            else if (value.isString()) {
+                const std::string str = value.str();
                 push(Value(static_cast<char>(str.empty() ? 0 : str[0])));
-            } else if (std::holds_alternative<bool>(value)) {
-                push(Value(static_cast<char>(std::get<bool>(value))));
+            } else if (value.isBool()) {
+                push(Value(static_cast<char>(value.as.boolean)));
             } else {
                 push(value);
             }
             return true;
 
         case OP_TYPEOF:
-            push(typeOf(value));
+            push(Value(typeOf(value)));
             return true;
 
         default:
@@ -256,7 +277,7 @@ bool VM::handleInputOp(uint8_t instruction) {
         case OP_READLINE: {
             std::string line;
             std::getline(std::cin, line);
-            push(line);
+            push(Value(line));
             return true;
         }
         default:
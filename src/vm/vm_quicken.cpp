@@ -0,0 +1,107 @@
+#include "vm/vm.h"
+
+namespace vm {
+
+// Generic binary opcodes count down once per execution with two int (or two
+// float) operands; when a site's counter reaches zero the opcode byte is
+// overwritten with the guarded variant for the operand types seen then. A
+// guarded opcode that meets other types puts the generic opcode back and
+// waits QUICKEN_BACKOFF observations before trying again, so sites whose
+// types keep changing do not flip on every execution.
+static constexpr uint8_t QUICKEN_WARMUP = 2;
+static constexpr uint8_t QUICKEN_BACKOFF = 64;
+
+struct QuickenRule {
+    OpCode generic;
+    OpCode intVariant;    // OP_COUNT if there is none
+    OpCode floatVariant;  // OP_COUNT if there is none
+};
+
+static const QuickenRule* quickenRule(uint8_t op) {
+    static const QuickenRule rules[] = {
+        {OP_ADD, OP_ADD_INT_GUARDED, OP_ADD_F64_GUARDED},
+        {OP_SUB, OP_SUB_INT_GUARDED, OP_SUB_F64_GUARDED},
+        {OP_MUL, OP_MUL_INT_GUARDED, OP_MUL_F64_GUARDED},
+        {OP_DIV, OP_COUNT, OP_DIV_F64_GUARDED},
+        {OP_LESSER, OP_LT_INT_GUARDED, OP_COUNT},
+        {OP_LESSER_EQUAL, OP_LE_INT_GUARDED, OP_COUNT},
+        {OP_GREATER, OP_GT_INT_GUARDED, OP_COUNT},
+        {OP_GREATER_EQUAL, OP_GE_INT_GUARDED, OP_COUNT},
+        {OP_EQUAL, OP_EQ_INT_GUARDED, OP_COUNT},
+        {OP_NOT_EQUAL, OP_NE_INT_GUARDED, OP_COUNT},
+    };
+
+    // The compound assignment opcodes behave exactly like their base opcode.
+    switch (op) {
+        case OP_PLUS_EQUAL: op = OP_ADD; break;
+        case OP_MINUS_EQUAL: op = OP_SUB; break;
+        case OP_MULTIPLY_EQUAL: op = OP_MUL; break;
+        case OP_DIVIDE_EQUAL: op = OP_DIV; break;
+        default: break;
+    }
+    for (const QuickenRule& rule : rules) {
+        if (rule.generic == op || rule.intVariant == op || rule.floatVariant == op) {
+            return &rule;
+        }
+    }
+    return nullptr;
+}
+
+static uint8_t& siteCounter(Chunk& chunk, uint8_t* site) {
+    if (chunk.quickenCounters.empty()) {
+        chunk.quickenCounters.assign(chunk.code.size(), QUICKEN_WARMUP);
+    }
+    return chunk.quickenCounters[site - chunk.code.data()];
+}
+
+void VM::quicken(Chunk& chunk, uint8_t* site) {
+    const QuickenRule* rule = quickenRule(*site);
+    if (!rule) return;
+
+    uint8_t& counter = siteCounter(chunk, site);
+    if (--counter > 0) return;
+
+    OpCode variant = peek().isInt() ? rule->intVariant : rule->floatVariant;
+    if (variant == OP_COUNT) {
+        counter = QUICKEN_BACKOFF;
+        return;
+    }
+    *site = variant;
+}
+
+void VM::deoptimize(Chunk& chunk, uint8_t* site) {
+    const QuickenRule* rule = quickenRule(*site);
+    *site = rule->generic;
+    siteCounter(chunk, site) = QUICKEN_BACKOFF;
+}
+
+bool VM::handleGuardedOp(CallFrame& frame, uint8_t instruction) {
+    bool wantInt = instruction < OP_ADD_F64_GUARDED;
+    const Value& a = peek(1);
+    const Value& b = peek();
+    if (wantInt ? !(a.isInt() && b.isInt()) : !(a.isFloat() && b.isFloat())) {
+        // Re-run the instruction as the generic opcode.
+        deoptimize(frame.function->chunk, frame.ip - 1);
+        --frame.ip;
+        return true;
+    }
+
+    switch (instruction) {
+        case OP_ADD_INT_GUARDED: return handleTypedOp(OP_ADD_INT);
+        case OP_SUB_INT_GUARDED: return handleTypedOp(OP_SUB_INT);
+        case OP_MUL_INT_GUARDED: return handleTypedOp(OP_MUL_INT);
+        case OP_LT_INT_GUARDED: return handleTypedOp(OP_LT_INT);
+        case OP_LE_INT_GUARDED: return handleTypedOp(OP_LE_INT);
+        case OP_GT_INT_GUARDED: return handleTypedOp(OP_GT_INT);
+        case OP_GE_INT_GUARDED: return handleTypedOp(OP_GE_INT);
+        case OP_EQ_INT_GUARDED: return handleTypedOp(OP_EQ_INT);
+        case OP_NE_INT_GUARDED: return handleTypedOp(OP_NE_INT);
+        case OP_ADD_F64_GUARDED: return handleTypedOp(OP_ADD_F64);
+        case OP_SUB_F64_GUARDED: return handleTypedOp(OP_SUB_F64);
+        case OP_MUL_F64_GUARDED: return handleTypedOp(OP_MUL_F64);
+        case OP_DIV_F64_GUARDED: return handleTypedOp(OP_DIV_F64);
+        default: return false;
+    }
+}
+
+}  // namespace vm